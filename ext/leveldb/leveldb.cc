@@ -1,9 +1,18 @@
 #include <ruby.h>
+#include <ruby/thread.h>
+#include <pthread.h>
+#include <deque>
 #include <memory>
+#include <vector>
 
 #include "leveldb/db.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/slice.h"
+#include "leveldb/statistics.h"
 #include "leveldb/write_batch.h"
 
 using namespace std;
@@ -12,11 +21,13 @@ static VALUE m_leveldb;
 static VALUE c_db;
 static VALUE c_iter;
 static VALUE c_batch;
+static VALUE c_column_family;
 static VALUE c_error;
 static VALUE c_no_compression;
 static VALUE c_snappy_compression;
 static VALUE k_fill;
 static VALUE k_verify;
+static VALUE k_perf_context;
 static VALUE k_sync;
 static VALUE k_from;
 static VALUE k_to;
@@ -31,11 +42,40 @@ static VALUE k_create_if_missing;
 static VALUE k_error_if_exists;
 static VALUE k_paranoid_checks;
 static VALUE k_write_buffer_size;
+static VALUE k_recovery_threads;
 static VALUE k_block_cache_size;
 static VALUE k_block_size;
 static VALUE k_block_restart_interval;
+static VALUE k_readahead_size;
+static VALUE k_use_direct_io_for_compaction;
+static VALUE k_num_levels;
+static VALUE k_level0_file_num_compaction_trigger;
+static VALUE k_level0_slowdown_writes_trigger;
+static VALUE k_level0_stop_writes_trigger;
+static VALUE k_target_file_size_base;
+static VALUE k_target_file_size_multiplier;
+static VALUE k_max_bytes_for_level_base;
+static VALUE k_max_bytes_for_level_multiplier;
+static VALUE k_level_compaction_dynamic_level_bytes;
+static VALUE k_ttl;
+static VALUE k_hide_expired_keys;
+static VALUE k_compaction_filter_prefix;
+static VALUE k_merge_operator;
+static VALUE k_uint64_add;
+static VALUE k_string_append;
 static VALUE k_compression;
 static VALUE k_max_open_files;
+static VALUE k_record_table_handles;
+static VALUE k_prewarm_threads;
+static VALUE k_cache_index_and_filter_blocks;
+static VALUE k_partition_index_and_filters;
+static VALUE k_metadata_block_size;
+static VALUE k_pin_l0_filter_and_index_blocks_in_cache;
+static VALUE k_column_families;
+static VALUE k_read_only;
+static VALUE k_secondary;
+static VALUE k_statistics;
+static VALUE k_listener;
 
 // support 1.9 and 1.8
 #ifndef RSTRING_PTR
@@ -50,8 +90,128 @@ static VALUE k_max_open_files;
   }  \
 } while(0)
 
+// Keeps the events of a database until the Ruby thread started by
+// db_make pushes them onto the :listener queue.  The database calls it
+// from a thread of its own, which cannot run Ruby code.  Shared by the
+// database and that thread, and deleted by whichever lets go last.
+class QueueListener : public leveldb::EventListener {
+ public:
+  struct Event {
+    enum Type { kFlush, kCompaction, kStall } type;
+    leveldb::FlushJobInfo flush;
+    leveldb::CompactionJobInfo compaction;
+    leveldb::WriteStallInfo stall;
+  };
+
+  QueueListener() : refs_(2), closed_(false), interrupted_(false), stopped_(false) {
+    pthread_mutex_init(&mu_, NULL);
+    pthread_cond_init(&cv_, NULL);
+  }
+
+  virtual void OnFlushCompleted(leveldb::DB* db, const leveldb::FlushJobInfo& info) {
+    Event event;
+    event.type = Event::kFlush;
+    event.flush = info;
+    Add(event);
+  }
+
+  virtual void OnCompactionCompleted(leveldb::DB* db, const leveldb::CompactionJobInfo& info) {
+    Event event;
+    event.type = Event::kCompaction;
+    event.compaction = info;
+    Add(event);
+  }
+
+  virtual void OnStallConditionsChanged(leveldb::DB* db, const leveldb::WriteStallInfo& info) {
+    Event event;
+    event.type = Event::kStall;
+    event.stall = info;
+    Add(event);
+  }
+
+  // Called once the database is deleted: no more events will come
+  void Close() {
+    pthread_mutex_lock(&mu_);
+    closed_ = true;
+    pthread_cond_signal(&cv_);
+    pthread_mutex_unlock(&mu_);
+  }
+
+  // Called once the Ruby thread exits, e.g. because it was killed: the
+  // events that nobody will push are dropped
+  void Stop() {
+    pthread_mutex_lock(&mu_);
+    stopped_ = true;
+    events_.clear();
+    pthread_mutex_unlock(&mu_);
+  }
+
+  void Unref() {
+    pthread_mutex_lock(&mu_);
+    bool last = (--refs_ == 0);
+    pthread_mutex_unlock(&mu_);
+    if(last) delete this;
+  }
+
+  // Wait, without the GVL, for events or for Close(), and move the
+  // events to "events".  Returns false once closed and drained.
+  static void* Wait(void* arg) {
+    QueueListener* listener = reinterpret_cast<QueueListener*>(arg);
+    pthread_mutex_lock(&listener->mu_);
+    while(listener->events_.empty() && !listener->closed_ && !listener->interrupted_) {
+      pthread_cond_wait(&listener->cv_, &listener->mu_);
+    }
+    listener->interrupted_ = false;
+    listener->waiting_.swap(listener->events_);
+    void* more = (listener->closed_ && listener->waiting_.empty()) ? NULL : arg;
+    pthread_mutex_unlock(&listener->mu_);
+    return more;
+  }
+
+  // Wakes up Wait() when Ruby interrupts the thread
+  static void Interrupt(void* arg) {
+    QueueListener* listener = reinterpret_cast<QueueListener*>(arg);
+    pthread_mutex_lock(&listener->mu_);
+    listener->interrupted_ = true;
+    pthread_cond_signal(&listener->cv_);
+    pthread_mutex_unlock(&listener->mu_);
+  }
+
+  // The events returned by the last Wait(), only used by the Ruby thread
+  std::deque<Event>* waiting() { return &waiting_; }
+
+ private:
+  ~QueueListener() {
+    pthread_cond_destroy(&cv_);
+    pthread_mutex_destroy(&mu_);
+  }
+
+  void Add(const Event& event) {
+    pthread_mutex_lock(&mu_);
+    if(!stopped_) {
+      events_.push_back(event);
+      pthread_cond_signal(&cv_);
+    }
+    pthread_mutex_unlock(&mu_);
+  }
+
+  pthread_mutex_t mu_;
+  pthread_cond_t cv_;
+  int refs_;
+  bool closed_;
+  bool interrupted_;
+  bool stopped_;
+  std::deque<Event> events_;
+  std::deque<Event> waiting_;
+};
+
 typedef struct bound_db {
   leveldb::DB* db;
+  leveldb::Statistics* statistics;
+  QueueListener* listener;
+  // allocated by set_db_option for the database and its column families
+  std::vector<const leveldb::CompactionFilter*> compaction_filters;
+  std::vector<const leveldb::MergeOperator*> merge_operators;
 } bound_db;
 
 static void db_free(bound_db* db) {
@@ -59,9 +219,38 @@ static void db_free(bound_db* db) {
     delete db->db;
     db->db = NULL;
   }
+  if(db->listener != NULL) {
+    db->listener->Close();
+    db->listener->Unref();
+  }
+  delete db->statistics;
+  for(size_t i = 0; i < db->compaction_filters.size(); i++) {
+    delete db->compaction_filters[i];
+  }
+  for(size_t i = 0; i < db->merge_operators.size(); i++) {
+    delete db->merge_operators[i];
+  }
   delete db;
 }
 
+// Keep what set_db_option allocated for "options" until the database is
+// freed
+static void keep_options(bound_db* db, const leveldb::Options& options) {
+  if(options.compaction_filter != NULL) db->compaction_filters.push_back(options.compaction_filter);
+  if(options.merge_operator != NULL) db->merge_operators.push_back(options.merge_operator);
+}
+
+// handles are owned by the DB, which the column family keeps alive
+// through its @db
+typedef struct bound_column_family {
+  bound_db* db;
+  leveldb::ColumnFamilyHandle* handle;
+} bound_column_family;
+
+static void column_family_free(bound_column_family* cf) {
+  delete cf;
+}
+
 static void sync_vals(VALUE opts, VALUE key, VALUE db_options, bool* pOptionVal) {
   VALUE v = rb_hash_aref(opts, key);
 
@@ -89,6 +278,16 @@ static void sync_vals(VALUE opts, VALUE key, VALUE db_options, int* pOptionVal)
   rb_iv_set(db_options, param.c_str(), INT2NUM(*pOptionVal));
 }
 
+// uint64_t may be the same type as size_t, so it cannot be an overload
+static void sync_u64_vals(VALUE opts, VALUE key, VALUE db_options, uint64_t* pOptionVal) {
+  VALUE v = rb_hash_aref(opts, key);
+
+  if(!NIL_P(v)) *pOptionVal = NUM2ULL(v);
+  string param("@");
+  param += rb_id2name(SYM2ID(key));
+  rb_iv_set(db_options, param.c_str(), ULL2NUM(*pOptionVal));
+}
+
 static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options) {
   if(NIL_P(o_options)) return;
   Check_Type(opts, T_HASH);
@@ -97,9 +296,29 @@ static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options
   sync_vals(opts, k_error_if_exists, o_options, &(options->error_if_exists));
   sync_vals(opts, k_paranoid_checks, o_options, &(options->paranoid_checks));
   sync_vals(opts, k_write_buffer_size, o_options, &(options->write_buffer_size));
+  sync_vals(opts, k_recovery_threads, o_options, &(options->recovery_threads));
   sync_vals(opts, k_max_open_files, o_options, &(options->max_open_files));
+  sync_vals(opts, k_record_table_handles, o_options, &(options->record_table_handles));
+  sync_vals(opts, k_prewarm_threads, o_options, &(options->prewarm_threads));
   sync_vals(opts, k_block_size, o_options, &(options->block_size));
   sync_vals(opts, k_block_restart_interval, o_options, &(options->block_restart_interval));
+  sync_vals(opts, k_readahead_size, o_options, &(options->readahead_size));
+  sync_vals(opts, k_use_direct_io_for_compaction, o_options, &(options->use_direct_io_for_compaction));
+  sync_vals(opts, k_num_levels, o_options, &(options->num_levels));
+  sync_vals(opts, k_level0_file_num_compaction_trigger, o_options, &(options->level0_file_num_compaction_trigger));
+  sync_vals(opts, k_level0_slowdown_writes_trigger, o_options, &(options->level0_slowdown_writes_trigger));
+  sync_vals(opts, k_level0_stop_writes_trigger, o_options, &(options->level0_stop_writes_trigger));
+  sync_vals(opts, k_target_file_size_base, o_options, &(options->target_file_size_base));
+  sync_vals(opts, k_target_file_size_multiplier, o_options, &(options->target_file_size_multiplier));
+  sync_u64_vals(opts, k_max_bytes_for_level_base, o_options, &(options->max_bytes_for_level_base));
+  sync_vals(opts, k_max_bytes_for_level_multiplier, o_options, &(options->max_bytes_for_level_multiplier));
+  sync_vals(opts, k_level_compaction_dynamic_level_bytes, o_options, &(options->level_compaction_dynamic_level_bytes));
+  sync_vals(opts, k_ttl, o_options, &(options->ttl));
+  sync_vals(opts, k_hide_expired_keys, o_options, &(options->hide_expired_keys));
+  sync_vals(opts, k_cache_index_and_filter_blocks, o_options, &(options->cache_index_and_filter_blocks));
+  sync_vals(opts, k_pin_l0_filter_and_index_blocks_in_cache, o_options, &(options->pin_l0_filter_and_index_blocks_in_cache));
+  sync_vals(opts, k_partition_index_and_filters, o_options, &(options->partition_index_and_filters));
+  sync_vals(opts, k_metadata_block_size, o_options, &(options->metadata_block_size));
 
   VALUE v = rb_hash_aref(opts, k_block_cache_size);
   if(!NIL_P(v)) {
@@ -107,6 +326,21 @@ static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options
     rb_iv_set(o_options, "@block_cache_size", v);
   }
 
+  v = rb_hash_aref(opts, k_compaction_filter_prefix);
+  if(!NIL_P(v)) {
+    StringValue(v);
+    options->compaction_filter = leveldb::NewPrefixCompactionFilter(leveldb::Slice(RSTRING_PTR(v), RSTRING_LEN(v)));
+    rb_iv_set(o_options, "@compaction_filter_prefix", v);
+  }
+
+  v = rb_hash_aref(opts, k_merge_operator);
+  if(!NIL_P(v)) {
+    if(v == k_uint64_add) options->merge_operator = leveldb::NewUInt64AddOperator();
+    else if(v == k_string_append) options->merge_operator = leveldb::NewStringAppendOperator(",");
+    else rb_raise(rb_eTypeError, "invalid type for %s", rb_id2name(SYM2ID(k_merge_operator)));
+    rb_iv_set(o_options, "@merge_operator", v);
+  }
+
   v = rb_hash_aref(opts, k_compression);
   if(!NIL_P(v)) {
     if(v == c_no_compression) options->compression = leveldb::kNoCompression;
@@ -149,11 +383,28 @@ static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options
  *                                 time the next time the database is opened.
  *
  *                                 Default: 4MB
+ * [options[ :recovery_threads ]] Number of threads used to replay the logs left behind by
+ *                                the previous process when the database is opened.  With
+ *                                more than one thread, recovery may hold up to this many
+ *                                write buffers in memory at the same time.
+ *
+ *                                Default: 1
  * [options[ :max_open_files ]] Number of open files that can be used by the DB.  You may need to
  *                              increase this if your database has a large working set (budget
  *                              one open file per 2MB of working set).
  *
  *                              Default: 1000
+ * [options[ :record_table_handles ]] If true, the location of the index and filter blocks of
+ *                                    each new table is saved in the descriptor, so that a
+ *                                    table can be opened without reading its footer.  Once
+ *                                    set, older versions of leveldb cannot open the database.
+ *
+ *                                    Default: false
+ * [options[ :prewarm_threads ]] Number of threads that open the tables of the database in
+ *                               the background after it is opened, most recent levels
+ *                               first.
+ *
+ *                               Default: 0
  * [options[ :block_cache_size ]] Control over blocks (user data is stored in a set of blocks,
  *                                and a block is the unit of reading from disk).
  *
@@ -174,6 +425,134 @@ static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options
  *                                      Most clients should leave this parameter alone.
  *
  *                                      Default: 16
+ * [options[ :readahead_size ]] Largest read issued by iterators that scan consecutive blocks
+ *                              of a table, and by compactions.  Readahead starts small and
+ *                              grows as long as the scan goes on.  0 disables readahead.
+ *
+ *                              Default: 0
+ * [options[ :use_direct_io_for_compaction ]] If true, compactions read and write tables
+ *                                            without going through the operating system's
+ *                                            page cache, which is left to regular reads.
+ *
+ *                                            Default: false
+ * [options[ :num_levels ]] Number of levels in the tree, between 2 and 7.  A database
+ *                          cannot be opened with fewer levels than it has data in.
+ *
+ *                          Default: 7
+ * [options[ :level0_file_num_compaction_trigger ]] Level-0 is compacted once it has this
+ *                                                  many files.
+ *
+ *                                                  Default: 4
+ * [options[ :level0_slowdown_writes_trigger ]] Writes are slowed down once this many
+ *                                              level-0 files have piled up.
+ *
+ *                                              Default: 8
+ * [options[ :level0_stop_writes_trigger ]] Writes stop until compactions catch up once
+ *                                          this many level-0 files have piled up.
+ *
+ *                                          Default: 12
+ * [options[ :target_file_size_base ]] Size of the tables that compactions write to level-1.
+ *
+ *                                     Default: 2MB
+ * [options[ :target_file_size_multiplier ]] Each deeper level multiplies the size of its
+ *                                           tables by this much.
+ *
+ *                                           Default: 1
+ * [options[ :max_bytes_for_level_base ]] Level-1 is compacted once it holds more than this
+ *                                        many bytes.
+ *
+ *                                        Default: 10MB
+ * [options[ :max_bytes_for_level_multiplier ]] Each deeper level may hold this many times
+ *                                              as much as the level above it.
+ *
+ *                                              Default: 10
+ * [options[ :level_compaction_dynamic_level_bytes ]] If true, the size limits of levels are
+ *                                                    derived from the size of the deepest
+ *                                                    level that holds data, instead of
+ *                                                    growing from :max_bytes_for_level_base.
+ *
+ *                                                    Default: false
+ * [options[ :ttl ]] If positive, entries expire this many seconds after they were written,
+ *                   and compactions remove them. A database written with a positive
+ *                   :ttl must always be opened with one.
+ *
+ *                   Default: 0
+ * [options[ :hide_expired_keys ]] If true (and :ttl is positive), reads do not return
+ *                                 expired entries that have not been compacted away yet.
+ *
+ *                                 Default: false
+ * [options[ :compaction_filter_prefix ]] If set, compactions remove the entries whose keys
+ *                                        start with this string as they rewrite them, so
+ *                                        that they are collected without extra I/O.  Until
+ *                                        then they can still be read.
+ *
+ *                                        Default: nil
+ * [options[ :merge_operator ]] How #merge combines a value with the ones stored before it:
+ *                              :uint64_add adds 64-bit unsigned integers, stored as 8
+ *                              little-endian bytes; :string_append joins strings with ",".
+ *                              A database written with merges must always be opened with
+ *                              the same operator.
+ *
+ *                              Default: nil
+ * [options[ :cache_index_and_filter_blocks ]] If true, the index and filter blocks of each
+ *                                             table are kept in the block cache and charged
+ *                                             against its size, instead of being held in
+ *                                             memory for as long as the table is open.
+ *
+ *                                             Default: false
+ * [options[ :pin_l0_filter_and_index_blocks_in_cache ]] If true (and
+ *                                                       :cache_index_and_filter_blocks is set),
+ *                                                       the index and filter blocks of level-0
+ *                                                       tables are never evicted from the block
+ *                                                       cache while the table is open.
+ *
+ *                                                       Default: false
+ * [options[ :partition_index_and_filters ]] If true, the index and filter of each new table
+ *                                           are split into partitions that are read through
+ *                                           the block cache on demand, so opening a large
+ *                                           table only reads a small top-level index.
+ *                                           Tables written this way cannot be read by older
+ *                                           versions of leveldb.
+ *
+ *                                           Default: false
+ * [options[ :metadata_block_size ]] Approximate size of each index partition when
+ *                                   :partition_index_and_filters is set.
+ *
+ *                                   Default: 4K
+ * [options[ :column_families ]] Column families to open along with the default one: an Array
+ *                               of names, or a Hash from names to Hashes of the options
+ *                               above (the options that apply to the whole database, like
+ *                               :max_open_files, are taken from the database).  Every column
+ *                               family of the database has to be listed; the ones that do
+ *                               not exist yet are created.  See #column_family.
+ *
+ *                               Default: nil
+ * [options[ :read_only ]] If true, open the existing database for reading only, without
+ *                         taking its lock, so that other processes can open it next to the
+ *                         one that writes it.  Column families may be left out of
+ *                         :column_families, and none are created.  Writes raise
+ *                         LevelDB::Error.  See LevelDB::DB.open_readonly.
+ *
+ *                         Default: false
+ * [options[ :secondary ]] Same as :read_only, except that #catch_up brings the database up
+ *                         to date with the writes of the process that writes it.
+ *
+ *                         Default: false
+ * [options[ :statistics ]] If true, the database counts block cache hits and misses, how
+ *                          often filters saved a read, how long writes were stalled, and
+ *                          the latency of gets, writes and seeks.  See #statistics.
+ *
+ *                          Default: false
+ * [options[ :listener ]] A Queue, or anything else with a #push method, that the database
+ *                        pushes a Hash onto for each memtable it flushes (:type =>
+ *                        :flush_completed), each compaction it runs (:type =>
+ *                        :compaction_completed, with the :input_files and :output_files,
+ *                        :bytes_read, :bytes_written and :micros) and each change in how it
+ *                        holds back writes (:type => :stall_conditions_changed, with the
+ *                        :previous and :current condition, :normal, :delayed or :stopped).
+ *                        A thread of its own pushes them, until the database is closed.
+ *
+ *                        Default: nil
  * [options[ :compression ]] LevelDB::CompressionType::SnappyCompression or
  *                           LevelDB::CompressionType::NoCompression.
  *
@@ -193,27 +572,418 @@ static void set_db_option(VALUE o_options, VALUE opts, leveldb::Options* options
  *                           efficiently detect that and will switch to uncompressed mode.
  * [return] LevelDB::DB instance
  */
+static VALUE column_family_make(VALUE o_db, bound_db* db, leveldb::ColumnFamilyHandle* handle, VALUE o_options) {
+  bound_column_family* cf = new bound_column_family;
+  cf->db = db;
+  cf->handle = handle;
+
+  VALUE o_cf = Data_Wrap_Struct(c_column_family, NULL, column_family_free, cf);
+  rb_iv_set(o_cf, "@db", o_db);
+  rb_iv_set(o_cf, "@name", rb_str_new2(handle->GetName().c_str()));
+  rb_iv_set(o_cf, "@options", o_options);
+  return o_cf;
+}
+
+static VALUE stall_condition(leveldb::WriteStallCondition condition) {
+  switch(condition) {
+    case leveldb::kWriteStallDelayed: return ID2SYM(rb_intern("delayed"));
+    case leveldb::kWriteStallStopped: return ID2SYM(rb_intern("stopped"));
+    default: return ID2SYM(rb_intern("normal"));
+  }
+}
+
+static VALUE file_numbers(const std::vector<uint64_t>& numbers) {
+  VALUE result = rb_ary_new();
+  for(size_t i = 0; i < numbers.size(); i++) {
+    rb_ary_push(result, ULL2NUM(numbers[i]));
+  }
+  return result;
+}
+
+static VALUE event_to_hash(const QueueListener::Event& event) {
+  VALUE h = rb_hash_new();
+  switch(event.type) {
+    case QueueListener::Event::kFlush: {
+      const leveldb::FlushJobInfo& info = event.flush;
+      rb_hash_aset(h, ID2SYM(rb_intern("type")), ID2SYM(rb_intern("flush_completed")));
+      rb_hash_aset(h, ID2SYM(rb_intern("column_family")), rb_str_new(info.cf_name.data(), info.cf_name.size()));
+      rb_hash_aset(h, ID2SYM(rb_intern("file_number")), ULL2NUM(info.file_number));
+      rb_hash_aset(h, ID2SYM(rb_intern("level")), INT2NUM(info.level));
+      rb_hash_aset(h, ID2SYM(rb_intern("file_size")), ULL2NUM(info.file_size));
+      rb_hash_aset(h, ID2SYM(rb_intern("micros")), ULL2NUM(info.micros));
+      break;
+    }
+    case QueueListener::Event::kCompaction: {
+      const leveldb::CompactionJobInfo& info = event.compaction;
+      rb_hash_aset(h, ID2SYM(rb_intern("type")), ID2SYM(rb_intern("compaction_completed")));
+      rb_hash_aset(h, ID2SYM(rb_intern("column_family")), rb_str_new(info.cf_name.data(), info.cf_name.size()));
+      rb_hash_aset(h, ID2SYM(rb_intern("base_level")), INT2NUM(info.base_level));
+      rb_hash_aset(h, ID2SYM(rb_intern("output_level")), INT2NUM(info.output_level));
+      rb_hash_aset(h, ID2SYM(rb_intern("input_files")), file_numbers(info.input_files));
+      rb_hash_aset(h, ID2SYM(rb_intern("output_files")), file_numbers(info.output_files));
+      rb_hash_aset(h, ID2SYM(rb_intern("bytes_read")), ULL2NUM(info.bytes_read));
+      rb_hash_aset(h, ID2SYM(rb_intern("bytes_written")), ULL2NUM(info.bytes_written));
+      rb_hash_aset(h, ID2SYM(rb_intern("micros")), ULL2NUM(info.micros));
+      rb_hash_aset(h, ID2SYM(rb_intern("status")), rb_str_new2(info.status.ToString().c_str()));
+      break;
+    }
+    case QueueListener::Event::kStall:
+      rb_hash_aset(h, ID2SYM(rb_intern("type")), ID2SYM(rb_intern("stall_conditions_changed")));
+      rb_hash_aset(h, ID2SYM(rb_intern("previous")), stall_condition(event.stall.previous));
+      rb_hash_aset(h, ID2SYM(rb_intern("current")), stall_condition(event.stall.current));
+      break;
+  }
+  return h;
+}
+
+// What the thread that pushes the events of a database needs
+typedef struct delivery {
+  QueueListener* listener;
+  VALUE queue;
+  VALUE event;  // the one being pushed
+} delivery;
+
+static VALUE push_event(VALUE arg) {
+  delivery* d = reinterpret_cast<delivery*>(arg);
+  return rb_funcall(d->queue, rb_intern("push"), 1, d->event);
+}
+
+// A queue that fails to take an event, e.g. because it was closed,
+// loses that event but does not stop the delivery of the next ones
+static VALUE drop_event(VALUE arg, VALUE error) {
+  VALUE message = rb_funcall(error, rb_intern("message"), 0);
+  rb_warn("leveldb: dropped an event of the listener: %s", StringValueCStr(message));
+  return Qnil;
+}
+
+static VALUE push_events(VALUE arg) {
+  delivery* d = reinterpret_cast<delivery*>(arg);
+  std::deque<QueueListener::Event>* events = d->listener->waiting();
+  void* more;
+  do {
+    more = rb_thread_call_without_gvl(QueueListener::Wait, d->listener,
+                                      QueueListener::Interrupt, d->listener);
+    while(!events->empty()) {
+      d->event = event_to_hash(events->front());
+      events->pop_front();
+      rb_rescue2(push_event, arg, drop_event, arg, rb_eStandardError, (VALUE)0);
+      d->event = Qnil;
+    }
+    rb_thread_check_ints();
+  } while(more != NULL);
+  return Qnil;
+}
+
+static VALUE release_delivery(VALUE arg) {
+  delivery* d = reinterpret_cast<delivery*>(arg);
+  rb_gc_unregister_address(&d->queue);
+  rb_gc_unregister_address(&d->event);
+  d->listener->Stop();
+  d->listener->Unref();
+  delete d;
+  return Qnil;
+}
+
+static VALUE deliver_events(void* arg) {
+  return rb_ensure(push_events, (VALUE)arg,
+                   release_delivery, (VALUE)arg);
+}
+
 static VALUE db_make(VALUE self, VALUE v_pathname, VALUE v_options) {
   Check_Type(v_pathname, T_STRING);
 
   auto_ptr<bound_db> db(new bound_db);
+  db->db = NULL;
+  db->statistics = NULL;
+  db->listener = NULL;
   std::string pathname = std::string((char*)RSTRING_PTR(v_pathname));
 
   leveldb::Options options;
   VALUE o_options = rb_class_new_instance(0, NULL, c_db_options);
   set_db_option(o_options, v_options, &options);
+  keep_options(db.get(), options);
+
+  // [name, options] of each column family, options being nil for those
+  // listed in an Array
+  VALUE v_cfs = NIL_P(v_options) ? Qnil : rb_hash_aref(v_options, k_column_families);
+  VALUE cf_pairs = rb_ary_new();
+  if(!NIL_P(v_cfs)) {
+    if(TYPE(v_cfs) == T_HASH) {
+      cf_pairs = rb_funcall(v_cfs, rb_intern("to_a"), 0);
+    } else {
+      Check_Type(v_cfs, T_ARRAY);
+      for(long i = 0; i < RARRAY_LEN(v_cfs); i++) {
+        rb_ary_push(cf_pairs, rb_assoc_new(rb_ary_entry(v_cfs, i), Qnil));
+      }
+    }
+  }
 
-  leveldb::Status status = leveldb::DB::Open(options, pathname, &db->db);
+  std::vector<leveldb::ColumnFamilyDescriptor> column_families;
+  VALUE cf_options = rb_ary_new();
+  for(long i = 0; i < RARRAY_LEN(cf_pairs); i++) {
+    VALUE v_name = rb_funcall(rb_ary_entry(rb_ary_entry(cf_pairs, i), 0), k_to_s, 0);
+    VALUE v_opts = rb_ary_entry(rb_ary_entry(cf_pairs, i), 1);
+    leveldb::Options family_options = options;
+    VALUE o_cf_options = o_options;
+    if(!NIL_P(v_opts)) {
+      family_options = leveldb::Options();
+      o_cf_options = rb_class_new_instance(0, NULL, c_db_options);
+      set_db_option(o_cf_options, v_opts, &family_options);
+      keep_options(db.get(), family_options);
+    }
+    rb_ary_push(cf_options, o_cf_options);
+    column_families.push_back(leveldb::ColumnFamilyDescriptor(std::string(RSTRING_PTR(v_name), RSTRING_LEN(v_name)), family_options));
+  }
+
+  if(!NIL_P(v_options) && RTEST(rb_hash_aref(v_options, k_statistics))) {
+    db->statistics = leveldb::NewStatistics();
+    options.statistics = db->statistics;
+  }
+  rb_iv_set(o_options, "@statistics", db->statistics != NULL ? Qtrue : Qfalse);
+  VALUE v_listener = NIL_P(v_options) ? Qnil : rb_hash_aref(v_options, k_listener);
+  if(!NIL_P(v_listener)) {
+    db->listener = new QueueListener;
+    options.listener = db->listener;
+  }
+  rb_iv_set(o_options, "@listener", v_listener);
+
+  std::vector<leveldb::ColumnFamilyHandle*> handles;
+  leveldb::Status status;
+  if(!NIL_P(v_options) && RTEST(rb_hash_aref(v_options, k_secondary))) {
+    status = leveldb::DB::OpenAsSecondary(options, pathname, column_families, &handles, &db->db);
+  } else if(!NIL_P(v_options) && RTEST(rb_hash_aref(v_options, k_read_only))) {
+    status = leveldb::DB::OpenForReadOnly(options, pathname, column_families, &handles, &db->db);
+  } else {
+    status = leveldb::DB::Open(options, pathname, column_families, &handles, &db->db);
+  }
+  bound_db* b_db = db.get();
   VALUE o_db = Data_Wrap_Struct(self, NULL, db_free, db.release());
+  if(b_db->listener != NULL) {
+    if(status.ok()) {
+      delivery* d = new delivery;
+      d->listener = b_db->listener;
+      d->queue = v_listener;
+      d->event = Qnil;
+      rb_gc_register_address(&d->queue);
+      rb_gc_register_address(&d->event);
+      rb_thread_create(deliver_events, d);
+    } else {
+      b_db->listener->Unref();  // no thread to let go of it
+    }
+  }
   RAISE_ON_ERROR(status);
 
+  VALUE o_cfs = rb_hash_new();
+  for(size_t i = 0; i < handles.size(); i++) {
+    VALUE o_cf = column_family_make(o_db, b_db, handles[i], rb_ary_entry(cf_options, i));
+    rb_hash_aset(o_cfs, rb_iv_get(o_cf, "@name"), o_cf);
+  }
+
   rb_iv_set(o_db, "@options", o_options);
+  rb_iv_set(o_db, "@column_families", o_cfs);
   VALUE init_argv[1] = { v_pathname };
   rb_obj_call_init(o_db, 1, init_argv);
 
   return o_db;
 }
 
+/*
+ * call-seq:
+ *   create_column_family(name, options = {})
+ *
+ * create a column family: a separate set of keys with options of its
+ * own, whose updates are logged together with those of the rest of the
+ * database.  The database has to be opened with it in
+ * :column_families from then on.
+ *
+ * [name] name of the column family
+ * [options] same as the column family options of #make
+ * [return] LevelDB::ColumnFamily instance
+ */
+static VALUE db_create_column_family(int argc, VALUE* argv, VALUE self) {
+  VALUE v_name, v_options;
+  rb_scan_args(argc, argv, "11", &v_name, &v_options);
+  Check_Type(v_name, T_STRING);
+
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+
+  leveldb::Options options;
+  VALUE o_options = rb_class_new_instance(0, NULL, c_db_options);
+  set_db_option(o_options, NIL_P(v_options) ? rb_hash_new() : v_options, &options);
+  keep_options(db, options);
+
+  leveldb::ColumnFamilyHandle* handle;
+  leveldb::Status status = db->db->CreateColumnFamily(options, std::string(RSTRING_PTR(v_name), RSTRING_LEN(v_name)), &handle);
+  RAISE_ON_ERROR(status);
+
+  VALUE o_cf = column_family_make(self, db, handle, o_options);
+  rb_hash_aset(rb_iv_get(self, "@column_families"), rb_iv_get(o_cf, "@name"), o_cf);
+  return o_cf;
+}
+
+static leveldb::ColumnFamilyHandle* column_family_handle(VALUE v_cf) {
+  if(c_column_family != rb_funcall(v_cf, k_class, 0)) {
+    rb_raise(rb_eArgError, "column family must be a LevelDB::ColumnFamily");
+  }
+  bound_column_family* cf;
+  Data_Get_Struct(v_cf, bound_column_family, cf);
+  if(cf->db->db == NULL) {
+    rb_raise(c_error, "db is closed");
+  }
+  return cf->handle;
+}
+
+/*
+ * call-seq:
+ *   drop_column_family(column_family)
+ *
+ * remove a column family and all of its data
+ *
+ * [column_family] LevelDB::ColumnFamily to drop
+ * [return] true
+ */
+static VALUE db_drop_column_family(VALUE self, VALUE v_cf) {
+  leveldb::ColumnFamilyHandle* handle = column_family_handle(v_cf);
+
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  leveldb::Status status = db->db->DropColumnFamily(handle);
+  RAISE_ON_ERROR(status);
+
+  rb_hash_delete(rb_iv_get(self, "@column_families"), rb_iv_get(v_cf, "@name"));
+  return Qtrue;
+}
+
+/*
+ * call-seq:
+ *   checkpoint(pathname)
+ *
+ * create a copy of the database as of now that can be opened with
+ * LevelDB::DB.load.  tables are hard linked when pathname is on the same
+ * file system as the database, so this takes little time or space.
+ *
+ * [pathname] path for the checkpoint, which must not exist
+ * [return] true
+ */
+static VALUE db_checkpoint(VALUE self, VALUE v_pathname) {
+  Check_Type(v_pathname, T_STRING);
+
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  std::string pathname = std::string((char*)RSTRING_PTR(v_pathname), RSTRING_LEN(v_pathname));
+  leveldb::Status status = db->db->CreateCheckpoint(pathname);
+  RAISE_ON_ERROR(status);
+  return Qtrue;
+}
+
+/*
+ * call-seq:
+ *   catch_up
+ *
+ * read the updates that the process writing the database has made
+ * since the database was opened or last caught up, so that they can
+ * be read.  only for a database opened with :secondary.
+ *
+ * [return] true
+ */
+static VALUE db_catch_up(VALUE self) {
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  leveldb::Status status = db->db->TryCatchUpWithPrimary();
+  RAISE_ON_ERROR(status);
+  return Qtrue;
+}
+
+static VALUE histogram_to_hash(const leveldb::HistogramData& data) {
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern("count")), ULL2NUM(data.count));
+  rb_hash_aset(h, ID2SYM(rb_intern("sum")), ULL2NUM(data.sum));
+  rb_hash_aset(h, ID2SYM(rb_intern("min")), ULL2NUM(data.min));
+  rb_hash_aset(h, ID2SYM(rb_intern("max")), ULL2NUM(data.max));
+  rb_hash_aset(h, ID2SYM(rb_intern("average")), rb_float_new(data.average));
+  rb_hash_aset(h, ID2SYM(rb_intern("median")), rb_float_new(data.median));
+  rb_hash_aset(h, ID2SYM(rb_intern("percentile95")), rb_float_new(data.percentile95));
+  rb_hash_aset(h, ID2SYM(rb_intern("percentile99")), rb_float_new(data.percentile99));
+  return h;
+}
+
+/*
+ * call-seq:
+ *   statistics
+ *
+ * the counters of a database opened with :statistics, e.g.
+ * :block_cache_hit, :bloom_filter_useful or :stall_micros, and its
+ * latency histograms (:get_micros, :write_micros, :seek_micros and
+ * :compaction_micros), each a Hash of :count, :sum, :min, :max,
+ * :average, :median, :percentile95 and :percentile99 in microseconds.
+ *
+ * [return] Hash, or nil if the database was not opened with :statistics
+ */
+static VALUE db_statistics(VALUE self) {
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  if(db->statistics == NULL) return Qnil;
+
+  VALUE result = rb_hash_new();
+  for(int i = 0; i < leveldb::kNumTickers; i++) {
+    leveldb::Ticker ticker = static_cast<leveldb::Ticker>(i);
+    rb_hash_aset(result, ID2SYM(rb_intern(leveldb::TickerName(ticker))),
+                 ULL2NUM(db->statistics->GetTickerCount(ticker)));
+  }
+  for(int i = 0; i < leveldb::kNumHistograms; i++) {
+    leveldb::HistogramType type = static_cast<leveldb::HistogramType>(i);
+    leveldb::HistogramData data;
+    db->statistics->GetHistogramData(type, &data);
+    rb_hash_aset(result, ID2SYM(rb_intern(leveldb::HistogramName(type))),
+                 histogram_to_hash(data));
+  }
+  return result;
+}
+
+static const struct {
+  const char* name;
+  uint64_t leveldb::PerfContext::*counter;
+} perf_counters[] = {
+  { "get_from_memtable_count", &leveldb::PerfContext::get_from_memtable_count },
+  { "get_from_memtable_time", &leveldb::PerfContext::get_from_memtable_time },
+  { "get_from_output_files_time", &leveldb::PerfContext::get_from_output_files_time },
+  { "files_checked", &leveldb::PerfContext::files_checked },
+  { "level0_files_checked", &leveldb::PerfContext::level0_files_checked },
+  { "find_table_count", &leveldb::PerfContext::find_table_count },
+  { "find_table_time", &leveldb::PerfContext::find_table_time },
+  { "table_open_count", &leveldb::PerfContext::table_open_count },
+  { "bloom_filter_checks", &leveldb::PerfContext::bloom_filter_checks },
+  { "bloom_filter_useful", &leveldb::PerfContext::bloom_filter_useful },
+  { "block_cache_hit_count", &leveldb::PerfContext::block_cache_hit_count },
+  { "block_read_count", &leveldb::PerfContext::block_read_count },
+  { "block_read_bytes", &leveldb::PerfContext::block_read_bytes },
+  { "block_read_time", &leveldb::PerfContext::block_read_time },
+  { "block_checksum_time", &leveldb::PerfContext::block_checksum_time },
+  { "block_decompress_time", &leveldb::PerfContext::block_decompress_time },
+};
+
+/*
+ * call-seq:
+ *   LevelDB.perf_context
+ *
+ * the breakdown of the last read of the calling thread made with
+ * :perf_context => true: how many memtables, tables, filters and
+ * blocks it went through, e.g. :files_checked or :block_read_count,
+ * and the nanoseconds spent on each step, e.g. :block_read_time.
+ *
+ * [return] Hash
+ */
+static VALUE leveldb_perf_context(VALUE self) {
+  const leveldb::PerfContext* context = leveldb::GetPerfContext();
+  VALUE result = rb_hash_new();
+  for(size_t i = 0; i < sizeof(perf_counters) / sizeof(perf_counters[0]); i++) {
+    rb_hash_aset(result, ID2SYM(rb_intern(perf_counters[i].name)),
+                 ULL2NUM(context->*perf_counters[i].counter));
+  }
+  return result;
+}
+
 static VALUE db_close(VALUE self) {
   bound_db* db;
   Data_Get_Struct(self, bound_db, db);
@@ -221,6 +991,7 @@ static VALUE db_close(VALUE self) {
   if(db->db != NULL) {
     delete db->db;
     db->db = NULL;
+    if(db->listener != NULL) db->listener->Close();
   }
   return Qtrue;
 }
@@ -274,47 +1045,71 @@ static leveldb::WriteOptions parse_write_options(VALUE options) {
  *                                verified against corresponding checksums.
  *
  *                                Default: false
+ * [options[ :perf_context ]] If true, count and time the steps of this read, so that
+ *                            LevelDB.perf_context tells where its time went.
+ *
+ *                            Default: false
  * [return] value of stored db
  */
-static VALUE db_get(int argc, VALUE* argv, VALUE self) {
+// a NULL handle stands for the default column family
+static VALUE get_value(leveldb::DB* db, leveldb::ColumnFamilyHandle* handle, int argc, VALUE* argv) {
   VALUE v_key, v_options;
   rb_scan_args(argc, argv, "11", &v_key, &v_options);
   Check_Type(v_key, T_STRING);
   leveldb::ReadOptions readOptions = parse_read_options(v_options);
-
-  bound_db* db;
-  Data_Get_Struct(self, bound_db, db);
+  bool perf = !NIL_P(v_options) && RTEST(rb_hash_aref(v_options, k_perf_context));
 
   leveldb::Slice key = RUBY_STRING_TO_SLICE(v_key);
   std::string value;
-  leveldb::Status status = db->db->Get(readOptions, key, &value);
+  leveldb::PerfLevel perf_level = leveldb::GetPerfLevel();
+  if(perf) {
+    leveldb::SetPerfLevel(leveldb::kEnableTime);
+    leveldb::GetPerfContext()->Reset();
+  }
+  leveldb::Status status = (handle == NULL ?
+                            db->Get(readOptions, key, &value) :
+                            db->Get(readOptions, handle, key, &value));
+  if(perf) leveldb::SetPerfLevel(perf_level);
   if(status.IsNotFound()) return Qnil;
 
   RAISE_ON_ERROR(status);
   return STRING_TO_RUBY_STRING(value);
 }
 
-static VALUE db_delete(int argc, VALUE* argv, VALUE self) {
+static VALUE delete_value(leveldb::DB* db, leveldb::ColumnFamilyHandle* handle, int argc, VALUE* argv) {
   VALUE v_key, v_options;
   rb_scan_args(argc, argv, "11", &v_key, &v_options);
   Check_Type(v_key, T_STRING);
   leveldb::WriteOptions writeOptions = parse_write_options(v_options);
 
-  bound_db* db;
-  Data_Get_Struct(self, bound_db, db);
-
   leveldb::Slice key = RUBY_STRING_TO_SLICE(v_key);
   std::string value;
-  leveldb::Status status = db->db->Get(uncached_read_options, key, &value);
+  leveldb::Status status = (handle == NULL ?
+                            db->Get(uncached_read_options, key, &value) :
+                            db->Get(uncached_read_options, handle, key, &value));
 
   if(status.IsNotFound()) return Qnil;
 
-  status = db->db->Delete(writeOptions, key);
+  status = (handle == NULL ?
+            db->Delete(writeOptions, key) :
+            db->Delete(writeOptions, handle, key));
   RAISE_ON_ERROR(status);
 
   return STRING_TO_RUBY_STRING(value);
 }
 
+static VALUE db_get(int argc, VALUE* argv, VALUE self) {
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  return get_value(db->db, NULL, argc, argv);
+}
+
+static VALUE db_delete(int argc, VALUE* argv, VALUE self) {
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  return delete_value(db->db, NULL, argc, argv);
+}
+
 static VALUE db_exists(VALUE self, VALUE v_key) {
   Check_Type(v_key, T_STRING);
 
@@ -355,7 +1150,7 @@ static VALUE db_exists(VALUE self, VALUE v_key) {
  *                    Default: false
  * [return] stored value
  */
-static VALUE db_put(int argc, VALUE* argv, VALUE self) {
+static VALUE put_value(leveldb::DB* db, leveldb::ColumnFamilyHandle* handle, int argc, VALUE* argv) {
   VALUE v_key, v_value, v_options;
 
   rb_scan_args(argc, argv, "21", &v_key, &v_value, &v_options);
@@ -363,18 +1158,125 @@ static VALUE db_put(int argc, VALUE* argv, VALUE self) {
   Check_Type(v_value, T_STRING);
   leveldb::WriteOptions writeOptions = parse_write_options(v_options);
 
+  leveldb::Slice key = RUBY_STRING_TO_SLICE(v_key);
+  leveldb::Slice value = RUBY_STRING_TO_SLICE(v_value);
+  leveldb::Status status = (handle == NULL ?
+                            db->Put(writeOptions, key, value) :
+                            db->Put(writeOptions, handle, key, value));
+
+  RAISE_ON_ERROR(status);
+
+  return v_value;
+}
+
+static VALUE db_put(int argc, VALUE* argv, VALUE self) {
   bound_db* db;
   Data_Get_Struct(self, bound_db, db);
+  return put_value(db->db, NULL, argc, argv);
+}
+
+/*
+ * call-seq:
+ *   merge(key, value, options = nil)
+ *
+ * combine value with the data stored under key, using the
+ * :merge_operator the DB was opened with.  The work is done lazily,
+ * when the key is read or compacted.
+ *
+ * [key] key you want to update
+ * [value] data to combine with the stored value.  With :uint64_add it
+ *         may be an Integer
+ * [options[ :sync ]] same as #put
+ * [return] value
+ */
+static VALUE merge_value(leveldb::DB* db, leveldb::ColumnFamilyHandle* handle, int argc, VALUE* argv) {
+  VALUE v_key, v_value, v_options;
 
+  rb_scan_args(argc, argv, "21", &v_key, &v_value, &v_options);
+  Check_Type(v_key, T_STRING);
+  leveldb::WriteOptions writeOptions = parse_write_options(v_options);
+
+  char buf[8];
+  leveldb::Slice value;
+  if(FIXNUM_P(v_value) || TYPE(v_value) == T_BIGNUM) {
+    unsigned LONG_LONG n = NUM2ULL(v_value);
+    for(int i = 0; i < 8; i++) {
+      buf[i] = static_cast<char>((n >> (8 * i)) & 0xff);
+    }
+    value = leveldb::Slice(buf, sizeof(buf));
+  } else {
+    Check_Type(v_value, T_STRING);
+    value = RUBY_STRING_TO_SLICE(v_value);
+  }
   leveldb::Slice key = RUBY_STRING_TO_SLICE(v_key);
-  leveldb::Slice value = RUBY_STRING_TO_SLICE(v_value);
-  leveldb::Status status = db->db->Put(writeOptions, key, value);
+  leveldb::Status status = (handle == NULL ?
+                            db->Merge(writeOptions, key, value) :
+                            db->Merge(writeOptions, handle, key, value));
 
   RAISE_ON_ERROR(status);
 
   return v_value;
 }
 
+static VALUE db_merge(int argc, VALUE* argv, VALUE self) {
+  bound_db* db;
+  Data_Get_Struct(self, bound_db, db);
+  return merge_value(db->db, NULL, argc, argv);
+}
+
+/*
+ * call-seq:
+ *   get(key, options = nil)
+ *
+ * same as LevelDB::DB#get, for the keys of this column family
+ */
+static VALUE cf_get(int argc, VALUE* argv, VALUE self) {
+  leveldb::ColumnFamilyHandle* handle = column_family_handle(self);
+  bound_column_family* cf;
+  Data_Get_Struct(self, bound_column_family, cf);
+  return get_value(cf->db->db, handle, argc, argv);
+}
+
+/*
+ * call-seq:
+ *   delete(key, options = nil)
+ *
+ * same as LevelDB::DB#delete, for the keys of this column family
+ */
+static VALUE cf_delete(int argc, VALUE* argv, VALUE self) {
+  leveldb::ColumnFamilyHandle* handle = column_family_handle(self);
+  bound_column_family* cf;
+  Data_Get_Struct(self, bound_column_family, cf);
+  return delete_value(cf->db->db, handle, argc, argv);
+}
+
+/*
+ * call-seq:
+ *   put(key, value, options = nil)
+ *
+ * same as LevelDB::DB#put, for the keys of this column family
+ */
+static VALUE cf_put(int argc, VALUE* argv, VALUE self) {
+  leveldb::ColumnFamilyHandle* handle = column_family_handle(self);
+  bound_column_family* cf;
+  Data_Get_Struct(self, bound_column_family, cf);
+  return put_value(cf->db->db, handle, argc, argv);
+}
+
+/*
+ * call-seq:
+ *   merge(key, value, options = nil)
+ *
+ * same as LevelDB::DB#merge, using the :merge_operator of this column
+ * family
+ */
+static VALUE cf_merge(int argc, VALUE* argv, VALUE self) {
+  leveldb::ColumnFamilyHandle* handle = column_family_handle(self);
+  bound_column_family* cf;
+  Data_Get_Struct(self, bound_column_family, cf);
+  return merge_value(cf->db->db, handle, argc, argv);
+}
+
 static VALUE db_size(VALUE self) {
   long count = 0;
 
@@ -598,22 +1500,49 @@ static VALUE batch_make(VALUE klass) {
   return o_batch;
 }
 
-static VALUE batch_put(VALUE self, VALUE v_key, VALUE v_value) {
+/*
+ * call-seq:
+ *   put(key, value, column_family = nil)
+ *
+ * add a put of key to the batch, in the given LevelDB::ColumnFamily
+ * or in the default one.  All the updates of a batch are applied at
+ * once, whatever their column families.
+ */
+static VALUE batch_put(int argc, VALUE* argv, VALUE self) {
+  VALUE v_key, v_value, v_cf;
+  rb_scan_args(argc, argv, "21", &v_key, &v_value, &v_cf);
   Check_Type(v_key, T_STRING);
   Check_Type(v_value, T_STRING);
 
   bound_batch* batch;
   Data_Get_Struct(self, bound_batch, batch);
-  batch->batch.Put(RUBY_STRING_TO_SLICE(v_key), RUBY_STRING_TO_SLICE(v_value));
+  if(NIL_P(v_cf)) {
+    batch->batch.Put(RUBY_STRING_TO_SLICE(v_key), RUBY_STRING_TO_SLICE(v_value));
+  } else {
+    batch->batch.Put(column_family_handle(v_cf), RUBY_STRING_TO_SLICE(v_key), RUBY_STRING_TO_SLICE(v_value));
+  }
 
   return v_value;
 }
 
-static VALUE batch_delete(VALUE self, VALUE v_key) {
+/*
+ * call-seq:
+ *   delete(key, column_family = nil)
+ *
+ * add a deletion of key to the batch, in the given
+ * LevelDB::ColumnFamily or in the default one
+ */
+static VALUE batch_delete(int argc, VALUE* argv, VALUE self) {
+  VALUE v_key, v_cf;
+  rb_scan_args(argc, argv, "11", &v_key, &v_cf);
   Check_Type(v_key, T_STRING);
   bound_batch* batch;
   Data_Get_Struct(self, bound_batch, batch);
-  batch->batch.Delete(RUBY_STRING_TO_SLICE(v_key));
+  if(NIL_P(v_cf)) {
+    batch->batch.Delete(RUBY_STRING_TO_SLICE(v_key));
+  } else {
+    batch->batch.Delete(column_family_handle(v_cf), RUBY_STRING_TO_SLICE(v_key));
+  }
   return Qtrue;
 }
 
@@ -640,6 +1569,7 @@ extern "C" {
 void Init_leveldb() {
   k_fill = ID2SYM(rb_intern("fill_cache"));
   k_verify = ID2SYM(rb_intern("verify_checksums"));
+  k_perf_context = ID2SYM(rb_intern("perf_context"));
   k_sync = ID2SYM(rb_intern("sync"));
   k_from = ID2SYM(rb_intern("from"));
   k_to = ID2SYM(rb_intern("to"));
@@ -650,17 +1580,47 @@ void Init_leveldb() {
   k_error_if_exists = ID2SYM(rb_intern("error_if_exists"));
   k_paranoid_checks = ID2SYM(rb_intern("paranoid_checks"));
   k_write_buffer_size = ID2SYM(rb_intern("write_buffer_size"));
+  k_recovery_threads = ID2SYM(rb_intern("recovery_threads"));
   k_block_cache_size = ID2SYM(rb_intern("block_cache_size"));
   k_block_size = ID2SYM(rb_intern("block_size"));
   k_block_restart_interval = ID2SYM(rb_intern("block_restart_interval"));
+  k_readahead_size = ID2SYM(rb_intern("readahead_size"));
+  k_use_direct_io_for_compaction = ID2SYM(rb_intern("use_direct_io_for_compaction"));
+  k_num_levels = ID2SYM(rb_intern("num_levels"));
+  k_level0_file_num_compaction_trigger = ID2SYM(rb_intern("level0_file_num_compaction_trigger"));
+  k_level0_slowdown_writes_trigger = ID2SYM(rb_intern("level0_slowdown_writes_trigger"));
+  k_level0_stop_writes_trigger = ID2SYM(rb_intern("level0_stop_writes_trigger"));
+  k_target_file_size_base = ID2SYM(rb_intern("target_file_size_base"));
+  k_target_file_size_multiplier = ID2SYM(rb_intern("target_file_size_multiplier"));
+  k_max_bytes_for_level_base = ID2SYM(rb_intern("max_bytes_for_level_base"));
+  k_max_bytes_for_level_multiplier = ID2SYM(rb_intern("max_bytes_for_level_multiplier"));
+  k_level_compaction_dynamic_level_bytes = ID2SYM(rb_intern("level_compaction_dynamic_level_bytes"));
+  k_ttl = ID2SYM(rb_intern("ttl"));
+  k_hide_expired_keys = ID2SYM(rb_intern("hide_expired_keys"));
+  k_compaction_filter_prefix = ID2SYM(rb_intern("compaction_filter_prefix"));
+  k_merge_operator = ID2SYM(rb_intern("merge_operator"));
+  k_uint64_add = ID2SYM(rb_intern("uint64_add"));
+  k_string_append = ID2SYM(rb_intern("string_append"));
   k_compression = ID2SYM(rb_intern("compression"));
+  k_cache_index_and_filter_blocks = ID2SYM(rb_intern("cache_index_and_filter_blocks"));
+  k_pin_l0_filter_and_index_blocks_in_cache = ID2SYM(rb_intern("pin_l0_filter_and_index_blocks_in_cache"));
+  k_partition_index_and_filters = ID2SYM(rb_intern("partition_index_and_filters"));
+  k_metadata_block_size = ID2SYM(rb_intern("metadata_block_size"));
   k_max_open_files = ID2SYM(rb_intern("max_open_files"));
+  k_record_table_handles = ID2SYM(rb_intern("record_table_handles"));
+  k_prewarm_threads = ID2SYM(rb_intern("prewarm_threads"));
+  k_column_families = ID2SYM(rb_intern("column_families"));
+  k_read_only = ID2SYM(rb_intern("read_only"));
+  k_secondary = ID2SYM(rb_intern("secondary"));
+  k_statistics = ID2SYM(rb_intern("statistics"));
+  k_listener = ID2SYM(rb_intern("listener"));
   k_to_s = rb_intern("to_s");
 
   uncached_read_options = leveldb::ReadOptions();
   uncached_read_options.fill_cache = false;
 
   m_leveldb = rb_define_module("LevelDB");
+  rb_define_module_function(m_leveldb, "perf_context", RUBY_METHOD_FUNC(leveldb_perf_context), 0);
 
   c_db = rb_define_class_under(m_leveldb, "DB", rb_cObject);
   rb_define_singleton_method(c_db, "make", RUBY_METHOD_FUNC(db_make), 2);
@@ -668,10 +1628,16 @@ void Init_leveldb() {
   rb_define_method(c_db, "get", RUBY_METHOD_FUNC(db_get), -1);
   rb_define_method(c_db, "delete", RUBY_METHOD_FUNC(db_delete), -1);
   rb_define_method(c_db, "put", RUBY_METHOD_FUNC(db_put), -1);
+  rb_define_method(c_db, "merge", RUBY_METHOD_FUNC(db_merge), -1);
   rb_define_method(c_db, "exists?", RUBY_METHOD_FUNC(db_exists), 1);
   rb_define_method(c_db, "close", RUBY_METHOD_FUNC(db_close), 0);
   rb_define_method(c_db, "size", RUBY_METHOD_FUNC(db_size), 0);
   rb_define_method(c_db, "batch", RUBY_METHOD_FUNC(db_batch), -1);
+  rb_define_method(c_db, "create_column_family", RUBY_METHOD_FUNC(db_create_column_family), -1);
+  rb_define_method(c_db, "drop_column_family", RUBY_METHOD_FUNC(db_drop_column_family), 1);
+  rb_define_method(c_db, "checkpoint", RUBY_METHOD_FUNC(db_checkpoint), 1);
+  rb_define_method(c_db, "catch_up", RUBY_METHOD_FUNC(db_catch_up), 0);
+  rb_define_method(c_db, "statistics", RUBY_METHOD_FUNC(db_statistics), 0);
 
   c_iter = rb_define_class_under(m_leveldb, "Iterator", rb_cObject);
   rb_define_singleton_method(c_iter, "make", RUBY_METHOD_FUNC(iter_make), 2);
@@ -684,8 +1650,14 @@ void Init_leveldb() {
 
   c_batch = rb_define_class_under(m_leveldb, "WriteBatch", rb_cObject);
   rb_define_singleton_method(c_batch, "make", RUBY_METHOD_FUNC(batch_make), 0);
-  rb_define_method(c_batch, "put", RUBY_METHOD_FUNC(batch_put), 2);
-  rb_define_method(c_batch, "delete", RUBY_METHOD_FUNC(batch_delete), 1);
+  rb_define_method(c_batch, "put", RUBY_METHOD_FUNC(batch_put), -1);
+  rb_define_method(c_batch, "delete", RUBY_METHOD_FUNC(batch_delete), -1);
+
+  c_column_family = rb_define_class_under(m_leveldb, "ColumnFamily", rb_cObject);
+  rb_define_method(c_column_family, "get", RUBY_METHOD_FUNC(cf_get), -1);
+  rb_define_method(c_column_family, "delete", RUBY_METHOD_FUNC(cf_delete), -1);
+  rb_define_method(c_column_family, "put", RUBY_METHOD_FUNC(cf_put), -1);
+  rb_define_method(c_column_family, "merge", RUBY_METHOD_FUNC(cf_merge), -1);
 
   c_db_options = rb_define_class_under(m_leveldb, "Options", rb_cObject);
 
@@ -0,0 +1,632 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A backup directory holds:
+//   shared/NUMBER_CRC_SIZE.sst   Tables, shared by the backups
+//   private/ID/                  The other files of backup ID, laid out
+//                                as in the DB directory
+//   meta/ID                      The files of backup ID, which exists
+//                                once the backup is complete
+//
+// A meta file starts with the time of the backup, followed by one line
+// per file: its name in the DB, its path in the backup directory, its
+// size and its crc32c.
+
+#include "leveldb/backup_engine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "leveldb/rate_limiter.h"
+#include "port/port.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// Defined in util/env.cc
+extern Status WriteStringToFileSync(Env* env, const Slice& data,
+                                    const std::string& fname);
+
+BackupOptions::BackupOptions()
+    : env(Env::Default()),
+      rate_limiter(NULL),
+      max_background_operations(4) {
+}
+
+BackupEngine::~BackupEngine() {
+}
+
+namespace {
+
+// A file of a backup
+struct BackupFile {
+  std::string name;     // Relative to the DB directory
+  std::string path;     // Relative to the backup directory
+  uint64_t size;
+  uint32_t crc;
+};
+
+struct Backup {
+  int64_t timestamp;
+  std::vector<BackupFile> files;
+};
+
+// Reads the first "size" bytes of "src", or takes "contents" if "src" is
+// empty, to compute their crc32c and, unless "dst" is empty, write
+// them to "dst".
+struct CopyJob {
+  std::string src;
+  std::string contents;
+  uint64_t size;
+  std::string dst;
+
+  uint32_t crc;         // Set by Run()
+  Status status;
+
+  void Run(Env* env, RateLimiter* limiter);
+};
+
+void CopyJob::Run(Env* env, RateLimiter* limiter) {
+  crc = 0;
+  if (src.empty()) {
+    crc = crc32c::Value(contents.data(), contents.size());
+    if (!dst.empty()) {
+      status = WriteStringToFileSync(env, contents, dst);
+    }
+    return;
+  }
+
+  SequentialFile* file;
+  status = env->NewSequentialFile(src, &file);
+  if (!status.ok()) {
+    return;
+  }
+  WritableFile* dest = NULL;
+  if (!dst.empty()) {
+    status = env->NewWritableFile(dst, &dest);
+    if (!status.ok()) {
+      delete file;
+      return;
+    }
+  }
+  static const size_t kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  uint64_t left = size;
+  while (left > 0) {
+    const size_t n = std::min<uint64_t>(left, kBufferSize);
+    if (limiter != NULL) {
+      limiter->Request(n);
+    }
+    Slice fragment;
+    status = file->Read(n, &fragment, space);
+    if (status.ok() && fragment.empty()) {
+      status = Status::Corruption(src, "file is shorter than expected");
+    }
+    if (status.ok() && dest != NULL) {
+      status = dest->Append(fragment);
+    }
+    if (!status.ok()) {
+      break;
+    }
+    crc = crc32c::Extend(crc, fragment.data(), fragment.size());
+    left -= fragment.size();
+  }
+  delete[] space;
+  delete file;
+  if (dest != NULL) {
+    if (status.ok()) {
+      status = dest->Sync();
+    }
+    if (status.ok()) {
+      status = dest->Close();
+    }
+    delete dest;
+    if (!status.ok()) {
+      env->DeleteFile(dst);
+    }
+  }
+}
+
+// Runs a list of CopyJobs on several threads
+struct CopyJobs {
+  Env* const env;
+  RateLimiter* const limiter;
+  std::vector<CopyJob>* const jobs;
+
+  port::Mutex mu;
+  port::CondVar cv;     // Signalled when a thread exits
+  size_t next_job;
+  int running;
+
+  CopyJobs(Env* e, RateLimiter* l, std::vector<CopyJob>* j)
+      : env(e), limiter(l), jobs(j), cv(&mu), next_job(0), running(0) {
+  }
+
+  static void Work(void* arg) {
+    CopyJobs* state = reinterpret_cast<CopyJobs*>(arg);
+    MutexLock l(&state->mu);
+    while (state->next_job < state->jobs->size()) {
+      CopyJob* job = &(*state->jobs)[state->next_job++];
+      state->mu.Unlock();
+      job->Run(state->env, state->limiter);
+      state->mu.Lock();
+    }
+    state->running--;
+    state->cv.SignalAll();
+  }
+};
+
+// Return the first error of the jobs
+Status RunCopyJobs(const BackupOptions& options, std::vector<CopyJob>* jobs) {
+  CopyJobs state(options.env, options.rate_limiter, jobs);
+  const int threads = static_cast<int>(std::min<size_t>(
+      std::max(options.max_background_operations, 1), jobs->size()));
+  MutexLock l(&state.mu);
+  for (int i = 0; i < threads; i++) {
+    state.running++;
+    options.env->StartThread(&CopyJobs::Work, &state);
+  }
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  for (size_t i = 0; i < jobs->size(); i++) {
+    if (!(*jobs)[i].status.ok()) {
+      return (*jobs)[i].status;
+    }
+  }
+  return Status::OK();
+}
+
+// Create the directories that the files with the given names, relative
+// to "dir", are in.
+Status CreateParentDirs(Env* env, const std::string& dir,
+                        const std::vector<std::string>& names) {
+  std::set<std::string> created;
+  for (size_t i = 0; i < names.size(); i++) {
+    const size_t slash = names[i].rfind('/');
+    if (slash != std::string::npos &&
+        created.insert(names[i].substr(0, slash)).second) {
+      Status s = env->CreateDir(dir + "/" + names[i].substr(0, slash));
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return Status::OK();
+}
+
+class BackupEngineImpl : public BackupEngine {
+ public:
+  BackupEngineImpl(const BackupOptions& options, const std::string& dir)
+      : options_(options),
+        env_(options.env),
+        dir_(dir) {
+  }
+  virtual ~BackupEngineImpl() { }
+
+  Status Load();
+
+  virtual Status CreateNewBackup(DB* db, uint32_t* backup_id);
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backup_info);
+  virtual Status VerifyBackup(uint32_t backup_id);
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir);
+  virtual Status RestoreDBFromLatestBackup(const std::string& db_dir);
+  virtual Status DeleteBackup(uint32_t backup_id);
+  virtual Status PurgeOldBackups(uint32_t num_backups_to_keep);
+
+ private:
+  std::string SharedDir() const { return dir_ + "/shared"; }
+  std::string PrivateDir() const { return dir_ + "/private"; }
+  std::string MetaDir() const { return dir_ + "/meta"; }
+  std::string PrivateDir(uint32_t id) const {
+    return PrivateDir() + "/" + NumberToString(id);
+  }
+  std::string MetaFileName(uint32_t id) const {
+    return MetaDir() + "/" + NumberToString(id);
+  }
+
+  Status WriteMetaFile(uint32_t id, const Backup& backup);
+  Status ReadMetaFile(uint32_t id, Backup* backup);
+
+  // Delete the files that no complete backup uses
+  void DeleteUnusedFiles();
+
+  const BackupOptions options_;
+  Env* const env_;
+  const std::string dir_;
+  std::map<uint32_t, Backup> backups_;
+};
+
+Status BackupEngineImpl::Load() {
+  env_->CreateDir(dir_);          // Errors are caught by GetChildren()
+  env_->CreateDir(SharedDir());
+  env_->CreateDir(PrivateDir());
+  env_->CreateDir(MetaDir());
+
+  std::vector<std::string> filenames;
+  Status s = env_->GetChildren(MetaDir(), &filenames);
+  for (size_t i = 0; s.ok() && i < filenames.size(); i++) {
+    Slice in(filenames[i]);
+    uint64_t id;
+    if (ConsumeDecimalNumber(&in, &id) && in.empty() && id > 0 &&
+        id <= 0xffffffffu) {
+      s = ReadMetaFile(static_cast<uint32_t>(id), &backups_[id]);
+    }
+  }
+  if (s.ok()) {
+    DeleteUnusedFiles();
+  }
+  return s;
+}
+
+Status BackupEngineImpl::WriteMetaFile(uint32_t id, const Backup& backup) {
+  std::string meta;
+  AppendNumberTo(&meta, backup.timestamp);
+  meta.push_back('\n');
+  for (size_t i = 0; i < backup.files.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    meta.append(f.name);
+    meta.push_back(' ');
+    meta.append(f.path);
+    meta.push_back(' ');
+    AppendNumberTo(&meta, f.size);
+    meta.push_back(' ');
+    AppendNumberTo(&meta, f.crc);
+    meta.push_back('\n');
+  }
+  // The backup exists once its meta file does
+  const std::string fname = MetaFileName(id);
+  const std::string tmp = fname + ".tmp";
+  Status s = WriteStringToFileSync(env_, meta, tmp);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp);
+  }
+  return s;
+}
+
+// Store in *field the characters of *in up to the next space, and
+// remove them and the space from *in.
+static bool ConsumeField(Slice* in, std::string* field) {
+  const char* space = static_cast<const char*>(
+      memchr(in->data(), ' ', in->size()));
+  if (space == NULL || space == in->data()) {
+    return false;
+  }
+  field->assign(in->data(), space - in->data());
+  in->remove_prefix(space - in->data() + 1);
+  return true;
+}
+
+Status BackupEngineImpl::ReadMetaFile(uint32_t id, Backup* backup) {
+  const std::string fname = MetaFileName(id);
+  std::string meta;
+  Status s = ReadFileToString(env_, fname, &meta);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice in(meta);
+  uint64_t timestamp;
+  if (!ConsumeDecimalNumber(&in, &timestamp) || !ConsumeChar(&in, '\n')) {
+    return Status::Corruption(fname, "bad timestamp");
+  }
+  backup->timestamp = static_cast<int64_t>(timestamp);
+  backup->files.clear();
+  while (!in.empty()) {
+    BackupFile f;
+    uint64_t crc;
+    if (!ConsumeField(&in, &f.name) || !ConsumeField(&in, &f.path) ||
+        !ConsumeDecimalNumber(&in, &f.size) || !ConsumeChar(&in, ' ') ||
+        !ConsumeDecimalNumber(&in, &crc) || !ConsumeChar(&in, '\n')) {
+      return Status::Corruption(fname, "bad file entry");
+    }
+    f.crc = static_cast<uint32_t>(crc);
+    backup->files.push_back(f);
+  }
+  return s;
+}
+
+void BackupEngineImpl::DeleteUnusedFiles() {
+  std::set<std::string> used;
+  for (std::map<uint32_t, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end(); ++it) {
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      used.insert(it->second.files[i].path);
+    }
+  }
+
+  std::vector<std::string> filenames;
+  env_->GetChildren(SharedDir(), &filenames);  // Ignoring errors on purpose
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (filenames[i] != "." && filenames[i] != ".." &&
+        used.count("shared/" + filenames[i]) == 0) {
+      env_->DeleteFile(SharedDir() + "/" + filenames[i]);
+    }
+  }
+
+  // The private files of a backup are laid out like a DB
+  Options options;
+  options.env = env_;
+  env_->GetChildren(PrivateDir(), &filenames);
+  for (size_t i = 0; i < filenames.size(); i++) {
+    Slice in(filenames[i]);
+    uint64_t id;
+    if (filenames[i] != "." && filenames[i] != ".." &&
+        !(ConsumeDecimalNumber(&in, &id) && in.empty() &&
+          backups_.count(id) > 0)) {
+      DestroyDB(PrivateDir() + "/" + filenames[i], options);
+    }
+  }
+
+  // Meta files that were being written
+  env_->GetChildren(MetaDir(), &filenames);
+  for (size_t i = 0; i < filenames.size(); i++) {
+    Slice in(filenames[i]);
+    uint64_t id;
+    if (filenames[i] != "." && filenames[i] != ".." &&
+        !(ConsumeDecimalNumber(&in, &id) && in.empty())) {
+      env_->DeleteFile(MetaDir() + "/" + filenames[i]);
+    }
+  }
+}
+
+// Return the path in the backup directory of a table
+static std::string SharedTablePath(uint64_t number, uint32_t crc,
+                                   uint64_t size) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "shared/%06llu_%u_%llu.sst",
+           static_cast<unsigned long long>(number),
+           static_cast<unsigned int>(crc),
+           static_cast<unsigned long long>(size));
+  return buf;
+}
+
+Status BackupEngineImpl::CreateNewBackup(DB* db, uint32_t* backup_id) {
+  const uint32_t id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+  std::vector<CheckpointFile> files;
+  Status s = db->GetCheckpointFiles(&files);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Tables never change once written, so one that an earlier backup
+  // has with the same name and size is not read again.
+  std::set<std::string> used;
+  std::map<std::pair<std::string, uint64_t>, const BackupFile*> backed_up;
+  for (std::map<uint32_t, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end(); ++it) {
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      const BackupFile& f = it->second.files[i];
+      used.insert(f.path);
+      if (Slice(f.path).starts_with("shared/")) {
+        backed_up[std::make_pair(f.name, f.size)] = &f;
+      }
+    }
+  }
+
+  Backup backup;
+  backup.timestamp = static_cast<int64_t>(env_->NowMicros() / 1000000);
+  backup.files.resize(files.size());
+  std::vector<CopyJob> copies;
+  std::vector<std::string> private_names;
+  std::vector<size_t> copied;         // Index in files of each copy
+  std::vector<uint64_t> new_tables;   // Number of each copied table, or 0
+  for (size_t i = 0; i < files.size(); i++) {
+    const CheckpointFile& file = files[i];
+    BackupFile* f = &backup.files[i];
+    f->name = file.name;
+    f->size = file.size;
+    CopyJob job;
+    job.src = file.source;
+    job.contents = file.contents;
+    job.size = file.size;
+    uint64_t number;
+    FileType type;
+    if (!file.source.empty() &&
+        ParseFileName(file.name.substr(file.name.rfind('/') + 1),
+                      &number, &type) &&
+        type == kTableFile) {
+      std::map<std::pair<std::string, uint64_t>,
+               const BackupFile*>::const_iterator previous =
+          backed_up.find(std::make_pair(file.name, file.size));
+      if (previous != backed_up.end()) {
+        f->path = previous->second->path;
+        f->crc = previous->second->crc;
+        continue;  // Already backed up
+      }
+      // Its name depends on its crc, which is computed while copying
+      // it, so it is renamed once complete.  This also ensures that a
+      // table in shared/ never has less than its name says.
+      job.dst = SharedDir() + "/" + NumberToString(id) + "_" +
+                NumberToString(i) + ".tmp";
+      new_tables.push_back(number);
+    } else {
+      f->path = "private/" + NumberToString(id) + "/" + file.name;
+      job.dst = dir_ + "/" + f->path;
+      private_names.push_back(file.name);
+      new_tables.push_back(0);
+    }
+    copies.push_back(job);
+    copied.push_back(i);
+  }
+  s = env_->CreateDir(PrivateDir(id));
+  if (s.ok()) {
+    s = CreateParentDirs(env_, PrivateDir(id), private_names);
+  }
+  if (s.ok()) {
+    s = RunCopyJobs(options_, &copies);
+  }
+  db->ReleaseCheckpointFiles();
+
+  for (size_t i = 0; s.ok() && i < copies.size(); i++) {
+    BackupFile* f = &backup.files[copied[i]];
+    f->crc = copies[i].crc;
+    if (new_tables[i] != 0) {
+      f->path = SharedTablePath(new_tables[i], f->crc, f->size);
+      if (used.insert(f->path).second) {
+        s = env_->RenameFile(copies[i].dst, dir_ + "/" + f->path);
+      } else {
+        env_->DeleteFile(copies[i].dst);  // Same contents as a backed up one
+      }
+    }
+  }
+  if (s.ok()) {
+    s = WriteMetaFile(id, backup);
+  }
+  if (s.ok()) {
+    backups_[id] = backup;
+    if (backup_id != NULL) {
+      *backup_id = id;
+    }
+  } else {
+    DeleteUnusedFiles();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GetBackupInfo(std::vector<BackupInfo>* backup_info) {
+  backup_info->clear();
+  for (std::map<uint32_t, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end(); ++it) {
+    BackupInfo info;
+    info.backup_id = it->first;
+    info.timestamp = it->second.timestamp;
+    info.size = 0;
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      info.size += it->second.files[i].size;
+    }
+    info.number_files = static_cast<uint32_t>(it->second.files.size());
+    backup_info->push_back(info);
+  }
+}
+
+Status BackupEngineImpl::VerifyBackup(uint32_t backup_id) {
+  std::map<uint32_t, Backup>::const_iterator it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+  const std::vector<BackupFile>& files = it->second.files;
+  Status s;
+  std::vector<CopyJob> checksums;
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    CopyJob job;
+    job.src = dir_ + "/" + files[i].path;
+    job.size = files[i].size;
+    uint64_t size;
+    s = env_->GetFileSize(job.src, &size);
+    if (s.ok() && size != files[i].size) {
+      s = Status::Corruption(job.src, "wrong size");
+    }
+    checksums.push_back(job);
+  }
+  if (s.ok()) {
+    s = RunCopyJobs(options_, &checksums);
+  }
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    if (checksums[i].crc != files[i].crc) {
+      s = Status::Corruption(checksums[i].src, "checksum mismatch");
+    }
+  }
+  return s;
+}
+
+Status BackupEngineImpl::RestoreDBFromBackup(uint32_t backup_id,
+                                             const std::string& db_dir) {
+  std::map<uint32_t, Backup>::const_iterator it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+  if (env_->FileExists(CurrentFileName(db_dir))) {
+    return Status::InvalidArgument(db_dir, "exists");
+  }
+  const std::vector<BackupFile>& files = it->second.files;
+
+  env_->CreateDir(db_dir);  // Errors are caught below
+  std::vector<std::string> names;
+  std::vector<CopyJob> copies;
+  for (size_t i = 0; i < files.size(); i++) {
+    names.push_back(files[i].name);
+    CopyJob job;
+    job.src = dir_ + "/" + files[i].path;
+    job.size = files[i].size;
+    job.dst = db_dir + "/" + files[i].name;
+    copies.push_back(job);
+  }
+  Status s = CreateParentDirs(env_, db_dir, names);
+  if (s.ok()) {
+    s = RunCopyJobs(options_, &copies);
+  }
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    if (copies[i].crc != files[i].crc) {
+      s = Status::Corruption(copies[i].src, "checksum mismatch");
+    }
+  }
+  if (!s.ok()) {
+    Options options;
+    options.env = env_;
+    DestroyDB(db_dir, options);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::RestoreDBFromLatestBackup(const std::string& db_dir) {
+  if (backups_.empty()) {
+    return Status::NotFound("no backups");
+  }
+  return RestoreDBFromBackup(backups_.rbegin()->first, db_dir);
+}
+
+Status BackupEngineImpl::DeleteBackup(uint32_t backup_id) {
+  if (backups_.count(backup_id) == 0) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+  Status s = env_->DeleteFile(MetaFileName(backup_id));
+  if (s.ok()) {
+    backups_.erase(backup_id);
+    DeleteUnusedFiles();
+  }
+  return s;
+}
+
+Status BackupEngineImpl::PurgeOldBackups(uint32_t num_backups_to_keep) {
+  Status s;
+  while (s.ok() && backups_.size() > num_backups_to_keep) {
+    const uint32_t id = backups_.begin()->first;
+    s = env_->DeleteFile(MetaFileName(id));
+    if (s.ok()) {
+      backups_.erase(id);
+    }
+  }
+  DeleteUnusedFiles();
+  return s;
+}
+
+}  // namespace
+
+Status BackupEngine::Open(const BackupOptions& options,
+                          const std::string& backup_dir,
+                          BackupEngine** result) {
+  *result = NULL;
+  BackupEngineImpl* impl = new BackupEngineImpl(options, backup_dir);
+  Status s = impl->Load();
+  if (s.ok()) {
+    *result = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+}  // namespace leveldb
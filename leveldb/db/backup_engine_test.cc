@@ -0,0 +1,300 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup_engine.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+// Counts the bytes that are read, without limiting them
+class CountingRateLimiter : public RateLimiter {
+ public:
+  CountingRateLimiter() : bytes_(0) { }
+  virtual void Request(size_t bytes) { bytes_ += bytes; }
+  virtual int64_t GetBytesPerSecond() const { return 0; }
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) { }
+  virtual uint64_t GetTotalWaitMicros() const { return 0; }
+  uint64_t bytes() const { return bytes_; }
+
+ private:
+  uint64_t bytes_;
+};
+
+class BackupEngineTest {
+ public:
+  Env* env_;
+  std::string dbname_;
+  std::string backup_dir_;
+  std::string restore_dir_;
+  BackupOptions backup_options_;
+  DB* db_;
+  BackupEngine* engine_;
+
+  BackupEngineTest() : env_(Env::Default()), db_(NULL), engine_(NULL) {
+    dbname_ = test::TmpDir() + "/backup_engine_db";
+    backup_dir_ = test::TmpDir() + "/backup_engine_backups";
+    restore_dir_ = test::TmpDir() + "/backup_engine_restore";
+    DestroyDB(dbname_, Options());
+    DestroyDB(restore_dir_, Options());
+    DeleteBackupDir();
+    Options options;
+    options.create_if_missing = true;
+    ASSERT_OK(DB::Open(options, dbname_, &db_));
+    ASSERT_OK(BackupEngine::Open(backup_options_, backup_dir_, &engine_));
+  }
+
+  ~BackupEngineTest() {
+    delete engine_;
+    delete db_;
+    DestroyDB(dbname_, Options());
+    DestroyDB(restore_dir_, Options());
+    DeleteBackupDir();
+  }
+
+  void DeleteBackupDir() {
+    const char* subdirs[] = { "shared", "meta", "private" };
+    for (int i = 0; i < 3; i++) {
+      const std::string dir = backup_dir_ + "/" + subdirs[i];
+      std::vector<std::string> children;
+      env_->GetChildren(dir, &children);
+      for (size_t j = 0; j < children.size(); j++) {
+        if (i == 2) {
+          DestroyDB(dir + "/" + children[j], Options());
+        } else {
+          env_->DeleteFile(dir + "/" + children[j]);
+        }
+      }
+      env_->DeleteDir(dir);
+    }
+    env_->DeleteDir(backup_dir_);
+  }
+
+  void ReopenEngine() {
+    delete engine_;
+    engine_ = NULL;
+    ASSERT_OK(BackupEngine::Open(backup_options_, backup_dir_, &engine_));
+  }
+
+  // Write "n" keys with the given prefix, and flush them to a table
+  void Fill(const std::string& prefix, int n) {
+    for (int i = 0; i < n; i++) {
+      ASSERT_OK(db_->Put(WriteOptions(), prefix + NumberToString(i),
+                         std::string(1000, 'a' + (i % 26))));
+    }
+    db_->CompactRange(NULL, NULL);
+  }
+
+  int CountSharedFiles() {
+    std::vector<std::string> children;
+    env_->GetChildren(backup_dir_ + "/shared", &children);
+    int count = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      if (children[i] != "." && children[i] != "..") {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  uint64_t SharedBytes() {
+    std::vector<std::string> children;
+    env_->GetChildren(backup_dir_ + "/shared", &children);
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      uint64_t size;
+      if (children[i] != "." && children[i] != ".." &&
+          env_->GetFileSize(backup_dir_ + "/shared/" + children[i],
+                            &size).ok()) {
+        bytes += size;
+      }
+    }
+    return bytes;
+  }
+
+  std::string SharedFile() {
+    std::vector<std::string> children;
+    env_->GetChildren(backup_dir_ + "/shared", &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      if (children[i] != "." && children[i] != "..") {
+        return backup_dir_ + "/shared/" + children[i];
+      }
+    }
+    return "";
+  }
+
+  // Return the value of "key" in the DB restored to restore_dir_
+  std::string RestoredGet(const std::string& key) {
+    DB* db;
+    Status s = DB::Open(Options(), restore_dir_, &db);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    std::string result;
+    s = db->Get(ReadOptions(), key, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    delete db;
+    return result;
+  }
+};
+
+TEST(BackupEngineTest, BackupAndRestore) {
+  Fill("a", 100);
+  ASSERT_OK(db_->Put(WriteOptions(), "log", "1"));  // Only in the log
+  uint32_t id1;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id1));
+  const int shared = CountSharedFiles();
+  ASSERT_GT(shared, 0);
+
+  // Only the tables written since are copied
+  ASSERT_OK(db_->Put(WriteOptions(), "log", "2"));
+  uint32_t id2;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id2));
+  ASSERT_GT(id2, id1);
+  ASSERT_EQ(shared, CountSharedFiles());
+  Fill("b", 100);
+  uint32_t id3;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id3));
+  ASSERT_GT(CountSharedFiles(), shared);
+
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(3, info.size());
+  ASSERT_EQ(id1, info[0].backup_id);
+  ASSERT_EQ(id3, info[2].backup_id);
+  ASSERT_GT(info[2].size, info[0].size);
+  ASSERT_GT(info[0].number_files, 0);
+  ASSERT_OK(engine_->VerifyBackup(id1));
+  ASSERT_TRUE(engine_->VerifyBackup(id3 + 1).IsNotFound());
+
+  ASSERT_OK(engine_->RestoreDBFromBackup(id1, restore_dir_));
+  ASSERT_TRUE(!engine_->RestoreDBFromBackup(id1, restore_dir_).ok());
+  ASSERT_EQ("1", RestoredGet("log"));
+  ASSERT_EQ(std::string(1000, 'a'), RestoredGet("a0"));
+  ASSERT_EQ("NOT_FOUND", RestoredGet("b0"));
+  ASSERT_OK(DestroyDB(restore_dir_, Options()));
+
+  // The backups outlive the engine
+  ReopenEngine();
+  ASSERT_OK(engine_->RestoreDBFromLatestBackup(restore_dir_));
+  ASSERT_EQ("2", RestoredGet("log"));
+  ASSERT_EQ(std::string(1000, 'a'), RestoredGet("b26"));
+}
+
+TEST(BackupEngineTest, DeleteAndPurge) {
+  Fill("a", 100);
+  uint32_t id1;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id1));
+  const int shared = CountSharedFiles();
+
+  // Replaces all the tables of the first backup
+  ASSERT_OK(db_->Delete(WriteOptions(), "a0"));
+  Fill("b", 100);
+  uint32_t id2, id3;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id2));
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id3));
+  const int all_shared = CountSharedFiles();
+  ASSERT_GT(all_shared, shared);
+
+  ASSERT_OK(engine_->DeleteBackup(id2));
+  ASSERT_TRUE(engine_->DeleteBackup(id2).IsNotFound());
+  ASSERT_OK(engine_->PurgeOldBackups(1));
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(1, info.size());
+  ASSERT_EQ(id3, info[0].backup_id);
+  // The tables only the first backup used are gone
+  ASSERT_LT(CountSharedFiles(), all_shared);
+  ASSERT_OK(engine_->VerifyBackup(id3));
+
+  ReopenEngine();
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(1, info.size());
+  ASSERT_OK(engine_->RestoreDBFromLatestBackup(restore_dir_));
+  ASSERT_EQ("NOT_FOUND", RestoredGet("a0"));
+  ASSERT_EQ(std::string(1000, 'b'), RestoredGet("b1"));
+}
+
+TEST(BackupEngineTest, Corruption) {
+  Fill("a", 100);
+  uint32_t id;
+  ASSERT_OK(engine_->CreateNewBackup(db_, &id));
+  const std::string fname = SharedFile();
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  contents[contents.size() / 2] ^= 0x80;
+  ASSERT_OK(WriteStringToFile(env_, contents, fname));
+
+  ASSERT_TRUE(!engine_->VerifyBackup(id).ok());
+  ASSERT_TRUE(!engine_->RestoreDBFromBackup(id, restore_dir_).ok());
+  ASSERT_TRUE(!env_->FileExists(restore_dir_ + "/CURRENT"));
+}
+
+TEST(BackupEngineTest, IncompleteBackupIsRemoved) {
+  Fill("a", 10);
+  ASSERT_OK(engine_->CreateNewBackup(db_, NULL));
+  const int shared = CountSharedFiles();
+  ASSERT_OK(WriteStringToFile(env_, "x", backup_dir_ + "/shared/7_1_1.sst"));
+  ASSERT_OK(env_->CreateDir(backup_dir_ + "/private/2"));
+  ASSERT_OK(WriteStringToFile(env_, "x",
+                              backup_dir_ + "/private/2/000007.log"));
+
+  ReopenEngine();
+  ASSERT_EQ(shared, CountSharedFiles());
+  ASSERT_TRUE(!env_->FileExists(backup_dir_ + "/private/2"));
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(1, info.size());
+}
+
+TEST(BackupEngineTest, TablesAreReadOnce) {
+  CountingRateLimiter* limiter = new CountingRateLimiter;
+  backup_options_.rate_limiter = limiter;
+  ReopenEngine();
+  Fill("a", 100);
+  ASSERT_OK(engine_->CreateNewBackup(db_, NULL));
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_GT(SharedBytes(), 100000);
+  ASSERT_LE(limiter->bytes(), info[0].size);
+
+  // The tables of the earlier backup are not read at all
+  const uint64_t read = limiter->bytes();
+  ASSERT_OK(db_->Put(WriteOptions(), "log", "1"));
+  ASSERT_OK(engine_->CreateNewBackup(db_, NULL));
+  engine_->GetBackupInfo(&info);
+  ASSERT_LE(limiter->bytes() - read, info[1].size - SharedBytes());
+  ASSERT_OK(engine_->VerifyBackup(info[1].backup_id));
+  delete engine_;
+  engine_ = NULL;
+  delete limiter;
+}
+
+TEST(BackupEngineTest, RateLimit) {
+  Fill("a", 500);
+  RateLimiter* limiter = NewRateLimiter(1 << 20);
+  backup_options_.rate_limiter = limiter;
+  ReopenEngine();
+  ASSERT_OK(engine_->CreateNewBackup(db_, NULL));
+  // About half a second for the tables
+  ASSERT_GT(limiter->GetTotalWaitMicros(), 200000);
+  delete engine_;
+  engine_ = NULL;
+  delete limiter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
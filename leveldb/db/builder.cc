@@ -11,6 +11,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
@@ -31,6 +32,7 @@ Status BuildTable(const std::string& dbname,
     if (!s.ok()) {
       return s;
     }
+    file = NewRateLimitedFile(file, options.rate_limiter);
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
@@ -46,6 +48,9 @@ Status BuildTable(const std::string& dbname,
       if (s.ok()) {
         meta->file_size = builder->FileSize();
         assert(meta->file_size > 0);
+        if (options.record_table_handles) {
+          meta->handles = builder->Handles();
+        }
       }
     } else {
       builder->Abandon();
@@ -66,7 +71,9 @@ Status BuildTable(const std::string& dbname,
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(),
                                               meta->number,
-                                              meta->file_size);
+                                              meta->file_size,
+                                              meta->handles,
+                                              0);
       s = it->status();
       delete it;
     }
@@ -373,6 +373,9 @@ void leveldb_writebatch_iterate(
     virtual void Delete(const Slice& key) {
       (*deleted_)(state_, key.data(), key.size());
     }
+    virtual void Merge(const Slice& key, const Slice& value) {
+      // Merges cannot be added through the C API
+    }
   };
   H handler;
   handler.state_ = state;
@@ -202,6 +202,24 @@ TEST(CorruptionTest, Recovery) {
   Check(36, 36);
 }
 
+TEST(CorruptionTest, ParallelRecovery) {
+  Build(100);
+  Check(100, 100);
+  Corrupt(kLogFile, 19, 1);      // WriteBatch tag for first record
+  Corrupt(kLogFile, log::kBlockSize + 1000, 1);  // Somewhere in second block
+
+  // Each log block is parsed by a different thread
+  Options options = options_;
+  options.recovery_threads = 4;
+  options.paranoid_checks = true;
+  ASSERT_TRUE(!TryReopen(&options).ok());
+  options.paranoid_checks = false;
+  Reopen(&options);
+
+  // Same losses as a sequential replay of the log
+  Check(36, 36);
+}
+
 TEST(CorruptionTest, RecoverWriteError) {
   env_.writable_file_error_ = true;
   Status s = TryReopen();
@@ -6,12 +6,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "db/db_impl.h"
+#include "db/memtable.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -27,6 +32,8 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      mergerandom   -- add 1 to the counters of N keys in random order
+//                       with merges (ignored with --ttl)
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
@@ -35,9 +42,18 @@
 //      seekrandom    -- N random seeks
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
+//      cachelookup   -- N lookups per thread in a warm cache of N entries
+//      filterprobe   -- N probes per thread of a filter over N keys, half
+//                       of them for keys that are not in the filter
+//      mergescan     -- N steps of a scan merging --merge_width memtables
+//                       that hold N interleaved keys between them
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
+//      ratelimiter -- Print the rate limiter's rate and wait time
+//      writeamp    -- Print the bytes flushed and written so far; compare
+//                     e.g. "fillrandom,writeamp" under each
+//                     --compaction_style
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
@@ -87,13 +103,77 @@ static int FLAGS_write_buffer_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Cache implementation to use: "lru" or "clock".
+static const char* FLAGS_cache_type = "lru";
+
+// Use 2^cache_shard_bits cache shards.  Negative means pick a shard
+// count based on the number of CPUs.
+static int FLAGS_cache_shard_bits = 4;
+
+// If true, keep index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, build one filter per table instead of one per 2KB of data.
+static bool FLAGS_full_filters = false;
+
+// If true, write tables with partitioned index and filter blocks of
+// roughly FLAGS_metadata_block_size bytes.
+static bool FLAGS_partition_index_and_filters = false;
+static int FLAGS_metadata_block_size = 4096;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Largest read issued by sequential scans and compactions; 0 disables
+// readahead (initialized to default value by "main")
+static int FLAGS_readahead_size = 0;
+
+// Number of data blocks iterators fetch ahead of time
+static int FLAGS_prefetch_blocks = 0;
+
+// If true, compactions bypass the page cache
+static bool FLAGS_use_direct_io_for_compaction = false;
+
+// If true, tables are read through mmap
+static bool FLAGS_mmap_read = false;
+
+// Bytes per second that compactions and flushes may write, or 0 for
+// no limit
+static int FLAGS_rate_limit = 0;
+
+// If true, --rate_limit is the highest rate of an auto-tuned limiter
+static bool FLAGS_rate_limit_auto_tune = false;
+
+// Shape of the tree (initialized to default values by "main")
+static int FLAGS_num_levels = 0;
+static int FLAGS_level0_file_num_compaction_trigger = 0;
+static int FLAGS_target_file_size_base = 0;
+static int FLAGS_target_file_size_multiplier = 0;
+static int FLAGS_max_bytes_for_level_base = 0;
+static int FLAGS_max_bytes_for_level_multiplier = 0;
+static bool FLAGS_level_compaction_dynamic_level_bytes = false;
+
+// "level", "universal" or "fifo" compaction
+static const char* FLAGS_compaction_style = "level";
+
+// Options of universal compaction (initialized to default values by "main")
+static int FLAGS_universal_size_ratio = 0;
+static int FLAGS_universal_max_size_amplification_percent = 0;
+
+// Seconds after which entries expire; zero if they never do
+static int FLAGS_ttl = 0;
+
+// Number of memtables merged by the mergescan benchmark, standing in
+// for the number of overlapping level-0 files.
+static int FLAGS_merge_width = 12;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Bloom filter implementation to use: "standard" or "blocked".
+static const char* FLAGS_bloom_type = "standard";
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -297,12 +377,36 @@ struct ThreadState {
   }
 };
 
+// Create a cache of the type selected by --cache_type.
+static Cache* NewBenchCache(size_t capacity, size_t estimated_entry_charge) {
+  if (strcmp(FLAGS_cache_type, "clock") == 0) {
+    return NewClockCache(capacity, FLAGS_cache_shard_bits,
+                         estimated_entry_charge);
+  }
+  return NewLRUCache(capacity, FLAGS_cache_shard_bits);
+}
+
+// Create a filter policy of the type selected by --bloom_type.
+static const FilterPolicy* NewBenchFilterPolicy(int bits_per_key) {
+  if (strcmp(FLAGS_bloom_type, "blocked") == 0) {
+    return NewBlockedBloomFilterPolicy(bits_per_key);
+  }
+  return NewBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* lookup_cache_;  // Used by the cachelookup benchmark
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
+  const FilterPolicy* probe_policy_;  // Used by the filterprobe benchmark
+  const MergeOperator* merge_operator_;
+  std::string probe_filter_;
+  InternalKeyComparator merge_comparator_;  // Used by mergescan
+  std::vector<MemTable*> merge_tables_;
   DB* db_;
   int num_;
   int value_size_;
@@ -387,10 +491,21 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
+  : cache_(FLAGS_cache_size >= 0
+           ? NewBenchCache(FLAGS_cache_size, Options().block_size)
+           : NULL),
+    lookup_cache_(NULL),
     filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                   ? NewBenchFilterPolicy(FLAGS_bloom_bits)
                    : NULL),
+    rate_limiter_(FLAGS_rate_limit <= 0
+                  ? NULL
+                  : FLAGS_rate_limit_auto_tune
+                  ? NewAutoTunedRateLimiter(FLAGS_rate_limit)
+                  : NewRateLimiter(FLAGS_rate_limit)),
+    probe_policy_(NULL),
+    merge_operator_(NewUInt64AddOperator()),
+    merge_comparator_(BytewiseComparator()),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -412,7 +527,12 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete lookup_cache_;
     delete filter_policy_;
+    delete rate_limiter_;
+    delete probe_policy_;
+    delete merge_operator_;
+    ReleaseMergeTables();
   }
 
   void Run() {
@@ -484,6 +604,8 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
@@ -493,6 +615,15 @@ class Benchmark {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("cachelookup")) {
+        FillLookupCache();
+        method = &Benchmark::CacheLookup;
+      } else if (name == Slice("mergescan")) {
+        BuildMergeTables();
+        method = &Benchmark::MergeScan;
+      } else if (name == Slice("filterprobe")) {
+        BuildProbeFilter();
+        method = &Benchmark::FilterProbe;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -503,6 +634,10 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("ratelimiter")) {
+        PrintStats("leveldb.rate-limiter");
+      } else if (name == Slice("writeamp")) {
+        PrintStats("leveldb.write-amplification");
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -640,6 +775,125 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
+  static void DeleteNothing(const Slice& key, void* value) { }
+
+  void FillLookupCache() {
+    delete lookup_cache_;
+    lookup_cache_ = NewBenchCache(num_, 1);
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      lookup_cache_->Release(lookup_cache_->Insert(
+          key, reinterpret_cast<void*>(i), 1, &DeleteNothing));
+    }
+  }
+
+  void CacheLookup(ThreadState* thread) {
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % num_;
+      snprintf(key, sizeof(key), "%016d", k);
+      Cache::Handle* h = lookup_cache_->Lookup(key);
+      if (h != NULL) {
+        found++;
+        lookup_cache_->Release(h);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found, %s cache)",
+             found, reads_, FLAGS_cache_type);
+    thread->stats.AddMessage(msg);
+  }
+
+  void ReleaseMergeTables() {
+    for (size_t i = 0; i < merge_tables_.size(); i++) {
+      merge_tables_[i]->Unref();
+    }
+    merge_tables_.clear();
+  }
+
+  // Deal keys out round-robin so that every step of the merge moves to
+  // a different child, as with overlapping level-0 files.
+  void BuildMergeTables() {
+    ReleaseMergeTables();
+    for (int i = 0; i < FLAGS_merge_width; i++) {
+      MemTable* mem = new MemTable(merge_comparator_);
+      mem->Ref();
+      merge_tables_.push_back(mem);
+    }
+    RandomGenerator gen;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      merge_tables_[i % FLAGS_merge_width]->Add(
+          i + 1, kTypeValue, key, gen.Generate(value_size_));
+    }
+  }
+
+  void MergeScan(ThreadState* thread) {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < merge_tables_.size(); i++) {
+      list.push_back(merge_tables_[i]->NewIterator());
+    }
+    Iterator* iter = NewMergingIterator(&merge_comparator_, &list[0],
+                                        list.size());
+    int64_t bytes = 0;
+    iter->SeekToFirst();
+    for (int i = 0; i < reads_; i++) {
+      if (!iter->Valid()) {
+        iter->SeekToFirst();
+      }
+      bytes += iter->key().size() + iter->value().size();
+      iter->Next();
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d-way merge)", FLAGS_merge_width);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Keys are fixed 8-byte encodings so that formatting them does not
+  // dominate the probe cost.
+  void BuildProbeFilter() {
+    delete probe_policy_;
+    probe_policy_ = NewBenchFilterPolicy(FLAGS_bloom_bits >= 0
+                                         ? FLAGS_bloom_bits : 10);
+    std::string keys;
+    for (int i = 0; i < num_; i++) {
+      PutFixed64(&keys, i);
+    }
+    std::vector<Slice> key_slices;
+    for (int i = 0; i < num_; i++) {
+      key_slices.push_back(Slice(keys.data() + 8 * i, 8));
+    }
+    probe_filter_.clear();
+    probe_policy_->CreateFilter(&key_slices[0], num_, &probe_filter_);
+  }
+
+  void FilterProbe(ThreadState* thread) {
+    int matched = 0;
+    int false_positives = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[8];
+      // Half of the draws are for keys past the end of the filter
+      const int k = thread->rand.Next() % (2 * num_);
+      EncodeFixed64(key, k);
+      if (probe_policy_->KeyMayMatch(Slice(key, 8), probe_filter_)) {
+        matched++;
+        if (k >= num_) false_positives++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d matched, %d false, %s bloom)",
+             matched, reads_, false_positives, FLAGS_bloom_type);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -694,6 +948,37 @@ class Benchmark {
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.filter_policy = filter_policy_;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.full_filters = FLAGS_full_filters;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.metadata_block_size = FLAGS_metadata_block_size;
+    options.readahead_size = FLAGS_readahead_size;
+    options.prefetch_blocks = FLAGS_prefetch_blocks;
+    options.use_direct_io_for_compaction = FLAGS_use_direct_io_for_compaction;
+    options.allow_mmap_reads = FLAGS_mmap_read;
+    options.rate_limiter = rate_limiter_;
+    options.num_levels = FLAGS_num_levels;
+    options.level0_file_num_compaction_trigger =
+        FLAGS_level0_file_num_compaction_trigger;
+    options.target_file_size_base = FLAGS_target_file_size_base;
+    options.target_file_size_multiplier = FLAGS_target_file_size_multiplier;
+    options.max_bytes_for_level_base = FLAGS_max_bytes_for_level_base;
+    options.max_bytes_for_level_multiplier =
+        FLAGS_max_bytes_for_level_multiplier;
+    options.level_compaction_dynamic_level_bytes =
+        FLAGS_level_compaction_dynamic_level_bytes;
+    if (strcmp(FLAGS_compaction_style, "universal") == 0) {
+      options.compaction_style = kCompactionStyleUniversal;
+    } else if (strcmp(FLAGS_compaction_style, "fifo") == 0) {
+      options.compaction_style = kCompactionStyleFIFO;
+    }
+    options.ttl = FLAGS_ttl;
+    if (FLAGS_ttl == 0) {
+      options.merge_operator = merge_operator_;
+    }
+    options.universal_size_ratio = FLAGS_universal_size_ratio;
+    options.universal_max_size_amplification_percent =
+        FLAGS_universal_max_size_amplification_percent;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -739,6 +1024,26 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void MergeRandom(ThreadState* thread) {
+    std::string one;
+    PutFixed64(&one, 1);
+    Status s;
+    int64_t bytes = 0;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      s = db_->Merge(write_options_, key, one);
+      if (!s.ok()) {
+        fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      bytes += one.size() + strlen(key);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadSequential(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -925,6 +1230,19 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_readahead_size = leveldb::Options().readahead_size;
+  FLAGS_num_levels = leveldb::Options().num_levels;
+  FLAGS_level0_file_num_compaction_trigger =
+      leveldb::Options().level0_file_num_compaction_trigger;
+  FLAGS_target_file_size_base = leveldb::Options().target_file_size_base;
+  FLAGS_target_file_size_multiplier =
+      leveldb::Options().target_file_size_multiplier;
+  FLAGS_max_bytes_for_level_base = leveldb::Options().max_bytes_for_level_base;
+  FLAGS_max_bytes_for_level_multiplier =
+      leveldb::Options().max_bytes_for_level_multiplier;
+  FLAGS_universal_size_ratio = leveldb::Options().universal_size_ratio;
+  FLAGS_universal_max_size_amplification_percent =
+      leveldb::Options().universal_max_size_amplification_percent;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -953,10 +1271,87 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strcmp(argv[i], "--cache_type=lru") == 0 ||
+               strcmp(argv[i], "--cache_type=clock") == 0) {
+      FLAGS_cache_type = argv[i] + strlen("--cache_type=");
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--full_filters=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filters = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
+    } else if (sscanf(argv[i], "--metadata_block_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_metadata_block_size = n;
+    } else if (sscanf(argv[i], "--merge_width=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_merge_width = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strcmp(argv[i], "--bloom_type=standard") == 0 ||
+               strcmp(argv[i], "--bloom_type=blocked") == 0) {
+      FLAGS_bloom_type = argv[i] + strlen("--bloom_type=");
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--prefetch_blocks=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_prefetch_blocks = n;
+    } else if (sscanf(argv[i], "--use_direct_io_for_compaction=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_io_for_compaction = n;
+    } else if (sscanf(argv[i], "--mmap_read=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_mmap_read = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_rate_limit = n;
+    } else if (sscanf(argv[i], "--rate_limit_auto_tune=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_rate_limit_auto_tune = n;
+    } else if (sscanf(argv[i], "--num_levels=%d%c", &n, &junk) == 1) {
+      FLAGS_num_levels = n;
+    } else if (sscanf(argv[i], "--level0_file_num_compaction_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_file_num_compaction_trigger = n;
+    } else if (sscanf(argv[i], "--target_file_size_base=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_target_file_size_base = n;
+    } else if (sscanf(argv[i], "--target_file_size_multiplier=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_target_file_size_multiplier = n;
+    } else if (sscanf(argv[i], "--max_bytes_for_level_base=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_max_bytes_for_level_base = n;
+    } else if (sscanf(argv[i], "--max_bytes_for_level_multiplier=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_bytes_for_level_multiplier = n;
+    } else if (sscanf(argv[i], "--level_compaction_dynamic_level_bytes=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_level_compaction_dynamic_level_bytes = n;
+    } else if (strcmp(argv[i], "--compaction_style=level") == 0 ||
+               strcmp(argv[i], "--compaction_style=universal") == 0 ||
+               strcmp(argv[i], "--compaction_style=fifo") == 0) {
+      FLAGS_compaction_style = argv[i] + strlen("--compaction_style=");
+    } else if (sscanf(argv[i], "--universal_size_ratio=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_size_ratio = n;
+    } else if (sscanf(argv[i],
+                      "--universal_max_size_amplification_percent=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_max_size_amplification_percent = n;
+    } else if (sscanf(argv[i], "--ttl=%d%c", &n, &junk) == 1 && n >= 0) {
+      FLAGS_ttl = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
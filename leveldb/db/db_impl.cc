@@ -5,6 +5,8 @@
 #include "db/db_impl.h"
 
 #include <algorithm>
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <stdint.h>
@@ -17,11 +19,17 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
 #include "db/table_cache.h"
+#include "db/ttl.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/statistics.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -32,9 +40,147 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
+const char* const kDefaultColumnFamilyName = "default";
+
+class DBImpl::ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  explicit ColumnFamilyHandleImpl(ColumnFamilyData* cfd) : cfd_(cfd) { }
+  virtual const std::string& GetName() const;
+  virtual uint32_t GetID() const;
+
+  ColumnFamilyData* cfd() const { return cfd_; }
+
+ private:
+  ColumnFamilyData* const cfd_;
+};
+
+// The state of one column family: its own tree of tables, memtables
+// and options.  The log, the writer queue and the background thread are
+// shared by all the column families of a DB.
+struct DBImpl::ColumnFamilyData {
+  const uint32_t id;
+  const std::string name;
+  const std::string dbname;  // Directory that holds its files
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  const Options options;     // options.comparator == &internal_comparator
+  TableCache* const table_cache;  // Provides its own synchronization
+  VersionSet* const versions;
+  ColumnFamilyHandleImpl handle;
+
+  // State below is protected by mutex_
+  MemTable* mem;
+  MemTable* imm;             // Memtable being compacted
+  uint64_t mem_log_number;   // Oldest log that may hold updates in mem
+  uint64_t imm_log_number;   // Oldest log that may hold updates in imm
+
+  // Set of table files to protect from deletion because they are
+  // part of ongoing compactions.
+  std::set<uint64_t> pending_outputs;
+
+  CompactionStats stats[config::kNumLevels];
+  CompactionStats flush_stats;  // Memtable flushes, also in stats
+
+  bool dropped;
+  int background_jobs;       // Flushes and compactions that use it
+
+  ColumnFamilyData(uint32_t i, const std::string& n, const std::string& dir,
+                   const Options& db_options, const Options& src,
+                   Cache* open_tables);
+  ~ColumnFamilyData();
+};
+
+const std::string& DBImpl::ColumnFamilyHandleImpl::GetName() const {
+  return cfd_->name;
+}
+
+uint32_t DBImpl::ColumnFamilyHandleImpl::GetID() const {
+  return cfd_->id;
+}
+
+// Maps the column family ids of the updates of a WriteBatch to the
+// memtables of the live column families.
+class DBImpl::ColumnFamilyMemTablesImpl : public ColumnFamilyMemTables {
+ public:
+  // When "log_number" is not zero, the updates are replayed from that
+  // log, and are skipped for the column families that have already
+  // written them to their tables, or that were dropped since.  Live
+  // writes to column families that do not exist fail instead.
+  ColumnFamilyMemTablesImpl(
+      const std::map<uint32_t, ColumnFamilyData*>* column_families,
+      uint64_t log_number)
+      : column_families_(column_families),
+        log_number_(log_number) {
+  }
+
+  virtual Status GetMemTable(uint32_t column_family_id, MemTable** mem) {
+    *mem = NULL;
+    std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+        column_families_->find(column_family_id);
+    if (it == column_families_->end() || it->second->dropped) {
+      if (log_number_ == 0) {
+        return Status::InvalidArgument("unknown or dropped column family");
+      }
+      return Status::OK();
+    }
+    const ColumnFamilyData* cfd = it->second;
+    if (log_number_ != 0 &&
+        log_number_ < cfd->versions->LogNumber() &&
+        log_number_ != cfd->versions->PrevLogNumber()) {
+      return Status::OK();
+    }
+    *mem = cfd->mem;
+    return Status::OK();
+  }
+
+ private:
+  const std::map<uint32_t, ColumnFamilyData*>* const column_families_;
+  const uint64_t log_number_;
+};
+
+// Finds the updates of a WriteBatch to column families that do not
+// exist or were dropped.
+class DBImpl::ColumnFamilyChecker : public WriteBatch::Handler {
+ public:
+  explicit ColumnFamilyChecker(
+      const std::map<uint32_t, ColumnFamilyData*>* column_families)
+      : column_families_(column_families), found_(false) { }
+
+  bool found() const { return found_; }
+
+  virtual void Put(const Slice& key, const Slice& value) { }
+  virtual void Delete(const Slice& key) { }
+  virtual void Merge(const Slice& key, const Slice& value) { }
+  virtual void PutCF(uint32_t column_family_id,
+                     const Slice& key, const Slice& value) {
+    Check(column_family_id);
+  }
+  virtual void DeleteCF(uint32_t column_family_id, const Slice& key) {
+    Check(column_family_id);
+  }
+  virtual void MergeCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value) {
+    Check(column_family_id);
+  }
+
+ private:
+  void Check(uint32_t column_family_id) {
+    std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+        column_families_->find(column_family_id);
+    if (it == column_families_->end() || it->second->dropped) {
+      found_ = true;
+    }
+  }
+
+  const std::map<uint32_t, ColumnFamilyData*>* const column_families_;
+  bool found_;
+};
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
@@ -47,6 +193,7 @@ struct DBImpl::Writer {
 };
 
 struct DBImpl::CompactionState {
+  ColumnFamilyData* const cfd;
   Compaction* const compaction;
 
   // Sequence numbers < smallest_snapshot are not significant since we
@@ -60,9 +207,13 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    std::string handles;
   };
   std::vector<Output> outputs;
 
+  // FileMetaData::newest_key_time of the outputs
+  uint64_t newest_key_time;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
@@ -71,31 +222,327 @@ struct DBImpl::CompactionState {
 
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
-  explicit CompactionState(Compaction* c)
-      : compaction(c),
+  CompactionState(ColumnFamilyData* f, Compaction* c)
+      : cfd(f),
+        compaction(c),
+        newest_key_time(0),
         outfile(NULL),
         builder(NULL),
         total_bytes(0) {
   }
 };
 
+// Log files are replayed in segments of at most this many bytes.  A
+// segment is read and checksummed as a unit, possibly by a different
+// thread than the one that replays its records.
+static const uint64_t kMaxRecoverySegmentSize = 1 << 20;
+
+namespace {
+
+// Presents a log file opened for random access as a SequentialFile so
+// that several log::Readers can parse the same file at once.
+class LogSegmentFile : public SequentialFile {
+ public:
+  LogSegmentFile(RandomAccessFile* file, uint64_t file_size)
+      : file_(file), file_size_(file_size), offset_(0), last_read_(0) { }
+
+  virtual Status Read(size_t n, Slice* result, char* scratch) {
+    last_read_ = offset_;
+    if (offset_ >= file_size_) {
+      *result = Slice();
+      return Status::OK();
+    }
+    n = static_cast<size_t>(std::min<uint64_t>(n, file_size_ - offset_));
+    Status s = file_->Read(offset_, n, result, scratch);
+    offset_ += result->size();
+    return s;
+  }
+
+  virtual Status Skip(uint64_t n) {
+    offset_ += n;
+    return Status::OK();
+  }
+
+  // Offset at which the most recent Read() started.
+  uint64_t last_read() const { return last_read_; }
+
+ private:
+  RandomAccessFile* file_;
+  uint64_t file_size_;
+  uint64_t offset_;
+  uint64_t last_read_;
+};
+
+}  // namespace
+
+// State shared between DBImpl::RecoverLogFile and the threads that
+// help it replay one log file.
+struct DBImpl::RecoveryState {
+  // A block-aligned range of the log.  Once "done" is set, holds the
+  // records that start inside the range.
+  struct Segment {
+    uint64_t start;
+    uint64_t limit;
+    bool done;
+    std::string records;    // Length-prefixed record contents
+    int64_t dropped_bytes;
+    Status status;          // First corruption if paranoid_checks is set
+  };
+
+  // A memtable filled by the replay that is written to a level-0 table.
+  struct Flush {
+    ColumnFamilyData* cfd;
+    MemTable* mem;
+    FileMetaData meta;
+    Status status;
+    int64_t micros;
+  };
+
+  const Options* const options;
+  Env* const env;
+  const std::string fname;
+  RandomAccessFile* const file;
+  const uint64_t file_size;
+  std::vector<Segment> segments;
+  std::vector<Flush*> flushes;  // In file number order
+
+  // State below is protected by mu
+  port::Mutex mu;
+  port::CondVar cv;             // Signalled whenever a thread finishes work
+  size_t next_segment;          // Next segment for a thread to parse
+  size_t segment_limit;         // Threads do not parse past this segment
+  std::deque<Flush*> queued;    // Flushes not yet picked up by a thread
+  int pending_flushes;          // Flushes queued or being written
+  Status flush_status;          // First error from writing a table
+  int threads;                  // Number of recovery threads started
+  int running;                  // Number of recovery threads still running
+  bool done;                    // No more work will be queued
+
+  RecoveryState(const Options* opt, const std::string& f,
+                RandomAccessFile* file, uint64_t size)
+      : options(opt),
+        env(opt->env),
+        fname(f),
+        file(file),
+        file_size(size),
+        cv(&mu),
+        next_segment(0),
+        segment_limit(0),
+        pending_flushes(0),
+        threads(0),
+        running(0),
+        done(false) {
+  }
+
+  void ParseSegment(Segment* segment);
+  void WriteTable(Flush* flush);
+  static void Work(void* arg);
+};
+
+void DBImpl::RecoveryState::ParseSegment(Segment* segment) {
+  struct SegmentReporter : public log::Reader::Reporter {
+    Logger* info_log;
+    const char* fname;
+    const LogSegmentFile* input;
+    Segment* segment;
+    bool paranoid;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      // A reader finishing the last record of its segment may run into
+      // damage in the next segment, which that segment reports itself.
+      if (input->last_read() >= segment->limit) return;
+      Log(info_log, "%s%s: dropping %d bytes; %s",
+          (paranoid ? "" : "(ignoring error) "),
+          fname, static_cast<int>(bytes), s.ToString().c_str());
+      segment->dropped_bytes += bytes;
+      if (paranoid && segment->status.ok()) segment->status = s;
+    }
+  };
+
+  LogSegmentFile input(file, file_size);
+  SegmentReporter reporter;
+  reporter.info_log = options->info_log;
+  reporter.fname = fname.c_str();
+  reporter.input = &input;
+  reporter.segment = segment;
+  reporter.paranoid = options->paranoid_checks;
+  // We intentially make log::Reader do checksumming even if
+  // paranoid_checks==false so that corruptions cause entire commits
+  // to be skipped instead of propagating bad information (like overly
+  // large sequence numbers).
+  log::Reader reader(&input, &reporter, true/*checksum*/,
+                     segment->start/*initial_offset*/);
+  std::string scratch;
+  Slice record;
+  while (reader.ReadRecord(&record, &scratch) &&
+         segment->status.ok()) {
+    if (reader.LastRecordOffset() >= segment->limit) {
+      // Belongs to the next segment
+      break;
+    }
+    PutLengthPrefixedSlice(&segment->records, record);
+  }
+}
+
+void DBImpl::RecoveryState::WriteTable(Flush* flush) {
+  const uint64_t start_micros = env->NowMicros();
+  Iterator* iter = flush->mem->NewIterator();
+  flush->status = BuildTable(flush->cfd->dbname, env, flush->cfd->options,
+                             flush->cfd->table_cache, iter, &flush->meta);
+  delete iter;
+  flush->mem->Unref();
+  flush->mem = NULL;
+  flush->micros = env->NowMicros() - start_micros;
+  Log(options->info_log, "Level-0 table #%llu: %lld bytes %s",
+      (unsigned long long) flush->meta.number,
+      (unsigned long long) flush->meta.file_size,
+      flush->status.ToString().c_str());
+}
+
+void DBImpl::RecoveryState::Work(void* arg) {
+  RecoveryState* state = reinterpret_cast<RecoveryState*>(arg);
+  MutexLock l(&state->mu);
+  while (true) {
+    // Tables first, since they release memory
+    if (!state->queued.empty()) {
+      Flush* flush = state->queued.front();
+      state->queued.pop_front();
+      state->mu.Unlock();
+      state->WriteTable(flush);
+      state->mu.Lock();
+      if (state->flush_status.ok()) {
+        state->flush_status = flush->status;
+      }
+      state->pending_flushes--;
+      state->cv.SignalAll();
+    } else if (!state->done && state->next_segment < state->segment_limit) {
+      Segment* segment = &state->segments[state->next_segment++];
+      state->mu.Unlock();
+      state->ParseSegment(segment);
+      state->mu.Lock();
+      segment->done = true;
+      state->cv.SignalAll();
+    } else if (state->done) {
+      break;
+    } else {
+      state->cv.Wait();
+    }
+  }
+  state->running--;
+  state->cv.SignalAll();
+}
+
+// An event waiting to be delivered to the listener
+struct DBImpl::Event {
+  enum Type {
+    kFlush,
+    kCompaction,
+    kStall
+  };
+  Type type;
+  FlushJobInfo flush;
+  CompactionJobInfo compaction;
+  WriteStallInfo stall;
+};
+
+// Tables left for the prewarm threads to open.
+struct DBImpl::PrewarmState {
+  struct File {
+    TableCache* table_cache;
+    int level;
+    const FileMetaData* meta;
+  };
+  DBImpl* db;
+  std::vector<Version*> versions;  // Keep the files alive; unref'ed by the
+                                   // last thread
+  std::vector<File> files;
+  size_t next_file;
+  int opened;
+  int running;
+  uint64_t start_micros;
+};
+
+static void RecordTick(Statistics* statistics, Ticker ticker,
+                       uint64_t count) {
+  if (statistics != NULL) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
   if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
+// Unlike the options that SanitizeOptions() clips into range, the
+// options that shape the tree are rejected if they make no sense.
+static Status ValidateOptions(const Options& options) {
+  static const int kMinNumLevels = 2;
+  if (options.num_levels < kMinNumLevels ||
+      options.num_levels > config::kNumLevels) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "num_levels must be between %d and %d",
+             kMinNumLevels, config::kNumLevels);
+    return Status::InvalidArgument(buf);
+  }
+  const char* msg = NULL;
+  if (options.level0_file_num_compaction_trigger < 1) {
+    msg = "level0_file_num_compaction_trigger must be positive";
+  } else if (options.target_file_size_base == 0) {
+    msg = "target_file_size_base must be positive";
+  } else if (options.target_file_size_multiplier < 1) {
+    msg = "target_file_size_multiplier must be positive";
+  } else if (options.max_bytes_for_level_base == 0) {
+    msg = "max_bytes_for_level_base must be positive";
+  } else if (options.max_bytes_for_level_multiplier < 2) {
+    msg = "max_bytes_for_level_multiplier must be at least 2";
+  } else if (options.compaction_style != kCompactionStyleLevel &&
+             options.compaction_style != kCompactionStyleUniversal &&
+             options.compaction_style != kCompactionStyleFIFO) {
+    msg = "unknown compaction_style";
+  } else if (options.universal_size_ratio < 0) {
+    msg = "universal_size_ratio must not be negative";
+  } else if (options.universal_min_merge_width < 2) {
+    msg = "universal_min_merge_width must be at least 2";
+  } else if (options.universal_max_merge_width <
+             options.universal_min_merge_width) {
+    msg = "universal_max_merge_width must be at least "
+        "universal_min_merge_width";
+  } else if (options.universal_max_size_amplification_percent < 0) {
+    msg = "universal_max_size_amplification_percent must not be negative";
+  } else if (options.ttl < 0) {
+    msg = "ttl must not be negative";
+  } else if (options.ttl > 0 && options.merge_operator != NULL) {
+    msg = "merge_operator cannot be combined with a ttl";
+  }
+  if (msg != NULL) {
+    return Status::InvalidArgument(msg);
+  }
+  return Status::OK();
+}
+
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
-                        const Options& src) {
+                        const Options& src,
+                        bool create_info_log) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
   ClipToRange(&result.max_open_files,            20,     50000);
   ClipToRange(&result.write_buffer_size,         64<<10, 1<<30);
+  ClipToRange(&result.recovery_threads,          1,      64);
+  ClipToRange(&result.prewarm_threads,           0,      64);
+  ClipToRange(&result.prefetch_blocks,           0,      64);
   ClipToRange(&result.block_size,                1<<10,  4<<20);
-  if (result.info_log == NULL) {
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              result.level0_file_num_compaction_trigger, 1000);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger + 1, 1001);
+  if (result.delayed_write_rate == 0) {
+    result.delayed_write_rate = Options().delayed_write_rate;
+  }
+  if (result.info_log == NULL && create_info_log) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
     src.env->RenameFile(InfoLogFileName(dbname), OldInfoLogFileName(dbname));
@@ -111,42 +558,145 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
-DBImpl::DBImpl(const Options& options, const std::string& dbname)
+// Options of a column family: "src", except for the settings that are
+// shared by the whole database, which come from "db_options" as
+// returned by SanitizeOptions().
+static Options SanitizeColumnFamilyOptions(const Options& db_options,
+                                           const InternalKeyComparator* icmp,
+                                           const InternalFilterPolicy* ipolicy,
+                                           const Options& src) {
+  Options result = src;
+  result.comparator = icmp;
+  result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  result.create_if_missing = db_options.create_if_missing;
+  result.error_if_exists = db_options.error_if_exists;
+  result.paranoid_checks = db_options.paranoid_checks;
+  result.env = db_options.env;
+  result.info_log = db_options.info_log;
+  result.level0_slowdown_writes_trigger =
+      db_options.level0_slowdown_writes_trigger;
+  result.level0_stop_writes_trigger = db_options.level0_stop_writes_trigger;
+  result.soft_pending_compaction_bytes_limit =
+      db_options.soft_pending_compaction_bytes_limit;
+  result.hard_pending_compaction_bytes_limit =
+      db_options.hard_pending_compaction_bytes_limit;
+  result.delayed_write_rate = db_options.delayed_write_rate;
+  result.recovery_threads = db_options.recovery_threads;
+  result.max_open_files = db_options.max_open_files;
+  result.prewarm_threads = db_options.prewarm_threads;
+  result.rate_limiter = db_options.rate_limiter;
+  result.statistics = db_options.statistics;
+  ClipToRange(&result.write_buffer_size,         64<<10, 1<<30);
+  ClipToRange(&result.prefetch_blocks,           0,      64);
+  ClipToRange(&result.block_size,                1<<10,  4<<20);
+  if (result.block_cache == NULL) {
+    result.block_cache = db_options.block_cache;
+  }
+  return result;
+}
+
+DBImpl::ColumnFamilyData::ColumnFamilyData(uint32_t i, const std::string& n,
+                                           const std::string& dir,
+                                           const Options& db_options,
+                                           const Options& src,
+                                           Cache* open_tables)
+    : id(i),
+      name(n),
+      dbname(dir),
+      internal_comparator(src.comparator),
+      internal_filter_policy(src.filter_policy),
+      options(SanitizeColumnFamilyOptions(
+          db_options, &internal_comparator, &internal_filter_policy, src)),
+      table_cache(new TableCache(dbname, &options, open_tables, i)),
+      versions(new VersionSet(dbname, &options, table_cache,
+                              &internal_comparator)),
+      handle(this),
+      mem(new MemTable(internal_comparator)),
+      imm(NULL),
+      mem_log_number(0),
+      imm_log_number(0),
+      dropped(false),
+      background_jobs(0) {
+  mem->Ref();
+}
+
+DBImpl::ColumnFamilyData::~ColumnFamilyData() {
+  delete versions;
+  if (mem != NULL) mem->Unref();
+  if (imm != NULL) imm->Unref();
+  delete table_cache;
+}
+
+// Delete the directory of a column family and the files in it.
+static Status DeleteColumnFamilyDir(Env* env, const std::string& dirname) {
+  std::vector<std::string> filenames;
+  env->GetChildren(dirname, &filenames);  // Ignoring errors on purpose
+  Status result;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type)) {
+      Status del = env->DeleteFile(dirname + "/" + filenames[i]);
+      if (result.ok() && !del.ok()) {
+        result = del;
+      }
+    }
+  }
+  Status del = env->DeleteDir(dirname);
+  if (result.ok() && !del.ok()) {
+    result = del;
+  }
+  return result;
+}
+
+DBImpl::DBImpl(const Options& options, const std::string& dbname,
+               OpenMode mode)
     : env_(options.env),
       internal_comparator_(options.comparator),
       internal_filter_policy_(options.filter_policy),
+      // Readers only log if they are given a logger, since the log file
+      // of the database belongs to the process that writes it.
       options_(SanitizeOptions(
-          dbname, &internal_comparator_, &internal_filter_policy_, options)),
+          dbname, &internal_comparator_, &internal_filter_policy_, options,
+          mode == kReadWrite)),
       owns_info_log_(options_.info_log != options.info_log),
       owns_cache_(options_.block_cache != options.block_cache),
       dbname_(dbname),
+      open_mode_(mode),
+      // Reserve ten files or so for other uses and give the rest to
+      // the tables.
+      open_tables_(NewLRUCache(options_.max_open_files - 10)),
       db_lock_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
-      mem_(new MemTable(internal_comparator_)),
-      imm_(NULL),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
+      file_deletions_disabled_(0),
+      last_compaction_cf_(0),
       tmp_batch_(new WriteBatch),
       bg_compaction_scheduled_(false),
-      manual_compaction_(NULL) {
-  mem_->Ref();
+      prewarm_threads_running_(0),
+      event_thread_running_(false),
+      manual_compaction_(NULL),
+      write_controller_(&options_) {
   has_imm_.Release_Store(NULL);
 
-  // Reserve ten files or so for other uses and give the rest to TableCache.
-  const int table_cache_size = options.max_open_files - 10;
-  table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
-
-  versions_ = new VersionSet(dbname_, &options_, table_cache_,
-                             &internal_comparator_);
+  default_cf_ = new ColumnFamilyData(0, kDefaultColumnFamilyName, dbname_,
+                                     options_, options, open_tables_);
+  column_families_[0] = default_cf_;
+  if (default_cf_->options.ttl > 0) {
+    ttl_column_families_.insert(0);
+  }
+  versions_ = default_cf_->versions;
 }
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_compaction_scheduled_ || prewarm_threads_running_ > 0 ||
+         event_thread_running_) {
     bg_cv_.Wait();
   }
   mutex_.Unlock();
@@ -155,13 +705,16 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
-  delete versions_;
-  if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
+  // The open tables refer to the options of their column families
+  delete open_tables_;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    delete it->second;
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
-  delete table_cache_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -171,14 +724,17 @@ DBImpl::~DBImpl() {
   }
 }
 
-Status DBImpl::NewDB() {
+Status DBImpl::NewDB(ColumnFamilyData* cfd) {
   VersionEdit new_db;
-  new_db.SetComparatorName(user_comparator()->Name());
+  new_db.SetComparatorName(cfd->internal_comparator.user_comparator()->Name());
+  if (cfd->options.ttl > 0) {
+    new_db.SetTimestampedValues();
+  }
   new_db.SetLogNumber(0);
   new_db.SetNextFile(2);
   new_db.SetLastSequence(0);
 
-  const std::string manifest = DescriptorFileName(dbname_, 1);
+  const std::string manifest = DescriptorFileName(cfd->dbname, 1);
   WritableFile* file;
   Status s = env_->NewWritableFile(manifest, &file);
   if (!s.ok()) {
@@ -196,7 +752,7 @@ Status DBImpl::NewDB() {
   delete file;
   if (s.ok()) {
     // Make "CURRENT" file that points to the new manifest file.
-    s = SetCurrentFile(env_, dbname_, 1);
+    s = SetCurrentFile(env_, cfd->dbname, 1);
   } else {
     env_->DeleteFile(manifest);
   }
@@ -212,13 +768,43 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
   }
 }
 
-void DBImpl::DeleteObsoleteFiles() {
+uint64_t DBImpl::MinLogNumberToKeep() const {
+  uint64_t min_log = logfile_number_;
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    const ColumnFamilyData* cfd = it->second;
+    if (cfd->dropped) {
+      continue;
+    }
+    min_log = std::min(min_log, cfd->mem_log_number);
+    if (cfd->imm != NULL) {
+      min_log = std::min(min_log, cfd->imm_log_number);
+    }
+  }
+  return min_log;
+}
+
+void DBImpl::DeleteObsoleteFiles(ColumnFamilyData* cfd) {
+  if (file_deletions_disabled_ > 0) {
+    // CreateCheckpoint() deletes them when it is done
+    return;
+  }
+  const uint64_t min_log = MinLogNumberToKeep();
+  if (cfd != default_cf_) {
+    DeleteObsoleteFilesIn(cfd, min_log);
+  }
+  // Holds the logs and the directories of the other column families
+  DeleteObsoleteFilesIn(default_cf_, min_log);
+}
+
+void DBImpl::DeleteObsoleteFilesIn(ColumnFamilyData* cfd, uint64_t min_log) {
   // Make a set of all of the live files
-  std::set<uint64_t> live = pending_outputs_;
-  versions_->AddLiveFiles(&live);
+  std::set<uint64_t> live = cfd->pending_outputs;
+  cfd->versions->AddLiveFiles(&live);
 
   std::vector<std::string> filenames;
-  env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
+  env_->GetChildren(cfd->dbname, &filenames); // Ignoring errors on purpose
   uint64_t number;
   FileType type;
   for (size_t i = 0; i < filenames.size(); i++) {
@@ -226,20 +812,20 @@ void DBImpl::DeleteObsoleteFiles() {
       bool keep = true;
       switch (type) {
         case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
+          keep = ((number >= min_log) ||
                   (number == versions_->PrevLogNumber()));
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
           // (in case there is a race that allows other incarnations)
-          keep = (number >= versions_->ManifestFileNumber());
+          keep = (number >= cfd->versions->ManifestFileNumber());
           break;
         case kTableFile:
           keep = (live.find(number) != live.end());
           break;
         case kTempFile:
           // Any temp files that are currently being written to must
-          // be recorded in pending_outputs_, which is inserted into "live"
+          // be recorded in pending_outputs, which is inserted into "live"
           keep = (live.find(number) != live.end());
           break;
         case kCurrentFile:
@@ -247,37 +833,55 @@ void DBImpl::DeleteObsoleteFiles() {
         case kInfoLogFile:
           keep = true;
           break;
+        case kColumnFamilyDir:
+          // The directory of a dropped column family, or one left over
+          // from a failed creation or drop
+          keep = (column_families_.count(number) > 0 &&
+                  !column_families_.find(number)->second->dropped);
+          break;
       }
 
       if (!keep) {
         if (type == kTableFile) {
-          table_cache_->Evict(number);
+          cfd->table_cache->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n",
             int(type),
             static_cast<unsigned long long>(number));
-        env_->DeleteFile(dbname_ + "/" + filenames[i]);
+        const std::string fname = cfd->dbname + "/" + filenames[i];
+        if (type == kColumnFamilyDir) {
+          DeleteColumnFamilyDir(env_, fname);
+        } else {
+          env_->DeleteFile(fname);
+        }
       }
     }
   }
 }
 
-Status DBImpl::Recover(VersionEdit* edit) {
+Status DBImpl::Recover(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::map<uint32_t, VersionEdit>* edits) {
   mutex_.AssertHeld();
 
-  // Ignore error from CreateDir since the creation of the DB is
-  // committed only when the descriptor is created, and this directory
-  // may already exist from a previous failed creation attempt.
-  env_->CreateDir(dbname_);
-  assert(db_lock_ == NULL);
-  Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
-  if (!s.ok()) {
-    return s;
+  Status s;
+  if (open_mode_ == kReadWrite) {
+    // Ignore error from CreateDir since the creation of the DB is
+    // committed only when the descriptor is created, and this directory
+    // may already exist from a previous failed creation attempt.
+    env_->CreateDir(dbname_);
+    assert(db_lock_ == NULL);
+    s = env_->LockFile(LockFileName(dbname_), &db_lock_);
+    if (!s.ok()) {
+      return s;
+    }
   }
 
   if (!env_->FileExists(CurrentFileName(dbname_))) {
-    if (options_.create_if_missing) {
-      s = NewDB();
+    if (open_mode_ != kReadWrite) {
+      return Status::InvalidArgument(dbname_, "does not exist");
+    } else if (options_.create_if_missing) {
+      s = NewDB(default_cf_);
       if (!s.ok()) {
         return s;
       }
@@ -292,18 +896,67 @@ Status DBImpl::Recover(VersionEdit* edit) {
     }
   }
 
+  const uint64_t start_micros = env_->NowMicros();
   s = versions_->Recover();
+
+  // Every column family of the database has to be opened, since the
+  // logs hold updates for all of them.
+  const std::map<uint32_t, std::string>& registered =
+      versions_->column_families();
+  for (std::map<uint32_t, std::string>::const_iterator it =
+           registered.begin();
+       s.ok() && it != registered.end(); ++it) {
+    const ColumnFamilyDescriptor* descriptor = NULL;
+    for (size_t i = 0; i < column_families.size(); i++) {
+      if (column_families[i].name == it->second) {
+        descriptor = &column_families[i];
+      }
+    }
+    if (descriptor == NULL) {
+      if (open_mode_ != kReadWrite) {
+        // Readers skip the updates of the column families left out
+        continue;
+      }
+      s = Status::InvalidArgument(it->second, "column family not opened");
+      break;
+    }
+    ColumnFamilyData* cfd = new ColumnFamilyData(
+        it->first, it->second, ColumnFamilyDirName(dbname_, it->first),
+        options_, descriptor->options, open_tables_);
+    column_families_[cfd->id] = cfd;
+    if (cfd->options.ttl > 0) {
+      ttl_column_families_.insert(cfd->id);
+    }
+    s = cfd->versions->Recover();
+  }
+  recovery_stats_.manifest_micros = env_->NowMicros() - start_micros;
+
+  if (s.ok() && open_mode_ == kSecondary) {
+    // The logs are read from where the last catch-up stopped
+    return TailLogs();
+  }
+
   if (s.ok()) {
     SequenceNumber max_sequence(0);
 
     // Recover from all newer log files than the ones named in the
-    // descriptor (new log files may have been added by the previous
-    // incarnation without registering them in the descriptor).
+    // descriptors (new log files may have been added by the previous
+    // incarnation without registering them in the descriptors).  Each
+    // column family skips the updates of the logs older than its own.
     //
     // Note that PrevLogNumber() is no longer used, but we pay
     // attention to it in case we are recovering a database
     // produced by an older version of leveldb.
-    const uint64_t min_log = versions_->LogNumber();
+    uint64_t min_log = versions_->LogNumber();
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      ColumnFamilyData* cfd = it->second;
+      min_log = std::min(min_log, cfd->versions->LogNumber());
+      if (cfd->versions->LastSequence() > max_sequence) {
+        max_sequence = cfd->versions->LastSequence();
+      }
+    }
     const uint64_t prev_log = versions_->PrevLogNumber();
     std::vector<std::string> filenames;
     s = env_->GetChildren(dbname_, &filenames);
@@ -324,7 +977,7 @@ Status DBImpl::Recover(VersionEdit* edit) {
     // Recover in the order in which the logs were generated
     std::sort(logs.begin(), logs.end());
     for (size_t i = 0; i < logs.size(); i++) {
-      s = RecoverLogFile(logs[i], edit, &max_sequence);
+      s = RecoverLogFile(logs[i], edits, &max_sequence);
 
       // The previous incarnation may not have written any MANIFEST
       // records after allocating this log number.  So we manually
@@ -337,13 +990,25 @@ Status DBImpl::Recover(VersionEdit* edit) {
         versions_->SetLastSequence(max_sequence);
       }
     }
+
+    if (!logs.empty()) {
+      Log(options_.info_log,
+          "Recovered %d logs (%lld bytes, %lld records) into %d tables "
+          "in %.3f sec using %d threads",
+          recovery_stats_.logs,
+          (long long) recovery_stats_.log_bytes,
+          (long long) recovery_stats_.records,
+          recovery_stats_.tables,
+          recovery_stats_.log_micros / 1e6,
+          options_.recovery_threads);
+    }
   }
 
   return s;
 }
 
 Status DBImpl::RecoverLogFile(uint64_t log_number,
-                              VersionEdit* edit,
+                              std::map<uint32_t, VersionEdit>* edits,
                               SequenceNumber* max_sequence) {
   struct LogReporter : public log::Reader::Reporter {
     Env* env;
@@ -359,91 +1024,252 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   };
 
   mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
 
   // Open the log file
   std::string fname = LogFileName(dbname_, log_number);
-  SequentialFile* file;
-  Status status = env_->NewSequentialFile(fname, &file);
+  uint64_t file_size;
+  RandomAccessFile* file = NULL;
+  Status status = env_->GetFileSize(fname, &file_size);
+  if (status.ok() && file_size > 0) {
+    // Empty logs have no records to replay (and cannot be mmapped)
+    status = env_->NewRandomAccessFile(fname, &file);
+  }
   if (!status.ok()) {
     MaybeIgnoreError(&status);
     return status;
   }
 
-  // Create the log reader.
+  // Reports records that pass the checksum but cannot be replayed.
   LogReporter reporter;
   reporter.env = env_;
   reporter.info_log = options_.info_log;
   reporter.fname = fname.c_str();
   reporter.status = (options_.paranoid_checks ? &status : NULL);
-  // We intentially make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
-  Log(options_.info_log, "Recovering log #%llu",
-      (unsigned long long) log_number);
-
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
+  Log(options_.info_log, "Recovering log #%llu (%llu bytes)",
+      (unsigned long long) log_number,
+      (unsigned long long) file_size);
+
+  // Split the log into enough block-aligned segments to keep the
+  // recovery threads busy.  This thread replays the segments in order
+  // while the others parse the segments ahead of it and write out the
+  // memtables it fills.
+  RecoveryState state(&options_, fname, file, file_size);
+  const int threads = options_.recovery_threads - 1;
+  uint64_t segment_size = file_size / (4 * options_.recovery_threads);
+  segment_size = std::max<uint64_t>(segment_size, 1);
+  segment_size = ((segment_size + log::kBlockSize - 1) / log::kBlockSize) *
+                 log::kBlockSize;
+  segment_size = std::min(segment_size, kMaxRecoverySegmentSize);
+  for (uint64_t start = 0; start < file_size; start += segment_size) {
+    RecoveryState::Segment segment;
+    segment.start = start;
+    segment.limit = std::min(start + segment_size, file_size);
+    segment.done = false;
+    segment.dropped_bytes = 0;
+    state.segments.push_back(segment);
+  }
+  state.segment_limit = std::min<size_t>(state.segments.size(), 2 * threads);
+  state.threads = threads;
+  state.running = threads;
+  for (int i = 0; i < threads; i++) {
+    env_->StartThread(&RecoveryState::Work, &state);
+  }
+
+  // Read all the records and add them to the memtables of their column
+  // families
   WriteBatch batch;
-  MemTable* mem = NULL;
-  while (reader.ReadRecord(&record, &scratch) &&
-         status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(
-          record.size(), Status::Corruption("log record too small"));
-      continue;
+  ColumnFamilyMemTablesImpl memtables(&column_families_, log_number);
+  int64_t records = 0;
+  int next_report = 10;
+  for (size_t i = 0; i < state.segments.size() && status.ok(); i++) {
+    RecoveryState::Segment* segment = &state.segments[i];
+    if (threads == 0) {
+      state.ParseSegment(segment);
+    } else {
+      MutexLock l(&state.mu);
+      while (!segment->done) {
+        state.cv.Wait();
+      }
     }
-    WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
-      mem->Ref();
+    Slice input(segment->records);
+    Slice record;
+    while (status.ok() && GetLengthPrefixedSlice(&input, &record)) {
+      if (record.size() < 12) {
+        reporter.Corruption(
+            record.size(), Status::Corruption("log record too small"));
+        recovery_stats_.dropped_bytes += record.size();
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch, record);
+
+      status = WriteBatchInternal::InsertInto(&batch, &memtables);
+      MaybeIgnoreError(&status);
+      if (!status.ok()) {
+        break;
+      }
+      records++;
+      const SequenceNumber last_seq =
+          WriteBatchInternal::Sequence(&batch) +
+          WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > *max_sequence) {
+        *max_sequence = last_seq;
+      }
+
+      // A read-only instance keeps every update in its memtables,
+      // since it may not write tables.
+      for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+               column_families_.begin();
+           status.ok() && open_mode_ == kReadWrite &&
+               it != column_families_.end(); ++it) {
+        ColumnFamilyData* cfd = it->second;
+        if (cfd->mem->ApproximateMemoryUsage() >
+            cfd->options.write_buffer_size) {
+          status = FlushRecoveredMemTable(&state, cfd);
+        }
+      }
     }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
-    MaybeIgnoreError(&status);
-    if (!status.ok()) {
-      break;
+    recovery_stats_.dropped_bytes += segment->dropped_bytes;
+    if (status.ok()) {
+      status = segment->status;
     }
-    const SequenceNumber last_seq =
-        WriteBatchInternal::Sequence(&batch) +
-        WriteBatchInternal::Count(&batch) - 1;
-    if (last_seq > *max_sequence) {
-      *max_sequence = last_seq;
+    std::string().swap(segment->records);
+
+    if (threads > 0) {
+      MutexLock l(&state.mu);
+      state.segment_limit = std::min<size_t>(state.segments.size(),
+                                             i + 1 + 2 * threads);
+      state.cv.SignalAll();
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = WriteLevel0Table(mem, edit, NULL);
-      if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
-        break;
+    if (state.segments.size() > 1) {
+      const int percent = static_cast<int>((segment->limit * 100) / file_size);
+      if (percent >= next_report) {
+        Log(options_.info_log,
+            "Recovering log #%llu: %d%% (%lld records, %d tables)",
+            (unsigned long long) log_number, percent,
+            (long long) records, static_cast<int>(state.flushes.size()));
+        next_report = percent - percent % 10 + 10;
       }
-      mem->Unref();
-      mem = NULL;
     }
   }
 
-  if (status.ok() && mem != NULL) {
-    status = WriteLevel0Table(mem, edit, NULL);
-    // Reflect errors immediately so that conditions like full
-    // file-systems cause the DB::Open() to fail.
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       status.ok() && open_mode_ == kReadWrite &&
+           it != column_families_.end(); ++it) {
+    if (!it->second->mem->Empty()) {
+      status = FlushRecoveredMemTable(&state, it->second);
+    }
   }
 
-  if (mem != NULL) mem->Unref();
+  // Reflect errors from writing tables so that conditions like full
+  // file-systems cause the DB::Open() to fail.
+  Status s = FinishLogRecovery(&state, edits);
+  if (status.ok()) {
+    status = s;
+  }
   delete file;
+
+  recovery_stats_.logs++;
+  recovery_stats_.log_bytes += file_size;
+  recovery_stats_.records += records;
+  recovery_stats_.log_micros += env_->NowMicros() - start_micros;
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::FlushRecoveredMemTable(RecoveryState* state,
+                                      ColumnFamilyData* cfd) {
+  mutex_.AssertHeld();
+  RecoveryState::Flush* flush = new RecoveryState::Flush;
+  flush->cfd = cfd;
+  flush->mem = cfd->mem;
+  cfd->mem = new MemTable(cfd->internal_comparator);
+  cfd->mem->Ref();
+  flush->meta.number = cfd->versions->NewFileNumber();
+  if (cfd->options.ttl > 0) {
+    flush->meta.newest_key_time = CurrentTimestamp(env_);
+  }
+  flush->micros = 0;
+  cfd->pending_outputs.insert(flush->meta.number);
+  state->flushes.push_back(flush);
+  Log(options_.info_log, "Level-0 table #%llu: started",
+      (unsigned long long) flush->meta.number);
+
+  if (state->threads == 0) {
+    mutex_.Unlock();
+    state->WriteTable(flush);
+    mutex_.Lock();
+    return flush->status;
+  }
+
+  // Each queued memtable stays in memory until its table is written,
+  // so wait for a thread to become free before replaying further.
+  MutexLock l(&state->mu);
+  state->queued.push_back(flush);
+  state->pending_flushes++;
+  state->cv.SignalAll();
+  while (state->pending_flushes > state->threads &&
+         state->flush_status.ok()) {
+    state->cv.Wait();
+  }
+  return state->flush_status;
+}
+
+Status DBImpl::FinishLogRecovery(RecoveryState* state,
+                                 std::map<uint32_t, VersionEdit>* edits) {
+  mutex_.AssertHeld();
+  {
+    MutexLock l(&state->mu);
+    state->done = true;
+    state->cv.SignalAll();
+    while (state->running > 0) {
+      state->cv.Wait();
+    }
+  }
+
+  Status s;
+  for (size_t i = 0; i < state->flushes.size(); i++) {
+    RecoveryState::Flush* flush = state->flushes[i];
+    ColumnFamilyData* cfd = flush->cfd;
+    const FileMetaData& meta = flush->meta;
+    cfd->pending_outputs.erase(meta.number);
+
+    // Note that if file_size is zero, the file has been deleted and
+    // should not be added to the manifest.
+    if (flush->status.ok() && meta.file_size > 0) {
+      (*edits)[cfd->id].AddFile(0, meta.number, meta.file_size,
+                                meta.smallest, meta.largest, meta.handles,
+                                meta.newest_key_time);
+      recovery_stats_.tables++;
+      recovery_stats_.table_bytes += meta.file_size;
+    }
+    if (s.ok()) {
+      s = flush->status;
+    }
+
+    CompactionStats stats;
+    stats.micros = flush->micros;
+    stats.bytes_written = meta.file_size;
+    cfd->stats[0].Add(stats);
+    cfd->flush_stats.Add(stats);
+    delete flush;
+  }
+  state->flushes.clear();
+  return s;
+}
+
+Status DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                                VersionEdit* edit, Version* base) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
-  pending_outputs_.insert(meta.number);
+  meta.number = cfd->versions->NewFileNumber();
+  if (cfd->options.ttl > 0) {
+    meta.newest_key_time = CurrentTimestamp(env_);
+  }
+  cfd->pending_outputs.insert(meta.number);
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
@@ -451,7 +1277,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(cfd->dbname, env_, cfd->options, cfd->table_cache, iter,
+                   &meta);
     mutex_.Lock();
   }
 
@@ -460,7 +1287,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  cfd->pending_outputs.erase(meta.number);
 
 
   // Note that if file_size is zero, the file has been deleted and
@@ -473,73 +1300,118 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+                  meta.smallest, meta.largest, meta.handles,
+                  meta.newest_key_time);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
-  stats_[level].Add(stats);
+  cfd->stats[level].Add(stats);
+  cfd->flush_stats.Add(stats);
+  RecordTick(options_.statistics, kFlushWriteBytes, stats.bytes_written);
+
+  if (options_.listener != NULL && s.ok() && meta.file_size > 0) {
+    Event* event = new Event;
+    event->type = Event::kFlush;
+    event->flush.cf_name = cfd->name;
+    event->flush.file_number = meta.number;
+    event->flush.level = level;
+    event->flush.file_size = meta.file_size;
+    event->flush.micros = stats.micros;
+    QueueEvent(event);
+  }
   return s;
 }
 
-Status DBImpl::CompactMemTable() {
+Status DBImpl::LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit) {
+  mutex_.AssertHeld();
+  if (cfd != default_cf_) {
+    // The log and sequence numbers are those of the whole database
+    cfd->versions->MarkFileNumberUsed(logfile_number_);
+    cfd->versions->SetLastSequence(std::max(cfd->versions->LastSequence(),
+                                            versions_->LastSequence()));
+  }
+  return cfd->versions->LogAndApply(edit, &mutex_);
+}
+
+Status DBImpl::CompactMemTable(ColumnFamilyData* cfd) {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(cfd->imm != NULL);
+  cfd->background_jobs++;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
-  Version* base = versions_->current();
+  Version* base = cfd->versions->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(cfd, cfd->imm, &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
-  if (s.ok()) {
+  // Replace immutable memtable with the generated Table, unless the
+  // column family was dropped in the meantime
+  if (s.ok() && !cfd->dropped) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Earlier logs no longer needed
+    edit.SetLogNumber(cfd->mem_log_number);
+    s = LogAndApply(cfd, &edit);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
-    has_imm_.Release_Store(NULL);
-    DeleteObsoleteFiles();
+    cfd->imm->Unref();
+    cfd->imm = NULL;
+    has_imm_.Release_Store(ImmToFlush());
+    DeleteObsoleteFiles(cfd);
   }
 
+  cfd->background_jobs--;
   return s;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  CompactRange(&default_cf_->handle, begin, end);
+}
+
+void DBImpl::CompactRange(ColumnFamilyHandle* column_family,
+                          const Slice* begin, const Slice* end) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
-    Version* base = versions_->current();
-    for (int level = 1; level < config::kNumLevels; level++) {
+    if (cfd->dropped || open_mode_ != kReadWrite) {
+      return;
+    }
+    Version* base = cfd->versions->current();
+    for (int level = 1; level < cfd->options.num_levels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
     }
   }
-  TEST_CompactMemTable(); // TODO(sanjay): Skip if memtable does not overlap
+  FlushMemTable(cfd); // TODO(sanjay): Skip if memtable does not overlap
   for (int level = 0; level < max_level_with_files; level++) {
-    TEST_CompactRange(level, begin, end);
+    RunManualCompaction(cfd, level, begin, end);
   }
 }
 
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
+  RunManualCompaction(default_cf_, level, begin, end);
+}
+
+void DBImpl::RunManualCompaction(ColumnFamilyData* cfd, int level,
+                                 const Slice* begin, const Slice* end) {
   assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
+  assert(level + 1 < cfd->options.num_levels);
 
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
+  manual.cfd = cfd;
   manual.level = level;
   manual.done = false;
   if (begin == NULL) {
@@ -569,45 +1441,169 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
 }
 
 Status DBImpl::TEST_CompactMemTable() {
+  return FlushMemTable(default_cf_);
+}
+
+Status DBImpl::FlushMemTable(ColumnFamilyData* cfd) {
   // NULL batch means just wait for earlier writes to be done
-  Status s = Write(WriteOptions(), NULL);
+  Status s = Write(WriteOptions(), NULL, cfd);
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (cfd->imm != NULL && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (cfd->imm != NULL) {
       s = bg_error_;
     }
   }
   return s;
 }
 
-void DBImpl::MaybeScheduleCompaction() {
+void DBImpl::MaybeStartPrewarm() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
-    // DB is being deleted; no more background compactions
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+  if (options_.prewarm_threads == 0) {
+    return;
+  }
+
+  // Hotter levels first, and no more tables than the caches can hold
+  PrewarmState* state = new PrewarmState;
+  state->db = this;
+  const size_t capacity = options_.max_open_files - 10;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    Version* version = cfd->versions->current();
+    version->Ref();
+    state->versions.push_back(version);
+    size_t added = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const std::vector<FileMetaData*>& files = version->files(level);
+      for (size_t i = 0; i < files.size() && added < capacity; i++) {
+        PrewarmState::File f;
+        f.table_cache = cfd->table_cache;
+        f.level = level;
+        f.meta = files[i];
+        state->files.push_back(f);
+        added++;
+      }
+    }
+  }
+  if (state->files.empty()) {
+    for (size_t i = 0; i < state->versions.size(); i++) {
+      state->versions[i]->Unref();
+    }
+    delete state;
+    return;
   }
-}
 
-void DBImpl::BGWork(void* db) {
-  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+  state->next_file = 0;
+  state->opened = 0;
+  state->running = std::min<int>(options_.prewarm_threads,
+                                 state->files.size());
+  state->start_micros = env_->NowMicros();
+  prewarm_threads_running_ += state->running;
+  for (int i = state->running; i > 0; i--) {
+    env_->StartThread(&DBImpl::PrewarmWork, state);
+  }
 }
 
-void DBImpl::BackgroundCall() {
-  MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
-  if (!shutting_down_.Acquire_Load()) {
+void DBImpl::PrewarmWork(void* arg) {
+  PrewarmState* state = reinterpret_cast<PrewarmState*>(arg);
+  DBImpl* db = state->db;
+  MutexLock l(&db->mutex_);
+  while (state->next_file < state->files.size() &&
+         !db->shutting_down_.Acquire_Load()) {
+    const PrewarmState::File& file = state->files[state->next_file];
+    const FileMetaData* f = file.meta;
+    state->next_file++;
+    db->mutex_.Unlock();
+    Status s = file.table_cache->Prewarm(f->number, f->file_size,
+                                         f->handles, file.level);
+    db->mutex_.Lock();
+    if (s.ok()) {
+      state->opened++;
+    }
+  }
+
+  if (--state->running == 0) {
+    RecoveryStats* stats = &db->recovery_stats_;
+    stats->prewarmed_tables = state->opened;
+    stats->prewarm_micros = db->env_->NowMicros() - state->start_micros;
+    Log(db->options_.info_log, "Prewarmed %d of %d tables in %.3f sec",
+        state->opened, static_cast<int>(state->files.size()),
+        stats->prewarm_micros / 1e6);
+    for (size_t i = 0; i < state->versions.size(); i++) {
+      state->versions[i]->Unref();
+    }
+    delete state;
+  }
+  db->prewarm_threads_running_--;
+  db->bg_cv_.SignalAll();
+}
+
+void DBImpl::QueueEvent(Event* event) {
+  mutex_.AssertHeld();
+  pending_events_.push_back(event);
+  if (!event_thread_running_) {
+    event_thread_running_ = true;
+    env_->StartThread(&DBImpl::EventWork, this);
+  }
+}
+
+void DBImpl::EventWork(void* arg) {
+  DBImpl* db = reinterpret_cast<DBImpl*>(arg);
+  EventListener* listener = db->options_.listener;
+  MutexLock l(&db->mutex_);
+  while (!db->pending_events_.empty()) {
+    Event* event = db->pending_events_.front();
+    db->pending_events_.pop_front();
+    db->mutex_.Unlock();
+    switch (event->type) {
+      case Event::kFlush:
+        listener->OnFlushCompleted(db, event->flush);
+        break;
+      case Event::kCompaction:
+        listener->OnCompactionCompleted(db, event->compaction);
+        break;
+      case Event::kStall:
+        listener->OnStallConditionsChanged(db, event->stall);
+        break;
+    }
+    delete event;
+    db->mutex_.Lock();
+  }
+  db->event_thread_running_ = false;
+  db->bg_cv_.SignalAll();
+}
+
+void DBImpl::MaybeScheduleCompaction() {
+  mutex_.AssertHeld();
+  if (bg_compaction_scheduled_) {
+    // Already scheduled
+  } else if (shutting_down_.Acquire_Load()) {
+    // DB is being deleted; no more background compactions
+  } else if (open_mode_ != kReadWrite) {
+    // Only the process that writes the DB compacts it
+  } else if (ImmToFlush() == NULL &&
+             manual_compaction_ == NULL &&
+             PickCompactionFamily() == NULL) {
+    // No work to be done
+  } else {
+    bg_compaction_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGWork, this);
+  }
+}
+
+void DBImpl::BGWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+}
+
+void DBImpl::BackgroundCall() {
+  MutexLock l(&mutex_);
+  assert(bg_compaction_scheduled_);
+  if (!shutting_down_.Acquire_Load()) {
     Status s = BackgroundCompaction();
     if (!s.ok()) {
       // Wait a little bit before retrying background compaction in
@@ -625,6 +1621,18 @@ void DBImpl::BackgroundCall() {
 
   bg_compaction_scheduled_ = false;
 
+  if (options_.rate_limiter != NULL) {
+    uint64_t pending = 0;
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      if (!it->second->dropped) {
+        pending += it->second->versions->PendingCompactionBytes();
+      }
+    }
+    options_.rate_limiter->ReportPendingCompactionBytes(pending);
+  }
+
   // Previous compaction may have produced too many files in a level,
   // so reschedule another compaction if needed.
   MaybeScheduleCompaction();
@@ -634,8 +1642,9 @@ void DBImpl::BackgroundCall() {
 Status DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
-    return CompactMemTable();
+  ColumnFamilyData* cfd = ImmToFlush();
+  if (cfd != NULL) {
+    return CompactMemTable(cfd);
   }
 
   Compaction* c;
@@ -643,8 +1652,14 @@ Status DBImpl::BackgroundCompaction() {
   InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
-    m->done = (c == NULL);
+    cfd = m->cfd;
+    if (cfd->dropped) {
+      c = NULL;
+    } else {
+      c = cfd->versions->CompactRange(m->level, m->begin, m->end);
+    }
+    // A compaction that stays in its level covers the whole range
+    m->done = (c == NULL || c->output_level() == c->level());
     if (c != NULL) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
     }
@@ -655,35 +1670,59 @@ Status DBImpl::BackgroundCompaction() {
         (m->end ? m->end->DebugString().c_str() : "(end)"),
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
-    c = versions_->PickCompaction();
+    cfd = PickCompactionFamily();
+    if (cfd == NULL) {
+      c = NULL;
+    } else {
+      last_compaction_cf_ = cfd->id;
+      c = cfd->versions->PickCompaction();
+    }
   }
 
   Status status;
+  if (c != NULL) {
+    cfd->background_jobs++;
+  }
   if (c == NULL) {
     // Nothing to do
+  } else if (c->IsDeletionCompaction()) {
+    // Drop the files without reading them
+    c->AddInputDeletions(c->edit());
+    status = LogAndApply(cfd, c->edit());
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "Deleted %d files from level-%d %s: %s\n",
+        c->num_input_files(0),
+        c->level(),
+        status.ToString().c_str(),
+        cfd->versions->LevelSummary(&tmp));
+    DeleteObsoleteFiles(cfd);
   } else if (!is_manual && c->IsTrivialMove()) {
     // Move file to next level
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size,
+                       f->smallest, f->largest, f->handles,
+                       f->newest_key_time);
+    status = LogAndApply(cfd, c->edit());
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
-        c->level() + 1,
+        c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(),
-        versions_->LevelSummary(&tmp));
+        cfd->versions->LevelSummary(&tmp));
   } else {
-    CompactionState* compact = new CompactionState(c);
+    CompactionState* compact = new CompactionState(cfd, c);
     status = DoCompactionWork(compact);
     CleanupCompaction(compact);
     c->ReleaseInputs();
-    DeleteObsoleteFiles();
+    DeleteObsoleteFiles(cfd);
+  }
+  if (c != NULL) {
+    delete c;
+    cfd->background_jobs--;
   }
-  delete c;
 
   if (status.ok()) {
     // Done
@@ -725,7 +1764,7 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
   delete compact->outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    pending_outputs_.erase(out.number);
+    compact->cfd->pending_outputs.erase(out.number);
   }
   delete compact;
 }
@@ -733,11 +1772,12 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
 Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   assert(compact != NULL);
   assert(compact->builder == NULL);
+  ColumnFamilyData* cfd = compact->cfd;
   uint64_t file_number;
   {
     mutex_.Lock();
-    file_number = versions_->NewFileNumber();
-    pending_outputs_.insert(file_number);
+    file_number = cfd->versions->NewFileNumber();
+    cfd->pending_outputs.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
     out.smallest.Clear();
@@ -747,10 +1787,17 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   }
 
   // Make the output file
-  std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  std::string fname = TableFileName(cfd->dbname, file_number);
+  Status s;
+  if (cfd->options.use_direct_io_for_compaction) {
+    s = env_->NewDirectWritableFile(fname, &compact->outfile);
+  } else {
+    s = env_->NewWritableFile(fname, &compact->outfile);
+  }
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->outfile = NewRateLimitedFile(compact->outfile,
+                                          options_.rate_limiter);
+    compact->builder = new TableBuilder(cfd->options, compact->outfile);
   }
   return s;
 }
@@ -769,6 +1816,9 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
     s = compact->builder->Finish();
+    if (s.ok() && compact->cfd->options.record_table_handles) {
+      compact->current_output()->handles = compact->builder->Handles();
+    }
   } else {
     compact->builder->Abandon();
   }
@@ -790,9 +1840,10 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter = table_cache_->NewIterator(ReadOptions(),
-                                               output_number,
-                                               current_bytes);
+    Iterator* iter = compact->cfd->table_cache->NewIterator(
+        ReadOptions(), output_number, current_bytes,
+        compact->current_output()->handles,
+        compact->compaction->output_level());
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -813,19 +1864,20 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1,
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+        level,
+        out.number, out.file_size, out.smallest, out.largest, out.handles,
+        compact->newest_key_time);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->cfd, compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -836,9 +1888,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  ColumnFamilyData* cfd = compact->cfd;
+  const Comparator* ucmp = cfd->internal_comparator.user_comparator();
+  assert(cfd->versions->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
   assert(compact->outfile == NULL);
   if (snapshots_.empty()) {
@@ -847,10 +1901,32 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      compact->newest_key_time = std::max(
+          compact->newest_key_time,
+          compact->compaction->input(which, i)->newest_key_time);
+    }
+  }
+
+  // Entries newer than every snapshot may be passed to the filter
+  const CompactionFilter* filter = cfd->options.compaction_filter;
+  const bool has_snapshots = !snapshots_.empty();
+  const SequenceNumber newest_snapshot =
+      has_snapshots ? snapshots_.newest()->number_ : 0;
+  const MergeOperator* merge_operator = cfd->options.merge_operator;
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  const int ttl = cfd->options.ttl;
+  const uint32_t now = (ttl > 0) ? CurrentTimestamp(env_) : 0;
+  std::string removed_key;     // Deletion marker for a removed value
+  std::string filtered_value;  // Value changed by the filter
+  std::string merged_key;      // Entry that operands were collapsed into
+  std::string merged_value;
+
+  Iterator* input = cfd->versions->MakeInputIterator(compact->compaction);
   input->SeekToFirst();
   Status status;
   ParsedInternalKey ikey;
@@ -862,8 +1938,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
-        CompactMemTable();
+      ColumnFamilyData* imm_cfd = ImmToFlush();
+      if (imm_cfd != NULL) {
+        CompactMemTable(imm_cfd);
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
@@ -880,7 +1957,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     // Handle key/value, add to state, etc.
+    Slice value = input->value();
     bool drop = false;
+    bool advanced = false;  // input is already at the next entry
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -888,7 +1967,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key,
+          ucmp->Compare(ikey.user_key,
                                      Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
@@ -896,6 +1975,38 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         last_sequence_for_key = kMaxSequenceNumber;
       }
 
+      bool remove = false;
+      if (ikey.type != kTypeValue) {
+        // Nothing to expire or filter
+      } else if (ttl > 0 && IsExpired(value, ttl, now)) {
+        remove = true;
+      } else if (filter != NULL &&
+                 last_sequence_for_key == kMaxSequenceNumber &&
+                 (!has_snapshots || ikey.sequence > newest_snapshot)) {
+        const Slice user_value = (ttl > 0) ? StripTimestamp(value) : value;
+        bool value_changed = false;
+        filtered_value.clear();
+        remove = filter->Filter(compact->compaction->output_level(),
+                                ikey.user_key, user_value,
+                                &filtered_value, &value_changed);
+        if (!remove && value_changed) {
+          // Keep the time the value was written, if any
+          filtered_value.append(value.data() + user_value.size(),
+                                value.size() - user_value.size());
+          value = filtered_value;
+        }
+      }
+      if (remove) {
+        // A removed value is kept only as a deletion marker, so that
+        // it still hides the older entries for its key.
+        removed_key.clear();
+        AppendInternalKey(&removed_key, ParsedInternalKey(
+            ikey.user_key, ikey.sequence, kTypeDeletion));
+        ikey.type = kTypeDeletion;
+        key = removed_key;
+        value = Slice();
+      }
+
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
@@ -913,6 +2024,75 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
 
       last_sequence_for_key = ikey.sequence;
+
+      if (!drop && ikey.type == kTypeMerge && merge_operator != NULL &&
+          (ikey.sequence <= compact->smallest_snapshot ||
+           ikey.sequence > newest_snapshot)) {
+        // Collapse the older entries for this key that no snapshot can
+        // tell apart from this one: those in the same range between
+        // two snapshots.
+        const bool oldest = (ikey.sequence <= compact->smallest_snapshot);
+        const SequenceNumber sequence = ikey.sequence;
+        MergeContext merge(merge_operator);
+        merge.Add(value);
+        bool key_ended = true;   // No older entries in this compaction
+        bool has_base = false;
+        bool deleted = false;
+        Slice base;
+        for (input->Next(); input->Valid(); input->Next()) {
+          ParsedInternalKey older;
+          if (!ParseInternalKey(input->key(), &older)) {
+            key_ended = false;
+            break;
+          }
+          if (ucmp->Compare(older.user_key,
+                                         Slice(current_user_key)) != 0) {
+            break;
+          }
+          if (!oldest && older.sequence <= newest_snapshot) {
+            key_ended = false;
+            break;
+          }
+          last_sequence_for_key = older.sequence;
+          if (older.type == kTypeMerge) {
+            merge.Add(input->value());
+          } else {
+            if (older.type == kTypeValue) {
+              base = input->value();
+              has_base = true;
+            } else {
+              deleted = true;
+            }
+            break;
+          }
+        }
+        advanced = true;
+
+        // Without a value or deletion to stop at, the operands apply to
+        // nothing only if no older entries exist for the key.
+        ValueType type = kTypeValue;
+        if (has_base) {
+          status = merge.Apply(current_user_key, &base, &merged_value);
+        } else if (deleted || (key_ended &&
+                   compact->compaction->IsBaseLevelForKey(current_user_key))) {
+          status = merge.Apply(current_user_key, NULL, &merged_value);
+        } else {
+          type = kTypeMerge;
+          status = merge.Combine(current_user_key, &merged_value);
+        }
+        if (!status.ok()) {
+          break;
+        }
+        if (has_base || deleted) {
+          // The entry the operands were applied to is folded in as well
+          input->Next();
+        }
+        merged_key.clear();
+        AppendInternalKey(&merged_key, ParsedInternalKey(
+            current_user_key, sequence, type));
+        key = merged_key;
+        value = merged_value;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -936,7 +2116,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         compact->current_output()->smallest.DecodeFrom(key);
       }
       compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->builder->Add(key, value);
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
@@ -948,7 +2128,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
     }
 
-    input->Next();
+    if (!advanced) {
+      input->Next();
+    }
   }
 
   if (status.ok() && shutting_down_.Acquire_Load()) {
@@ -973,16 +2155,44 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  Statistics* const statistics = options_.statistics;
+  if (statistics != NULL) {
+    statistics->RecordTick(kCompactReadBytes, stats.bytes_read);
+    statistics->RecordTick(kCompactWriteBytes, stats.bytes_written);
+    statistics->MeasureTime(kCompactionMicros, stats.micros);
+  }
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  cfd->stats[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
   }
+  if (options_.listener != NULL) {
+    Event* event = new Event;
+    event->type = Event::kCompaction;
+    CompactionJobInfo* info = &event->compaction;
+    info->cf_name = cfd->name;
+    info->base_level = compact->compaction->level();
+    info->output_level = compact->compaction->output_level();
+    for (int which = 0; which < 2; which++) {
+      for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+        info->input_files.push_back(
+            compact->compaction->input(which, i)->number);
+      }
+    }
+    for (size_t i = 0; i < compact->outputs.size(); i++) {
+      info->output_files.push_back(compact->outputs[i].number);
+    }
+    info->bytes_read = stats.bytes_read;
+    info->bytes_written = stats.bytes_written;
+    info->micros = stats.micros;
+    info->status = status;
+    QueueEvent(event);
+  }
   VersionSet::LevelSummaryStorage tmp;
   Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
+      "compacted to: %s", cfd->versions->LevelSummary(&tmp));
   return status;
 }
 
@@ -1006,28 +2216,34 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 }  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      ColumnFamilyData* cfd,
                                       SequenceNumber* latest_snapshot) {
-  IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
+  if (cfd->dropped) {
+    mutex_.Unlock();
+    return NewErrorIterator(Status::InvalidArgument(
+        cfd->name, "column family was dropped"));
+  }
 
   // Collect together all needed child iterators
+  IterState* cleanup = new IterState;
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(cfd->mem->NewIterator());
+  cfd->mem->Ref();
+  if (cfd->imm != NULL) {
+    list.push_back(cfd->imm->NewIterator());
+    cfd->imm->Ref();
   }
-  versions_->current()->AddIterators(options, &list);
+  cfd->versions->current()->AddIterators(options, &list);
   Iterator* internal_iter =
-      NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
+      NewMergingIterator(&cfd->internal_comparator, &list[0], list.size());
+  cfd->versions->current()->Ref();
 
   cleanup->mu = &mutex_;
-  cleanup->mem = mem_;
-  cleanup->imm = imm_;
-  cleanup->version = versions_->current();
+  cleanup->mem = cfd->mem;
+  cleanup->imm = cfd->imm;
+  cleanup->version = cfd->versions->current();
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
   mutex_.Unlock();
@@ -1036,7 +2252,7 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
-  return NewInternalIterator(ReadOptions(), &ignored);
+  return NewInternalIterator(ReadOptions(), default_cf_, &ignored);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1047,8 +2263,22 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  return Get(options, &default_cf_->handle, key, value);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family,
+                   const Slice& key,
+                   std::string* value) {
+  Statistics* const statistics = options_.statistics;
+  const uint64_t start_micros = (statistics != NULL) ? env_->NowMicros() : 0;
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   Status s;
   MutexLock l(&mutex_);
+  if (cfd->dropped) {
+    return Status::InvalidArgument(cfd->name, "column family was dropped");
+  }
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1056,9 +2286,10 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
+  const Options& cf_options = cfd->options;
+  MemTable* mem = cfd->mem;
+  MemTable* imm = cfd->imm;
+  Version* current = cfd->versions->current();
   mem->Ref();
   if (imm != NULL) imm->Ref();
   current->Ref();
@@ -1071,14 +2302,37 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    MergeContext merge(cf_options.merge_operator);
+    PerfTimer memtable_timer(&perf_context.get_from_memtable_time);
+    PERF_COUNTER_ADD(get_from_memtable_count, 1);
+    bool done = mem->Get(lkey, value, &s, &merge);
+    if (!done && imm != NULL) {
+      PERF_COUNTER_ADD(get_from_memtable_count, 1);
+      done = imm->Get(lkey, value, &s, &merge);
+    }
+    memtable_timer.Stop();
+    if (!done) {
+      s = current->Get(options, lkey, value, &stats, &merge);
       have_stat_update = true;
     }
+    if (s.ok() && cf_options.ttl > 0) {
+      if (cf_options.hide_expired_keys &&
+          IsExpired(*value, cf_options.ttl, CurrentTimestamp(env_))) {
+        value->clear();
+        s = Status::NotFound(Slice());
+      } else {
+        value->resize(StripTimestamp(*value).size());
+      }
+    }
+    if (statistics != NULL) {
+      statistics->RecordTick(have_stat_update ? kMemtableMiss : kMemtableHit,
+                             1);
+      statistics->RecordTick(kKeysRead, 1);
+      if (s.ok()) {
+        statistics->RecordTick(kBytesRead, value->size());
+      }
+      statistics->MeasureTime(kGetMicros, env_->NowMicros() - start_micros);
+    }
     mutex_.Lock();
   }
 
@@ -1092,13 +2346,25 @@ Status DBImpl::Get(const ReadOptions& options,
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIterator(options, &default_cf_->handle);
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   SequenceNumber latest_snapshot;
-  Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot);
+  Iterator* internal_iter = NewInternalIterator(options, cfd,
+                                                &latest_snapshot);
+  const Options& cf_options = cfd->options;
   return NewDBIterator(
-      &dbname_, env_, user_comparator(), internal_iter,
+      &cfd->dbname, env_, cfd->internal_comparator.user_comparator(),
+      internal_iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
-       : latest_snapshot));
+       : latest_snapshot),
+      cf_options.ttl, cf_options.hide_expired_keys,
+      cf_options.merge_operator, options_.statistics);
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1120,13 +2386,60 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  return Merge(options, &default_cf_->handle, key, value);
+}
+
+Status DBImpl::Merge(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  if (cfd->options.merge_operator == NULL) {
+    return Status::InvalidArgument("no merge_operator was set");
+  }
+  return DB::Merge(options, column_family, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  Statistics* const statistics = options_.statistics;
+  if (statistics == NULL || my_batch == NULL) {
+    return Write(options, my_batch, my_batch == NULL ? default_cf_ : NULL);
+  }
+  const uint64_t start_micros = env_->NowMicros();
+  Status s = Write(options, my_batch, NULL);
+  if (s.ok()) {
+    statistics->RecordTick(kKeysWritten, WriteBatchInternal::Count(my_batch));
+    statistics->RecordTick(kBytesWritten,
+                           WriteBatchInternal::ByteSize(my_batch));
+  }
+  statistics->MeasureTime(kWriteMicros, env_->NowMicros() - start_micros);
+  return s;
+}
+
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch,
+                     ColumnFamilyData* force) {
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  MutexLock l(&mutex_);
+  WriteBatch stamped;
+  if (!ttl_column_families_.empty() && my_batch != NULL) {
+    Status s = AddTimestamps(*my_batch, CurrentTimestamp(env_),
+                             ttl_column_families_, &stamped);
+    if (!s.ok()) {
+      return s;
+    }
+    my_batch = &stamped;
+  }
+
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
   w.done = false;
 
-  MutexLock l(&mutex_);
   writers_.push_back(&w);
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
@@ -1135,27 +2448,44 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     return w.status;
   }
 
+  // Column families are only created or dropped from the front of the
+  // writer queue, so they cannot change until this write is done.
+  Status status;
+  if (my_batch != NULL) {
+    status = CheckColumnFamilies(my_batch);
+  }
+  if (!status.ok()) {
+    LeaveWriteQueue(&w);
+    return status;
+  }
+
   // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(my_batch == NULL);
+  status = MakeRoomForWrite(force);
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
+    if (write_controller_.state() != WriteController::kNormal) {
+      write_controller_.RecordWrite(env_->NowMicros(),
+                                    WriteBatchInternal::ByteSize(updates));
+    }
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
-    // into mem_.
+    // into the memtables.  Column families are only added or dropped
+    // from the front of the writer queue.
     {
+      ColumnFamilyMemTablesImpl memtables(&column_families_, 0);
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(updates));
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
       }
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+        status = WriteBatchInternal::InsertInto(updates, &memtables);
       }
       mutex_.Lock();
     }
@@ -1183,6 +2513,36 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+Status DBImpl::CheckColumnFamilies(const WriteBatch* batch) {
+  mutex_.AssertHeld();
+  ColumnFamilyChecker checker(&column_families_);
+  Status s = batch->Iterate(&checker);
+  if (s.ok() && checker.found()) {
+    s = Status::InvalidArgument("unknown or dropped column family");
+  }
+  return s;
+}
+
+void DBImpl::EnterWriteQueue(Writer* w) {
+  mutex_.AssertHeld();
+  w->batch = NULL;
+  w->sync = false;
+  w->done = false;
+  writers_.push_back(w);
+  while (w != writers_.front()) {
+    w->cv.Wait();
+  }
+}
+
+void DBImpl::LeaveWriteQueue(Writer* w) {
+  mutex_.AssertHeld();
+  assert(writers_.front() == w);
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1211,95 +2571,269 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != NULL) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == NULL) {
+      // A flush, or a change to the column families, must not be
+      // handled by a group that was formed before it.
+      break;
+    }
 
-      // Append to *reuslt
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    if (!CheckColumnFamilies(w->batch).ok()) {
+      // Fails on its own once it reaches the front of the queue
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *reuslt
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
 }
 
+// Longest sleep of a delayed write before it checks whether compactions
+// have caught up
+static const uint64_t kDelayStepMicros = 1000;
+
+// Number of log files that may be kept alive by column families that
+// are rarely written to before their memtables are flushed
+static const size_t kMaxAliveLogs = 8;
+
+static WriteStallCondition StallCondition(WriteController::State state) {
+  switch (state) {
+    case WriteController::kDelayed:
+      return kWriteStallDelayed;
+    case WriteController::kStopped:
+      return kWriteStallStopped;
+    default:
+      return kWriteStallNormal;
+  }
+}
+
+void DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  // Writes share one log, so the column family that is furthest
+  // behind holds all of them back.  FIFO compaction never merges
+  // level-0 files, so only the bytes it has yet to drop count.
+  int level0_files = 0;
+  uint64_t pending_bytes = 0;
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    const ColumnFamilyData* cfd = it->second;
+    if (cfd->dropped) {
+      continue;
+    }
+    if (cfd->options.compaction_style != kCompactionStyleFIFO) {
+      level0_files = std::max(level0_files, cfd->versions->NumLevelFiles(0));
+    }
+    pending_bytes = std::max(pending_bytes,
+                             cfd->versions->PendingCompactionBytes());
+  }
+  const WriteController::State previous = write_controller_.state();
+  write_controller_.Update(level0_files, pending_bytes);
+  if (options_.listener != NULL && write_controller_.state() != previous) {
+    Event* event = new Event;
+    event->type = Event::kStall;
+    event->stall.previous = StallCondition(previous);
+    event->stall.current = StallCondition(write_controller_.state());
+    QueueEvent(event);
+  }
+}
+
+DBImpl::ColumnFamilyData* DBImpl::MemTableToSwitch() {
+  mutex_.AssertHeld();
+  ColumnFamilyData* oldest = NULL;
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    if (cfd->dropped) {
+      continue;
+    }
+    if (cfd->mem->ApproximateMemoryUsage() > cfd->options.write_buffer_size) {
+      return cfd;
+    }
+    if (!cfd->mem->Empty() && cfd->mem_log_number < logfile_number_ &&
+        (oldest == NULL || cfd->mem_log_number < oldest->mem_log_number)) {
+      oldest = cfd;
+    }
+  }
+
+  // A memtable that holds on to too many logs is flushed early
+  const uint64_t min_log = MinLogNumberToKeep();
+  while (!alive_logs_.empty() && alive_logs_.front() < min_log) {
+    alive_logs_.pop_front();
+  }
+  return (alive_logs_.size() > kMaxAliveLogs) ? oldest : NULL;
+}
+
+DBImpl::ColumnFamilyData* DBImpl::ImmToFlush() const {
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    if (it->second->imm != NULL) {
+      return it->second;
+    }
+  }
+  return NULL;
+}
+
+DBImpl::ColumnFamilyData* DBImpl::PickCompactionFamily() const {
+  // Take turns, so that one busy column family does not starve the rest
+  std::map<uint32_t, ColumnFamilyData*>::const_iterator start =
+      column_families_.upper_bound(last_compaction_cf_);
+  std::map<uint32_t, ColumnFamilyData*>::const_iterator it;
+  for (it = start; it != column_families_.end(); ++it) {
+    if (!it->second->dropped && it->second->versions->NeedsCompaction()) {
+      return it->second;
+    }
+  }
+  for (it = column_families_.begin(); it != start; ++it) {
+    if (!it->second->dropped && it->second->versions->NeedsCompaction()) {
+      return it->second;
+    }
+  }
+  return NULL;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(ColumnFamilyData* force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
+  bool allow_delay = (force == NULL);
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    }
+
+    UpdateWriteController();
+    ColumnFamilyData* cfd =
+        (force != NULL && !force->dropped) ? force : MemTableToSwitch();
+    if (allow_delay &&
+        write_controller_.state() != WriteController::kNormal) {
+      // Compactions are falling behind.  Rather than stopping writes
+      // for several seconds once they are too far behind, slow each
+      // write down to the rate the controller allows, to reduce
+      // latency variance.  This also hands over some CPU to the
+      // compaction thread in case it is sharing the same core as the
+      // writer.  The delay is taken in small steps so that it ends
+      // early if compactions catch up.
+      const uint64_t start = env_->NowMicros();
+      uint64_t now = start;
+      uint64_t delay;
+      while (write_controller_.state() != WriteController::kNormal &&
+             (delay = write_controller_.GetDelay(now)) > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(
+            static_cast<int>(std::min<uint64_t>(delay, kDelayStepMicros)));
+        mutex_.Lock();
+        UpdateWriteController();
+        now = env_->NowMicros();
+      }
+      if (now > start) {
+        write_controller_.RecordDelay(now - start);
+        RecordTick(options_.statistics, kStallMicros, now - start);
+      }
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
-    } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
-      // There is room in current memtable
+    } else if (cfd == NULL) {
+      // There is room in every memtable
       break;
-    } else if (imm_ != NULL) {
+    } else if (cfd->imm != NULL) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
-      // There are too many level-0 files.
+      RecordTick(options_.statistics, kStallMicros, env_->NowMicros() - start);
+    } else if (write_controller_.state() == WriteController::kStopped) {
+      // There are too many level-0 files, or too many bytes waiting
+      // to be compacted.
       Log(options_.info_log, "waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      const uint64_t stopped = env_->NowMicros() - start;
+      write_controller_.RecordStop(stopped);
+      RecordTick(options_.statistics, kStallMicros, stopped);
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
-      assert(versions_->PrevLogNumber() == 0);
-      uint64_t new_log_number = versions_->NewFileNumber();
-      WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      MemTable* mem = cfd->mem;
+      const uint64_t mem_log_number = cfd->mem_log_number;
+      s = SwitchToNewLog();
       if (!s.ok()) {
-        // Avoid chewing through file number space in a tight loop.
-        versions_->ReuseFileNumber(new_log_number);
         break;
       }
-      delete log_;
-      delete logfile_;
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
-      mem_->Ref();
-      force = false;   // Do not force another compaction if have room
+      cfd->imm = mem;
+      cfd->imm_log_number = mem_log_number;
+      has_imm_.Release_Store(cfd->imm);
+      cfd->mem = new MemTable(cfd->internal_comparator);
+      cfd->mem->Ref();
+      cfd->mem_log_number = logfile_number_;
+      force = NULL;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
   }
   return s;
 }
 
+Status DBImpl::SwitchToNewLog() {
+  mutex_.AssertHeld();
+  assert(versions_->PrevLogNumber() == 0);
+  uint64_t new_log_number = versions_->NewFileNumber();
+  WritableFile* lfile = NULL;
+  Status s = env_->NewWritableFile(LogFileName(dbname_, new_log_number),
+                                   &lfile);
+  if (!s.ok()) {
+    // Avoid chewing through file number space in a tight loop.
+    versions_->ReuseFileNumber(new_log_number);
+    return s;
+  }
+  delete log_;
+  delete logfile_;
+  logfile_ = lfile;
+  logfile_number_ = new_log_number;
+  log_ = new log::Writer(lfile);
+  alive_logs_.push_back(new_log_number);
+  // Memtables without updates need none of the older logs
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    if (it->second->mem->Empty()) {
+      it->second->mem_log_number = new_log_number;
+    }
+  }
+  return s;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  return GetProperty(&default_cf_->handle, property, value);
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const Slice& property, std::string* value) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
   value->clear();
 
   MutexLock l(&mutex_);
+  if (cfd->dropped) {
+    return false;
+  }
+  VersionSet* const versions = cfd->versions;
+  const CompactionStats* const stats = cfd->stats;
   Slice in = property;
   Slice prefix("leveldb.");
   if (!in.starts_with(prefix)) return false;
@@ -1309,12 +2843,12 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     in.remove_prefix(strlen("num-files-at-level"));
     uint64_t level;
     bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
-    if (!ok || level >= config::kNumLevels) {
+    if (!ok || level >= static_cast<uint64_t>(cfd->options.num_levels)) {
       return false;
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "%d",
-               versions_->NumLevelFiles(static_cast<int>(level)));
+               versions->NumLevelFiles(static_cast<int>(level)));
       *value = buf;
       return true;
     }
@@ -1327,23 +2861,95 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              );
     value->append(buf);
     for (int level = 0; level < config::kNumLevels; level++) {
-      int files = versions_->NumLevelFiles(level);
-      if (stats_[level].micros > 0 || files > 0) {
+      int files = versions->NumLevelFiles(level);
+      if (stats[level].micros > 0 || files > 0) {
         snprintf(
             buf, sizeof(buf),
             "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
             level,
             files,
-            versions_->NumLevelBytes(level) / 1048576.0,
-            stats_[level].micros / 1e6,
-            stats_[level].bytes_read / 1048576.0,
-            stats_[level].bytes_written / 1048576.0);
+            versions->NumLevelBytes(level) / 1048576.0,
+            stats[level].micros / 1e6,
+            stats[level].bytes_read / 1048576.0,
+            stats[level].bytes_written / 1048576.0);
         value->append(buf);
       }
     }
     return true;
+  } else if (in == "recovery-stats") {
+    const RecoveryStats& r = recovery_stats_;
+    char buf[400];
+    snprintf(buf, sizeof(buf),
+             "Open: %.3f sec (descriptor %.3f sec, logs %.3f sec)\n"
+             "Logs: %d files, %.1f MB, %lld records, %lld bytes dropped\n"
+             "Level-0 tables: %d files, %.1f MB\n"
+             "Recovery threads: %d\n"
+             "Prewarmed tables: %d in %.3f sec\n",
+             r.micros / 1e6,
+             r.manifest_micros / 1e6,
+             r.log_micros / 1e6,
+             r.logs,
+             r.log_bytes / 1048576.0,
+             (long long) r.records,
+             (long long) r.dropped_bytes,
+             r.tables,
+             r.table_bytes / 1048576.0,
+             options_.recovery_threads,
+             r.prewarmed_tables,
+             r.prewarm_micros / 1e6);
+    value->append(buf);
+    return true;
   } else if (in == "sstables") {
-    *value = versions_->current()->DebugString();
+    *value = versions->current()->DebugString();
+    return true;
+  } else if (in == "pending-compaction-bytes") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             (unsigned long long) versions->PendingCompactionBytes());
+    *value = buf;
+    return true;
+  } else if (in == "write-delay") {
+    const WriteController& c = write_controller_;
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Delayed writes: %llu, %.3f sec\n"
+             "Stopped writes: %llu, %.3f sec\n"
+             "Delayed write rate: %.3f MB/sec\n",
+             (unsigned long long) c.delays(),
+             c.delay_micros() / 1e6,
+             (unsigned long long) c.stops(),
+             c.stop_micros() / 1e6,
+             c.delayed_write_rate() / 1048576.0);
+    *value = buf;
+    return true;
+  } else if (in == "write-amplification") {
+    int64_t written = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      written += stats[level].bytes_written;
+    }
+    const int64_t flushed = cfd->flush_stats.bytes_written;
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Flushed: %.3f MB\n"
+             "Written: %.3f MB\n"
+             "Write amplification: %.2f\n",
+             flushed / 1048576.0,
+             written / 1048576.0,
+             flushed > 0 ? static_cast<double>(written) / flushed : 0.0);
+    *value = buf;
+    return true;
+  } else if (in == "rate-limiter" && options_.rate_limiter != NULL) {
+    RateLimiter* limiter = options_.rate_limiter;
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Rate: %.3f MB/sec\n"
+             "Waited: %.3f sec\n",
+             limiter->GetBytesPerSecond() / 1048576.0,
+             limiter->GetTotalWaitMicros() / 1e6);
+    *value = buf;
+    return true;
+  } else if (in == "statistics" && options_.statistics != NULL) {
+    *value = options_.statistics->ToString();
     return true;
   }
 
@@ -1390,37 +2996,707 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                 const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::CreateColumnFamily(const Options& options, const std::string& name,
+                              ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  return Status::NotSupported("column families");
+}
+
+Status DB::DropColumnFamily(ColumnFamilyHandle* handle) {
+  return Status::NotSupported("column families");
+}
+
+ColumnFamilyHandle* DB::DefaultColumnFamily() const {
+  return NULL;
+}
+
+Status DB::Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, std::string* value) {
+  return Status::NotSupported("column families");
+}
+
+Iterator* DB::NewIterator(const ReadOptions& options,
+                          ColumnFamilyHandle* column_family) {
+  return NewErrorIterator(Status::NotSupported("column families"));
+}
+
+bool DB::GetProperty(ColumnFamilyHandle* column_family,
+                     const Slice& property, std::string* value) {
+  return false;
+}
+
+void DB::CompactRange(ColumnFamilyHandle* column_family,
+                      const Slice* begin, const Slice* end) {
+}
+
+Status DB::CreateCheckpoint(const std::string& checkpoint_dir) {
+  return Status::NotSupported("checkpoints");
+}
+
+Status DB::GetCheckpointFiles(std::vector<CheckpointFile>* files) {
+  files->clear();
+  return Status::NotSupported("checkpoints");
+}
+
+void DB::ReleaseCheckpointFiles() {
+}
+
+Status DB::TryCatchUpWithPrimary() {
+  return Status::NotSupported("not a secondary instance");
+}
+
 DB::~DB() { }
 
+ColumnFamilyHandle::~ColumnFamilyHandle() { }
+
+DBImpl::ColumnFamilyData* DBImpl::FindColumnFamily(
+    const std::string& name) const {
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    if (!it->second->dropped && it->second->name == name) {
+      return it->second;
+    }
+  }
+  return NULL;
+}
+
+Status DBImpl::AddColumnFamily(const Options& options,
+                               const std::string& name,
+                               ColumnFamilyData** result) {
+  mutex_.AssertHeld();
+  *result = NULL;
+  if (FindColumnFamily(name) != NULL) {
+    return Status::InvalidArgument(name, "column family already exists");
+  }
+
+  const uint32_t id = versions_->MaxColumnFamily() + 1;
+  const std::string dirname = ColumnFamilyDirName(dbname_, id);
+  ColumnFamilyData* cfd = new ColumnFamilyData(id, name, dirname,
+                                               options_, options,
+                                               open_tables_);
+  column_families_[id] = cfd;
+  env_->CreateDir(dirname);  // Checked by NewDB() below
+  Status s = NewDB(cfd);
+  if (s.ok()) {
+    s = cfd->versions->Recover();
+  }
+  if (s.ok()) {
+    // Its updates start with the current log
+    cfd->mem_log_number = logfile_number_;
+    VersionEdit edit;
+    edit.SetLogNumber(logfile_number_);
+    s = LogAndApply(cfd, &edit);
+  }
+  if (s.ok()) {
+    // The column family exists once the descriptor of the DB names it
+    VersionEdit edit;
+    edit.AddColumnFamily(id, name);
+    s = LogAndApply(default_cf_, &edit);
+  }
+  if (s.ok()) {
+    if (cfd->options.ttl > 0) {
+      ttl_column_families_.insert(id);
+    }
+    *result = cfd;
+  } else {
+    column_families_.erase(id);
+    delete cfd;
+    DeleteColumnFamilyDir(env_, dirname);
+  }
+  return s;
+}
+
+Status DBImpl::CreateColumnFamily(const Options& options,
+                                  const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  Status s = CheckWritable();
+  if (s.ok()) {
+    s = ValidateOptions(options);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  MutexLock l(&mutex_);
+  Writer w(&mutex_);
+  EnterWriteQueue(&w);
+  ColumnFamilyData* cfd;
+  s = AddColumnFamily(options, name, &cfd);
+  if (s.ok()) {
+    *handle = &cfd->handle;
+  }
+  LeaveWriteQueue(&w);
+  return s;
+}
+
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() const {
+  return &default_cf_->handle;
+}
+
+Status DBImpl::DropColumnFamily(ColumnFamilyHandle* handle) {
+  ColumnFamilyData* cfd =
+      reinterpret_cast<ColumnFamilyHandleImpl*>(handle)->cfd();
+  if (cfd == default_cf_) {
+    return Status::InvalidArgument("cannot drop the default column family");
+  }
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+
+  MutexLock l(&mutex_);
+  Writer w(&mutex_);
+  EnterWriteQueue(&w);
+  Status s;
+  if (cfd->dropped) {
+    s = Status::InvalidArgument(cfd->name, "column family was dropped");
+  } else {
+    VersionEdit edit;
+    edit.DropColumnFamily(cfd->id);
+    s = LogAndApply(default_cf_, &edit);
+  }
+  if (s.ok()) {
+    // The handle stays valid until the DB is deleted, but its files
+    // can go as soon as no flush or compaction uses them.
+    cfd->dropped = true;
+    ttl_column_families_.erase(cfd->id);
+    while (cfd->background_jobs > 0) {
+      bg_cv_.Wait();
+    }
+    if (cfd->imm != NULL) {
+      cfd->imm->Unref();
+      cfd->imm = NULL;
+      has_imm_.Release_Store(ImmToFlush());
+    }
+    // Its tables no longer count against the open files of the others
+    std::set<uint64_t> live;
+    cfd->versions->AddLiveFiles(&live);
+    for (std::set<uint64_t>::const_iterator it = live.begin();
+         it != live.end(); ++it) {
+      cfd->table_cache->Evict(*it);
+    }
+    DeleteObsoleteFiles(default_cf_);  // Deletes its directory
+  }
+  LeaveWriteQueue(&w);
+  return s;
+}
+
+// Defined in util/env.cc
+extern Status WriteStringToFileSync(Env* env, const Slice& data,
+                                    const std::string& fname);
+
+namespace {
+// A file that stores what is written to it in a string
+class StringFile : public WritableFile {
+ public:
+  explicit StringFile(std::string* contents) : contents_(contents) { }
+  virtual Status Append(const Slice& data) {
+    contents_->append(data.data(), data.size());
+    return Status::OK();
+  }
+  virtual Status Close() { return Status::OK(); }
+  virtual Status Flush() { return Status::OK(); }
+  virtual Status Sync() { return Status::OK(); }
+
+ private:
+  std::string* contents_;
+};
+}  // namespace
+
+// Return the name of "fname", a file in "dir" or in one of its
+// subdirectories, relative to "dir".
+static std::string RelativeFileName(const std::string& dir,
+                                    const std::string& fname) {
+  assert(Slice(fname).starts_with(dir + "/"));
+  return fname.substr(dir.size() + 1);
+}
+
+Status DBImpl::GetCheckpointFiles(std::vector<CheckpointFile>* files) {
+  files->clear();
+  // Creating a checkpoint starts a new log
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  std::vector<CheckpointFile> descriptors;
+  uint64_t min_log = 0;
+  uint64_t prev_log = 0;
+  uint64_t log_limit = 0;
+  mutex_.Lock();
+  Writer w(&mutex_);
+  EnterWriteQueue(&w);
+  // Closing the current log leaves every update so far in logs that no
+  // longer change, so they can be copied without blocking writes.
+  Status s = SwitchToNewLog();
+  if (s.ok()) {
+    file_deletions_disabled_++;
+    for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      ColumnFamilyData* cfd = it->second;
+      if (cfd->dropped) {
+        continue;
+      }
+      Version* current = cfd->versions->current();
+      for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& tables = current->files(level);
+        for (size_t i = 0; i < tables.size(); i++) {
+          CheckpointFile table;
+          table.source = TableFileName(cfd->dbname, tables[i]->number);
+          table.name = RelativeFileName(dbname_, table.source);
+          table.size = tables[i]->file_size;
+          files->push_back(table);
+        }
+      }
+
+      // A descriptor that starts with the current state
+      const uint64_t manifest_number = cfd->versions->ManifestFileNumber();
+      CheckpointFile manifest;
+      manifest.name = RelativeFileName(
+          dbname_, DescriptorFileName(cfd->dbname, manifest_number));
+      std::string record;
+      cfd->versions->EncodeSnapshot(&record);
+      StringFile file(&manifest.contents);
+      log::Writer log(&file);
+      log.AddRecord(record);
+      manifest.size = manifest.contents.size();
+      descriptors.push_back(manifest);
+
+      CheckpointFile current_file;
+      current_file.name = RelativeFileName(dbname_,
+                                           CurrentFileName(cfd->dbname));
+      current_file.contents = RelativeFileName(
+          cfd->dbname, DescriptorFileName(cfd->dbname, manifest_number));
+      current_file.contents.push_back('\n');
+      current_file.size = current_file.contents.size();
+      descriptors.push_back(current_file);
+    }
+    min_log = MinLogNumberToKeep();
+    prev_log = versions_->PrevLogNumber();
+    log_limit = logfile_number_;
+  }
+  LeaveWriteQueue(&w);
+  mutex_.Unlock();
+  if (!s.ok()) {
+    files->clear();
+    return s;
+  }
+
+  // The updates that are not in the tables yet
+  std::vector<std::string> filenames;
+  s = env_->GetChildren(dbname_, &filenames);
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; s.ok() && i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        type == kLogFile &&
+        ((number >= min_log && number < log_limit) ||
+         (prev_log != 0 && number == prev_log))) {
+      CheckpointFile log;
+      log.name = filenames[i];
+      log.source = dbname_ + "/" + filenames[i];
+      s = env_->GetFileSize(log.source, &log.size);
+      files->push_back(log);
+    }
+  }
+  if (!s.ok()) {
+    files->clear();
+    ReleaseCheckpointFiles();
+    return s;
+  }
+  // Descriptors last, each followed by the CURRENT file naming it
+  files->insert(files->end(), descriptors.begin(), descriptors.end());
+  return s;
+}
+
+void DBImpl::ReleaseCheckpointFiles() {
+  MutexLock l(&mutex_);
+  assert(file_deletions_disabled_ > 0);
+  if (--file_deletions_disabled_ == 0) {
+    // Catch up with the deletions that were skipped meanwhile
+    const uint64_t min_log = MinLogNumberToKeep();
+    for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      if (it->second != default_cf_ && !it->second->dropped) {
+        DeleteObsoleteFilesIn(it->second, min_log);
+      }
+    }
+    DeleteObsoleteFilesIn(default_cf_, min_log);
+  }
+}
+
+Status DBImpl::CreateCheckpoint(const std::string& checkpoint_dir) {
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  if (env_->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+  // The checkpoint is built next to its final place and renamed when
+  // it is complete, so that a failure leaves nothing behind that could
+  // be taken for a checkpoint.
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  DestroyDB(tmp_dir, options_);  // Left over from a failed attempt
+  Status s = env_->CreateDir(tmp_dir);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<CheckpointFile> files;
+  s = GetCheckpointFiles(&files);
+  if (s.ok()) {
+    std::set<std::string> dirs;
+    for (size_t i = 0; s.ok() && i < files.size(); i++) {
+      const CheckpointFile& file = files[i];
+      const std::string fname = tmp_dir + "/" + file.name;
+      const size_t slash = file.name.rfind('/');
+      if (slash != std::string::npos &&
+          dirs.insert(file.name.substr(0, slash)).second) {
+        s = env_->CreateDir(tmp_dir + "/" + file.name.substr(0, slash));
+      }
+      uint64_t number;
+      FileType type;
+      if (!s.ok()) {
+        // Stop here
+      } else if (file.source.empty()) {
+        s = WriteStringToFileSync(env_, file.contents, fname);
+      } else if (ParseFileName(file.name.substr(slash + 1), &number, &type) &&
+                 type == kTableFile &&
+                 env_->LinkFile(file.source, fname).ok()) {
+        // Tables never change once written, so a hard link is as good
+        // as a copy.  It fails if the checkpoint is on another file
+        // system, and the table is copied instead.
+      } else {
+        s = CopyFile(env_, file.source, fname, file.size);
+      }
+    }
+    ReleaseCheckpointFiles();
+  }
+  if (s.ok()) {
+    s = env_->RenameFile(tmp_dir, checkpoint_dir);
+  }
+  if (!s.ok()) {
+    DestroyDB(tmp_dir, options_);
+  }
+  Log(options_.info_log, "Checkpoint %s: %s\n",
+      checkpoint_dir.c_str(), s.ToString().c_str());
+  return s;
+}
+
+Status DBImpl::CheckWritable() const {
+  if (open_mode_ != kReadWrite) {
+    return Status::NotSupported(dbname_, "opened for reading only");
+  }
+  return Status::OK();
+}
+
+Status DBImpl::TryCatchUpWithPrimary() {
+  if (open_mode_ != kSecondary) {
+    return DB::TryCatchUpWithPrimary();
+  }
+  MutexLock l(&mutex_);
+  // The descriptor of the default column family also lists the others
+  Status s = versions_->CatchUp();
+  const std::map<uint32_t, std::string>& registered =
+      versions_->column_families();
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       s.ok() && it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    if (cfd == default_cf_ || cfd->dropped) {
+      continue;
+    }
+    if (registered.count(cfd->id) == 0) {
+      // Dropped by the primary, which deletes its files
+      cfd->dropped = true;
+    } else {
+      s = cfd->versions->CatchUp();
+    }
+  }
+  if (s.ok()) {
+    s = TailLogs();
+  }
+  return s;
+}
+
+Status DBImpl::TailLogs() {
+  struct LogReporter : public log::Reader::Reporter {
+    Logger* info_log;
+    const char* fname;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      Log(info_log, "%s: dropping %d bytes; %s",
+          fname, static_cast<int>(bytes), s.ToString().c_str());
+    }
+  };
+
+  mutex_.AssertHeld();
+  uint64_t min_log = versions_->LogNumber();
+  SequenceNumber max_sequence = 0;
+  bool restart = false;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    if (cfd->dropped) {
+      continue;
+    }
+    min_log = std::min(min_log, cfd->versions->LogNumber());
+    max_sequence = std::max(max_sequence, cfd->versions->LastSequence());
+    // The updates in its memtable are in its tables now, and replaying
+    // the logs again cannot skip the ones already in it.
+    if (cfd->versions->LogNumber() > cfd->mem_log_number) {
+      restart = true;
+    }
+  }
+  if (restart) {
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      ColumnFamilyData* cfd = it->second;
+      cfd->mem->Unref();
+      cfd->mem = new MemTable(cfd->internal_comparator);
+      cfd->mem->Ref();
+      cfd->mem_log_number = cfd->versions->LogNumber();
+    }
+    tailed_logs_.clear();
+  }
+
+  // Tolerate logs that the primary deletes while they are listed: their
+  // updates are in tables that the next catch-up finds.
+  const uint64_t prev_log = versions_->PrevLogNumber();
+  std::vector<std::string> filenames;
+  Status s = env_->GetChildren(dbname_, &filenames);
+  uint64_t number;
+  FileType type;
+  std::vector<uint64_t> logs;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type)
+        && type == kLogFile
+        && ((number >= min_log) || (number == prev_log))) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+
+  std::map<uint64_t, uint64_t> tailed;
+  for (size_t i = 0; s.ok() && i < logs.size(); i++) {
+    const std::string fname = LogFileName(dbname_, logs[i]);
+    uint64_t offset = 0;
+    if (tailed_logs_.count(logs[i]) > 0) {
+      offset = tailed_logs_[logs[i]];
+    }
+    SequentialFile* file;
+    s = env_->NewSequentialFile(fname, &file);
+    if (!s.ok()) {
+      if (!env_->FileExists(fname)) {
+        s = Status::OK();
+      }
+      continue;
+    }
+
+    // A record at the end of the log may not be complete yet: it is
+    // read again by the next call.
+    LogReporter reporter;
+    reporter.info_log = options_.info_log;
+    reporter.fname = fname.c_str();
+    log::Reader reader(file, &reporter, true/*checksum*/, offset);
+    ColumnFamilyMemTablesImpl memtables(&column_families_, logs[i]);
+    Slice record;
+    std::string scratch;
+    WriteBatch batch;
+    while (s.ok() && reader.ReadRecord(&record, &scratch)) {
+      // Records start at increasing offsets, so reading from just past
+      // the start of this one skips it and the ones before it
+      offset = reader.LastRecordOffset() + 1;
+      if (record.size() < 12) {
+        reporter.Corruption(
+            record.size(), Status::Corruption("log record too small"));
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch, record);
+      s = WriteBatchInternal::InsertInto(&batch, &memtables);
+      MaybeIgnoreError(&s);
+      const SequenceNumber last_seq =
+          WriteBatchInternal::Sequence(&batch) +
+          WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > max_sequence) {
+        max_sequence = last_seq;
+      }
+    }
+    delete file;
+    tailed[logs[i]] = offset;
+  }
+  // Forget the logs that are gone
+  tailed_logs_.swap(tailed);
+
+  if (versions_->LastSequence() < max_sequence) {
+    versions_->SetLastSequence(max_sequence);
+  }
+  return s;
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                DB** dbptr) {
+  return Open(options, dbname, std::vector<ColumnFamilyDescriptor>(), NULL,
+              dbptr);
+}
+
 Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles,
                 DB** dbptr) {
+  return DBImpl::Open(DBImpl::kReadWrite, options, dbname, column_families,
+                      handles, dbptr);
+}
+
+Status DB::OpenForReadOnly(const Options& options, const std::string& dbname,
+                           DB** dbptr) {
+  return OpenForReadOnly(options, dbname,
+                         std::vector<ColumnFamilyDescriptor>(), NULL, dbptr);
+}
+
+Status DB::OpenForReadOnly(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<ColumnFamilyHandle*>* handles,
+    DB** dbptr) {
+  return DBImpl::Open(DBImpl::kReadOnly, options, dbname, column_families,
+                      handles, dbptr);
+}
+
+Status DB::OpenAsSecondary(const Options& options, const std::string& dbname,
+                           DB** dbptr) {
+  return OpenAsSecondary(options, dbname,
+                         std::vector<ColumnFamilyDescriptor>(), NULL, dbptr);
+}
+
+Status DB::OpenAsSecondary(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<ColumnFamilyHandle*>* handles,
+    DB** dbptr) {
+  return DBImpl::Open(DBImpl::kSecondary, options, dbname, column_families,
+                      handles, dbptr);
+}
+
+Status DBImpl::Open(OpenMode mode, const Options& options,
+                    const std::string& dbname,
+                    const std::vector<ColumnFamilyDescriptor>& column_families,
+                    std::vector<ColumnFamilyHandle*>* handles,
+                    DB** dbptr) {
   *dbptr = NULL;
+  if (handles != NULL) {
+    handles->clear();
+  }
+
+  Status valid = ValidateOptions(options);
+  for (size_t i = 0; valid.ok() && i < column_families.size(); i++) {
+    valid = ValidateOptions(column_families[i].options);
+  }
+  if (!valid.ok()) {
+    return valid;
+  }
 
-  DBImpl* impl = new DBImpl(options, dbname);
+  const uint64_t start_micros = options.env->NowMicros();
+  DBImpl* impl = new DBImpl(options, dbname, mode);
   impl->mutex_.Lock();
-  VersionEdit edit;
-  Status s = impl->Recover(&edit); // Handles create_if_missing, error_if_exists
-  if (s.ok()) {
+  std::map<uint32_t, VersionEdit> edits;
+  // Handles create_if_missing, error_if_exists
+  Status s = impl->Recover(column_families, &edits);
+  if (s.ok() && mode != kReadWrite) {
+    for (size_t i = 0; s.ok() && i < column_families.size(); i++) {
+      const ColumnFamilyDescriptor& descriptor = column_families[i];
+      DBImpl::ColumnFamilyData* cfd = impl->FindColumnFamily(descriptor.name);
+      if (cfd == NULL) {
+        s = Status::InvalidArgument(descriptor.name, "does not exist");
+      } else if (handles != NULL) {
+        handles->push_back(&cfd->handle);
+      }
+    }
+    if (s.ok()) {
+      impl->MaybeStartPrewarm();
+    }
+  } else if (s.ok()) {
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
     s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
                                      &lfile);
     if (s.ok()) {
-      edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+      impl->alive_logs_.push_back(new_log_number);
+    }
+    for (std::map<uint32_t, DBImpl::ColumnFamilyData*>::iterator it =
+             impl->column_families_.begin();
+         s.ok() && it != impl->column_families_.end(); ++it) {
+      DBImpl::ColumnFamilyData* cfd = it->second;
+      VersionEdit* edit = &edits[cfd->id];
+      edit->SetLogNumber(new_log_number);
+      cfd->mem_log_number = new_log_number;
+      s = impl->LogAndApply(cfd, edit);
+    }
+    // Column families that do not exist yet are created
+    for (size_t i = 0; s.ok() && i < column_families.size(); i++) {
+      const ColumnFamilyDescriptor& descriptor = column_families[i];
+      DBImpl::ColumnFamilyData* cfd = impl->FindColumnFamily(descriptor.name);
+      if (cfd == NULL) {
+        s = impl->AddColumnFamily(descriptor.options, descriptor.name, &cfd);
+      }
+      if (s.ok() && handles != NULL) {
+        handles->push_back(&cfd->handle);
+      }
     }
     if (s.ok()) {
-      impl->DeleteObsoleteFiles();
+      for (std::map<uint32_t, DBImpl::ColumnFamilyData*>::iterator it =
+               impl->column_families_.begin();
+           it != impl->column_families_.end(); ++it) {
+        impl->DeleteObsoleteFiles(it->second);
+      }
       impl->MaybeScheduleCompaction();
+      impl->MaybeStartPrewarm();
     }
   }
+  impl->recovery_stats_.micros = options.env->NowMicros() - start_micros;
   impl->mutex_.Unlock();
   if (s.ok()) {
     *dbptr = impl;
   } else {
+    if (handles != NULL) {
+      handles->clear();
+    }
     delete impl;
   }
   return s;
@@ -1447,7 +3723,10 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
     for (size_t i = 0; i < filenames.size(); i++) {
       if (ParseFileName(filenames[i], &number, &type) &&
           type != kDBLockFile) {  // Lock file will be deleted at end
-        Status del = env->DeleteFile(dbname + "/" + filenames[i]);
+        const std::string fname = dbname + "/" + filenames[i];
+        Status del = (type == kColumnFamilyDir
+                      ? DeleteColumnFamilyDir(env, fname)
+                      : env->DeleteFile(fname));
         if (result.ok() && !del.ok()) {
           result = del;
         }
@@ -6,16 +6,19 @@
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
 #include <deque>
+#include <map>
 #include <set>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 
 namespace leveldb {
 
+class Cache;
 class MemTable;
 class TableCache;
 class Version;
@@ -24,22 +27,50 @@ class VersionSet;
 
 class DBImpl : public DB {
  public:
-  DBImpl(const Options& options, const std::string& dbname);
+  // How the database is opened.  Read-only and secondary instances do
+  // not take its lock and never write to its directory, so that they
+  // can run next to the process that does.
+  enum OpenMode { kReadWrite, kReadOnly, kSecondary };
+
+  DBImpl(const Options& options, const std::string& dbname, OpenMode mode);
   virtual ~DBImpl();
 
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
+  virtual Status Merge(const WriteOptions&, ColumnFamilyHandle* column_family,
+                       const Slice& key, const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle);
+  virtual Status DropColumnFamily(ColumnFamilyHandle* handle);
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const;
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     std::string* value);
   virtual Iterator* NewIterator(const ReadOptions&);
+  virtual Iterator* NewIterator(const ReadOptions&,
+                                ColumnFamilyHandle* column_family);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end);
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir);
+  virtual Status GetCheckpointFiles(std::vector<CheckpointFile>* files);
+  virtual void ReleaseCheckpointFiles();
+  virtual Status TryCatchUpWithPrimary();
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -60,37 +91,140 @@ class DBImpl : public DB {
 
  private:
   friend class DB;
+  class ColumnFamilyChecker;
+  class ColumnFamilyHandleImpl;
+  class ColumnFamilyMemTablesImpl;
+  struct ColumnFamilyData;
   struct CompactionState;
+  struct PrewarmState;
+  struct RecoveryState;
   struct Writer;
 
-  Iterator* NewInternalIterator(const ReadOptions&,
+  Iterator* NewInternalIterator(const ReadOptions&, ColumnFamilyData* cfd,
                                 SequenceNumber* latest_snapshot);
 
-  Status NewDB();
+  // Open the database "dbname" in the given mode.  Implements
+  // DB::Open(), DB::OpenForReadOnly() and DB::OpenAsSecondary().
+  static Status Open(OpenMode mode, const Options& options,
+                     const std::string& dbname,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles,
+                     DB** dbptr);
+
+  // Return NotSupported unless the database was opened for writing.
+  Status CheckWritable() const;
 
-  // Recover the descriptor from persistent storage.  May do a significant
-  // amount of work to recover recently logged updates.  Any changes to
-  // be made to the descriptor are added to *edit.
-  Status Recover(VersionEdit* edit);
+  // Create the descriptor of a new, empty column family.
+  Status NewDB(ColumnFamilyData* cfd);
+
+  // Recover the descriptors of the database and of "column_families"
+  // from persistent storage.  May do a significant amount of work to
+  // recover recently logged updates.  Any changes to be made to the
+  // descriptor of a column family are added to (*edits)[id].
+  Status Recover(const std::vector<ColumnFamilyDescriptor>& column_families,
+                 std::map<uint32_t, VersionEdit>* edits);
 
   void MaybeIgnoreError(Status* s) const;
 
-  // Delete any unneeded files and stale in-memory entries.
-  void DeleteObsoleteFiles();
+  // Delete any unneeded files of "cfd", and the logs that no column
+  // family needs any more.  Does nothing while a checkpoint is being
+  // created.
+  void DeleteObsoleteFiles(ColumnFamilyData* cfd);
+  void DeleteObsoleteFilesIn(ColumnFamilyData* cfd, uint64_t min_log);
+
+  // Return the number of the oldest log that holds updates not yet
+  // written to the tables of their column family.
+  uint64_t MinLogNumberToKeep() const;
+
+  // Apply *edit to the descriptor of "cfd".
+  Status LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit);
+
+  // Compact the immutable memtable of "cfd" to disk and write a new
+  // descriptor iff successful.
+  Status CompactMemTable(ColumnFamilyData* cfd);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
-  Status CompactMemTable();
+  // Switch "cfd" to a new memtable and wait until the old one has been
+  // compacted.
+  Status FlushMemTable(ColumnFamilyData* cfd);
 
   Status RecoverLogFile(uint64_t log_number,
-                        VersionEdit* edit,
+                        std::map<uint32_t, VersionEdit>* edits,
                         SequenceNumber* max_sequence);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base);
+  // Replay the records that were added to the logs since the last
+  // call, starting over with new memtables once the updates in the
+  // current ones have been written to tables.  Used by secondary
+  // instances, which follow the logs that the primary is writing.
+  Status TailLogs();
+
+  // Hand the memtable of "cfd", which log recovery filled, to the
+  // recovery threads, or write it out directly if there are none.
+  Status FlushRecoveredMemTable(RecoveryState* state, ColumnFamilyData* cfd);
+
+  // Wait for the recovery threads to exit and record the level-0
+  // tables they wrote in *edits.
+  Status FinishLogRecovery(RecoveryState* state,
+                           std::map<uint32_t, VersionEdit>* edits);
+
+  Status WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                          VersionEdit* edit, Version* base);
+
+  // Return the live column family named "name", or NULL.
+  ColumnFamilyData* FindColumnFamily(const std::string& name) const;
+
+  // Create a column family and register it in the descriptor.
+  // REQUIRES: mutex_ is held and no writer is applying its updates
+  Status AddColumnFamily(const Options& options, const std::string& name,
+                         ColumnFamilyData** result);
+
+  // Wait until "w" is at the front of the writer queue, which keeps
+  // other writers from touching the memtables until
+  // LeaveWriteQueue(w) is called.
+  void EnterWriteQueue(Writer* w);
+  void LeaveWriteQueue(Writer* w);
+
+  // Return InvalidArgument if "batch" updates a column family that does
+  // not exist or was dropped.
+  Status CheckColumnFamilies(const WriteBatch* batch);
+
+  // Same as Write(), but makes room in the memtable of "force" even if
+  // it is not full.
+  Status Write(const WriteOptions& options, WriteBatch* updates,
+               ColumnFamilyData* force);
+
+  Status MakeRoomForWrite(ColumnFamilyData* force /* compact even if there
+                                                     is room? */);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */);
+  // Close the current log and continue in a new one.
+  // REQUIRES: mutex_ is held and this thread is at the front of writers_
+  Status SwitchToNewLog();
+
+  ColumnFamilyData* MemTableToSwitch();
+  void UpdateWriteController();
   WriteBatch* BuildBatchGroup(Writer** last_writer);
 
+  // Return a live column family with an immutable memtable, or NULL.
+  ColumnFamilyData* ImmToFlush() const;
+
+  // Return a live column family that needs a compaction, or NULL.
+  ColumnFamilyData* PickCompactionFamily() const;
+
+  // Compact the files of "cfd" in the named level that overlap
+  // [*begin,*end].
+  void RunManualCompaction(ColumnFamilyData* cfd, int level,
+                           const Slice* begin, const Slice* end);
+
+  // Start options_.prewarm_threads threads that open the tables of the
+  // current version, unless prewarming is disabled.
+  void MaybeStartPrewarm();
+  static void PrewarmWork(void* state);
+
+  // Hand "event" to the thread that delivers events to
+  // options_.listener, starting it if it is not running.
+  struct Event;
+  void QueueEvent(Event* event);
+  static void EventWork(void* db);
+
   void MaybeScheduleCompaction();
   static void BGWork(void* db);
   void BackgroundCall();
@@ -110,9 +244,11 @@ class DBImpl : public DB {
   bool owns_info_log_;
   bool owns_cache_;
   const std::string dbname_;
+  const OpenMode open_mode_;
 
-  // table_cache_ provides its own synchronization
-  TableCache* table_cache_;
+  // The open tables of every column family, which share the budget of
+  // options_.max_open_files
+  Cache* const open_tables_;
 
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
@@ -121,28 +257,55 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
-  MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  port::AtomicPointer has_imm_;  // So bg thread can detect an immutable
+                                 // memtable in any column family
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
 
+  // Logs created since the oldest one still needed, oldest first
+  std::deque<uint64_t> alive_logs_;
+
+  // Column families by id, including the dropped ones, which are kept
+  // until the DB is deleted.  Only changed by the writer at the front
+  // of writers_, since the others apply their updates without mutex_.
+  std::map<uint32_t, ColumnFamilyData*> column_families_;
+  ColumnFamilyData* default_cf_;
+
+  // Ids of the column families whose values carry a timestamp
+  std::set<uint32_t> ttl_column_families_;
+
+  // Number of checkpoints being created, which keep
+  // DeleteObsoleteFiles() from deleting the files they link or copy
+  int file_deletions_disabled_;
+
+  // Column family that was picked for the last compaction
+  uint32_t last_compaction_cf_;
+
+  // For secondary instances: offset from which the next records of
+  // each log that TailLogs() replayed are read
+  std::map<uint64_t, uint64_t> tailed_logs_;
+
   // Queue of writers.
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
   SnapshotList snapshots_;
 
-  // Set of table files to protect from deletion because they are
-  // part of ongoing compactions.
-  std::set<uint64_t> pending_outputs_;
-
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Number of prewarm threads that are still running
+  int prewarm_threads_running_;
+
+  // Events waiting to be delivered to options_.listener, oldest first,
+  // and whether a thread is delivering them
+  std::deque<Event*> pending_events_;
+  bool event_thread_running_;
+
   // Information for a manual compaction
   struct ManualCompaction {
+    ColumnFamilyData* cfd;
     int level;
     bool done;
     const InternalKey* begin;   // NULL means beginning of key range
@@ -151,13 +314,20 @@ class DBImpl : public DB {
   };
   ManualCompaction* manual_compaction_;
 
+  // Descriptor of the default column family, which also holds the
+  // sequence and file numbers of the whole database and the list of its
+  // column families.
   VersionSet* versions_;
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_;
 
-  // Per level compaction stats.  stats_[level] stores the stats for
-  // compactions that produced data for the specified "level".
+  // Delays or stops writes while compactions fall behind
+  WriteController write_controller_;
+
+  // Per level compaction stats of a column family.  stats[level]
+  // stores the stats for compactions that produced data for the
+  // specified "level".
   struct CompactionStats {
     int64_t micros;
     int64_t bytes_read;
@@ -171,7 +341,26 @@ class DBImpl : public DB {
       this->bytes_written += c.bytes_written;
     }
   };
-  CompactionStats stats_[config::kNumLevels];
+  // Work done by DB::Open to bring the database up to date.
+  struct RecoveryStats {
+    int64_t micros;           // Total time spent in DB::Open
+    int64_t manifest_micros;  // Time spent reading the descriptor
+    int64_t log_micros;       // Time spent replaying logs
+    int logs;
+    int64_t log_bytes;
+    int64_t records;
+    int64_t dropped_bytes;    // Log bytes dropped due to corruption
+    int tables;               // Level-0 tables written during replay
+    int64_t table_bytes;
+    int prewarmed_tables;     // Tables opened by the prewarm threads
+    int64_t prewarm_micros;   // Time until the last one was opened
+
+    RecoveryStats()
+        : micros(0), manifest_micros(0), log_micros(0), logs(0),
+          log_bytes(0), records(0), dropped_bytes(0), tables(0),
+          table_bytes(0), prewarmed_tables(0), prewarm_micros(0) { }
+  };
+  RecoveryStats recovery_stats_;
 
   // No copying allowed
   DBImpl(const DBImpl&);
@@ -182,12 +371,14 @@ class DBImpl : public DB {
   }
 };
 
-// Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
+// Sanitize db options.  Unless "create_info_log" is false, a log file
+// is opened in the db directory if src.info_log is NULL.  The caller
+// should delete result.info_log if it is not equal to src.info_log.
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
                                const InternalFilterPolicy* ipolicy,
-                               const Options& src);
+                               const Options& src,
+                               bool create_info_log);
 
 }  // namespace leveldb
 
@@ -6,8 +6,11 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
+#include "db/ttl.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/statistics.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -38,7 +41,8 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), or,
+  //     if merged_, past the entries merged into this->value().
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -47,13 +51,21 @@ class DBIter: public Iterator {
   };
 
   DBIter(const std::string* dbname, Env* env,
-         const Comparator* cmp, Iterator* iter, SequenceNumber s)
+         const Comparator* cmp, Iterator* iter, SequenceNumber s,
+         int ttl, bool hide_expired, const MergeOperator* merge_operator,
+         Statistics* statistics)
       : dbname_(dbname),
         env_(env),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        ttl_(ttl),
+        hide_expired_(ttl > 0 && hide_expired),
+        now_(hide_expired_ ? CurrentTimestamp(env) : 0),
+        merge_operator_(merge_operator),
+        statistics_(statistics),
         direction_(kForward),
+        merged_(false),
         valid_(false) {
   }
   virtual ~DBIter() {
@@ -62,11 +74,14 @@ class DBIter: public Iterator {
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_)
+        ? ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    Slice v = (direction_ == kForward && !merged_)
+        ? iter_->value() : saved_value_;
+    return (ttl_ > 0) ? StripTimestamp(v) : v;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -85,8 +100,19 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Return the type of the entry at iter_, counting hidden expired
+  // values as deletions.
+  ValueType EntryType(const ParsedInternalKey& ikey) const {
+    if (hide_expired_ && ikey.type == kTypeValue &&
+        IsExpired(iter_->value(), ttl_, now_)) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -105,11 +131,17 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const int ttl_;
+  const bool hide_expired_;
+  const uint32_t now_;        // Time values are checked for expiry against
+  const MergeOperator* const merge_operator_;
+  Statistics* const statistics_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
+  bool merged_;               // saved_key_/saved_value_ hold a merged entry
   bool valid_;
 
   // No copying allowed
@@ -144,6 +176,17 @@ void DBIter::Next() {
       saved_key_.clear();
       return;
     }
+  } else if (merged_) {
+    // iter_ is already past the newest entries for this->key(), which
+    // is in saved_key_: skip any older ones that are left.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+    FindNextUserEntry(true, &saved_key_);
+    return;
   }
 
   // Temporarily use saved_key_ as storage for key to skip.
@@ -159,7 +202,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      switch (EntryType(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
@@ -176,6 +219,15 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeValuesNewToOld();
+            return;
+          }
+          break;
       }
     }
     iter_->Next();
@@ -184,16 +236,60 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesNewToOld() {
+  // iter_ is at the newest visible entry for its key, a merge operand.
+  // Collect the operands that follow it down to the value (or deletion)
+  // they apply to, and leave iter_ at that value or past the key.
+  MergeContext merge(merge_operator_);
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  merge.Add(iter_->value());
+  Slice base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    const ValueType type = EntryType(ikey);
+    if (type == kTypeValue) {
+      base = iter_->value();
+      has_base = true;
+      break;
+    } else if (type == kTypeDeletion) {
+      break;
+    }
+    merge.Add(iter_->value());
+  }
+
+  Status s = merge.Apply(saved_key_, has_base ? &base : NULL, &saved_value_);
+  if (s.ok()) {
+    merged_ = true;
+    valid_ = true;
+  } else {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+  }
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past it if merged_.
+    // Scan backwards until the key changes so we can use the normal
+    // reverse scanning code.
+    if (merged_) {
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
-      iter_->Prev();
       if (!iter_->Valid()) {
         valid_ = false;
         saved_key_.clear();
@@ -204,6 +300,7 @@ void DBIter::Prev() {
                                     saved_key_) < 0) {
         break;
       }
+      iter_->Prev();
     }
     direction_ = kReverse;
   }
@@ -224,11 +321,31 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
+        const ValueType type = EntryType(ikey);
+        if (type == kTypeMerge) {
+          // The older entries for the key have been seen already, so
+          // the operand applies to them right away.
+          MergeContext merge(merge_operator_);
+          merge.Add(iter_->value());
+          Slice base(saved_value_);
+          Status s = merge.Apply(ikey.user_key,
+                                 (value_type != kTypeDeletion) ? &base : NULL,
+                                 &saved_value_);
+          if (!s.ok()) {
+            status_ = s;
+            valid_ = false;
+            saved_key_.clear();
+            ClearSavedValue();
+            return;
+          }
+          SaveKey(ikey.user_key, &saved_key_);
+          value_type = kTypeValue;
+        } else if (type == kTypeDeletion) {
+          value_type = type;
           saved_key_.clear();
           ClearSavedValue();
         } else {
+          value_type = type;
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -254,7 +371,9 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  const uint64_t start_micros = (statistics_ != NULL) ? env_->NowMicros() : 0;
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
@@ -265,10 +384,15 @@ void DBIter::Seek(const Slice& target) {
   } else {
     valid_ = false;
   }
+  if (statistics_ != NULL) {
+    statistics_->RecordTick(kSeeks, 1);
+    statistics_->MeasureTime(kSeekMicros, env_->NowMicros() - start_micros);
+  }
 }
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -280,6 +404,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -292,8 +417,13 @@ Iterator* NewDBIterator(
     Env* env,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
-    const SequenceNumber& sequence) {
-  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence);
+    const SequenceNumber& sequence,
+    int ttl,
+    bool hide_expired,
+    const MergeOperator* merge_operator,
+    Statistics* statistics) {
+  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence,
+                    ttl, hide_expired, merge_operator, statistics);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,21 @@ namespace leveldb {
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "ttl" is positive, values are
+// followed by the time they were written, and those that have expired
+// are skipped if "hide_expired" is true.  Merge operands are applied
+// with "merge_operator", which may be NULL if there are none.  Seeks
+// are counted and timed in "statistics" unless it is NULL.
 extern Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
-    const SequenceNumber& sequence);
+    const SequenceNumber& sequence,
+    int ttl,
+    bool hide_expired,
+    const MergeOperator* merge_operator,
+    Statistics* statistics);
 
 }  // namespace leveldb
 
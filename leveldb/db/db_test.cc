@@ -3,14 +3,21 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/db.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -36,6 +43,10 @@ class AtomicCounter {
     MutexLock l(&mu_);
     count_++;
   }
+  void IncrementBy(int n) {
+    MutexLock l(&mu_);
+    count_ += n;
+  }
   int Read() {
     MutexLock l(&mu_);
     return count_;
@@ -62,13 +73,21 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of table files open for reading while count_open_tables_
+  bool count_open_tables_;
+  AtomicCounter open_tables_;
+
   AtomicCounter sleep_counter_;
 
+  // Seconds by which the clock is put forward
+  AtomicCounter clock_skip_seconds_;
+
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_sstable_sync_.Release_Store(NULL);
     no_space_.Release_Store(NULL);
     non_writable_.Release_Store(NULL);
     count_random_reads_ = false;
+    count_open_tables_ = false;
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -131,10 +150,32 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
+    class OpenTableFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+      AtomicCounter* counter_;
+     public:
+      OpenTableFile(RandomAccessFile* target, AtomicCounter* counter)
+          : target_(target), counter_(counter) {
+        counter_->Increment();
+      }
+      virtual ~OpenTableFile() {
+        delete target_;
+        counter_->IncrementBy(-1);
+      }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        return target_->Read(offset, n, result, scratch);
+      }
+    };
+
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
+    if (s.ok() && count_open_tables_ && strstr(f.c_str(), ".sst") != NULL) {
+      *r = new OpenTableFile(*r, &open_tables_);
+    }
     return s;
   }
 
@@ -142,17 +183,30 @@ class SpecialEnv : public EnvWrapper {
     sleep_counter_.Increment();
     target()->SleepForMicroseconds(micros);
   }
+
+  virtual uint64_t NowMicros() {
+    return target()->NowMicros() +
+        static_cast<uint64_t>(clock_skip_seconds_.Read()) * 1000000;
+  }
 };
 
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  const FilterPolicy* blocked_filter_policy_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kFilter,
     kUncompressed,
+    kCacheIndexAndFilter,
+    kPartitionedIndexAndFilter,
+    kFullFilter,
+    kBlockedFullFilter,
+    kParallelRecovery,
+    kRecordTableHandles,
+    kPrefetchBlocks,
     kEnd
   };
   int option_config_;
@@ -167,6 +221,7 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    blocked_filter_policy_ = NewBlockedBloomFilterPolicy(10);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -178,6 +233,7 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete blocked_filter_policy_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -202,6 +258,37 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kCacheIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.pin_l0_filter_and_index_blocks_in_cache = true;
+        break;
+      case kPartitionedIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 128;
+        break;
+      case kFullFilter:
+        options.filter_policy = filter_policy_;
+        options.full_filters = true;
+        break;
+      case kBlockedFullFilter:
+        options.filter_policy = blocked_filter_policy_;
+        options.full_filters = true;
+        break;
+      case kParallelRecovery:
+        options.recovery_threads = 4;
+        break;
+      case kRecordTableHandles:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.record_table_handles = true;
+        options.prewarm_threads = 2;
+        break;
+      case kPrefetchBlocks:
+        options.block_size = 256;
+        options.prefetch_blocks = 4;
+        break;
       default:
         break;
     }
@@ -243,6 +330,23 @@ class DBTest {
     return DB::Open(opts, dbname_, &db_);
   }
 
+  // Reopen the database with the listed column families, storing their
+  // handles in *handles.
+  Status TryReopenWithColumnFamilies(const std::vector<std::string>& names,
+                                     const Options& cf_options,
+                                     std::vector<ColumnFamilyHandle*>* handles) {
+    delete db_;
+    db_ = NULL;
+    Options opts = CurrentOptions();
+    opts.create_if_missing = true;
+    last_options_ = opts;
+    std::vector<ColumnFamilyDescriptor> column_families;
+    for (size_t i = 0; i < names.size(); i++) {
+      column_families.push_back(ColumnFamilyDescriptor(names[i], cf_options));
+    }
+    return DB::Open(opts, dbname_, column_families, handles, &db_);
+  }
+
   Status Put(const std::string& k, const std::string& v) {
     return db_->Put(WriteOptions(), k, v);
   }
@@ -251,6 +355,10 @@ class DBTest {
     return db_->Delete(WriteOptions(), k);
   }
 
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = NULL) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -264,6 +372,29 @@ class DBTest {
     return result;
   }
 
+  std::string Get(ColumnFamilyHandle* cf, const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), cf, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Return the value of "k" in "db", which need not be db_
+  std::string GetFrom(DB* db, const std::string& k) {
+    std::string result;
+    Status s = db->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -320,6 +451,9 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE " + iter->value().ToString();
+              break;
           }
         }
         iter->Next();
@@ -886,6 +1020,88 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, ParallelRecovery) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;  // Keep everything in the log
+  Reopen(&options);
+
+  // Write 4MB, with some values that span several log blocks
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 2000; i++) {
+    values.push_back(RandomString(&rnd, (i % 50 == 0) ? 50000 : 1000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_OK(Delete(Key(7)));
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+
+  // Replay the log with several threads into many level-0 tables
+  options.write_buffer_size = 200000;
+  options.recovery_threads = 4;
+  Reopen(&options);
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_EQ(i == 7 ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.recovery-stats", &stats));
+  ASSERT_TRUE(stats.find("2001 records, 0 bytes dropped") != std::string::npos)
+      << stats;
+  ASSERT_TRUE(stats.find("Level-0 tables: 1 files") == std::string::npos)
+      << stats;
+  ASSERT_TRUE(stats.find("Recovery threads: 4") != std::string::npos)
+      << stats;
+}
+
+TEST(DBTest, PrewarmTables) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options = CurrentOptions();
+  options.filter_policy = policy;
+  options.cache_index_and_filter_blocks = true;
+  options.record_table_handles = true;
+  Reopen(&options);
+
+  // Spread tables over a few levels
+  for (int i = 0; i < 300; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(1000, 'v')));
+    if (i % 100 == 99) {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_OK(Put(Key(1000), "last"));
+  dbfull()->TEST_CompactMemTable();
+
+  options.prewarm_threads = 3;
+  Reopen(&options);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ(Key(i) + std::string(1000, 'v'), Get(Key(i)));
+  }
+  ASSERT_EQ("last", Get(Key(1000)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(2000)));
+
+  // Closing the database waits for the prewarm threads
+  Reopen(&options);
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.recovery-stats", &stats));
+  ASSERT_TRUE(stats.find("Prewarmed tables: ") != std::string::npos)
+      << stats;
+  ASSERT_OK(Put(Key(1001), "more"));
+  ASSERT_EQ("more", Get(Key(1001)));
+
+  // Tables written without handles are opened the usual way
+  options.record_table_handles = false;
+  ASSERT_OK(Put(Key(1002), "plain"));
+  dbfull()->TEST_CompactMemTable();
+  options.prewarm_threads = 0;
+  Reopen(&options);
+  ASSERT_EQ("last", Get(Key(1000)));
+  ASSERT_EQ("plain", Get(Key(1002)));
+
+  Close();
+  delete policy;
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -912,6 +1128,1101 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, DirectIOForCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.use_direct_io_for_compaction = true;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 80; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+
+  // Compact level-0 files, then the concatenated level-1 files
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  ASSERT_GT(NumTableFilesAtLevel(2), 1);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  Reopen(&options);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST(DBTest, RateLimiter) {
+  std::string property;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.rate-limiter", &property));
+
+  RateLimiter* limiter = NewRateLimiter(4 << 20);
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.rate_limiter = limiter;
+  Reopen(&options);
+
+  // Flushes and compactions of 2MB take about half a second
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 20; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  ASSERT_GT(limiter->GetTotalWaitMicros(), 0);
+  ASSERT_TRUE(db_->GetProperty("leveldb.rate-limiter", &property));
+  ASSERT_NE(property.find("Rate: 4.000 MB/sec"), std::string::npos);
+  ASSERT_TRUE(db_->GetProperty("leveldb.pending-compaction-bytes", &property));
+  ASSERT_EQ("0", property);
+
+  Close();
+  delete limiter;
+}
+
+TEST(DBTest, Statistics) {
+  std::string property;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.statistics", &property));
+
+  Statistics* stats = NewStatistics();
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options = CurrentOptions();
+  options.filter_policy = policy;
+  options.statistics = stats;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(2 * i), "v"));
+  }
+  ASSERT_EQ(100, stats->GetTickerCount(kKeysWritten));
+  ASSERT_GT(stats->GetTickerCount(kBytesWritten), 100 * 10);
+  HistogramData data;
+  stats->GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(100, data.count);
+
+  ASSERT_EQ("v", Get(Key(0)));
+  ASSERT_EQ(1, stats->GetTickerCount(kMemtableHit));
+  ASSERT_EQ(1, stats->GetTickerCount(kBytesRead));
+
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(stats->GetTickerCount(kFlushWriteBytes), 0);
+  ASSERT_EQ(1, TotalTableFiles());
+  stats->Reset();
+
+  // Every key in the table passes its filter; every key that is not
+  // is either ruled out by the filter or a false positive, except for
+  // the last one, which is past the end of the table.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ("v", Get(Key(2 * i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(2 * i + 1)));
+  }
+  const uint64_t useful = stats->GetTickerCount(kBloomFilterUseful);
+  const uint64_t false_positive =
+      stats->GetTickerCount(kBloomFilterFalsePositive);
+  ASSERT_EQ(200, stats->GetTickerCount(kMemtableMiss));
+  ASSERT_EQ(200, stats->GetTickerCount(kKeysRead));
+  ASSERT_EQ(99, useful + false_positive);
+  ASSERT_GT(useful, 80);
+  ASSERT_EQ(100 + false_positive,
+            stats->GetTickerCount(kBloomFilterPositive));
+  // Blocks of memory-mapped files are not cached
+  ASSERT_GT(stats->GetTickerCount(kBlockCacheMiss), 0);
+  ASSERT_LE(stats->GetTickerCount(kBlockCacheAdd),
+            stats->GetTickerCount(kBlockCacheMiss));
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(200, data.count);
+  ASSERT_LE(data.median, data.percentile99);
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(Key(10));
+  ASSERT_EQ(Key(10), iter->key().ToString());
+  delete iter;
+  ASSERT_EQ(1, stats->GetTickerCount(kSeeks));
+  stats->GetHistogramData(kSeekMicros, &data);
+  ASSERT_EQ(1, data.count);
+
+  // A second, overlapping table makes the compaction merge them
+  ASSERT_OK(Put(Key(1), "v"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_GT(stats->GetTickerCount(kCompactReadBytes), 0);
+  ASSERT_GT(stats->GetTickerCount(kCompactWriteBytes), 0);
+  stats->GetHistogramData(kCompactionMicros, &data);
+  ASSERT_GE(data.count, 1);
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &property));
+  ASSERT_NE(property.find("keys_read: 200\n"), std::string::npos);
+
+  Close();
+  delete stats;
+  delete policy;
+}
+
+TEST(DBTest, PerfContext) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options = CurrentOptions();
+  options.filter_policy = policy;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(2 * i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, TotalTableFiles());
+  Reopen(&options);  // Close the table
+
+  ASSERT_EQ(kDisable, GetPerfLevel());
+  PerfContext* context = GetPerfContext();
+  context->Reset();
+  SetPerfLevel(kEnableTime);
+  ASSERT_EQ("v", Get(Key(2)));
+  ASSERT_EQ(1, context->get_from_memtable_count);
+  ASSERT_EQ(1, context->files_checked);
+  ASSERT_EQ(1, context->find_table_count);
+  ASSERT_EQ(1, context->table_open_count);
+  ASSERT_EQ(1, context->bloom_filter_checks);
+  ASSERT_EQ(0, context->bloom_filter_useful);
+  ASSERT_GE(context->block_read_count, 1);
+  ASSERT_GT(context->block_read_bytes, 0);
+  ASSERT_GT(context->get_from_output_files_time, 0);
+  ASSERT_GE(context->get_from_output_files_time, context->find_table_time);
+  ASSERT_GT(context->block_read_time, 0);
+  ASSERT_NE(context->ToString().find("files_checked = 1"), std::string::npos);
+
+  // The table is open now, and a key the filter rules out needs no
+  // data block
+  context->Reset();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(2 * i + 1)));
+  }
+  ASSERT_EQ(10, context->files_checked);
+  ASSERT_EQ(0, context->table_open_count);
+  ASSERT_EQ(10, context->bloom_filter_checks);
+  ASSERT_GT(context->bloom_filter_useful, 5);
+
+  // Counting without timing
+  SetPerfLevel(kEnableCount);
+  context->Reset();
+  ASSERT_EQ("v", Get(Key(4)));
+  ASSERT_EQ(1, context->files_checked);
+  ASSERT_EQ(0, context->get_from_output_files_time);
+  ASSERT_EQ(0, context->get_from_memtable_time);
+
+  // Nothing is counted once disabled again
+  SetPerfLevel(kDisable);
+  context->Reset();
+  ASSERT_EQ("v", Get(Key(6)));
+  ASSERT_EQ("", context->ToString());
+  delete policy;
+}
+
+namespace {
+// Records the events it is told about
+class RecordingListener : public EventListener {
+ public:
+  port::Mutex mu;
+  std::vector<FlushJobInfo> flushes;
+  std::vector<CompactionJobInfo> compactions;
+  std::vector<WriteStallInfo> stalls;
+
+  virtual void OnFlushCompleted(DB* db, const FlushJobInfo& info) {
+    MutexLock l(&mu);
+    flushes.push_back(info);
+  }
+  virtual void OnCompactionCompleted(DB* db, const CompactionJobInfo& info) {
+    MutexLock l(&mu);
+    compactions.push_back(info);
+  }
+  virtual void OnStallConditionsChanged(DB* db, const WriteStallInfo& info) {
+    MutexLock l(&mu);
+    stalls.push_back(info);
+  }
+};
+}  // namespace
+
+TEST(DBTest, EventListener) {
+  RecordingListener listener;
+  Options options = CurrentOptions();
+  options.listener = &listener;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Two overlapping tables, pushed down to levels 2 and 1, then merged
+  for (int t = 0; t < 2; t++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'a' + t)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  Close();  // Delivers every pending event
+
+  ASSERT_EQ(2, listener.flushes.size());
+  for (int t = 0; t < 2; t++) {
+    const FlushJobInfo& flush = listener.flushes[t];
+    ASSERT_EQ("default", flush.cf_name);
+    ASSERT_EQ(2 - t, flush.level);
+    ASSERT_GT(flush.file_size, 10000);
+  }
+  ASSERT_LT(listener.flushes[0].file_number, listener.flushes[1].file_number);
+
+  ASSERT_EQ(1, listener.compactions.size());
+  const CompactionJobInfo& compaction = listener.compactions[0];
+  ASSERT_OK(compaction.status);
+  ASSERT_EQ("default", compaction.cf_name);
+  ASSERT_EQ(1, compaction.base_level);
+  ASSERT_EQ(2, compaction.output_level);
+  ASSERT_EQ(2, compaction.input_files.size());
+  ASSERT_EQ(listener.flushes[0].file_number, compaction.input_files[1]);
+  ASSERT_EQ(listener.flushes[1].file_number, compaction.input_files[0]);
+  ASSERT_EQ(1, compaction.output_files.size());
+  ASSERT_GT(compaction.bytes_read, compaction.bytes_written);
+  ASSERT_GT(compaction.bytes_written, 10000);
+  ASSERT_TRUE(listener.stalls.empty());
+
+  // Level-0 tables pile up until writes are delayed
+  options.write_buffer_size = 100000;
+  options.level0_slowdown_writes_trigger = 2;
+  options.level0_stop_writes_trigger = 100;
+  Reopen(&options);
+  Random rnd(301);
+  std::string value = RandomString(&rnd, 10000);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(Put(Key(i % 50), value));
+  }
+  Close();
+  ASSERT_GT(listener.flushes.size(), 2);
+  ASSERT_GE(listener.stalls.size(), 1);
+  WriteStallCondition condition = kWriteStallNormal;
+  for (size_t i = 0; i < listener.stalls.size(); i++) {
+    ASSERT_EQ(condition, listener.stalls[i].previous);
+    ASSERT_NE(condition, listener.stalls[i].current);
+    condition = listener.stalls[i].current;
+  }
+  ASSERT_EQ(kWriteStallDelayed, listener.stalls[0].current);
+}
+
+TEST(DBTest, WriteDelay) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.level0_slowdown_writes_trigger = 4;
+  options.level0_stop_writes_trigger = 5;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::string value = RandomString(&rnd, 10000);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_OK(Put(Key(i % 50), value));
+    ASSERT_LE(NumTableFilesAtLevel(0), 5);
+  }
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-delay", &property));
+  ASSERT_TRUE(property.find("Delayed writes: ") == 0);
+}
+
+static bool IsInvalidArgument(const Status& s) {
+  return strstr(s.ToString().c_str(), "Invalid argument") != NULL;
+}
+
+TEST(DBTest, LevelShapeOptions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.num_levels = 3;
+  options.target_file_size_base = 100000;
+  options.target_file_size_multiplier = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 80; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+
+  // Each table written to level-1 holds about one value
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_GT(NumTableFilesAtLevel(1), 40);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+  std::string property;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.num-files-at-level3", &property));
+
+  // Data below the last level cannot be opened
+  options.num_levels = 2;
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(IsInvalidArgument(s)) << s.ToString();
+
+  options.num_levels = 4;
+  options.level_compaction_dynamic_level_bytes = true;
+  Reopen(&options);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST(DBTest, InvalidLevelShapeOptions) {
+  Options options = CurrentOptions();
+  options.num_levels = config::kNumLevels + 1;
+  ASSERT_TRUE(IsInvalidArgument(TryReopen(&options)));
+
+  options = CurrentOptions();
+  options.num_levels = 1;
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(IsInvalidArgument(s));
+  ASSERT_TRUE(s.ToString().find("between 2 and 7") != std::string::npos)
+      << s.ToString();
+
+  options = CurrentOptions();
+  options.target_file_size_base = 0;
+  ASSERT_TRUE(IsInvalidArgument(TryReopen(&options)));
+
+  options = CurrentOptions();
+  options.max_bytes_for_level_multiplier = 1;
+  ASSERT_TRUE(IsInvalidArgument(TryReopen(&options)));
+}
+
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.compaction_style = kCompactionStyleUniversal;
+  options.level0_file_num_compaction_trigger = 3;
+  Reopen(&options);
+
+  // Runs are merged out of order of their file numbers, so reads must
+  // still find the newest value of each key.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 3000; i++) {
+    const std::string key = Key(rnd.Uniform(200));
+    if (rnd.OneIn(5)) {
+      ASSERT_OK(Delete(key));
+      model.erase(key);
+    } else {
+      const std::string value = RandomString(&rnd, 1000);
+      ASSERT_OK(Put(key, value));
+      model[key] = value;
+    }
+    if (i % 500 == 499) {
+      for (int k = 0; k < 200; k++) {
+        std::map<std::string, std::string>::iterator it = model.find(Key(k));
+        ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(k)));
+      }
+    }
+  }
+  ASSERT_LE(NumTableFilesAtLevel(0), options.level0_stop_writes_trigger);
+  for (int level = 1; level < config::kNumLevels; level++) {
+    ASSERT_EQ(NumTableFilesAtLevel(level), 0);
+  }
+
+  // Merging every run leaves a single one
+  Reopen(&options);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 1);
+  for (int k = 0; k < 200; k++) {
+    std::map<std::string, std::string>::iterator it = model.find(Key(k));
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(k)));
+  }
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-amplification", &property));
+  ASSERT_TRUE(property.find("Flushed: ") == 0);
+}
+
+TEST(DBTest, UniversalCompactionSkipsNewestRun) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleUniversal;
+  options.level0_file_num_compaction_trigger = 100;
+  Reopen(&options);
+
+  // Two large runs of the same size, then a small newer one
+  Random rnd(301);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(Key(0), "newest"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(NumTableFilesAtLevel(0), 3);
+
+  // The large runs are merged into a file numbered after the small run
+  options.level0_file_num_compaction_trigger = 3;
+  Reopen(&options);
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 2; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 2);
+  ASSERT_EQ("newest", Get(Key(0)));
+  Reopen(&options);
+  ASSERT_EQ("newest", Get(Key(0)));
+}
+
+TEST(DBTest, TTL) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.ttl = 100;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("(a->va)(b->vb)", Contents());
+
+  // Expired entries are still returned until they are compacted away
+  env_->clock_skip_seconds_.IncrementBy(150);
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("(a->va)(b->vb)(c->vc)", Contents());
+
+  // ...unless they are hidden
+  options.hide_expired_keys = true;
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ("(c->vc)", Contents());
+
+  db_->CompactRange(NULL, NULL);
+  options.hide_expired_keys = false;
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("(c->vc)", Contents());
+}
+
+TEST(DBTest, TTLMustMatch) {
+  Options options = CurrentOptions();
+  ASSERT_OK(Put("a", "value"));
+  options.ttl = 100;
+  ASSERT_TRUE(IsInvalidArgument(TryReopen(&options)));
+  options.ttl = 0;
+  Reopen(&options);
+  ASSERT_EQ("value", Get("a"));
+
+  options.ttl = 100;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put("a", "value"));
+  options.ttl = 0;
+  ASSERT_TRUE(IsInvalidArgument(TryReopen(&options)));
+
+  // The flag survives a new descriptor and applies to each column family
+  options.ttl = 100;
+  Reopen(&options);
+  ColumnFamilyHandle* plain;
+  Options plain_options = CurrentOptions();
+  ASSERT_OK(db_->CreateColumnFamily(plain_options, "plain", &plain));
+  ASSERT_OK(db_->Put(WriteOptions(), plain, "b", "value"));
+  std::vector<ColumnFamilyDescriptor> families;
+  families.push_back(ColumnFamilyDescriptor("plain", options));
+  std::vector<ColumnFamilyHandle*> handles;
+  Close();
+  ASSERT_TRUE(IsInvalidArgument(
+      DB::Open(options, dbname_, families, &handles, &db_)));
+  families[0].options = plain_options;
+  ASSERT_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ASSERT_EQ("value", Get(handles[0], "b"));
+  ASSERT_EQ("value", Get("a"));
+}
+
+namespace {
+// Removes the values "stale" and changes the values "old" to "new"
+class StaleCompactionFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "StaleCompactionFilter"; }
+  virtual bool Filter(int level, const Slice& key, const Slice& value,
+                      std::string* new_value, bool* value_changed) const {
+    if (value == "old") {
+      new_value->assign("new");
+      *value_changed = true;
+    }
+    return value == "stale";
+  }
+};
+}
+
+TEST(DBTest, CompactionFilter) {
+  StaleCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "stale"));
+  ASSERT_OK(Put("b", "old"));
+  ASSERT_OK(Put("c", "kept"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("d", "stale"));
+  ASSERT_OK(Put("e", "old"));
+
+  // Entries that the snapshot reads are left alone.  Manual compactions
+  // rewrite every file, even the ones a trivial move would do for.
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level <= config::kMaxMemCompactLevel; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("(a->stale)(b->old)(c->kept)(e->new)", Contents());
+  ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  std::string value;
+  ASSERT_OK(db_->Get(read_options, "a", &value));
+  ASSERT_EQ("stale", value);
+
+  db_->ReleaseSnapshot(snapshot);
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("(b->new)(c->kept)(e->new)", Contents());
+
+  // The filter sees values without the time they were written
+  options.ttl = 1000;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put("a", "stale"));
+  ASSERT_OK(Put("b", "old"));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("(b->new)", Contents());
+}
+
+TEST(DBTest, PrefixCompactionFilter) {
+  const CompactionFilter* filter = NewPrefixCompactionFilter("tmp:");
+  Options options = CurrentOptions();
+  options.compaction_filter = filter;
+  Reopen(&options);
+
+  ASSERT_OK(Put("tmp", "v1"));
+  ASSERT_OK(Put("tmp:1", "v2"));
+  ASSERT_OK(Put("tmp:2", "v3"));
+  ASSERT_OK(Put("u", "v4"));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("(tmp->v1)(u->v4)", Contents());
+
+  delete db_;
+  db_ = NULL;
+  delete filter;
+}
+
+TEST(DBTest, FIFOCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_max_table_files_size = 500000;
+  Reopen(&options);
+
+  // The oldest tables are deleted to stay within the size limit
+  Random rnd(301);
+  for (int t = 0; t < 10; t++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(t * 100 + i), RandomString(&rnd, 1000)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 5; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_LE(NumTableFilesAtLevel(0), 5);
+  ASSERT_GE(NumTableFilesAtLevel(0), 4);
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_NE("NOT_FOUND", Get(Key(999)));
+  for (int level = 1; level < config::kNumLevels; level++) {
+    ASSERT_EQ(NumTableFilesAtLevel(level), 0);
+  }
+
+  // ...and tables are deleted once their entries have expired
+  options.ttl = 100;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int t = 0; t < 2; t++) {
+    ASSERT_OK(Put(Key(t), "old"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 2);
+  env_->clock_skip_seconds_.IncrementBy(150);
+  ASSERT_OK(Put(Key(2), "new"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 1; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 1);
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("new", Get(Key(2)));
+}
+
+TEST(DBTest, Merge) {
+  const MergeOperator* op = NewStringAppendOperator(",");
+  Options options = CurrentOptions();
+  options.merge_operator = op;
+  Reopen(&options);
+
+  ASSERT_OK(Merge("a", "1"));
+  ASSERT_OK(Put("b", "x"));
+  ASSERT_OK(Merge("b", "y"));
+  ASSERT_OK(Put("c", "old"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(Merge("c", "z"));
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_EQ("x,y", Get("b"));
+  ASSERT_EQ("z", Get("c"));
+  ASSERT_EQ("(a->1)(b->x,y)(c->z)", Contents());
+
+  // Operands in the memtable apply to values in tables
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Merge("a", "2"));
+  ASSERT_OK(Merge("b", "w"));
+  ASSERT_EQ("1,2", Get("a"));
+  ASSERT_EQ("x,y,w", Get("b"));
+  ASSERT_EQ("(a->1,2)(b->x,y,w)(c->z)", Contents());
+
+  // Switch directions on a merged entry
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->x,y,w");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->1,2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,w");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->z");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,w");
+  iter->SeekToFirst();
+  iter->Next();
+  iter->Next();
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  iter->SeekToLast();
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,w");
+  delete iter;
+
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Merge("a", "3"));
+  ASSERT_EQ("1,2", Get("a", snapshot));
+  ASSERT_EQ("1,2,3", Get("a"));
+  db_->ReleaseSnapshot(snapshot);
+
+  delete db_;
+  db_ = NULL;
+  delete op;
+}
+
+TEST(DBTest, MergeCompaction) {
+  const MergeOperator* op = NewStringAppendOperator(",");
+  Options options = CurrentOptions();
+  options.merge_operator = op;
+  Reopen(&options);
+
+  // Operands are collapsed into the value they apply to, or into a
+  // value of their own if the key has no older entries
+  ASSERT_OK(Put("a", "x"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Merge("a", "1"));
+  ASSERT_OK(Merge("b", "1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Merge("a", "2"));
+  ASSERT_OK(Merge("b", "2"));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("[ x,1,2 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ 1,2 ]", AllEntriesFor("b"));
+
+  // Operands a snapshot can see on their own are kept apart
+  ASSERT_OK(Merge("c", "1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Merge("c", "2"));
+  ASSERT_OK(Merge("c", "3"));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("[ MERGE 2,3, 1 ]", AllEntriesFor("c"));
+  ASSERT_EQ("1", Get("c", snapshot));
+  ASSERT_EQ("1,2,3", Get("c"));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(Merge("c", "4"));
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, NULL, NULL);
+  }
+  ASSERT_EQ("[ 1,2,3,4 ]", AllEntriesFor("c"));
+
+  delete db_;
+  db_ = NULL;
+  delete op;
+}
+
+TEST(DBTest, MergeUInt64Add) {
+  const MergeOperator* op = NewUInt64AddOperator();
+  Options options = CurrentOptions();
+  options.merge_operator = op;
+  Reopen(&options);
+
+  std::string one, two;
+  PutFixed64(&one, 1);
+  PutFixed64(&two, 2);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Merge("counter", (i % 2 == 0) ? one : two));
+    if (i == 4) {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+  std::string value = Get("counter");
+  ASSERT_EQ(8, value.size());
+  ASSERT_EQ(15, DecodeFixed64(value.data()));
+
+  Reopen(&options);
+  value = Get("counter");
+  ASSERT_EQ(8, value.size());
+  ASSERT_EQ(15, DecodeFixed64(value.data()));
+
+  delete db_;
+  db_ = NULL;
+  delete op;
+}
+
+TEST(DBTest, MergeWithoutOperator) {
+  ASSERT_TRUE(!Merge("a", "1").ok());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+TEST(DBTest, ColumnFamilies) {
+  const MergeOperator* op = NewStringAppendOperator(",");
+  Options cf_options = CurrentOptions();
+  cf_options.merge_operator = op;
+  cf_options.write_buffer_size = 100000;
+  ColumnFamilyHandle* users;
+  ASSERT_OK(db_->CreateColumnFamily(cf_options, "users", &users));
+  ASSERT_EQ("users", users->GetName());
+  ASSERT_TRUE(users->GetID() != 0);
+  ColumnFamilyHandle* dup;
+  ASSERT_TRUE(!db_->CreateColumnFamily(cf_options, "users", &dup).ok());
+
+  // Same keys, separate data and options
+  ASSERT_OK(Put("a", "default"));
+  ASSERT_OK(db_->Put(WriteOptions(), users, "a", "user"));
+  ASSERT_OK(db_->Merge(WriteOptions(), users, "a", "merged"));
+  ASSERT_TRUE(!Merge("a", "1").ok());
+  ASSERT_EQ("default", Get("a"));
+  ASSERT_EQ("user,merged", Get(users, "a"));
+
+  // A batch updates several column families at once
+  WriteBatch batch;
+  batch.Put("b", "v1");
+  batch.Put(users, "b", "v2");
+  batch.Delete(users, "a");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("(a->default)(b->v1)", Contents());
+  ASSERT_EQ("NOT_FOUND", Get(users, "a"));
+  Iterator* iter = db_->NewIterator(ReadOptions(), users);
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "b->v2");
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  // Each column family is flushed and compacted on its own
+  db_->CompactRange(users, NULL, NULL);
+  std::string files;
+  ASSERT_TRUE(db_->GetProperty(users, "leveldb.num-files-at-level0", &files));
+  ASSERT_EQ("0", files);
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("v2", Get(users, "b"));
+  ASSERT_OK(db_->Put(WriteOptions(), users, "c", "v3"));
+
+  // Every column family has to be listed when the database is opened
+  std::vector<std::string> names;
+  std::vector<ColumnFamilyHandle*> handles;
+  ASSERT_TRUE(!TryReopenWithColumnFamilies(names, cf_options, &handles).ok());
+  names.push_back("users");
+  names.push_back("new");
+  ASSERT_OK(TryReopenWithColumnFamilies(names, cf_options, &handles));
+  ASSERT_EQ(2, handles.size());
+  users = handles[0];
+  ASSERT_EQ("default", Get("a"));
+  ASSERT_EQ("v1", Get("b"));
+  ASSERT_EQ("v2", Get(users, "b"));
+  ASSERT_EQ("v3", Get(users, "c"));
+  ASSERT_EQ("NOT_FOUND", Get(handles[1], "b"));
+
+  // Dropping a column family removes its data
+  ASSERT_TRUE(!db_->DropColumnFamily(db_->DefaultColumnFamily()).ok());
+  ASSERT_OK(db_->DropColumnFamily(users));
+  ASSERT_TRUE(IsInvalidArgument(db_->Put(WriteOptions(), users, "d", "v4")));
+  ASSERT_TRUE(!db_->DropColumnFamily(users).ok());
+
+  // A batch that names a dropped or unknown column family fails as a
+  // whole
+  WriteBatch bad;
+  bad.Put("e", "v5");
+  WriteBatchInternal::Put(&bad, 99, "e", "v5");
+  ASSERT_TRUE(IsInvalidArgument(db_->Write(WriteOptions(), &bad)));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  ASSERT_TRUE(!env_->FileExists(ColumnFamilyDirName(dbname_,
+                                                    users->GetID())));
+  ASSERT_EQ("v1", Get("b"));
+  names.erase(names.begin());
+  ASSERT_OK(TryReopenWithColumnFamilies(names, cf_options, &handles));
+  ASSERT_EQ("v1", Get("b"));
+  ASSERT_OK(db_->CreateColumnFamily(cf_options, "users", &users));
+  ASSERT_EQ("NOT_FOUND", Get(users, "b"));
+
+  delete db_;
+  db_ = NULL;
+  delete op;
+}
+
+TEST(DBTest, ColumnFamiliesShareOpenFiles) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.max_open_files = 20;  // Ten for tables
+  options.create_if_missing = true;
+  env_->count_open_tables_ = true;
+  DestroyAndReopen(&options);
+  std::vector<ColumnFamilyHandle*> families;
+  families.push_back(db_->DefaultColumnFamily());
+  for (int i = 0; i < 3; i++) {
+    ColumnFamilyHandle* handle;
+    ASSERT_OK(db_->CreateColumnFamily(options, "cf" + NumberToString(i),
+                                      &handle));
+    families.push_back(handle);
+  }
+
+  // Ten tables with disjoint keys in each column family
+  for (int t = 0; t < 10; t++) {
+    const std::string key = Key(t);
+    for (size_t f = 0; f < families.size(); f++) {
+      ASSERT_OK(db_->Put(WriteOptions(), families[f], key, "v"));
+      Slice k(key);
+      db_->CompactRange(families[f], &k, &k);
+    }
+  }
+  int tables = 0;
+  for (size_t f = 0; f < families.size(); f++) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::string property;
+      ASSERT_TRUE(db_->GetProperty(
+          families[f], "leveldb.num-files-at-level" + NumberToString(level),
+          &property));
+      tables += atoi(property.c_str());
+    }
+  }
+  ASSERT_EQ(40, tables);
+
+  // Reading all of them keeps no more tables open than a single cache
+  // holds: its ten entries are rounded up to one in each of 16 shards
+  for (int round = 0; round < 2; round++) {
+    for (int t = 0; t < 10; t++) {
+      for (size_t f = 0; f < families.size(); f++) {
+        ASSERT_EQ("v", Get(families[f], Key(t)));
+        ASSERT_LE(env_->open_tables_.Read(), 16);
+      }
+    }
+  }
+  Close();
+  ASSERT_EQ(0, env_->open_tables_.Read());
+  env_->count_open_tables_ = false;
+}
+
+TEST(DBTest, ColumnFamilyKeepsLogs) {
+  Options cf_options = CurrentOptions();
+  ColumnFamilyHandle* cold;
+  ASSERT_OK(db_->CreateColumnFamily(cf_options, "cold", &cold));
+  ASSERT_OK(db_->Put(WriteOptions(), cold, "key", "value"));
+
+  // The log that holds the update of "cold" outlives the memtables of
+  // the default column family
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;
+  std::vector<std::string> names;
+  names.push_back("cold");
+  std::vector<ColumnFamilyHandle*> handles;
+  delete db_;
+  db_ = NULL;
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.push_back(ColumnFamilyDescriptor("cold", cf_options));
+  ASSERT_OK(DB::Open(options, dbname_, column_families, &handles, &db_));
+  ASSERT_OK(db_->Put(WriteOptions(), handles[0], "key2", "value2"));
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'x')));
+  }
+  ASSERT_GT(TotalTableFiles(), 0);
+  ASSERT_OK(TryReopenWithColumnFamilies(names, cf_options, &handles));
+  ASSERT_EQ("value", Get(handles[0], "key"));
+  ASSERT_EQ("value2", Get(handles[0], "key2"));
+  ASSERT_EQ(std::string(1000, 'x'), Get(Key(199)));
+}
+
+TEST(DBTest, Checkpoint) {
+  Options cf_options = CurrentOptions();
+  ColumnFamilyHandle* users;
+  ASSERT_OK(db_->CreateColumnFamily(cf_options, "users", &users));
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(db_->Put(WriteOptions(), users, "a", "u1"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(users, NULL, NULL);
+  ASSERT_OK(Put("bar", "v2"));  // Only in the log
+  ASSERT_OK(db_->Put(WriteOptions(), users, "b", "u2"));
+
+  const std::string dir = dbname_ + "_checkpoint";
+  DestroyDB(dir, Options());
+  ASSERT_OK(db_->CreateCheckpoint(dir));
+  ASSERT_TRUE(!db_->CreateCheckpoint(dir).ok());
+
+  // Later changes, and the compactions that delete the tables the
+  // checkpoint links to, leave the checkpoint alone
+  ASSERT_OK(Put("foo", "v3"));
+  ASSERT_OK(Delete("bar"));
+  ASSERT_OK(db_->DropColumnFamily(users));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("(foo->v3)", Contents());
+
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.push_back(ColumnFamilyDescriptor("users", cf_options));
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* checkpoint;
+  ASSERT_OK(DB::Open(CurrentOptions(), dir, column_families, &handles,
+                     &checkpoint));
+  std::string value;
+  ASSERT_OK(checkpoint->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_OK(checkpoint->Get(ReadOptions(), "bar", &value));
+  ASSERT_EQ("v2", value);
+  ASSERT_OK(checkpoint->Get(ReadOptions(), handles[0], "a", &value));
+  ASSERT_EQ("u1", value);
+  ASSERT_OK(checkpoint->Get(ReadOptions(), handles[0], "b", &value));
+  ASSERT_EQ("u2", value);
+  delete checkpoint;
+  ASSERT_OK(DestroyDB(dir, Options()));
+}
+
+TEST(DBTest, ReadOnly) {
+  do {
+    ASSERT_OK(Put("foo", "v1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("bar", "v2"));  // Only in the log
+    std::vector<std::string> files;
+    ASSERT_OK(env_->GetChildren(dbname_, &files));
+
+    // Any number of readers can open the DB next to the writer
+    DB* reader1;
+    DB* reader2;
+    ASSERT_OK(DB::OpenForReadOnly(CurrentOptions(), dbname_, &reader1));
+    ASSERT_OK(DB::OpenForReadOnly(CurrentOptions(), dbname_, &reader2));
+    ASSERT_EQ("v1", GetFrom(reader1, "foo"));
+    ASSERT_EQ("v2", GetFrom(reader2, "bar"));
+
+    ASSERT_TRUE(reader1->Put(WriteOptions(), "foo", "v3").IsNotSupported());
+    ASSERT_TRUE(reader1->Delete(WriteOptions(), "foo").IsNotSupported());
+    ASSERT_TRUE(reader1->CreateCheckpoint(dbname_ + "_checkpoint")
+                .IsNotSupported());
+    ASSERT_TRUE(reader1->TryCatchUpWithPrimary().IsNotSupported());
+    reader1->CompactRange(NULL, NULL);
+    ASSERT_EQ("v1", GetFrom(reader1, "foo"));
+
+    // Later writes are not seen
+    ASSERT_OK(Put("foo", "v4"));
+    ASSERT_EQ("v1", GetFrom(reader1, "foo"));
+    delete reader1;
+    delete reader2;
+
+    // Nothing was written to the directory
+    std::vector<std::string> after;
+    ASSERT_OK(env_->GetChildren(dbname_, &after));
+    ASSERT_EQ(files.size(), after.size());
+
+    DB* db;
+    ASSERT_TRUE(!DB::OpenForReadOnly(CurrentOptions(), dbname_ + "_missing",
+                                     &db).ok());
+    ASSERT_TRUE(!env_->FileExists(dbname_ + "_missing"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, Secondary) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+  ColumnFamilyHandle* users;
+  ASSERT_OK(db_->CreateColumnFamily(options, "users", &users));
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(db_->Put(WriteOptions(), users, "a", "u1"));
+
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.push_back(ColumnFamilyDescriptor("users", options));
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* secondary;
+  ASSERT_OK(DB::OpenAsSecondary(options, dbname_, column_families, &handles,
+                                &secondary));
+  ASSERT_EQ("v1", GetFrom(secondary, "foo"));
+  ASSERT_TRUE(secondary->Put(WriteOptions(), "foo", "v").IsNotSupported());
+
+  // The writes of the primary are seen after a catch-up
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(Put("bar", "v3"));
+  ASSERT_EQ("v1", GetFrom(secondary, "foo"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v2", GetFrom(secondary, "foo"));
+  ASSERT_EQ("v3", GetFrom(secondary, "bar"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());  // Nothing new
+  ASSERT_EQ("v2", GetFrom(secondary, "foo"));
+
+  // Including the ones that were written to tables and compacted since
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 10000)));
+  }
+  ASSERT_OK(Delete("bar"));
+  ASSERT_OK(db_->Put(WriteOptions(), users, "a", "u2"));
+  db_->CompactRange(NULL, NULL);
+  db_->CompactRange(users, NULL, NULL);
+  ASSERT_OK(Put("foo", "v4"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v4", GetFrom(secondary, "foo"));
+  ASSERT_EQ("NOT_FOUND", GetFrom(secondary, "bar"));
+  ASSERT_EQ(Get(Key(50)), GetFrom(secondary, Key(50)));
+  std::string value;
+  ASSERT_OK(secondary->Get(ReadOptions(), handles[0], "a", &value));
+  ASSERT_EQ("u2", value);
+
+  // And a new descriptor, once the primary reopens
+  std::vector<std::string> names;
+  names.push_back("users");
+  std::vector<ColumnFamilyHandle*> primary_handles;
+  ASSERT_OK(TryReopenWithColumnFamilies(names, options, &primary_handles));
+  ASSERT_OK(Put("foo", "v5"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v5", GetFrom(secondary, "foo"));
+  ASSERT_EQ(Get(Key(50)), GetFrom(secondary, Key(50)));
+  ASSERT_OK(secondary->Get(ReadOptions(), handles[0], "a", &value));
+  ASSERT_EQ("u2", value);
+  delete secondary;
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -919,8 +2230,9 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles =
+      config::kNumLevels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1696,6 +3008,9 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void Merge(const Slice& key, const Slice& value) {
+        // The model is only run without a merge operator
+      }
     };
     Handler handler;
     handler.map_ = &map_;
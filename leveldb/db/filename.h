@@ -24,7 +24,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kColumnFamilyDir
 };
 
 // Return the name of the log file with the specified number
@@ -56,6 +57,12 @@ extern std::string LockFileName(const std::string& dbname);
 // The result will be prefixed with "dbname".
 extern std::string TempFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the directory holding the files of the column
+// family with the specified id in the db named by "dbname".  The
+// result will be prefixed with "dbname".
+extern std::string ColumnFamilyDirName(const std::string& dbname,
+                                       uint32_t id);
+
 // Return the name of the info log file for "dbname".
 extern std::string InfoLogFileName(const std::string& dbname);
 
@@ -73,6 +73,11 @@ class Reader {
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  // True while skipping the tail of a fragmented record that began
+  // before initial_offset_.  Its middle and last fragments are not
+  // corruption and are dropped without being reported.
+  bool resyncing_;
+
   // Extend record types with the following special values
   enum {
     kEof = kMaxRecordType + 1,
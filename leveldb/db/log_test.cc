@@ -189,6 +189,14 @@ class LogTest {
     }
   }
 
+  // Returns a reader that starts at "initial_offset" of what was
+  // written.  The caller should delete it when done.
+  Reader* NewReaderAt(uint64_t initial_offset) {
+    reading_ = true;
+    source_.contents_ = Slice(dest_.contents_);
+    return new Reader(&source_, &report_, true/*checksum*/, initial_offset);
+  }
+
   void CheckOffsetPastEndReturnsNoRecords(uint64_t offset_past_end) {
     WriteInitialOffsetLog();
     reading_ = true;
@@ -438,6 +446,24 @@ TEST(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2*kBlockSize);
 }
 
+TEST(LogTest, SkipIntoMultiRecord) {
+  // Consider a fragmented record:
+  //    first(R1) middle(R1) last(R1) first(R2)
+  // A reader that starts after first(R1) must skip the remaining
+  // fragments of R1 without reporting them as missing their start.
+  Write(BigString("foo", 3*kBlockSize));
+  Write("correct");
+  Reader* offset_reader = NewReaderAt(kBlockSize);
+  Slice record;
+  std::string scratch;
+  ASSERT_TRUE(offset_reader->ReadRecord(&record, &scratch));
+  ASSERT_EQ("correct", record.ToString());
+  ASSERT_TRUE(!offset_reader->ReadRecord(&record, &scratch));
+  ASSERT_EQ("", ReportMessage());
+  ASSERT_EQ(0, DroppedBytes());
+  delete offset_reader;
+}
+
 TEST(LogTest, ReadStart) {
   CheckInitialOffsetRecord(0, 0);
 }
@@ -4,6 +4,7 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -21,6 +22,7 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
+      empty_(true),
       table_(comparator_, &arena_) {
 }
 
@@ -103,13 +105,14 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
   table_.Insert(buf);
+  empty_ = false;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -124,19 +127,31 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue:
+        if (merge->empty()) {
           value->assign(v.data(), v.size());
-          return true;
+        } else {
+          *s = merge->Apply(key.user_key(), &v, value);
         }
-        case kTypeDeletion:
+        return true;
+      case kTypeDeletion:
+        if (merge->empty()) {
           *s = Status::NotFound(Slice());
-          return true;
-      }
+        } else {
+          *s = merge->Apply(key.user_key(), NULL, value);
+        }
+        return true;
+      case kTypeMerge:
+        // Keep looking for the value the operand applies to
+        merge->Add(v);
+        break;
     }
   }
   return false;
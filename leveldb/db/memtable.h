@@ -14,6 +14,7 @@
 namespace leveldb {
 
 class InternalKeyComparator;
+class MergeContext;
 class Mutex;
 class MemTableIterator;
 
@@ -42,6 +43,9 @@ class MemTable {
   // operations on the same MemTable.
   size_t ApproximateMemoryUsage();
 
+  // Return true iff no entry has been added to the memtable.
+  bool Empty() const { return empty_; }
+
   // Return an iterator that yields the contents of the memtable.
   //
   // The caller must ensure that the underlying MemTable remains live
@@ -61,7 +65,10 @@ class MemTable {
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // The merge operands found for key before its value or deletion are
+  // added to *merge, and applied to the value or deletion if found.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
@@ -78,6 +85,7 @@ class MemTable {
 
   KeyComparator comparator_;
   int refs_;
+  bool empty_;
   Arena arena_;
   Table table_;
 
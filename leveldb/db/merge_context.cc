@@ -0,0 +1,56 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_context.h"
+
+#include <assert.h>
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+// Apply the n oldest operands to *result, which holds a value if
+// has_value.
+Status MergeContext::Fold(const Slice& user_key, size_t n,
+                          std::string* result, bool has_value) const {
+  if (n > 0 && op_ == NULL) {
+    return Status::InvalidArgument("merge operand found without a merge "
+                                   "operator for ", user_key);
+  }
+  std::string merged;
+  for (size_t i = n; i > 0; i--) {
+    Slice existing(*result);
+    if (!op_->Merge(user_key, has_value ? &existing : NULL, operands_[i - 1],
+                    &merged)) {
+      return Status::Corruption("bad merge operand for ", user_key);
+    }
+    result->swap(merged);
+    has_value = true;
+  }
+  return Status::OK();
+}
+
+Status MergeContext::Apply(const Slice& user_key, const Slice* base,
+                           std::string* value) const {
+  std::string result;
+  if (base != NULL) {
+    result.assign(base->data(), base->size());
+  }
+  Status s = Fold(user_key, operands_.size(), &result, base != NULL);
+  if (s.ok()) {
+    value->swap(result);
+  }
+  return s;
+}
+
+Status MergeContext::Combine(const Slice& user_key, std::string* value) const {
+  assert(!empty());
+  std::string result = operands_.back();
+  Status s = Fold(user_key, operands_.size() - 1, &result, true);
+  if (s.ok()) {
+    value->swap(result);
+  }
+  return s;
+}
+
+}  // namespace leveldb
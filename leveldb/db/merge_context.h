@@ -0,0 +1,51 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+#define STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// The operands of the kTypeMerge entries found for a key, collected
+// from the newest entry to the oldest one.
+class MergeContext {
+ public:
+  // "op" may be NULL, in which case operands cannot be applied.
+  explicit MergeContext(const MergeOperator* op) : op_(op) { }
+
+  bool empty() const { return operands_.empty(); }
+
+  // Add an operand older than the ones added so far.
+  void Add(const Slice& operand) {
+    operands_.push_back(operand.ToString());
+  }
+
+  // Store in *value the result of applying the operands, oldest first,
+  // to "*base", or to nothing if base is NULL.  "*base" may be part of
+  // *value.
+  Status Apply(const Slice& user_key, const Slice* base,
+               std::string* value) const;
+
+  // Store in *value the operand that has the effect of all the
+  // operands.  REQUIRES: !empty()
+  Status Combine(const Slice& user_key, std::string* value) const;
+
+ private:
+  Status Fold(const Slice& user_key, size_t n, std::string* result,
+              bool has_value) const;
+
+  const MergeOperator* op_;
+  std::vector<std::string> operands_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
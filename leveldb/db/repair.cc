@@ -49,7 +49,7 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options, true)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -265,7 +265,7 @@ class Repairer {
     Status status = env_->GetFileSize(fname, &t->meta.file_size);
     if (status.ok()) {
       Iterator* iter = table_cache_->NewIterator(
-          ReadOptions(), t->meta.number, t->meta.file_size);
+          ReadOptions(), t->meta.number, t->meta.file_size, Slice(), -1);
       bool empty = true;
       ParsedInternalKey parsed;
       t->max_sequence = 0;
@@ -316,6 +316,9 @@ class Repairer {
     }
 
     edit_.SetComparatorName(icmp_.user_comparator()->Name());
+    if (options_.ttl > 0) {
+      edit_.SetTimestampedValues();
+    }
     edit_.SetLogNumber(0);
     edit_.SetNextFile(next_file_number_);
     edit_.SetLastSequence(max_sequence);
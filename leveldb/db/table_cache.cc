@@ -8,6 +8,7 @@
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -23,6 +24,11 @@ static void DeleteEntry(const Slice& key, void* value) {
   delete tf;
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<Table*>(arg1);
+  delete reinterpret_cast<RandomAccessFile*>(arg2);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
@@ -35,27 +41,67 @@ TableCache::TableCache(const std::string& dbname,
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      owns_cache_(true),
+      id_(0) {
+}
+
+TableCache::TableCache(const std::string& dbname,
+                       const Options* options,
+                       Cache* tables,
+                       uint32_t id)
+    : env_(options->env),
+      dbname_(dbname),
+      options_(options),
+      cache_(tables),
+      owns_cache_(false),
+      id_(id) {
 }
 
 TableCache::~TableCache() {
-  delete cache_;
+  if (owns_cache_) {
+    delete cache_;
+  }
+}
+
+// Tables are cached under the id of their TableCache followed by their
+// file number.
+static const size_t kCacheKeySize = 4 + 8;
+
+Slice TableCache::CacheKey(uint64_t file_number, char* buf) const {
+  EncodeFixed32(buf, id_);
+  EncodeFixed64(buf + 4, file_number);
+  return Slice(buf, kCacheKeySize);
 }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             const Slice& handles, int level,
                              Cache::Handle** handle) {
+  PerfTimer timer(&perf_context.find_table_time);
+  PERF_COUNTER_ADD(find_table_count, 1);
   Status s;
-  char buf[sizeof(file_number)];
-  EncodeFixed64(buf, file_number);
-  Slice key(buf, sizeof(buf));
+  char buf[kCacheKeySize];
+  Slice key = CacheKey(file_number, buf);
   *handle = cache_->Lookup(key);
   if (*handle == NULL) {
+    PERF_COUNTER_ADD(table_open_count, 1);
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    s = env_->NewRandomAccessFile(fname, &file);
+    if (options_->allow_mmap_reads) {
+      s = env_->NewMmapRandomAccessFile(fname, &file);
+    } else {
+      s = env_->NewRandomAccessFile(fname, &file);
+    }
     if (s.ok()) {
-      s = Table::Open(*options_, file, file_size, &table);
+      // Only level-0 tables, which every read consults, get their index
+      // and filter blocks pinned.  A table keeps its pin if it is later
+      // moved to a deeper level, until it drops out of this cache.
+      Options table_options = *options_;
+      if (level != 0) {
+        table_options.pin_l0_filter_and_index_blocks_in_cache = false;
+      }
+      s = Table::Open(table_options, file, file_size, handles, &table);
     }
 
     if (!s.ok()) {
@@ -76,13 +122,15 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
+                                  const Slice& handles,
+                                  int level,
                                   Table** tableptr) {
   if (tableptr != NULL) {
     *tableptr = NULL;
   }
 
   Cache::Handle* handle = NULL;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, handles, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -96,26 +144,78 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size,
+                                            const Slice& handles,
+                                            int level) {
+  // The table is read once from start to end, so there is little to
+  // gain from sharing it, or its index and filter blocks, with the
+  // caches.
+  std::string fname = TableFileName(dbname_, file_number);
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  Status s;
+  if (options_->use_direct_io_for_compaction) {
+    s = env_->NewDirectRandomAccessFile(fname, &file);
+  } else {
+    s = env_->NewRandomAccessFile(fname, &file);
+    if (s.ok()) {
+      file->Advise(0, 0, RandomAccessFile::kSequential);
+    }
+  }
+  if (s.ok()) {
+    Options table_options = *options_;
+    table_options.cache_index_and_filter_blocks = false;
+    table_options.pin_l0_filter_and_index_blocks_in_cache = false;
+    s = Table::Open(table_options, file, file_size, handles, &table);
+  }
+  if (!s.ok()) {
+    assert(table == NULL);
+    delete file;
+    return NewErrorIterator(s);
+  }
+  Iterator* result = table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, table, file);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
+                       const Slice& handles,
+                       int level,
                        const Slice& k,
                        void* arg,
-                       void (*saver)(void*, const Slice&, const Slice&)) {
+                       bool (*saver)(void*, const Slice&, const Slice&),
+                       bool* filter_passed) {
   Cache::Handle* handle = NULL;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, handles, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    s = t->InternalGet(options, k, arg, saver, filter_passed);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::Prewarm(uint64_t file_number,
+                           uint64_t file_size,
+                           const Slice& handles,
+                           int level) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, handles, level, &handle);
+  if (s.ok()) {
+    reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table->
+        LoadMetadata();
     cache_->Release(handle);
   }
   return s;
 }
 
 void TableCache::Evict(uint64_t file_number) {
-  char buf[sizeof(file_number)];
-  EncodeFixed64(buf, file_number);
-  cache_->Erase(Slice(buf, sizeof(buf)));
+  char buf[kCacheKeySize];
+  cache_->Erase(CacheKey(file_number, buf));
 }
 
 }  // namespace leveldb
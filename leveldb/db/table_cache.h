@@ -21,10 +21,22 @@ class Env;
 class TableCache {
  public:
   TableCache(const std::string& dbname, const Options* options, int entries);
+
+  // Like the constructor above, but keeps its tables open in "tables",
+  // which may be shared by the TableCaches of several column families
+  // so that they stay within one budget of open files.  "id" sets the
+  // tables of this TableCache apart from the others in "tables".  Does
+  // not take ownership of "tables", which must outlive the TableCache.
+  TableCache(const std::string& dbname, const Options* options,
+             Cache* tables, uint32_t id);
+
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  "handles" is the
+  // result of TableBuilder::Handles() for the file, or empty if that is
+  // not known; see Table::Open.  "level" is the
+  // level the file belongs to, or -1 if that is not known.  If "tableptr" is
   // non-NULL, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or NULL if no Table object underlies
   // the returned iterator.  The returned "*tableptr" object is owned by
@@ -33,16 +45,43 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        const Slice& handles,
+                        int level,
                         Table** tableptr = NULL);
 
+  // Like NewIterator(), but for reading the file as the input of a
+  // compaction.  The file is opened anew, so that it can be read
+  // sequentially, or bypass the page cache if
+  // options_->use_direct_io_for_compaction is set, without affecting
+  // the reads of the cached table.  It is closed again when the
+  // returned iterator is deleted.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number,
+                                  uint64_t file_size,
+                                  const Slice& handles,
+                                  int level);
+
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value), and again with
+  // the entries that follow for as long as it returns true.  Unless
+  // filter_passed is NULL, sets *filter_passed to whether the file's
+  // filter was checked and could not rule "k" out.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
+             const Slice& handles,
+             int level,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             bool (*handle_result)(void*, const Slice&, const Slice&),
+             bool* filter_passed);
+
+  // Open the specified file if it is not open yet, and read its index
+  // and filter blocks into the block cache if they are kept there.
+  Status Prewarm(uint64_t file_number,
+                 uint64_t file_size,
+                 const Slice& handles,
+                 int level);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -52,8 +91,14 @@ class TableCache {
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
+  const bool owns_cache_;
+  const uint32_t id_;
+
+  // Return the key of "file_number" in cache_, stored in "buf"
+  Slice CacheKey(uint64_t file_number, char* buf) const;
 
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size,
+                   const Slice& handles, int level, Cache::Handle**);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,76 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/ttl.h"
+
+#include "leveldb/env.h"
+#include "db/dbformat.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/write_batch.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+uint32_t CurrentTimestamp(Env* env) {
+  return static_cast<uint32_t>(env->NowMicros() / 1000000);
+}
+
+namespace {
+class TimestampInserter : public WriteBatch::Handler {
+ public:
+  WriteBatch* batch_;
+  const std::set<uint32_t>* column_families_;
+  char timestamp_[kTimestampSize];
+  std::string value_;
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    PutCF(0, key, value);
+  }
+  virtual void Delete(const Slice& key) {
+    DeleteCF(0, key);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    MergeCF(0, key, value);
+  }
+  virtual void PutCF(uint32_t column_family_id,
+                     const Slice& key, const Slice& value) {
+    if (column_families_->count(column_family_id) == 0) {
+      WriteBatchInternal::Put(batch_, column_family_id, key, value);
+    } else {
+      value_.assign(value.data(), value.size());
+      value_.append(timestamp_, kTimestampSize);
+      WriteBatchInternal::Put(batch_, column_family_id, key, value_);
+    }
+  }
+  virtual void DeleteCF(uint32_t column_family_id, const Slice& key) {
+    WriteBatchInternal::Delete(batch_, column_family_id, key);
+  }
+  virtual void MergeCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value) {
+    // Not allowed together with a ttl
+    WriteBatchInternal::Merge(batch_, column_family_id, key, value);
+  }
+};
+}  // namespace
+
+Status AddTimestamps(const WriteBatch& src, uint32_t now,
+                     const std::set<uint32_t>& column_families,
+                     WriteBatch* dst) {
+  TimestampInserter inserter;
+  inserter.batch_ = dst;
+  inserter.column_families_ = &column_families;
+  EncodeFixed32(inserter.timestamp_, now);
+  return src.Iterate(&inserter);
+}
+
+bool IsExpired(const Slice& value, int ttl, uint32_t now) {
+  if (value.size() < kTimestampSize) {
+    return false;
+  }
+  const uint32_t written =
+      DecodeFixed32(value.data() + value.size() - kTimestampSize);
+  return static_cast<uint64_t>(written) + ttl <= now;
+}
+
+}  // namespace leveldb
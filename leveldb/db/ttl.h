@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The values of a database opened with a positive Options::ttl are
+// followed by the time they were written, in seconds since the epoch,
+// as a fixed32.
+
+#ifndef STORAGE_LEVELDB_DB_TTL_H_
+#define STORAGE_LEVELDB_DB_TTL_H_
+
+#include <stdint.h>
+#include <set>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class WriteBatch;
+
+static const size_t kTimestampSize = 4;
+
+// Return the current time of "env" as stored in values.
+extern uint32_t CurrentTimestamp(Env* env);
+
+// Store in *dst the updates of "src", with "now" appended to the value
+// of each Put() to one of the column families with the given ids.
+extern Status AddTimestamps(const WriteBatch& src, uint32_t now,
+                            const std::set<uint32_t>& column_families,
+                            WriteBatch* dst);
+
+// Return true iff "value" was written at least "ttl" seconds before
+// "now".
+extern bool IsExpired(const Slice& value, int ttl, uint32_t now);
+
+// Return "value" without the time it was written.
+inline Slice StripTimestamp(const Slice& value) {
+  if (value.size() < kTimestampSize) {
+    return value;
+  }
+  return Slice(value.data(), value.size() - kTimestampSize);
+}
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TTL_H_
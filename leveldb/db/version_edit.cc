@@ -20,7 +20,14 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFileWithHandles   = 10,  // kNewFile followed by TableBuilder::Handles()
+  kNewFileTime          = 11,  // FileMetaData::newest_key_time of the
+                               // file added by the previous entry
+  kColumnFamily         = 12,
+  kDropColumnFamily     = 13,
+  kMaxColumnFamily      = 14,
+  kTimestampedValues    = 15
 };
 
 void VersionEdit::Clear() {
@@ -30,10 +37,15 @@ void VersionEdit::Clear() {
   last_sequence_ = 0;
   next_file_number_ = 0;
   has_comparator_ = false;
+  timestamped_values_ = false;
   has_log_number_ = false;
   has_prev_log_number_ = false;
   has_next_file_number_ = false;
   has_last_sequence_ = false;
+  max_column_family_ = 0;
+  has_max_column_family_ = false;
+  new_column_families_.clear();
+  dropped_column_families_.clear();
   deleted_files_.clear();
   new_files_.clear();
 }
@@ -43,6 +55,10 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     PutVarint32(dst, kComparator);
     PutLengthPrefixedSlice(dst, comparator_);
   }
+  if (timestamped_values_) {
+    PutVarint32(dst, kTimestampedValues);
+    PutVarint32(dst, 1);
+  }
   if (has_log_number_) {
     PutVarint32(dst, kLogNumber);
     PutVarint64(dst, log_number_);
@@ -59,6 +75,21 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     PutVarint32(dst, kLastSequence);
     PutVarint64(dst, last_sequence_);
   }
+  if (has_max_column_family_) {
+    PutVarint32(dst, kMaxColumnFamily);
+    PutVarint32(dst, max_column_family_);
+  }
+
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, new_column_families_[i].first);
+    PutLengthPrefixedSlice(dst, new_column_families_[i].second);
+  }
+
+  for (size_t i = 0; i < dropped_column_families_.size(); i++) {
+    PutVarint32(dst, kDropColumnFamily);
+    PutVarint32(dst, dropped_column_families_[i]);
+  }
 
   for (size_t i = 0; i < compact_pointers_.size(); i++) {
     PutVarint32(dst, kCompactPointer);
@@ -76,12 +107,21 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Only files that carry handles use the newer tag, so that the
+    // descriptor stays readable by older versions when they are unused.
+    PutVarint32(dst, f.handles.empty() ? kNewFile : kNewFileWithHandles);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (!f.handles.empty()) {
+      PutLengthPrefixedSlice(dst, f.handles);
+    }
+    if (f.newest_key_time != 0) {
+      PutVarint32(dst, kNewFileTime);
+      PutVarint64(dst, f.newest_key_time);
+    }
   }
 }
 
@@ -115,6 +155,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   // Temporary storage for parsing
   int level;
   uint64_t number;
+  uint32_t id;
   FileMetaData f;
   Slice str;
   InternalKey key;
@@ -130,6 +171,14 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kTimestampedValues:
+        if (GetVarint32(&input, &id)) {
+          timestamped_values_ = (id != 0);
+        } else {
+          msg = "timestamped values";
+        }
+        break;
+
       case kLogNumber:
         if (GetVarint64(&input, &log_number_)) {
           has_log_number_ = true;
@@ -162,6 +211,31 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kMaxColumnFamily:
+        if (GetVarint32(&input, &max_column_family_)) {
+          has_max_column_family_ = true;
+        } else {
+          msg = "max column family";
+        }
+        break;
+
+      case kColumnFamily:
+        if (GetVarint32(&input, &id) &&
+            GetLengthPrefixedSlice(&input, &str)) {
+          new_column_families_.push_back(std::make_pair(id, str.ToString()));
+        } else {
+          msg = "column family";
+        }
+        break;
+
+      case kDropColumnFamily:
+        if (GetVarint32(&input, &id)) {
+          dropped_column_families_.push_back(id);
+        } else {
+          msg = "dropped column family";
+        }
+        break;
+
       case kCompactPointer:
         if (GetLevel(&input, &level) &&
             GetInternalKey(&input, &key)) {
@@ -186,12 +260,38 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.handles.clear();
+          f.newest_key_time = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewFileWithHandles:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetLengthPrefixedSlice(&input, &str)) {
+          f.handles = str.ToString();
+          f.newest_key_time = 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+
+      case kNewFileTime:
+        if (!new_files_.empty() &&
+            GetVarint64(&input, &new_files_.back().second.newest_key_time)) {
+          // Applies to the file added last
+        } else {
+          msg = "new-file time";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -216,6 +316,9 @@ std::string VersionEdit::DebugString() const {
     r.append("\n  Comparator: ");
     r.append(comparator_);
   }
+  if (timestamped_values_) {
+    r.append("\n  TimestampedValues");
+  }
   if (has_log_number_) {
     r.append("\n  LogNumber: ");
     AppendNumberTo(&r, log_number_);
@@ -232,6 +335,20 @@ std::string VersionEdit::DebugString() const {
     r.append("\n  LastSeq: ");
     AppendNumberTo(&r, last_sequence_);
   }
+  if (has_max_column_family_) {
+    r.append("\n  MaxColumnFamily: ");
+    AppendNumberTo(&r, max_column_family_);
+  }
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, new_column_families_[i].first);
+    r.append(" ");
+    r.append(new_column_families_[i].second);
+  }
+  for (size_t i = 0; i < dropped_column_families_.size(); i++) {
+    r.append("\n  DropColumnFamily: ");
+    AppendNumberTo(&r, dropped_column_families_[i]);
+  }
   for (size_t i = 0; i < compact_pointers_.size(); i++) {
     r.append("\n  CompactPointer: ");
     AppendNumberTo(&r, compact_pointers_[i].first);
@@ -21,8 +21,12 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  std::string handles;        // TableBuilder::Handles(), or empty
+  uint64_t newest_key_time;   // Latest time (seconds since the epoch) any
+                              // entry may have been written, or 0
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0),
+                   newest_key_time(0) { }
 };
 
 class VersionEdit {
@@ -36,6 +40,11 @@ class VersionEdit {
     has_comparator_ = true;
     comparator_ = name.ToString();
   }
+  // Record that every value carries the time it was written, as it
+  // does once Options::ttl is positive.
+  void SetTimestampedValues() {
+    timestamped_values_ = true;
+  }
   void SetLogNumber(uint64_t num) {
     has_log_number_ = true;
     log_number_ = num;
@@ -59,15 +68,20 @@ class VersionEdit {
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "handles" is empty or the result of TableBuilder::Handles()
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               const Slice& handles = Slice(),
+               uint64_t newest_key_time = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.handles = handles.ToString();
+    f.newest_key_time = newest_key_time;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -76,6 +90,27 @@ class VersionEdit {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // Register the column family with the specified id and name.  Only
+  // recorded in the descriptor of the default column family.
+  void AddColumnFamily(uint32_t id, const std::string& name) {
+    new_column_families_.push_back(std::make_pair(id, name));
+    SetMaxColumnFamily(id);
+  }
+
+  // Forget the column family with the specified id.
+  void DropColumnFamily(uint32_t id) {
+    dropped_column_families_.push_back(id);
+  }
+
+  // Column family ids are never reused, so the largest one handed out
+  // is remembered even after its column family is dropped.
+  void SetMaxColumnFamily(uint32_t id) {
+    if (!has_max_column_family_ || id > max_column_family_) {
+      has_max_column_family_ = true;
+      max_column_family_ = id;
+    }
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -92,11 +127,16 @@ class VersionEdit {
   uint64_t next_file_number_;
   SequenceNumber last_sequence_;
   bool has_comparator_;
+  bool timestamped_values_;
   bool has_log_number_;
   bool has_prev_log_number_;
   bool has_next_file_number_;
   bool has_last_sequence_;
+  uint32_t max_column_family_;
+  bool has_max_column_family_;
 
+  std::vector< std::pair<uint32_t, std::string> > new_column_families_;
+  std::vector<uint32_t> dropped_column_families_;
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector< std::pair<int, FileMetaData> > new_files_;
@@ -28,15 +28,29 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(5, kBig + 800 + i, kBig + 400 + i,
+                 InternalKey("bar", kBig + 500 + i, kTypeValue),
+                 InternalKey("car", kBig + 600 + i, kTypeDeletion),
+                 std::string(i + 1, 'h'));
+    edit.AddFile(0, kBig + 900 + i, kBig + 400 + i,
+                 InternalKey("dar", kBig + 500 + i, kTypeValue),
+                 InternalKey("ear", kBig + 600 + i, kTypeValue),
+                 Slice(), kBig + 1000 + i);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
 
   edit.SetComparatorName("foo");
+  edit.SetTimestampedValues();
   edit.SetLogNumber(kBig + 100);
   edit.SetNextFile(kBig + 200);
   edit.SetLastSequence(kBig + 1000);
   TestEncodeDecode(edit);
+
+  edit.AddColumnFamily(3, "users");
+  edit.DropColumnFamily(2);
+  edit.SetMaxColumnFamily(7);
+  TestEncodeDecode(edit);
 }
 
 }  // namespace leveldb
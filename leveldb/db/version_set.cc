@@ -10,40 +10,43 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
 #include "db/table_cache.h"
+#include "db/ttl.h"
 #include "leveldb/env.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
-static const int kTargetFileSize = 2 * 1048576;
+// Size of the tables that compactions build in "level"
+static uint64_t MaxFileSizeForLevel(const Options* options, int level) {
+  uint64_t result = options->target_file_size_base;
+  while (level > 1) {
+    result *= options->target_file_size_multiplier;
+    level--;
+  }
+  return result;
+}
 
 // Maximum bytes of overlaps in grandparent (i.e., level+2) before we
 // stop building a single file in a level->level+1 compaction.
-static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
+static int64_t MaxGrandParentOverlapBytes(const Options* options,
+                                          int level) {
+  return 10 * MaxFileSizeForLevel(options, level + 1);
+}
 
 // Maximum number of bytes in all compacted files.  We avoid expanding
 // the lower level file set of a compaction if it would make the
 // total compaction cover more than this many bytes.
-static const int64_t kExpandedCompactionByteSizeLimit = 25 * kTargetFileSize;
-
-static double MaxBytesForLevel(int level) {
-  // Note: the result for level zero is not really used since we set
-  // the level-0 compaction threshold based on number of files.
-  double result = 10 * 1048576.0;  // Result for both level-0 and level-1
-  while (level > 1) {
-    result *= 10;
-    level--;
-  }
-  return result;
-}
-
-static uint64_t MaxFileSizeForLevel(int level) {
-  return kTargetFileSize;  // We could vary per level to reduce number of files?
+static int64_t ExpandedCompactionByteSizeLimit(const Options* options,
+                                               int level) {
+  return 25 * MaxFileSizeForLevel(options, level + 1);
 }
 
 static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
@@ -162,9 +165,9 @@ bool SomeFileOverlapsRange(
 
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
-// is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// is the largest key that occurs in the file, and value() holds the
+// file number and file size, both encoded using EncodeFixed64,
+// followed by the file's table handles.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
@@ -201,9 +204,12 @@ class Version::LevelFileNumIterator : public Iterator {
   }
   Slice value() const {
     assert(Valid());
-    EncodeFixed64(value_buf_, (*flist_)[index_]->number);
-    EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
-    return Slice(value_buf_, sizeof(value_buf_));
+    const FileMetaData* f = (*flist_)[index_];
+    value_buf_.resize(16);
+    EncodeFixed64(&value_buf_[0], f->number);
+    EncodeFixed64(&value_buf_[8], f->file_size);
+    value_buf_.append(f->handles);
+    return Slice(value_buf_);
   }
   virtual Status status() const { return Status::OK(); }
  private:
@@ -211,21 +217,42 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and handles.
+  mutable std::string value_buf_;
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() < 16) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
+    // Only used for levels > 0, whose exact level does not matter here
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              Slice(file_value.data() + 16,
+                                    file_value.size() - 16),
+                              -1);
+  }
+}
+
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() < 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(options,
+                                        DecodeFixed64(file_value.data()),
+                                        DecodeFixed64(file_value.data() + 8),
+                                        Slice(file_value.data() + 16,
+                                              file_value.size() - 16),
+                                        -1);
   }
 }
 
@@ -242,7 +269,8 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->handles, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -268,34 +296,84 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  MergeContext* merge;
+  bool key_seen;        // An entry for user_key was found
 };
 }
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      s->key_seen = true;
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          s->value->assign(v.data(), v.size());
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeMerge:
+          // Keep looking for the value the operand applies to
+          s->merge->Add(v);
+          return true;
       }
     }
   }
+  return false;
+}
+
+// Level-0 files hold disjoint ranges of sequence numbers: each is a
+// memtable, or (with kCompactionStyleUniversal) the merge of files that
+// were written one after the other.  So the sequence number of any
+// entry of a file orders it against the other level-0 files, unlike
+// its file number, which says when the merge happened.
+static SequenceNumber FileSequence(const FileMetaData* f) {
+  const Slice key = f->largest.Encode();
+  return DecodeFixed64(key.data() + key.size() - 8) >> 8;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
-  return a->number > b->number;
+  return FileSequence(a) > FileSequence(b);
+}
+
+// Store in *drop the level-0 files that kCompactionStyleFIFO removes
+// from "files": the oldest ones, for as long as they have expired or
+// the files take up more than options->fifo_max_table_files_size.
+static void PickFIFOFilesToDrop(const Options* options,
+                                const std::vector<FileMetaData*>& files,
+                                std::vector<FileMetaData*>* drop) {
+  drop->clear();
+  std::vector<FileMetaData*> oldest_first = files;
+  std::sort(oldest_first.begin(), oldest_first.end(), NewestFirst);
+  std::reverse(oldest_first.begin(), oldest_first.end());
+  const uint64_t now = (options->ttl > 0) ? CurrentTimestamp(options->env) : 0;
+  uint64_t total = TotalFileSize(files);
+  for (size_t i = 0; i < oldest_first.size(); i++) {
+    FileMetaData* f = oldest_first[i];
+    const bool expired = (options->ttl > 0 && f->newest_key_time != 0 &&
+                          f->newest_key_time + options->ttl <= now);
+    if (!expired && total <= options->fifo_max_table_files_size) {
+      break;
+    }
+    drop->push_back(f);
+    total -= f->file_size;
+  }
 }
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    MergeContext* merge) {
+  PerfTimer timer(&perf_context.get_from_output_files_time);
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
+  Statistics* statistics = vset_->options_->statistics;
   Status s;
 
   stats->seek_file = NULL;
@@ -359,23 +437,41 @@ Status Version::Get(const ReadOptions& options,
       FileMetaData* f = files[i];
       last_file_read = f;
       last_file_read_level = level;
+      PERF_COUNTER_ADD(files_checked, 1);
+      if (level == 0) {
+        PERF_COUNTER_ADD(level0_files_checked, 1);
+      }
 
       Saver saver;
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.merge = merge;
+      saver.key_seen = false;
+      bool filter_passed = false;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+                                   f->handles, level, ikey, &saver,
+                                   SaveValue, &filter_passed);
       if (!s.ok()) {
         return s;
       }
       switch (saver.state) {
         case kNotFound:
+          if (filter_passed && !saver.key_seen && statistics != NULL) {
+            statistics->RecordTick(kBloomFilterFalsePositive, 1);
+          }
           break;      // Keep searching in other files
         case kFound:
+          if (!merge->empty()) {
+            Slice base(*value);
+            s = merge->Apply(user_key, &base, value);
+          }
           return s;
         case kDeleted:
+          if (!merge->empty()) {
+            return merge->Apply(user_key, NULL, value);
+          }
           s = Status::NotFound(Slice());  // Use empty error message for speed
           return s;
         case kCorrupt:
@@ -385,12 +481,16 @@ Status Version::Get(const ReadOptions& options,
     }
   }
 
+  if (!merge->empty()) {
+    return merge->Apply(user_key, NULL, value);
+  }
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != NULL) {
+  if (f != NULL &&
+      vset_->options_->compaction_style == kCompactionStyleLevel) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
       file_to_compact_ = f;
@@ -425,19 +525,24 @@ int Version::PickLevelForMemTableOutput(
     const Slice& smallest_user_key,
     const Slice& largest_user_key) {
   int level = 0;
-  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+  if (vset_->options_->compaction_style != kCompactionStyleLevel) {
+    // Every memtable becomes a new level-0 file
+  } else if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    const Options* options = vset_->options_;
+    const int max_level = std::min(config::kMaxMemCompactLevel,
+                                   options->num_levels - 2);
+    while (level < max_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
       GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
       const int64_t sum = TotalFileSize(overlaps);
-      if (sum > kMaxGrandParentOverlapBytes) {
+      if (sum > MaxGrandParentOverlapBytes(options, level + 1)) {
         break;
       }
       level++;
@@ -703,6 +808,8 @@ VersionSet::VersionSet(const std::string& dbname,
       last_sequence_(0),
       log_number_(0),
       prev_log_number_(0),
+      max_column_family_(0),
+      recovered_offset_(0),
       descriptor_file_(NULL),
       descriptor_log_(NULL),
       dummy_versions_(this),
@@ -802,6 +909,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    ApplyColumnFamilies(*edit);
   } else {
     delete v;
     if (!new_manifest_file.empty()) {
@@ -817,10 +925,18 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
 }
 
 Status VersionSet::Recover() {
+  return ReadDescriptor(false);
+}
+
+Status VersionSet::CatchUp() {
+  return ReadDescriptor(true);
+}
+
+Status VersionSet::ReadDescriptor(bool tail) {
   struct LogReporter : public log::Reader::Reporter {
-    Status* status;
+    Status* status;  // NULL if errors are ignored
     virtual void Corruption(size_t bytes, const Status& s) {
-      if (this->status->ok()) *this->status = s;
+      if (this->status != NULL && this->status->ok()) *this->status = s;
     }
   };
 
@@ -836,6 +952,7 @@ Status VersionSet::Recover() {
   current.resize(current.size() - 1);
 
   std::string dscname = dbname_ + "/" + current;
+  const bool incremental = tail && dscname == recovered_descriptor_;
   SequentialFile* file;
   s = env_->NewSequentialFile(dscname, &file);
   if (!s.ok()) {
@@ -846,19 +963,30 @@ Status VersionSet::Recover() {
   bool have_prev_log_number = false;
   bool have_next_file = false;
   bool have_last_sequence = false;
+  bool timestamped_values = false;
   uint64_t next_file = 0;
   uint64_t last_sequence = 0;
   uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+  int records = 0;
+  uint64_t last_record_offset = 0;
+  // A new descriptor starts with a snapshot of all the files, which
+  // must not be added to the ones of the current version
+  Builder builder(this, (tail && !incremental) ? new Version(this) : current_);
+  if (!incremental) {
+    column_families_.clear();
+    max_column_family_ = 0;
+  }
 
   {
     LogReporter reporter;
-    reporter.status = &s;
-    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+    reporter.status = (tail ? NULL : &s);
+    log::Reader reader(file, &reporter, true/*checksum*/,
+                       incremental ? recovered_offset_ : 0);
     Slice record;
     std::string scratch;
     while (reader.ReadRecord(&record, &scratch) && s.ok()) {
+      records++;
       VersionEdit edit;
       s = edit.DecodeFrom(record);
       if (s.ok()) {
@@ -868,10 +996,12 @@ Status VersionSet::Recover() {
               edit.comparator_ + "does not match existing comparator ",
               icmp_.user_comparator()->Name());
         }
+        timestamped_values = timestamped_values || edit.timestamped_values_;
       }
 
       if (s.ok()) {
         builder.Apply(&edit);
+        ApplyColumnFamilies(edit);
       }
 
       if (edit.has_log_number_) {
@@ -894,21 +1024,37 @@ Status VersionSet::Recover() {
         have_last_sequence = true;
       }
     }
+    last_record_offset = reader.LastRecordOffset();
   }
   delete file;
   file = NULL;
 
-  if (s.ok()) {
+  if (incremental) {
+    if (!s.ok() || records == 0) {
+      return s;
+    }
+  } else if (s.ok()) {
     if (!have_next_file) {
       s = Status::Corruption("no meta-nextfile entry in descriptor");
     } else if (!have_log_number) {
       s = Status::Corruption("no meta-lognumber entry in descriptor");
     } else if (!have_last_sequence) {
       s = Status::Corruption("no last-sequence-number entry in descriptor");
+    } else if (timestamped_values && options_->ttl <= 0) {
+      // Reading its values would return their timestamps as data
+      s = Status::InvalidArgument(dbname_,
+                                  "was written with a ttl, but options.ttl "
+                                  "is not positive");
+    } else if (!timestamped_values && options_->ttl > 0) {
+      // Its values would lose their last bytes, taken as timestamps
+      s = Status::InvalidArgument(dbname_,
+                                  "was written without a ttl, but "
+                                  "options.ttl is positive");
     }
 
     if (!have_prev_log_number) {
       prev_log_number = 0;
+      have_prev_log_number = true;
     }
 
     MarkFileNumberUsed(prev_log_number);
@@ -918,31 +1064,107 @@ Status VersionSet::Recover() {
   if (s.ok()) {
     Version* v = new Version(this);
     builder.SaveTo(v);
+    for (int level = options_->num_levels; level < config::kNumLevels;
+         level++) {
+      if (!v->files_[level].empty()) {
+        char buf[100];
+        snprintf(buf, sizeof(buf), "database has files at level %d, but "
+                 "num_levels is %d", level, options_->num_levels);
+        delete v;
+        return Status::InvalidArgument(buf);
+      }
+    }
     // Install recovered version
     Finalize(v);
     AppendVersion(v);
-    manifest_file_number_ = next_file;
-    next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
-    log_number_ = log_number;
-    prev_log_number_ = prev_log_number;
+    if (have_next_file) {
+      manifest_file_number_ = next_file;
+      next_file_number_ = next_file + 1;
+    }
+    // The sequence never moves backwards, since a reader that follows
+    // the descriptor may have replayed newer updates from the logs.
+    if (have_last_sequence && last_sequence > last_sequence_) {
+      last_sequence_ = last_sequence;
+    }
+    if (have_log_number) {
+      log_number_ = log_number;
+    }
+    if (have_prev_log_number) {
+      prev_log_number_ = prev_log_number;
+    }
+    // Records start at increasing offsets, so reading from just past
+    // the start of the last one skips it and the ones before it
+    recovered_descriptor_ = dscname;
+    recovered_offset_ = last_record_offset + 1;
   }
 
   return s;
 }
 
+void VersionSet::ApplyColumnFamilies(const VersionEdit& edit) {
+  for (size_t i = 0; i < edit.new_column_families_.size(); i++) {
+    column_families_[edit.new_column_families_[i].first] =
+        edit.new_column_families_[i].second;
+  }
+  for (size_t i = 0; i < edit.dropped_column_families_.size(); i++) {
+    column_families_.erase(edit.dropped_column_families_[i]);
+  }
+  if (edit.has_max_column_family_ &&
+      edit.max_column_family_ > max_column_family_) {
+    max_column_family_ = edit.max_column_family_;
+  }
+}
+
 void VersionSet::MarkFileNumberUsed(uint64_t number) {
   if (next_file_number_ <= number) {
     next_file_number_ = number + 1;
   }
 }
 
+void VersionSet::MaxBytesForLevels(const Version* v,
+                                   double* max_bytes) const {
+  // Note: the result for level zero is not really used since we set
+  // the level-0 compaction threshold based on number of files.
+  const int multiplier = options_->max_bytes_for_level_multiplier;
+  max_bytes[0] = max_bytes[1] = options_->max_bytes_for_level_base;
+  for (int level = 2; level < options_->num_levels; level++) {
+    max_bytes[level] = max_bytes[level - 1] * multiplier;
+  }
+
+  if (options_->level_compaction_dynamic_level_bytes) {
+    // Size the levels above the deepest one that holds data after it
+    int bottom = options_->num_levels - 1;
+    while (bottom > 1 && v->files_[bottom].empty()) {
+      bottom--;
+    }
+    double limit = TotalFileSize(v->files_[bottom]);
+    for (int level = bottom - 1; level >= 1; level--) {
+      limit /= multiplier;
+      max_bytes[level] = std::max<double>(limit,
+                                          options_->max_bytes_for_level_base);
+    }
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    FinalizeUniversal(v);
+    return;
+  }
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    FinalizeFIFO(v);
+    return;
+  }
+
+  double max_bytes[config::kNumLevels];
+  MaxBytesForLevels(v, max_bytes);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
+  uint64_t pending_bytes = 0;
 
-  for (int level = 0; level < config::kNumLevels-1; level++) {
+  for (int level = 0; level < options_->num_levels-1; level++) {
     double score;
     if (level == 0) {
       // We treat level-0 specially by bounding the number of files
@@ -957,11 +1179,17 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-          static_cast<double>(config::kL0_CompactionTrigger);
+          static_cast<double>(options_->level0_file_num_compaction_trigger);
+      if (score >= 1) {
+        pending_bytes += TotalFileSize(v->files_[level]);
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
+      score = static_cast<double>(level_bytes) / max_bytes[level];
+      if (score > 1) {
+        pending_bytes += static_cast<uint64_t>(level_bytes - max_bytes[level]);
+      }
     }
 
     if (score > best_score) {
@@ -972,21 +1200,66 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  v->pending_compaction_bytes_ = pending_bytes;
 }
 
-Status VersionSet::WriteSnapshot(log::Writer* log) {
-  // TODO: Break up into multiple records to reduce memory usage on recovery?
+void VersionSet::FinalizeUniversal(Version* v) {
+  // Each level-0 file is a sorted run.  We bound the number of runs
+  // rather than their sizes, for the same reasons we bound the number
+  // of level-0 files of leveled compactions; the sizes only decide
+  // which runs get merged.  A single run has nothing to be merged with.
+  const std::vector<FileMetaData*>& runs = v->files_[0];
+  double score = 0;
+  uint64_t pending_bytes = 0;
+  if (runs.size() >= 2) {
+    score = runs.size() /
+        static_cast<double>(options_->level0_file_num_compaction_trigger);
+  }
+  if (score >= 1) {
+    // All but the oldest run are due to be rewritten
+    const FileMetaData* oldest = *std::max_element(runs.begin(), runs.end(),
+                                                   NewestFirst);
+    pending_bytes = TotalFileSize(runs) - oldest->file_size;
+  }
+
+  v->compaction_level_ = 0;
+  v->compaction_score_ = score;
+  v->pending_compaction_bytes_ = pending_bytes;
+}
+
+void VersionSet::FinalizeFIFO(Version* v) {
+  // Files are only ever dropped, which costs no I/O, so nothing is
+  // pending once the files to drop have been found.
+  std::vector<FileMetaData*> drop;
+  PickFIFOFilesToDrop(options_, v->files_[0], &drop);
+  v->compaction_level_ = 0;
+  v->compaction_score_ = drop.empty() ? 0 : 1;
+  v->pending_compaction_bytes_ = 0;
+}
 
+void VersionSet::SnapshotEdit(VersionEdit* edit) {
   // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  edit->SetComparatorName(icmp_.user_comparator()->Name());
+  if (options_->ttl > 0) {
+    edit->SetTimestampedValues();
+  }
+
+  // Save column families
+  for (std::map<uint32_t, std::string>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    edit->AddColumnFamily(it->first, it->second);
+  }
+  if (max_column_family_ > 0) {
+    edit->SetMaxColumnFamily(max_column_family_);
+  }
 
   // Save compaction pointers
   for (int level = 0; level < config::kNumLevels; level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
-      edit.SetCompactPointer(level, key);
+      edit->SetCompactPointer(level, key);
     }
   }
 
@@ -995,15 +1268,32 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit->AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                    f->handles, f->newest_key_time);
     }
   }
+}
 
+Status VersionSet::WriteSnapshot(log::Writer* log) {
+  // TODO: Break up into multiple records to reduce memory usage on recovery?
+  VersionEdit edit;
+  SnapshotEdit(&edit);
   std::string record;
   edit.EncodeTo(&record);
   return log->AddRecord(record);
 }
 
+void VersionSet::EncodeSnapshot(std::string* record) {
+  VersionEdit edit;
+  SnapshotEdit(&edit);
+  edit.SetLogNumber(log_number_);
+  edit.SetPrevLogNumber(prev_log_number_);
+  edit.SetNextFile(next_file_number_);
+  edit.SetLastSequence(last_sequence_);
+  record->clear();
+  edit.EncodeTo(record);
+}
+
 int VersionSet::NumLevelFiles(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
@@ -1046,7 +1336,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->handles, level, &tableptr);
         if (tableptr != NULL) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1134,6 +1425,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  // Inputs are read from start to end
+  options.readahead_size = options_->readahead_size;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1146,14 +1439,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size,
+              files[i]->handles, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1164,6 +1458,13 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction();
+  }
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    return PickFIFOCompaction();
+  }
+
   Compaction* c;
   int level;
 
@@ -1174,8 +1475,8 @@ Compaction* VersionSet::PickCompaction() {
   if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
+    assert(level+1 < options_->num_levels);
+    c = new Compaction(options_, level);
 
     // Pick the first file that comes after compact_pointer_[level]
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
@@ -1192,7 +1493,7 @@ Compaction* VersionSet::PickCompaction() {
     }
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(level);
+    c = new Compaction(options_, level);
     c->inputs_[0].push_back(current_->file_to_compact_);
   } else {
     return NULL;
@@ -1217,6 +1518,85 @@ Compaction* VersionSet::PickCompaction() {
   return c;
 }
 
+Compaction* VersionSet::PickUniversalCompaction() {
+  if (current_->compaction_score_ < 1) {
+    return NULL;
+  }
+
+  std::vector<FileMetaData*> runs = current_->files_[0];
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+  const size_t n = runs.size();
+  const size_t min_width = options_->universal_min_merge_width;
+  const size_t max_width = options_->universal_max_merge_width;
+  size_t start = 0;
+  size_t limit = 0;  // Merge runs [start, limit)
+
+  // Merge all runs once the space taken up by the newer ones, which
+  // may be mostly stale versions of the keys in the oldest, gets large.
+  const uint64_t oldest_bytes = runs[n - 1]->file_size;
+  const uint64_t newer_bytes = TotalFileSize(runs) - oldest_bytes;
+  if (newer_bytes * 100 >=
+      oldest_bytes * options_->universal_max_size_amplification_percent) {
+    limit = n;
+  }
+
+  // Otherwise merge the newest stretch of runs in which each run is not
+  // much larger than the runs before it put together.
+  for (size_t i = 0; limit == 0 && i + min_width <= n; i++) {
+    uint64_t picked_bytes = runs[i]->file_size;
+    size_t j = i + 1;
+    while (j < n && j - i < max_width &&
+           runs[j]->file_size * 100 <=
+           picked_bytes * (100 + options_->universal_size_ratio)) {
+      picked_bytes += runs[j]->file_size;
+      j++;
+    }
+    if (j - i >= min_width) {
+      start = i;
+      limit = j;
+    }
+  }
+
+  // Otherwise merge just enough of the newest runs to bring their
+  // number back under the trigger.
+  if (limit == 0) {
+    limit = std::max(min_width,
+                     n - options_->level0_file_num_compaction_trigger + 1);
+    limit = std::min(limit, std::min(n, max_width));
+  }
+
+  return NewUniversalCompaction(runs, start, limit);
+}
+
+Compaction* VersionSet::PickFIFOCompaction() {
+  std::vector<FileMetaData*> drop;
+  PickFIFOFilesToDrop(options_, current_->files_[0], &drop);
+  if (drop.empty()) {
+    return NULL;
+  }
+  Compaction* c = new Compaction(options_, 0);
+  c->output_level_ = 0;
+  c->deletion_only_ = true;
+  c->inputs_[0] = drop;
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  return c;
+}
+
+Compaction* VersionSet::NewUniversalCompaction(
+    const std::vector<FileMetaData*>& runs, size_t start, size_t limit) {
+  Compaction* c = new Compaction(options_, 0);
+  c->output_level_ = 0;
+  // The result must be a single file to remain one run that is newer
+  // than all the runs after it and older than all the runs before it.
+  c->max_output_file_size_ = ~static_cast<uint64_t>(0);
+  c->skips_older_runs_ = (limit < runs.size());
+  c->inputs_[0].assign(runs.begin() + start, runs.begin() + limit);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  return c;
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1237,7 +1617,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit) {
+        inputs1_size + expanded0_size <
+            ExpandedCompactionByteSizeLimit(options_, level)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1264,7 +1645,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
+  if (level + 2 < options_->num_levels) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
@@ -1288,6 +1669,21 @@ Compaction* VersionSet::CompactRange(
     int level,
     const InternalKey* begin,
     const InternalKey* end) {
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // Files are never merged
+    return NULL;
+  }
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Runs overlap each other, so any range is compacted by merging
+    // every run.
+    if (level != 0 || current_->files_[0].empty()) {
+      return NULL;
+    }
+    std::vector<FileMetaData*> runs = current_->files_[0];
+    std::sort(runs.begin(), runs.end(), NewestFirst);
+    return NewUniversalCompaction(runs, 0, runs.size());
+  }
+
   std::vector<FileMetaData*> inputs;
   current_->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
@@ -1295,7 +1691,7 @@ Compaction* VersionSet::CompactRange(
   }
 
   // Avoid compacting too much in one shot in case the range is large.
-  const uint64_t limit = MaxFileSizeForLevel(level);
+  const uint64_t limit = MaxFileSizeForLevel(options_, level);
   uint64_t total = 0;
   for (size_t i = 0; i < inputs.size(); i++) {
     uint64_t s = inputs[i]->file_size;
@@ -1306,7 +1702,7 @@ Compaction* VersionSet::CompactRange(
     }
   }
 
-  Compaction* c = new Compaction(level);
+  Compaction* c = new Compaction(options_, level);
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
@@ -1314,13 +1710,18 @@ Compaction* VersionSet::CompactRange(
   return c;
 }
 
-Compaction::Compaction(int level)
+Compaction::Compaction(const Options* options, int level)
     : level_(level),
-      max_output_file_size_(MaxFileSizeForLevel(level)),
+      output_level_(level + 1),
+      max_output_file_size_(MaxFileSizeForLevel(options, level + 1)),
+      max_grandparent_overlap_bytes_(
+          MaxGrandParentOverlapBytes(options, level)),
       input_version_(NULL),
       grandparent_index_(0),
       seen_key_(false),
-      overlapped_bytes_(0) {
+      overlapped_bytes_(0),
+      skips_older_runs_(false),
+      deletion_only_(false) {
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
@@ -1336,9 +1737,10 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 &&
+  return (output_level_ > level_ &&
+          num_input_files(0) == 1 &&
           num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
+          TotalFileSize(grandparents_) <= max_grandparent_overlap_bytes_);
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
@@ -1351,8 +1753,12 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
+  if (skips_older_runs_) {
+    // Older runs in level_ may hold the key
+    return false;
+  }
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     for (; level_ptrs_[lvl] < files.size(); ) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1383,7 +1789,7 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
   seen_key_ = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (overlapped_bytes_ > max_grandparent_overlap_bytes_) {
     // Too much overlap for current output; start new output
     overlapped_bytes_ = 0;
     return true;
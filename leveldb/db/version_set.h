@@ -29,6 +29,7 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -64,13 +65,15 @@ class Version {
 
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // The merge operands found for key are added to *merge and applied
+  // to the value found, if any.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, MergeContext* merge);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -103,6 +106,12 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Return the files at the specified level, sorted by smallest key.
+  // REQUIRES: this version has been Ref'ed.
+  const std::vector<FileMetaData*>& files(int level) const {
+    return files_[level];
+  }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -131,12 +140,17 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // Estimate of the bytes that have to be compacted before no level
+  // needs compaction any more.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
   }
 
   ~Version();
@@ -164,6 +178,12 @@ class VersionSet {
   // Recover the last saved descriptor from persistent storage.
   Status Recover();
 
+  // Install a version with the edits that were saved to the descriptor
+  // since the last call to Recover() or CatchUp(), or with the whole
+  // descriptor if CURRENT names a new one.  Lets a reader follow the
+  // descriptor that another process keeps writing.
+  Status CatchUp();
+
   // Return the current version.
   Version* current() const { return current_; }
 
@@ -188,6 +208,12 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the number of bytes waiting to be compacted in the current
+  // version.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -207,6 +233,15 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
+  // Return the names of the column families registered with this set
+  // by VersionEdit::AddColumnFamily(), indexed by id.
+  const std::map<uint32_t, std::string>& column_families() const {
+    return column_families_;
+  }
+
+  // Return the largest column family id handed out so far, or zero.
+  uint32_t MaxColumnFamily() const { return max_column_family_; }
+
   // Pick level and inputs for a new compaction.
   // Returns NULL if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
@@ -236,6 +271,12 @@ class VersionSet {
     return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
   }
 
+  // Store in *record a descriptor record that recreates the current
+  // version, with the log and file numbers of this VersionSet.  A new
+  // descriptor that starts with it describes the same state.
+  // REQUIRES: *mu is held (the mutex passed to LogAndApply())
+  void EncodeSnapshot(std::string* record);
+
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
@@ -259,6 +300,23 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Store in max_bytes[level] the number of bytes above which "level"
+  // of "v" needs compaction, for 0 <= level < options_->num_levels.
+  void MaxBytesForLevels(const Version* v, double* max_bytes) const;
+
+  // Finalize() and PickCompaction() for kCompactionStyleUniversal
+  void FinalizeUniversal(Version* v);
+  Compaction* PickUniversalCompaction();
+
+  // Finalize() and PickCompaction() for kCompactionStyleFIFO
+  void FinalizeFIFO(Version* v);
+  Compaction* PickFIFOCompaction();
+
+  // Return a compaction that merges runs[start,limit-1] into one run,
+  // where "runs" holds the level-0 files of current_, newest first.
+  Compaction* NewUniversalCompaction(const std::vector<FileMetaData*>& runs,
+                                     size_t start, size_t limit);
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -270,11 +328,25 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Store in *edit the metadata, column families, compaction pointers
+  // and files of the current version
+  void SnapshotEdit(VersionEdit* edit);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
   void AppendVersion(Version* v);
 
+  // Read the descriptor named by CURRENT.  If "tail" is set and it is
+  // the descriptor that was read last, only the records after the ones
+  // already read are applied to the current version, and corrupt
+  // records at its end, which may not have been written completely
+  // yet, are ignored.
+  Status ReadDescriptor(bool tail);
+
+  // Apply the column family changes of *edit to column_families_.
+  void ApplyColumnFamilies(const VersionEdit& edit);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
@@ -285,6 +357,13 @@ class VersionSet {
   uint64_t last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
+  std::map<uint32_t, std::string> column_families_;
+  uint32_t max_column_family_;
+
+  // Descriptor read by the last Recover() or CatchUp(), and the offset
+  // from which CatchUp() reads the records that follow
+  std::string recovered_descriptor_;
+  uint64_t recovered_offset_;
 
   // Opened lazily
   WritableFile* descriptor_file_;
@@ -310,6 +389,10 @@ class Compaction {
   // and "level+1" will be merged to produce a set of "level+1" files.
   int level() const { return level_; }
 
+  // Return the level the output goes to: "level+1", or "level" for
+  // the merges of kCompactionStyleUniversal.
+  int output_level() const { return output_level_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -327,6 +410,10 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // Is this a compaction of kCompactionStyleFIFO, which just deletes
+  // its inputs?
+  bool IsDeletionCompaction() const { return deletion_only_; }
+
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
@@ -347,10 +434,12 @@ class Compaction {
   friend class Version;
   friend class VersionSet;
 
-  explicit Compaction(int level);
+  Compaction(const Options* options, int level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
+  int64_t max_grandparent_overlap_bytes_;
   Version* input_version_;
   VersionEdit edit_;
 
@@ -372,6 +461,11 @@ class Compaction {
   // higher level than the ones involved in this compaction (i.e. for
   // all L >= level_ + 2).
   size_t level_ptrs_[config::kNumLevels];
+
+  // Are older runs in level_ left out of this compaction?
+  bool skips_older_runs_;
+
+  bool deletion_only_;
 };
 
 }  // namespace leveldb
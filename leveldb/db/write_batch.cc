@@ -8,7 +8,13 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTagColumnFamilyValue varint32 varstring varstring |
+//    kTagColumnFamilyDeletion varint32 varstring        |
+//    kTagColumnFamilyMerge varint32 varstring varstring
+// where the varint32 is the id of a column family other than the
+// default one.
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -26,6 +32,15 @@ namespace leveldb {
 // WriteBatch header has an 8-byte sequence number followed by a 4-byte count.
 static const size_t kHeader = 12;
 
+// Tags of the records that update a column family other than the
+// default one.  The records of the default column family are tagged
+// with the ValueType of their internal keys instead.
+enum ColumnFamilyTag {
+  kTagColumnFamilyDeletion = 0x4,
+  kTagColumnFamilyValue = 0x5,
+  kTagColumnFamilyMerge = 0x6
+};
+
 WriteBatch::WriteBatch() {
   Clear();
 }
@@ -34,6 +49,20 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::PutCF(uint32_t column_family_id,
+                                const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteCF(uint32_t column_family_id,
+                                   const Slice& key) {
+}
+
+void WriteBatch::Handler::MergeCF(uint32_t column_family_id,
+                                  const Slice& key, const Slice& value) {
+}
+
+ColumnFamilyMemTables::~ColumnFamilyMemTables() { }
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -47,6 +76,7 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(kHeader);
   Slice key, value;
+  uint32_t column_family_id;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -68,6 +98,40 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTagColumnFamilyValue:
+        if (GetVarint32(&input, &column_family_id) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->PutCF(column_family_id, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Put");
+        }
+        break;
+      case kTagColumnFamilyDeletion:
+        if (GetVarint32(&input, &column_family_id) &&
+            GetLengthPrefixedSlice(&input, &key)) {
+          handler->DeleteCF(column_family_id, key);
+        } else {
+          return Status::Corruption("bad WriteBatch Delete");
+        }
+        break;
+      case kTagColumnFamilyMerge:
+        if (GetVarint32(&input, &column_family_id) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->MergeCF(column_family_id, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -96,41 +160,138 @@ void WriteBatchInternal::SetSequence(WriteBatch* b, SequenceNumber seq) {
 }
 
 void WriteBatch::Put(const Slice& key, const Slice& value) {
-  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
-  rep_.push_back(static_cast<char>(kTypeValue));
-  PutLengthPrefixedSlice(&rep_, key);
-  PutLengthPrefixedSlice(&rep_, value);
+  WriteBatchInternal::Put(this, 0, key, value);
 }
 
 void WriteBatch::Delete(const Slice& key) {
-  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
-  rep_.push_back(static_cast<char>(kTypeDeletion));
-  PutLengthPrefixedSlice(&rep_, key);
+  WriteBatchInternal::Delete(this, 0, key);
+}
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::Merge(this, 0, key, value);
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value) {
+  WriteBatchInternal::Put(this, column_family->GetID(), key, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  WriteBatchInternal::Delete(this, column_family->GetID(), key);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family,
+                       const Slice& key, const Slice& value) {
+  WriteBatchInternal::Merge(this, column_family->GetID(), key, value);
+}
+
+// Append the tag of a record, and the column family id it needs if any
+static void PutTag(std::string* rep, ValueType type, ColumnFamilyTag cf_tag,
+                   uint32_t column_family_id) {
+  if (column_family_id == 0) {
+    rep->push_back(static_cast<char>(type));
+  } else {
+    rep->push_back(static_cast<char>(cf_tag));
+    PutVarint32(rep, column_family_id);
+  }
+}
+
+void WriteBatchInternal::Put(WriteBatch* b, uint32_t column_family_id,
+                             const Slice& key, const Slice& value) {
+  SetCount(b, Count(b) + 1);
+  PutTag(&b->rep_, kTypeValue, kTagColumnFamilyValue, column_family_id);
+  PutLengthPrefixedSlice(&b->rep_, key);
+  PutLengthPrefixedSlice(&b->rep_, value);
+}
+
+void WriteBatchInternal::Delete(WriteBatch* b, uint32_t column_family_id,
+                                const Slice& key) {
+  SetCount(b, Count(b) + 1);
+  PutTag(&b->rep_, kTypeDeletion, kTagColumnFamilyDeletion,
+         column_family_id);
+  PutLengthPrefixedSlice(&b->rep_, key);
+}
+
+void WriteBatchInternal::Merge(WriteBatch* b, uint32_t column_family_id,
+                               const Slice& key, const Slice& value) {
+  SetCount(b, Count(b) + 1);
+  PutTag(&b->rep_, kTypeMerge, kTagColumnFamilyMerge, column_family_id);
+  PutLengthPrefixedSlice(&b->rep_, key);
+  PutLengthPrefixedSlice(&b->rep_, value);
 }
 
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
-  MemTable* mem_;
+  ColumnFamilyMemTables* memtables_;
+  Status status_;  // Set by the first update that could not be applied
 
-  virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
+  // Every update uses up a sequence number, even a skipped one
+  void Add(uint32_t column_family_id, ValueType type,
+           const Slice& key, const Slice& value) {
+    if (!status_.ok()) {
+      return;
+    }
+    MemTable* mem;
+    status_ = memtables_->GetMemTable(column_family_id, &mem);
+    if (status_.ok() && mem != NULL) {
+      mem->Add(sequence_, type, key, value);
+    }
     sequence_++;
   }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    Add(0, kTypeValue, key, value);
+  }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
-    sequence_++;
+    Add(0, kTypeDeletion, key, Slice());
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    Add(0, kTypeMerge, key, value);
+  }
+  virtual void PutCF(uint32_t column_family_id,
+                     const Slice& key, const Slice& value) {
+    Add(column_family_id, kTypeValue, key, value);
+  }
+  virtual void DeleteCF(uint32_t column_family_id, const Slice& key) {
+    Add(column_family_id, kTypeDeletion, key, Slice());
+  }
+  virtual void MergeCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value) {
+    Add(column_family_id, kTypeMerge, key, value);
   }
 };
+
+class DefaultMemTable : public ColumnFamilyMemTables {
+ public:
+  explicit DefaultMemTable(MemTable* mem) : mem_(mem) { }
+  virtual Status GetMemTable(uint32_t column_family_id, MemTable** mem) {
+    *mem = (column_family_id == 0) ? mem_ : NULL;
+    return Status::OK();
+  }
+
+ private:
+  MemTable* mem_;
+};
 }  // namespace
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                       MemTable* memtable) {
+  DefaultMemTable memtables(memtable);
+  return InsertInto(b, &memtables);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      ColumnFamilyMemTables* memtables) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
-  inserter.mem_ = memtable;
-  return b->Iterate(&inserter);
+  inserter.memtables_ = memtables;
+  Status s = b->Iterate(&inserter);
+  if (s.ok()) {
+    s = inserter.status_;
+  }
+  return s;
 }
 
 void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
@@ -11,6 +11,19 @@ namespace leveldb {
 
 class MemTable;
 
+// Maps the column families updated by a WriteBatch to the memtables
+// that receive their updates.
+class ColumnFamilyMemTables {
+ public:
+  virtual ~ColumnFamilyMemTables();
+
+  // Set "*mem" to the memtable of the column family with the given id,
+  // or to NULL if the updates of that column family are to be skipped.
+  // Returns an error if they can be neither applied nor skipped, which
+  // stops the insertion of the batch.
+  virtual Status GetMemTable(uint32_t column_family_id, MemTable** mem) = 0;
+};
+
 // WriteBatchInternal provides static methods for manipulating a
 // WriteBatch that we don't want in the public WriteBatch interface.
 class WriteBatchInternal {
@@ -38,8 +51,22 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Add an update of the column family with the given id, which is the
+  // default column family if it is 0.
+  static void Put(WriteBatch* batch, uint32_t column_family_id,
+                  const Slice& key, const Slice& value);
+  static void Delete(WriteBatch* batch, uint32_t column_family_id,
+                     const Slice& key);
+  static void Merge(WriteBatch* batch, uint32_t column_family_id,
+                    const Slice& key, const Slice& value);
+
+  // Apply the updates of the default column family to "memtable", and
+  // skip the others.
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  static Status InsertInto(const WriteBatch* batch,
+                           ColumnFamilyMemTables* memtables);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
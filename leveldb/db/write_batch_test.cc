@@ -38,6 +38,14 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
@@ -74,6 +82,19 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("baz"));
+  batch.Merge(Slice("box"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Merge(box, boo)@102"
+            "Merge(foo, baz)@101"
+            "Put(foo, bar)@100",
+            PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -113,6 +134,98 @@ TEST(WriteBatchTest, Append) {
             PrintContents(&b1));
 }
 
+namespace {
+// Records the updates of a batch, and feeds those of column family 3 to
+// its own memtable.
+class ColumnFamilyRecorder : public WriteBatch::Handler,
+                             public ColumnFamilyMemTables {
+ public:
+  std::string state;
+  MemTable* mem;
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    state.append("Put(" + key.ToString() + ", " + value.ToString() + ")");
+  }
+  virtual void Delete(const Slice& key) {
+    state.append("Delete(" + key.ToString() + ")");
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    state.append("Merge(" + key.ToString() + ", " + value.ToString() + ")");
+  }
+  virtual void PutCF(uint32_t id, const Slice& key, const Slice& value) {
+    state.append("PutCF(" + NumberToString(id) + ", " + key.ToString() +
+                 ", " + value.ToString() + ")");
+  }
+  virtual void DeleteCF(uint32_t id, const Slice& key) {
+    state.append("DeleteCF(" + NumberToString(id) + ", " + key.ToString() +
+                 ")");
+  }
+  virtual void MergeCF(uint32_t id, const Slice& key, const Slice& value) {
+    state.append("MergeCF(" + NumberToString(id) + ", " + key.ToString() +
+                 ", " + value.ToString() + ")");
+  }
+  virtual Status GetMemTable(uint32_t id, MemTable** result) {
+    if (id == 5) {
+      return Status::InvalidArgument("unknown column family");
+    }
+    *result = (id == 3) ? mem : NULL;
+    return Status::OK();
+  }
+};
+}  // namespace
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  WriteBatchInternal::Put(&batch, 3, Slice("foo"), Slice("x"));
+  WriteBatchInternal::Delete(&batch, 3, Slice("box"));
+  WriteBatchInternal::Merge(&batch, 4, Slice("baz"), Slice("boo"));
+  WriteBatchInternal::Put(&batch, 0, Slice("a"), Slice("b"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(5, WriteBatchInternal::Count(&batch));
+
+  ColumnFamilyRecorder recorder;
+  ASSERT_OK(batch.Iterate(&recorder));
+  ASSERT_EQ("Put(foo, bar)"
+            "PutCF(3, foo, x)"
+            "DeleteCF(3, box)"
+            "MergeCF(4, baz, boo)"
+            "Put(a, b)",
+            recorder.state);
+
+  // Skipped updates still use up their sequence numbers
+  InternalKeyComparator cmp(BytewiseComparator());
+  recorder.mem = new MemTable(cmp);
+  recorder.mem->Ref();
+  ASSERT_OK(WriteBatchInternal::InsertInto(&batch, &recorder));
+  std::string state;
+  Iterator* iter = recorder.mem->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    state.append(ikey.user_key.ToString() + "@" +
+                 NumberToString(ikey.sequence));
+  }
+  delete iter;
+  ASSERT_EQ("box@102foo@101", state);
+
+  // An update that can be neither applied nor skipped stops the batch
+  WriteBatch bad;
+  WriteBatchInternal::Put(&bad, 5, Slice("x"), Slice("y"));
+  WriteBatchInternal::Put(&bad, 3, Slice("z"), Slice("y"));
+  WriteBatchInternal::SetSequence(&bad, 200);
+  Status s = WriteBatchInternal::InsertInto(&bad, &recorder);
+  ASSERT_TRUE(s.ToString().find("Invalid argument") == 0) << s.ToString();
+  int entries = 0;
+  iter = recorder.mem->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    entries++;
+  }
+  delete iter;
+  ASSERT_EQ(2, entries);
+  recorder.mem->Unref();
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
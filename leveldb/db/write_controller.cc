@@ -0,0 +1,83 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+// The allowed rate never drops below this fraction of
+// Options::delayed_write_rate, which bounds the delay of a single write.
+static const int kMinRateDivisor = 16;
+
+WriteController::WriteController(const Options* options)
+    : options_(options),
+      state_(kNormal),
+      rate_(options->delayed_write_rate),
+      next_write_micros_(0),
+      delays_(0),
+      delay_micros_(0),
+      stops_(0),
+      stop_micros_(0) {
+}
+
+void WriteController::Update(int level0_files,
+                             uint64_t pending_compaction_bytes) {
+  const int l0_slowdown = options_->level0_slowdown_writes_trigger;
+  const int l0_stop = options_->level0_stop_writes_trigger;
+  const uint64_t soft = options_->soft_pending_compaction_bytes_limit;
+  const uint64_t hard = options_->hard_pending_compaction_bytes_limit;
+
+  const uint64_t max_rate = options_->delayed_write_rate;
+  const uint64_t min_rate = std::max<uint64_t>(1, max_rate / kMinRateDivisor);
+  if (level0_files >= l0_stop ||
+      (hard > 0 && pending_compaction_bytes >= hard)) {
+    // Writes that still fit in the memtable go on at the lowest rate
+    state_ = kStopped;
+    rate_ = min_rate;
+    return;
+  }
+
+  // How far each backlog has gone from its soft limit to its hard one
+  double debt = -1;
+  if (level0_files >= l0_slowdown) {
+    debt = static_cast<double>(level0_files - l0_slowdown) /
+        (l0_stop - l0_slowdown);
+  }
+  if (soft > 0 && pending_compaction_bytes >= soft) {
+    double bytes_debt = 0;
+    if (hard > soft) {
+      bytes_debt = static_cast<double>(pending_compaction_bytes - soft) /
+          (hard - soft);
+    }
+    debt = std::max(debt, bytes_debt);
+  }
+
+  if (debt < 0) {
+    state_ = kNormal;
+    next_write_micros_ = 0;
+    return;
+  }
+  state_ = kDelayed;
+  rate_ = std::max<uint64_t>(min_rate,
+                             static_cast<uint64_t>(max_rate * (1 - debt)));
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros) const {
+  if (state_ == kNormal || next_write_micros_ <= now_micros) {
+    return 0;
+  }
+  return next_write_micros_ - now_micros;
+}
+
+void WriteController::RecordWrite(uint64_t now_micros, size_t bytes) {
+  if (state_ == kNormal) {
+    return;
+  }
+  next_write_micros_ = std::max(next_write_micros_, now_micros) +
+      static_cast<uint64_t>(bytes * 1e6 / rate_);
+}
+
+}  // namespace leveldb
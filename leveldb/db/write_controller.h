@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Decides how long writes have to wait while compactions fall behind.
+//
+// Writes are delayed once the number of level-0 files, or the number of
+// bytes waiting to be compacted, reaches its soft limit.  The allowed
+// write rate starts at Options::delayed_write_rate and drops as the
+// backlog approaches its hard limit, where writes stop altogether until
+// compactions catch up (writes that still fit in the memtable are let
+// through at the lowest rate).  Every write is charged for its size, and the
+// next write waits until the writes before it would have been done at
+// the allowed rate, so the delay is shared by writers in proportion to
+// what they write instead of being a fixed sleep per write.
+//
+// Not thread-safe: the owner must provide synchronization (e.g. the
+// DB mutex).
+class WriteController {
+ public:
+  enum State {
+    kNormal,
+    kDelayed,
+    kStopped
+  };
+
+  // "options" must have been sanitized, and must outlive this object.
+  explicit WriteController(const Options* options);
+
+  // Recompute the state and the allowed rate from the current backlog.
+  void Update(int level0_files, uint64_t pending_compaction_bytes);
+
+  State state() const { return state_; }
+
+  // Bytes per second allowed unless the state is kNormal
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  // Return the number of microseconds the next write has to wait if it
+  // is made at "now_micros".
+  uint64_t GetDelay(uint64_t now_micros) const;
+
+  // Charge a write of "bytes" bytes made at "now_micros".
+  void RecordWrite(uint64_t now_micros, size_t bytes);
+
+  // Statistics
+  void RecordDelay(uint64_t micros) { delays_++; delay_micros_ += micros; }
+  void RecordStop(uint64_t micros) { stops_++; stop_micros_ += micros; }
+  uint64_t delays() const { return delays_; }
+  uint64_t delay_micros() const { return delay_micros_; }
+  uint64_t stops() const { return stops_; }
+  uint64_t stop_micros() const { return stop_micros_; }
+
+ private:
+  const Options* const options_;
+  State state_;
+  uint64_t rate_;
+  uint64_t next_write_micros_;   // When the charged writes are paid for
+
+  uint64_t delays_;
+  uint64_t delay_micros_;
+  uint64_t stops_;
+  uint64_t stop_micros_;
+
+  // No copying allowed
+  WriteController(const WriteController&);
+  void operator=(const WriteController&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
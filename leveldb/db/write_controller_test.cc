@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest {
+ public:
+  Options options_;
+
+  WriteControllerTest() {
+    options_.level0_slowdown_writes_trigger = 8;
+    options_.level0_stop_writes_trigger = 12;
+    options_.delayed_write_rate = 1 << 20;
+  }
+};
+
+TEST(WriteControllerTest, Level0Files) {
+  WriteController c(&options_);
+  c.Update(7, 0);
+  ASSERT_EQ(WriteController::kNormal, c.state());
+  ASSERT_EQ(0, c.GetDelay(0));
+
+  // The rate drops as the number of files grows
+  c.Update(8, 0);
+  ASSERT_EQ(WriteController::kDelayed, c.state());
+  ASSERT_EQ(1 << 20, c.delayed_write_rate());
+  c.Update(10, 0);
+  ASSERT_EQ(WriteController::kDelayed, c.state());
+  ASSERT_EQ(1 << 19, c.delayed_write_rate());
+  c.Update(11, 0);
+  ASSERT_EQ(1 << 18, c.delayed_write_rate());
+
+  c.Update(12, 0);
+  ASSERT_EQ(WriteController::kStopped, c.state());
+  ASSERT_EQ(1 << 16, c.delayed_write_rate());
+
+  c.Update(3, 0);
+  ASSERT_EQ(WriteController::kNormal, c.state());
+}
+
+TEST(WriteControllerTest, PendingBytes) {
+  WriteController c(&options_);
+  c.Update(0, 1ull << 40);
+  ASSERT_EQ(WriteController::kNormal, c.state());  // No limits set
+
+  options_.soft_pending_compaction_bytes_limit = 100 << 20;
+  options_.hard_pending_compaction_bytes_limit = 200 << 20;
+  c.Update(0, 99 << 20);
+  ASSERT_EQ(WriteController::kNormal, c.state());
+  c.Update(0, 150 << 20);
+  ASSERT_EQ(WriteController::kDelayed, c.state());
+  ASSERT_EQ(1 << 19, c.delayed_write_rate());
+  c.Update(0, 200 << 20);
+  ASSERT_EQ(WriteController::kStopped, c.state());
+
+  // The larger backlog decides
+  c.Update(11, 150 << 20);
+  ASSERT_EQ(1 << 18, c.delayed_write_rate());
+}
+
+TEST(WriteControllerTest, Delay) {
+  WriteController c(&options_);
+
+  // Writes are not charged while the state is normal
+  c.RecordWrite(1000, 1 << 20);
+  c.Update(8, 0);
+  ASSERT_EQ(0, c.GetDelay(1000));
+
+  // Each write pushes back the next one by its share of a second
+  c.RecordWrite(1000, 1 << 18);
+  ASSERT_EQ(250000, c.GetDelay(1000));
+  c.RecordWrite(1000, 1 << 18);
+  ASSERT_EQ(500000, c.GetDelay(1000));
+  ASSERT_EQ(100000, c.GetDelay(401000));
+  ASSERT_EQ(0, c.GetDelay(501000));
+
+  // Time that passed without writes is not saved up
+  c.RecordWrite(2001000, 1 << 18);
+  ASSERT_EQ(250000, c.GetDelay(2001000));
+
+  // Nothing is owed once compactions catch up
+  c.Update(0, 0);
+  ASSERT_EQ(0, c.GetDelay(2001000));
+  c.Update(8, 0);
+  ASSERT_EQ(0, c.GetDelay(2001000));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
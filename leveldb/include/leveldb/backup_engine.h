@@ -0,0 +1,106 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A BackupEngine keeps backups of a DB in a directory of its own.
+// Tables never change once written, so each one is stored once under
+// a name made of its number, checksum and size, and shared by all the
+// backups that contain it: a new backup only copies the tables that
+// were written since the previous ones.  The logs and descriptors are
+// kept separately for each backup.
+//
+// A backup directory may only be used by one BackupEngine at a time,
+// and a BackupEngine is not safe for concurrent use.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+#define STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Env;
+class RateLimiter;
+
+// Options to control the behavior of a BackupEngine
+struct BackupOptions {
+  // Used to read the files of the DB, and to access the backups and
+  // the directories they are restored to.
+  // Default: Env::Default()
+  Env* env;
+
+  // If non-NULL, bounds the rate at which the files of backups and
+  // restores are read, so that they leave some of the device's
+  // bandwidth to the DB.  It must outlive the BackupEngine.
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // Number of files that are checksummed or copied at the same time.
+  // Default: 4
+  int max_background_operations;
+
+  // Create a BackupOptions object with default values for all fields.
+  BackupOptions();
+};
+
+// Describes one backup, as returned by BackupEngine::GetBackupInfo()
+struct BackupInfo {
+  uint32_t backup_id;
+  int64_t timestamp;      // Seconds since the epoch
+  uint64_t size;          // Bytes in its files, shared or not
+  uint32_t number_files;
+};
+
+class BackupEngine {
+ public:
+  // Open the backups in the directory "backup_dir", which is created
+  // if it does not exist.  Removes whatever a backup that did not
+  // complete left behind.  Stores a pointer to the engine in *result
+  // and returns OK on success.  Stores NULL in *result and returns a
+  // non-OK status on error.  Caller should delete *result when it is
+  // no longer needed.
+  static Status Open(const BackupOptions& options,
+                     const std::string& backup_dir,
+                     BackupEngine** result);
+
+  BackupEngine() { }
+  virtual ~BackupEngine();
+
+  // Back up the current state of "db".  Writes to "db" are only
+  // blocked while it switches to a new log.  On success, stores the id
+  // of the new backup in *backup_id unless it is NULL.  Ids increase
+  // with every backup.
+  virtual Status CreateNewBackup(DB* db, uint32_t* backup_id) = 0;
+
+  // Store in *backup_info the backups that exist, oldest first.
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backup_info) = 0;
+
+  // Check that the files of the given backup have the size and
+  // checksum they had when it was created.
+  virtual Status VerifyBackup(uint32_t backup_id) = 0;
+
+  // Write the DB as of the given backup to "db_dir", which must not
+  // hold a DB.  Every file is checked against its checksum on the way.
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir) = 0;
+  virtual Status RestoreDBFromLatestBackup(const std::string& db_dir) = 0;
+
+  // Delete the given backup, and the tables no other backup uses.
+  virtual Status DeleteBackup(uint32_t backup_id) = 0;
+
+  // Delete all but the "num_backups_to_keep" most recent backups.
+  virtual Status PurgeOldBackups(uint32_t num_backups_to_keep) = 0;
+
+ private:
+  // No copying allowed
+  BackupEngine(const BackupEngine&);
+  void operator=(const BackupEngine&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
@@ -10,10 +10,12 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Two builtin cache implementations are provided: one with a
+// least-recently-used eviction policy, and one that approximates it
+// with the CLOCK algorithm so that lookups need no locks.  Clients may
+// use their own implementations if they want something more
+// sophisticated (like scan-resistance, a custom eviction policy,
+// variable cache sizing, etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -29,6 +31,36 @@ class Cache;
 // of Cache uses a least-recently-used eviction policy.
 extern Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but the cache is split into
+// 2^num_shard_bits independently locked shards.  If num_shard_bits is
+// negative, the number of shards is picked based on the number of
+// CPUs in the machine.
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Like NewLRUCache(capacity, num_shard_bits), but reserves the given
+// fraction of the capacity for entries inserted with kHighPriority.
+// High priority entries that do not fit in that pool are treated like
+// any other entry.  The two argument form uses a ratio of 0.5.
+extern Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                          double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// approximates LRU with the CLOCK algorithm: Lookup() and Release()
+// only touch atomic reference counts and never block, so many threads
+// can read from a warm cache without contending on a mutex.  Insert()
+// and Erase() still serialize on a per-shard mutex.
+//
+// Each shard uses a fixed-size hash table whose size is derived from
+// "estimated_entry_charge", the expected average charge of an entry
+// (e.g. Options::block_size for a block cache).  If a table fills up,
+// Insert() still returns a usable handle but the entry is not kept in
+// the cache once it is released.  num_shard_bits is interpreted as for
+// NewLRUCache().
+//
+// REQUIRES: estimated_entry_charge > 0
+extern Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                            size_t estimated_entry_charge);
+
 class Cache {
  public:
   Cache() { }
@@ -40,6 +72,14 @@ class Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // Hint about how valuable an entry is.  High priority entries, such
+  // as table index and filter blocks, are evicted only after low
+  // priority entries that have not been used recently.
+  enum Priority {
+    kLowPriority,
+    kHighPriority
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -52,6 +92,12 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but with an eviction priority hint.  The
+  // default implementation ignores the hint.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -81,6 +127,12 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Return an estimate of the combined charges of all elements stored
+  // in the cache, including ones that have been evicted or erased but
+  // are still referenced through a handle.  The default implementation
+  // returns 0.
+  virtual size_t TotalCharge() const;
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
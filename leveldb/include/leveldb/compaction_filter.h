@@ -0,0 +1,54 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object.
+// Compactions pass it the entries they rewrite, so that it can remove
+// or change them while they are being copied anyway: garbage that a
+// filter recognizes is collected without any extra I/O.
+//
+// A filter that removes every key with a given prefix is provided (see
+// NewPrefixCompactionFilter() below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter.  Used for logging.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" each time a compaction other
+  // than a trivial move rewrites it into "level", unless a snapshot
+  // may still read it.  Return true to remove the entry; the key then
+  // reads as deleted.  Otherwise, to replace the value, store the new
+  // one in *new_value and set *value_changed to true.
+  //
+  // Filter() is called from the background compaction thread, and may
+  // be called again with an entry it kept before.  It must not call
+  // back into the database.
+  virtual bool Filter(int level,
+                      const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const = 0;
+};
+
+// Return a new filter that removes every entry whose key starts with
+// "prefix", e.g. the records of a table that has been dropped.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const CompactionFilter* NewPrefixCompactionFilter(const Slice& prefix);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
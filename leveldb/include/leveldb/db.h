@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -29,6 +31,35 @@ class Snapshot {
   virtual ~Snapshot();
 };
 
+// Handle to a column family of a DB: a separate tree of keys with its
+// own Options, sharing the log and the writes of the DB it belongs to.
+// Handles are owned by the DB and stay valid until it is deleted.
+class ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle();
+
+  // Return the name the column family was created with.
+  virtual const std::string& GetName() const = 0;
+
+  // Return the id of the column family in WriteBatch records.  The
+  // default column family, which holds the updates that do not name
+  // one, has id zero.
+  virtual uint32_t GetID() const = 0;
+};
+
+// The name of the default column family.
+extern const char* const kDefaultColumnFamilyName;
+
+// A column family to open together with a DB.
+struct ColumnFamilyDescriptor {
+  std::string name;
+  Options options;
+
+  ColumnFamilyDescriptor() { }
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) { }
+};
+
 // A range of keys
 struct Range {
   Slice start;          // Included in the range
@@ -38,6 +69,22 @@ struct Range {
   Range(const Slice& s, const Slice& l) : start(s), limit(l) { }
 };
 
+// A file of a copy of a DB, as listed by DB::GetCheckpointFiles().
+struct CheckpointFile {
+  // Name of the file relative to the directory of the copy.  The files
+  // of column families other than the default one are in
+  // subdirectories.
+  std::string name;
+
+  // The file holds the first "size" bytes of the file of the DB named
+  // "source", or "contents" if "source" is empty.
+  std::string source;
+  uint64_t size;
+  std::string contents;
+
+  CheckpointFile() : size(0) { }
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -52,6 +99,56 @@ class DB {
                      const std::string& name,
                      DB** dbptr);
 
+  // Open the database with the specified "name" together with the
+  // listed column families, creating the ones that do not exist yet.
+  // Every column family of the database other than the default one
+  // must be listed.  On success stores in *handles one handle per
+  // entry of "column_families", in the same order.  The "env",
+  // "info_log" and the other settings shared by the whole database
+  // are taken from "options"; a column family without a block_cache
+  // of its own shares the one of "options".
+  static Status Open(const Options& options,
+                     const std::string& name,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles,
+                     DB** dbptr);
+
+  // Open the existing database with the specified "name" for reading
+  // only.  Unlike Open(), this does not take the lock of the database,
+  // so any number of processes may open it this way, next to the one
+  // that writes it.  The updates in its logs are kept in memory rather
+  // than written to tables, and the instance does not see the writes
+  // made after it was opened.  Writes to it return NotSupported.
+  //
+  // Column families may be left out of "column_families", but none of
+  // the listed ones is created.
+  static Status OpenForReadOnly(const Options& options,
+                                const std::string& name,
+                                DB** dbptr);
+  static Status OpenForReadOnly(
+      const Options& options,
+      const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles,
+      DB** dbptr);
+
+  // Same as OpenForReadOnly(), except that TryCatchUpWithPrimary() can
+  // bring the instance up to date with the writes of the process that
+  // has the database open with Open().
+  //
+  // Tables are read from the files of the primary, which may delete
+  // them once it compacts them.  A secondary that does not catch up
+  // often enough may then fail to read the tables it knows of.
+  static Status OpenAsSecondary(const Options& options,
+                                const std::string& name,
+                                DB** dbptr);
+  static Status OpenAsSecondary(
+      const Options& options,
+      const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles,
+      DB** dbptr);
+
   DB() { }
   virtual ~DB();
 
@@ -68,11 +165,48 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as an operand of Options::merge_operator for "key",
+  // without reading the current value.  Reads of "key" return the
+  // result of applying the operands to the value written before them.
+  // Fails with an invalid argument error if the database was opened
+  // without a merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Create a new column family named "name" with the specified options
+  // and store a handle to it in *handle.  Fails if a column family of
+  // that name exists already.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle);
+
+  // Remove the column family of "handle" and all its data.  The handle
+  // stays owned by the DB, but all further uses of it fail.  The
+  // default column family cannot be dropped.
+  virtual Status DropColumnFamily(ColumnFamilyHandle* handle);
+
+  // Return the handle of the default column family, which is used by
+  // the methods that take no handle, or NULL if the DB has no column
+  // families.  The handle is owned by the DB.
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const;
+
+  // Same as Put(), Delete() and Merge() above, for the column family
+  // of "handle".
+  virtual Status Put(const WriteOptions& options, ColumnFamilyHandle* handle,
+                     const Slice& key, const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* handle, const Slice& key);
+  virtual Status Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* handle,
+                       const Slice& key, const Slice& value);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -83,6 +217,10 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Same as Get() above, for the column family of "handle".
+  virtual Status Get(const ReadOptions& options, ColumnFamilyHandle* handle,
+                     const Slice& key, std::string* value);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -91,6 +229,10 @@ class DB {
   // The returned iterator should be deleted before this db is deleted.
   virtual Iterator* NewIterator(const ReadOptions& options) = 0;
 
+  // Same as NewIterator() above, for the column family of "handle".
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* handle);
+
   // Return a handle to the current DB state.  Iterators created with
   // this handle will all observe a stable snapshot of the current DB
   // state.  The caller must call ReleaseSnapshot(result) when the
@@ -115,8 +257,32 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.recovery-stats" - returns a multi-line string that describes
+  //     the time DB::Open took and the logs it replayed.
+  //  "leveldb.pending-compaction-bytes" - returns an estimate of the number
+  //     of bytes that have to be compacted before no level needs compaction.
+  //  "leveldb.write-delay" - returns a multi-line string that describes how
+  //     often and for how long writes were delayed or stopped to let
+  //     compactions catch up.
+  //  "leveldb.write-amplification" - returns a multi-line string with the
+  //     bytes written by memtable flushes, the bytes written by flushes and
+  //     compactions together, and their ratio.
+  //  "leveldb.rate-limiter" - returns a multi-line string that describes the
+  //     current rate of Options::rate_limiter and the time writes have
+  //     waited for it.  Not valid if the database has no rate limiter.
+  //  "leveldb.statistics" - returns a multi-line string with the tickers
+  //     and histograms of Options::statistics (see leveldb/statistics.h).
+  //     Not valid if the database has no statistics.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
+  // Same as GetProperty() above, for the column family of "handle".
+  // The properties that describe the shared state of the database
+  // ("leveldb.recovery-stats", "leveldb.write-delay",
+  // "leveldb.rate-limiter" and "leveldb.statistics") are the same for
+  // every column family.
+  virtual bool GetProperty(ColumnFamilyHandle* handle,
+                           const Slice& property, std::string* value);
+
   // For each i in [0,n-1], store in "sizes[i]", the approximate
   // file system space used by keys in "[range[i].start .. range[i].limit)".
   //
@@ -140,6 +306,39 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Same as CompactRange() above, for the column family of "handle".
+  virtual void CompactRange(ColumnFamilyHandle* handle,
+                            const Slice* begin, const Slice* end);
+
+  // Create in the directory "checkpoint_dir", which must not exist yet,
+  // a copy of the DB as of now that can be opened on its own.  Tables
+  // are hard linked when "checkpoint_dir" is on the same file system as
+  // the DB, so that the checkpoint takes little time and space; the
+  // logs and descriptors are copied.  Writes are only blocked while the
+  // current log is closed.
+  //
+  // Returns NotSupported if the implementation cannot create checkpoints.
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir);
+
+  // Store in *files the files that make up a copy of the DB as of now,
+  // without writing them anywhere.  The files of the DB that *files
+  // names are kept, even if the DB no longer needs them, until
+  // ReleaseCheckpointFiles() is called once for every successful call.
+  //
+  // Returns NotSupported if the implementation cannot create checkpoints.
+  virtual Status GetCheckpointFiles(std::vector<CheckpointFile>* files);
+  virtual void ReleaseCheckpointFiles();
+
+  // For an instance opened with OpenAsSecondary(): read the edits the
+  // primary saved to its descriptors and the records it added to its
+  // logs since the last call, so that reads see the updates it has
+  // made so far.  Only reads the parts of the files that are new, unless
+  // the primary has written out its memtables or started a new
+  // descriptor since.
+  //
+  // Returns NotSupported for the other instances.
+  virtual Status TryCatchUpWithPrimary();
+
  private:
   // No copying allowed
   DB(const DB&);
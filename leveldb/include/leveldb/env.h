@@ -23,6 +23,7 @@ namespace leveldb {
 
 class FileLock;
 class Logger;
+class PendingRead;
 class RandomAccessFile;
 class SequentialFile;
 class Slice;
@@ -69,6 +70,31 @@ class Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) = 0;
 
+  // Like NewRandomAccessFile(), but reads from the returned file bypass
+  // the operating system's page cache where that is supported.  Meant
+  // for large one-off reads, such as those done by compactions.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewRandomAccessFile(), but the returned file may read by
+  // mapping the file into memory where that is supported and address
+  // space is plentiful.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         RandomAccessFile** result);
+
+  // Like NewWritableFile(), but writes to the returned file bypass the
+  // operating system's page cache where that is supported.  Data
+  // appended to the file may be held back until Sync() or Close() even
+  // if Flush() is called, so the file should not be read until then.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -94,6 +120,13 @@ class Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Make target a hard link to the existing file src, so that both names
+  // refer to the same contents.  target must not exist.
+  //
+  // The default implementation returns NotSupported; callers should fall
+  // back to copying the file (e.g. with CopyFile()).
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores NULL in
   // *lock and returns non-OK.
@@ -142,6 +175,11 @@ class Env {
   // useful for computing deltas of time.
   virtual uint64_t NowMicros() = 0;
 
+  // Like NowMicros(), in nanoseconds, for timing short operations.
+  //
+  // The default implementation scales NowMicros().
+  virtual uint64_t NowNanos();
+
   // Sleep/delay the thread for the perscribed number of micro-seconds.
   virtual void SleepForMicroseconds(int micros) = 0;
 
@@ -194,6 +232,49 @@ class RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  enum AccessPattern {
+    kNormal,
+    kSequential,  // The file will be read from start to end
+    kWillNeed     // The range will be read soon
+  };
+
+  // Tell the operating system how bytes [offset..offset+n-1] of the
+  // file are about to be accessed; n == 0 extends the range to the
+  // end of the file.  This is only a hint.  The default implementation
+  // does nothing.
+  virtual void Advise(uint64_t offset, size_t n, AccessPattern pattern) const;
+
+  // Start the equivalent of Read(offset, n, result, scratch) without
+  // waiting for it to finish.  The caller takes ownership of the
+  // result, whose Wait() yields what Read() would have returned.
+  // "scratch[0..n-1]" and this file must stay live until the result
+  // is deleted.
+  //
+  // The default implementation reads synchronously.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual PendingRead* ReadAsync(uint64_t offset, size_t n,
+                                 char* scratch) const;
+};
+
+// A read started by RandomAccessFile::ReadAsync().
+class PendingRead {
+ public:
+  PendingRead() { }
+
+  // Waits for the read to finish if Wait() has not been called.
+  virtual ~PendingRead();
+
+  // Block until the read has finished.  Sets "*result" and returns
+  // the status as RandomAccessFile::Read() does.  May be called at
+  // most once.
+  virtual Status Wait(Slice* result) = 0;
+
+ private:
+  // No copying allowed
+  PendingRead(const PendingRead&);
+  void operator=(const PendingRead&);
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -257,6 +338,11 @@ extern Status WriteStringToFile(Env* env, const Slice& data,
 extern Status ReadFileToString(Env* env, const std::string& fname,
                                std::string* data);
 
+// A utility routine: write the first "size" bytes of the file named
+// "src" to a new file named "target", and sync it.
+extern Status CopyFile(Env* env, const std::string& src,
+                       const std::string& target, uint64_t size);
+
 // An implementation of Env that forwards all calls to another Env.
 // May be useful to clients who wish to override just part of the
 // functionality of another Env.
@@ -279,6 +365,10 @@ class EnvWrapper : public Env {
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     return target_->NewWritableFile(f, r);
   }
+  // NewDirectRandomAccessFile(), NewMmapRandomAccessFile() and
+  // NewDirectWritableFile() are not forwarded: they fall back to the
+  // methods above, so that a subclass that overrides those sees every
+  // file that gets opened.
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -292,6 +382,9 @@ class EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) {
     return target_->LockFile(f, l);
   }
@@ -311,6 +404,9 @@ class EnvWrapper : public Env {
   uint64_t NowMicros() {
     return target_->NowMicros();
   }
+  uint64_t NowNanos() {
+    return target_->NowNanos();
+  }
   void SleepForMicroseconds(int micros) {
     target_->SleepForMicroseconds(micros);
   }
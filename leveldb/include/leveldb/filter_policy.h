@@ -65,6 +65,20 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a blocked bloom filter: all of
+// the bits tested for a key lie within one 64-byte cache line, and on
+// x86 CPUs with AVX2 they are tested with a single vector compare.
+// bits_per_key only determines the filter size; every key sets eight
+// bits.  At 10 bits per key the false positive rate is ~1.4%, somewhat
+// higher than NewBloomFilterPolicy(10), in exchange for one cache miss
+// per probe.  Best used with Options::full_filters, where filters are
+// large.  The filters are tagged with a different name than those of
+// NewBloomFilterPolicy(), so switching an existing database to this
+// policy leaves older tables unfiltered until they are compacted.
+//
+// The same caveats about custom comparators apply.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
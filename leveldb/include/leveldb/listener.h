@@ -0,0 +1,77 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An EventListener is told about the background work of a database:
+// the memtables it flushes, the compactions it runs, and the changes in
+// how much it holds back writes.  Pass one in Options::listener.
+//
+// The database records each event under its lock and hands it to a
+// thread of its own that calls the listener, so a slow listener never
+// holds up writes or compactions; events are delivered in the order
+// they happened, and all of them before the database is deleted.  The
+// listener must not delete the database it is called for.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+#define STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+
+struct FlushJobInfo {
+  std::string cf_name;
+  uint64_t file_number;   // The table written
+  int level;              // Level the table was placed at
+  uint64_t file_size;
+  uint64_t micros;        // Time spent writing the table
+};
+
+struct CompactionJobInfo {
+  std::string cf_name;
+  int base_level;         // Level the compaction was picked at
+  int output_level;
+  std::vector<uint64_t> input_files;
+  std::vector<uint64_t> output_files;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t micros;        // Time spent merging, not counting flushes
+  Status status;
+};
+
+enum WriteStallCondition {
+  kWriteStallNormal,
+  kWriteStallDelayed,     // Writes are slowed down
+  kWriteStallStopped      // Writes wait for compactions to catch up
+};
+
+struct WriteStallInfo {
+  WriteStallCondition previous;
+  WriteStallCondition current;
+};
+
+class EventListener {
+ public:
+  virtual ~EventListener();
+
+  // Called after a memtable was written to a table.  The default
+  // implementations of these methods do nothing.
+  virtual void OnFlushCompleted(DB* db, const FlushJobInfo& info);
+
+  // Called after a compaction merged tables, whether it succeeded or
+  // not.  Compactions that only move a table to the next level are not
+  // reported.
+  virtual void OnCompactionCompleted(DB* db, const CompactionJobInfo& info);
+
+  // Called when writes start or stop being delayed or stopped.
+  virtual void OnStallConditionsChanged(DB* db, const WriteStallInfo& info);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_LISTENER_H_
@@ -0,0 +1,64 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a MergeOperator object, which
+// gives meaning to DB::Merge().  A merge records an operand for a key
+// without reading its value: reads apply the operands to the value
+// written before them, and compactions fold them together as they go.
+// A counter can thus be incremented with a single write, and without
+// racing other writers.
+//
+// Operators that add unsigned 64-bit integers and that append strings
+// are provided (see NewUInt64AddOperator() and NewStringAppendOperator()
+// below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  Used for logging.
+  virtual const char* Name() const = 0;
+
+  // Store in *new_value the result of applying "operand" to
+  // "*existing_value", or to nothing if existing_value is NULL (the key
+  // had no value, or was deleted).  Return false if the operand cannot
+  // be applied; the read or compaction then fails with a corruption
+  // error.
+  //
+  // The operation must be associative: compactions may merge two
+  // operands by passing the older one as existing_value, and apply the
+  // result to the value of the key later on.
+  virtual bool Merge(const Slice& key,
+                     const Slice* existing_value,
+                     const Slice& operand,
+                     std::string* new_value) const = 0;
+};
+
+// Return a new operator that adds unsigned 64-bit integers stored as
+// 8 bytes in little-endian order (see EncodeFixed64()).  Values and
+// operands of any other size count as zero.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const MergeOperator* NewUInt64AddOperator();
+
+// Return a new operator that appends each operand to the value, with
+// "delimiter" in between.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const MergeOperator* NewStringAppendOperator(const Slice& delimiter);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
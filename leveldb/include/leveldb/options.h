@@ -6,15 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
+class EventListener;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
 class Snapshot;
+class Statistics;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -27,6 +33,27 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// How the database merges its tables in the background.
+enum CompactionStyle {
+  // Tables are merged into a sequence of levels, each holding
+  // disjoint key ranges and about ten times the data of the one above.
+  // Reads are cheap, but each byte is rewritten about once per level.
+  kCompactionStyleLevel = 0,
+
+  // Every memtable becomes a sorted run in level-0, and runs of
+  // similar sizes are merged into larger ones.  Each byte is rewritten
+  // far fewer times, at the cost of reads that consult more runs and
+  // of up to twice the space while a large merge is under way.
+  kCompactionStyleUniversal = 1,
+
+  // Every memtable becomes a table in level-0 that is never merged.
+  // The oldest tables are deleted, without being read, once all tables
+  // take up more than fifo_max_table_files_size bytes or once they
+  // expire (see ttl).  Meant for caches and time series that only keep
+  // recent data.
+  kCompactionStyleFIFO = 2
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
   // -------------------
@@ -82,6 +109,158 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // Writes are slowed down once this many level-0 files have piled up
+  // because compactions cannot keep up.  The allowed write rate drops
+  // from delayed_write_rate as the number of files approaches
+  // level0_stop_writes_trigger.  Values below
+  // level0_file_num_compaction_trigger are raised to it.
+  //
+  // Default: 8
+  int level0_slowdown_writes_trigger;
+
+  // Writes stop once the memtable is full and this many level-0 files
+  // are waiting to be compacted, until compactions catch up.  Must be
+  // larger than level0_slowdown_writes_trigger.
+  //
+  // Default: 12
+  int level0_stop_writes_trigger;
+
+  // Like level0_slowdown_writes_trigger and level0_stop_writes_trigger,
+  // but for the estimated number of bytes that have to be compacted
+  // before no level needs compaction (see the
+  // "leveldb.pending-compaction-bytes" property).  0 disables a limit.
+  //
+  // Default: 0
+  uint64_t soft_pending_compaction_bytes_limit;
+
+  // Default: 0
+  uint64_t hard_pending_compaction_bytes_limit;
+
+  // Bytes per second that writes are allowed once they are slowed
+  // down.  The rate drops to as little as a sixteenth of this as the
+  // backlog of compactions approaches its hard limit.
+  //
+  // Default: 16MB
+  uint64_t delayed_write_rate;
+
+  // Number of levels in the tree.  A database cannot be opened with
+  // fewer levels than it has data in.  Must be between 2 and 7.
+  //
+  // Default: 7
+  int num_levels;
+
+  // Level-0 is compacted once it has this many files.
+  //
+  // Default: 4
+  int level0_file_num_compaction_trigger;
+
+  // Tables written to level-1 by compactions are about this large.
+  // Each deeper level multiplies the size by target_file_size_multiplier,
+  // which reduces the number of files in large databases.
+  //
+  // Default: 2MB and 1
+  size_t target_file_size_base;
+  int target_file_size_multiplier;
+
+  // Level-1 is compacted once it holds more than max_bytes_for_level_base
+  // bytes.  Each deeper level may hold max_bytes_for_level_multiplier
+  // times as much as the level above it.
+  //
+  // Default: 10MB and 10
+  uint64_t max_bytes_for_level_base;
+  int max_bytes_for_level_multiplier;
+
+  // If true, the size limits of levels are derived from the actual size
+  // of the deepest level that holds data: each level above it may hold
+  // 1/max_bytes_for_level_multiplier as much as the level below, but no
+  // less than max_bytes_for_level_base.  This keeps the ratio between
+  // levels steady as the database grows, which bounds the space taken
+  // up by stale versions of keys.
+  //
+  // Default: false
+  bool level_compaction_dynamic_level_bytes;
+
+  // How tables are merged in the background.  level0_* triggers count
+  // the sorted runs of kCompactionStyleUniversal.  Tables below level-0
+  // that a database was given under kCompactionStyleLevel are left
+  // where they are by kCompactionStyleUniversal.
+  //
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style;
+
+  // kCompactionStyleUniversal merges the runs that follow a run as long
+  // as each is at most universal_size_ratio percent larger than all the
+  // runs picked before it.
+  //
+  // Default: 1
+  int universal_size_ratio;
+
+  // Number of runs merged at once by kCompactionStyleUniversal.
+  //
+  // Default: 2 and no limit
+  int universal_min_merge_width;
+  int universal_max_merge_width;
+
+  // Once all the other runs together are this many percent of the size
+  // of the oldest run, kCompactionStyleUniversal merges every run,
+  // which bounds the space taken up by stale versions of keys.
+  //
+  // Default: 200
+  int universal_max_size_amplification_percent;
+
+  // kCompactionStyleFIFO deletes the oldest tables while all tables
+  // take up more than this many bytes.
+  //
+  // Default: 1GB
+  uint64_t fifo_max_table_files_size;
+
+  // If positive, entries expire this many seconds after they were
+  // written.  Every value is then stored with the time it was written,
+  // and compactions turn expired values into deletions, or drop them
+  // where no older version can be left behind.  kCompactionStyleFIFO
+  // also deletes whole tables once all of their entries have expired.
+  //
+  // Whether the ttl is positive is recorded when the database (or
+  // column family) is created; opening it with a ttl that disagrees
+  // fails with InvalidArgument.
+  //
+  // Default: 0
+  int ttl;
+
+  // If true (and ttl is positive), reads do not return expired entries
+  // that have not been compacted away yet.
+  //
+  // Default: false
+  bool hide_expired_keys;
+
+  // If non-NULL, compactions pass the entries they rewrite to the
+  // specified filter, which may remove or change them (see
+  // leveldb/compaction_filter.h).  With a positive ttl, the filter sees
+  // the values without the time they were written.  The filter must
+  // outlive the database.
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // If non-NULL, DB::Merge() records operands that reads apply with
+  // the specified operator (see leveldb/merge_operator.h).  A database
+  // that holds merge operands must always be opened with the same
+  // operator.  Cannot be combined with a positive ttl.  The operator
+  // must outlive the database.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // Number of threads DB::Open uses to replay the logs left behind by
+  // the previous incarnation.  With more than one thread, log blocks
+  // are read and checksummed concurrently with the replay and the
+  // level-0 tables that the replay produces are built in the
+  // background.  Recovery may then hold up to recovery_threads write
+  // buffers in memory at the same time.
+  //
+  // Default: 1
+  int recovery_threads;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -89,6 +268,24 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // If true, the descriptor records where the index and filter of each
+  // new table are stored, and tables are opened with that information
+  // instead of reading it back from the file.  Together with
+  // cache_index_and_filter_blocks, opening a table then reads nothing
+  // until the table is first used.  Descriptors that record this
+  // information cannot be read by versions of leveldb that predate it.
+  //
+  // Default: false
+  bool record_table_handles;
+
+  // Number of threads that open tables in the background once DB::Open
+  // has returned, level by level starting at level-0, until the table
+  // cache is full.  This takes the cost of opening tables off the first
+  // reads that touch them.  0 disables prewarming.
+  //
+  // Default: 0
+  int prewarm_threads;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -112,6 +309,61 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // Upper bound on the number of bytes an iterator reads from a table
+  // at a time once it notices that it is reading consecutive blocks.
+  // Readahead starts small and doubles with every sequential read up
+  // to this size; compactions read this much from the start.  0
+  // disables readahead.
+  //
+  // Default: 0
+  size_t readahead_size;
+
+  // Number of data blocks past the current one that an iterator reads
+  // in the background once it moves forward from one block to the
+  // next, so that fetching them overlaps with the work done on the
+  // current block.  0 disables prefetching.
+  //
+  // Default: 0
+  int prefetch_blocks;
+
+  // If true, the tables read and written by compactions bypass the
+  // operating system's page cache (e.g. via O_DIRECT), so that moving
+  // data between levels does not evict pages that foreground reads
+  // need.  Reads issued by the user keep going through the page cache
+  // and the block cache.  Has no effect if the Env does not support
+  // direct I/O for the files involved.
+  //
+  // Default: false
+  bool use_direct_io_for_compaction;
+
+  // If true, tables are read by mapping them into memory where the Env
+  // supports it (see Env::NewMmapRandomAccessFile), rather than with
+  // explicit reads.  Readahead and prefetching then only hint the
+  // operating system.
+  //
+  // Default: false
+  bool allow_mmap_reads;
+
+  // If non-NULL, use the specified limiter to bound the rate at which
+  // compactions and memtable flushes write tables (see
+  // leveldb/rate_limiter.h).  The limiter must outlive the database.
+  //
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // If non-NULL, the database counts what it does in the specified
+  // object (see leveldb/statistics.h).  It must outlive the database.
+  //
+  // Default: NULL
+  Statistics* statistics;
+
+  // If non-NULL, the database reports its flushes, compactions and
+  // write stalls to the specified listener (see leveldb/listener.h).
+  // It must outlive the database.
+  //
+  // Default: NULL
+  EventListener* listener;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +387,49 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If true, filter_policy builds one filter over all the keys of each
+  // new table (or of each partition, see partition_index_and_filters)
+  // instead of one filter per 2KB of data.  Such a filter is consulted
+  // before the index, so lookups of absent keys skip the index seek.
+  // Older versions of leveldb can still read these tables.
+  //
+  // Default: false
+  bool full_filters;
+
+  // If true, the index and filter blocks of each table are stored in
+  // block_cache, charged against its capacity and inserted with high
+  // priority, instead of being held on the heap for as long as the
+  // table is open.  This bounds their memory use on databases with
+  // many files, at the cost of occasionally re-reading them.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
+  // If true and cache_index_and_filter_blocks is set, the index and
+  // filter blocks of level-0 tables stay pinned in block_cache for as
+  // long as the table is open, so that the tables every read consults
+  // never miss.  Pinned blocks still count against the cache capacity.
+  //
+  // Default: false
+  bool pin_l0_filter_and_index_blocks_in_cache;
+
+  // If true, new tables split their index and filter into partitions
+  // of roughly metadata_block_size bytes, found through a small
+  // top-level index.  Table::Open then only reads the top-level index;
+  // partitions are loaded on demand through block_cache.  This keeps
+  // the resident metadata of large tables small.  Tables written with
+  // this option cannot be read by versions of leveldb that predate it.
+  //
+  // Default: false
+  bool partition_index_and_filters;
+
+  // Approximate size of each index partition when
+  // partition_index_and_filters is set.  This parameter can be changed
+  // dynamically.
+  //
+  // Default: 4K
+  size_t metadata_block_size;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -158,10 +453,17 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If non-zero, iterators read this many bytes at a time from the
+  // first block of each table on, rather than waiting to notice a
+  // sequential scan.  Useful for scans known to cover a large range.
+  // Default: 0
+  size_t readahead_size;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        readahead_size(0) {
   }
 };
 
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down where the reads of one thread spend their
+// time: searching memtables, checking tables and their filters, and
+// reading, checksumming and decompressing blocks.  Every thread has a
+// context of its own, which counts nothing until the thread raises its
+// perf level, so that the cost of measuring is only paid by the
+// operations being diagnosed:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   leveldb::SetPerfLevel(leveldb::kDisable);
+//   ... = leveldb::GetPerfContext()->ToString();
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum PerfLevel {
+  kDisable = 0,       // Count nothing
+  kEnableCount = 1,   // Count steps and bytes, but do not time them
+  kEnableTime = 2     // Count and time steps
+};
+
+// Set or return the perf level of the calling thread.
+extern void SetPerfLevel(PerfLevel level);
+extern PerfLevel GetPerfLevel();
+
+// Times are in nanoseconds.
+struct PerfContext {
+  // Set every counter to zero.
+  void Reset();
+
+  // Return the non-zero counters, e.g. "block_read_count = 2, ..."
+  std::string ToString() const;
+
+  uint64_t get_from_memtable_count;   // Memtables searched
+  uint64_t get_from_memtable_time;
+  uint64_t get_from_output_files_time;  // Searching the tables of a Version
+  uint64_t files_checked;             // Tables whose key range held the key
+  uint64_t level0_files_checked;      // ... of which at level 0
+  uint64_t find_table_count;          // Tables looked up in the table cache
+  uint64_t find_table_time;
+  uint64_t table_open_count;          // ... of which were not open yet
+  uint64_t bloom_filter_checks;       // Filter lookups
+  uint64_t bloom_filter_useful;       // ... that ruled the key out
+  uint64_t block_cache_hit_count;
+  uint64_t block_read_count;          // Blocks read from files
+  uint64_t block_read_bytes;
+  uint64_t block_read_time;           // Includes checksums and decompression
+  uint64_t block_checksum_time;
+  uint64_t block_decompress_time;
+};
+
+// Return the perf context of the calling thread.
+extern PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which a database writes the tables
+// produced by compactions and memtable flushes, so that this
+// background work leaves some of the device's bandwidth to foreground
+// reads.  A RateLimiter has internal synchronization, and may be shared
+// by several databases to bound the total rate of their background
+// writes.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace leveldb {
+
+class RateLimiter {
+ public:
+  virtual ~RateLimiter();
+
+  // Block until "bytes" more bytes may be written.
+  virtual void Request(size_t bytes) = 0;
+
+  // Return the number of bytes currently allowed per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Change the number of bytes allowed per second.  For an auto-tuned
+  // limiter, this changes the highest rate it may pick.  REQUIRES:
+  // bytes_per_second > 0
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the total number of microseconds that callers of Request()
+  // have been made to wait.
+  virtual uint64_t GetTotalWaitMicros() const = 0;
+
+  // Called by a database whenever the number of bytes that are waiting
+  // to be compacted may have changed.  The default implementation
+  // ignores it.
+  virtual void ReportPendingCompactionBytes(uint64_t bytes);
+};
+
+// Return a new rate limiter that allows "bytes_per_second" bytes per
+// second, using a token bucket that holds at most a tenth of a
+// second's worth of tokens.
+// REQUIRES: bytes_per_second > 0
+extern RateLimiter* NewRateLimiter(int64_t bytes_per_second);
+
+// Return a new rate limiter whose rate follows the compaction backlog:
+// it starts at an eighth of "max_bytes_per_second", and moves towards
+// "max_bytes_per_second" as long as the number of bytes waiting to be
+// compacted keeps growing, and back down as it shrinks.  Best used by
+// a single database, since the backlogs reported by several of them
+// would be mixed up.
+// REQUIRES: max_bytes_per_second > 0
+extern RateLimiter* NewAutoTunedRateLimiter(int64_t max_bytes_per_second);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,111 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object collects counters ("tickers") and latency
+// histograms about the work a database does: block cache hits and
+// misses, how often filters saved a read, how long writes were
+// stalled, and how long Get, Write and Seek calls took.  Pass one in
+// Options::statistics to have the database update it.
+//
+// A Statistics object has internal synchronization and may be shared
+// by several databases to collect their combined numbers.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum Ticker {
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+  kBlockCacheAdd,
+  // A filter showed that a table does not contain the key looked for,
+  // so its data blocks were not read.
+  kBloomFilterUseful,
+  // A filter could not rule the key out.
+  kBloomFilterPositive,
+  // A filter could not rule the key out, but the table turned out not
+  // to contain it.
+  kBloomFilterFalsePositive,
+  kMemtableHit,
+  kMemtableMiss,
+  kKeysRead,
+  kKeysWritten,
+  kBytesRead,
+  kBytesWritten,
+  kSeeks,
+  // Microseconds writers were delayed or stopped to let compactions
+  // catch up.
+  kStallMicros,
+  kCompactReadBytes,
+  kCompactWriteBytes,
+  kFlushWriteBytes,
+  kNumTickers
+};
+
+enum HistogramType {
+  kGetMicros = 0,
+  kWriteMicros,
+  kSeekMicros,
+  kCompactionMicros,
+  kNumHistograms
+};
+
+// Return the name of the ticker or histogram, e.g. "block_cache_hit".
+extern const char* TickerName(Ticker ticker);
+extern const char* HistogramName(HistogramType type);
+
+struct HistogramData {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  double average;
+  double median;
+  double percentile95;
+  double percentile99;
+};
+
+class Statistics {
+ public:
+  Statistics() { }
+  virtual ~Statistics();
+
+  // Add "count" to the given ticker.
+  virtual void RecordTick(Ticker ticker, uint64_t count) = 0;
+
+  // Return the current value of the given ticker.
+  virtual uint64_t GetTickerCount(Ticker ticker) const = 0;
+
+  // Add a measurement of "micros" to the given histogram.
+  virtual void MeasureTime(HistogramType type, uint64_t micros) = 0;
+
+  // Store a summary of the given histogram in *data.
+  virtual void GetHistogramData(HistogramType type,
+                                HistogramData* data) const = 0;
+
+  // Set all tickers and histograms back to zero.  Updates that happen
+  // at the same time may be lost.
+  virtual void Reset() = 0;
+
+  // Return a human-readable dump of all tickers and histograms.
+  virtual std::string ToString() const;
+
+ private:
+  // No copying allowed
+  Statistics(const Statistics&);
+  void operator=(const Statistics&);
+};
+
+// Return a new Statistics object.  Its counters are spread over the
+// processors of the machine, so that updates from threads running on
+// different processors rarely touch the same cache line.
+extern Statistics* NewStatistics();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
@@ -6,17 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include "leveldb/cache.h"
 #include "leveldb/iterator.h"
 
 namespace leveldb {
 
 class Block;
 class BlockHandle;
+struct CachedFilter;
+class FilterBlockReader;
 class Footer;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableHandles;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -35,9 +39,27 @@ class Table {
   // for the duration of the returned table's lifetime.
   //
   // *file must remain live while this Table is in use.
+  //
+  // If options.cache_index_and_filter_blocks is set, the index and
+  // filter blocks are inserted into options.block_cache and, if
+  // options.pin_l0_filter_and_index_blocks_in_cache is also set,
+  // pinned there until the table is deleted.
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     Table** table);
+
+  // Like Open() above, but "handles" may hold the result of
+  // TableBuilder::Handles() for this table, which is used instead of
+  // reading the footer and the metaindex block.  If, in addition,
+  // options.cache_index_and_filter_blocks is set and the blocks are
+  // not pinned, the index and filter blocks are read on first use, so
+  // that opening the table reads nothing from the file.  Empty or
+  // malformed handles are ignored.
   static Status Open(const Options& options,
                      RandomAccessFile* file,
                      uint64_t file_size,
+                     const Slice& handles,
                      Table** table);
 
   ~Table();
@@ -61,20 +83,72 @@ class Table {
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* ScanBlockReader(void*, const ReadOptions&, const Slice&);
+  static void PrefetchBlock(void*, const ReadOptions&, const Slice&);
+  static Iterator* PartitionReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* ReadCachedBlock(Table* table, RandomAccessFile* file,
+                                   const ReadOptions&,
+                                   const Slice& index_value,
+                                   Cache::Priority priority);
+
+  // Returns an iterator mapping keys to data block handles.  For
+  // partitioned tables this iterates over all index partitions.
+  Iterator* NewIndexIterator() const;
+
+  // Returns an iterator over the index block named by the footer,
+  // fetching it through the block cache if it is not held by this
+  // table.  For partitioned tables this is the top-level index.
+  Iterator* NewIndexBlockIterator() const;
+
+  // Returns an iterator over the index partition that may contain k,
+  // and stores the partition's filter, if any, in *filter.  The filter
+  // must be released like the result of LoadFilter().  Sets
+  // *filter_passed if a filter of the partition was checked and could
+  // not rule k out.
+  Iterator* NewPartitionIterator(const Slice& k,
+                                 FilterBlockReader** filter,
+                                 uint64_t* filter_base,
+                                 Cache::Handle** filter_cache_handle,
+                                 CachedFilter** uncached_filter,
+                                 bool* filter_passed) const;
+
+  // Returns the filter for this table, or NULL if there is none.  If
+  // *cache_handle is non-NULL on return, the caller must release it
+  // from the block cache once done with the filter.
+  FilterBlockReader* GetFilter(Cache::Handle** cache_handle) const;
+
+  // Returns the filter stored at handle, read through the block cache,
+  // or NULL if it cannot be read.  The caller must release a non-NULL
+  // *cache_handle and delete *uncached once done with the filter.
+  FilterBlockReader* LoadFilter(const BlockHandle& handle,
+                                Cache::Handle** cache_handle,
+                                CachedFilter** uncached) const;
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key), and then with the entries that follow it for as long
+  // as handle_result returns true.  May not make such a call if filter
+  // policy says that key is not present.  Unless filter_passed is NULL,
+  // sets *filter_passed to whether a filter was checked and could not
+  // rule the key out.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
-      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      bool* filter_passed);
 
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
 
+  // Sets up the filter described by handles recorded at build time.
+  // If lazy, the filter is left to be read on first use.
+  void UseRecordedMeta(const TableHandles& handles, bool lazy);
+
+  // Reads the index and filter blocks into the block cache if they are
+  // kept there and are not present yet.
+  void LoadMetadata() const;
+
   // No copying allowed
   Table(const Table&);
   void operator=(const Table&);
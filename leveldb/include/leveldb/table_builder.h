@@ -60,6 +60,12 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   Status Finish();
 
+  // Returns an encoding of where the finished table keeps its index and
+  // filter.  Passing it to Table::Open spares reading that information
+  // back from the file.
+  // REQUIRES: Finish() has been called and returned ok
+  std::string Handles() const;
+
   // Indicate that the contents of this builder should be abandoned.  Stops
   // using the file passed to the constructor after this function returns.
   // If the caller is not going to call Finish(), it must call Abandon()
@@ -78,6 +84,7 @@ class TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void FinishPartition();
 
   struct Rep;
   Rep* rep_;
@@ -21,11 +21,13 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
 #include <string>
 #include "leveldb/status.h"
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class WriteBatch {
@@ -39,6 +41,18 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Record "value" as a merge operand for "key" (see DB::Merge()).
+  void Merge(const Slice& key, const Slice& value);
+
+  // Variants of the above that update "column_family" instead of the
+  // default column family.  The updates of all the column families in
+  // a batch are applied atomically.
+  void Put(ColumnFamilyHandle* column_family,
+           const Slice& key, const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void Merge(ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +62,16 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    virtual void Merge(const Slice& key, const Slice& value) = 0;
+
+    // Updates of the column family with the given id (never the
+    // default column family, whose id is 0).  The default
+    // implementations ignore them.
+    virtual void PutCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value);
+    virtual void DeleteCF(uint32_t column_family_id, const Slice& key);
+    virtual void MergeCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value);
   };
   Status Iterate(Handler* handler) const;
 
@@ -70,6 +70,12 @@ typedef intptr_t OnceType;
 #define LEVELDB_ONCE_INIT 0
 extern void InitOnce(port::OnceType*, void (*initializer)());
 
+// Storage class for variables of which every thread has its own copy.
+// Only types without constructors or destructors may be used.
+// Used as follows:
+//      static LEVELDB_THREAD_LOCAL int counter;
+#define LEVELDB_THREAD_LOCAL __thread
+
 // A type that holds a pointer that can be read or written atomically
 // (i.e., without word-tearing.)
 class AtomicPointer {
@@ -99,6 +105,24 @@ class AtomicPointer {
   void NoBarrier_Store(void* v);
 };
 
+// Atomically add "delta" to *p and return the new value.  Acts as a
+// full memory barrier.
+extern uint32_t AtomicAdd32(volatile uint32_t* p, int32_t delta);
+
+// If *p == old_value, atomically replace it with new_value and return
+// true.  Else return false.  Acts as a full memory barrier.
+extern bool AtomicCompareAndSwap32(volatile uint32_t* p,
+                                   uint32_t old_value, uint32_t new_value);
+
+// Like AtomicAdd32, but for size_t counters.  Subtract by passing
+// the two's complement of the amount.
+extern size_t AtomicAddSize(volatile size_t* p, size_t delta);
+
+// 64-bit versions of AtomicAdd32 and AtomicCompareAndSwap32.
+extern uint64_t AtomicAdd64(volatile uint64_t* p, uint64_t delta);
+extern bool AtomicCompareAndSwap64(volatile uint64_t* p,
+                                   uint64_t old_value, uint64_t new_value);
+
 // ------------------ Compression -------------------
 
 // Store the snappy compression of "input[0,input_length-1]" in *output.
@@ -124,6 +148,16 @@ extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
 
 // ------------------ Miscellaneous -------------------
 
+// Returns the number of processors that are currently online, or 1
+// if that cannot be determined.
+extern int NumCPUs();
+
+// Returns the processor the calling thread is running on, or 0 if that
+// cannot be determined.  The thread may have moved by the time the
+// caller looks at the result, so it is only a hint for spreading
+// contended data across processors.
+extern int CurrentCPU();
+
 // If heap profiling is not supported, returns false.
 // Else repeatedly calls (*func)(arg, data, n) and then returns true.
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
@@ -5,8 +5,12 @@
 #include "port/port_posix.h"
 
 #include <cstdlib>
+#if defined(OS_LINUX)
+#include <sched.h>
+#endif
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "util/logging.h"
 
 namespace leveldb {
@@ -50,5 +54,19 @@ void InitOnce(OnceType* once, void (*initializer)()) {
   PthreadCall("once", pthread_once(once, initializer));
 }
 
+int NumCPUs() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? static_cast<int>(n) : 1;
+}
+
+int CurrentCPU() {
+#if defined(OS_LINUX)
+  int cpu = sched_getcpu();
+  return (cpu >= 0) ? cpu : 0;
+#else
+  return 0;
+#endif
+}
+
 }  // namespace port
 }  // namespace leveldb
@@ -103,6 +103,34 @@ typedef pthread_once_t OnceType;
 #define LEVELDB_ONCE_INIT PTHREAD_ONCE_INIT
 extern void InitOnce(OnceType* once, void (*initializer)());
 
+#define LEVELDB_THREAD_LOCAL __thread
+
+inline uint32_t AtomicAdd32(volatile uint32_t* p, int32_t delta) {
+  return __sync_add_and_fetch(p, delta);
+}
+
+inline bool AtomicCompareAndSwap32(volatile uint32_t* p,
+                                   uint32_t old_value, uint32_t new_value) {
+  return __sync_bool_compare_and_swap(p, old_value, new_value);
+}
+
+inline size_t AtomicAddSize(volatile size_t* p, size_t delta) {
+  return __sync_add_and_fetch(p, delta);
+}
+
+inline uint64_t AtomicAdd64(volatile uint64_t* p, uint64_t delta) {
+  return __sync_add_and_fetch(p, delta);
+}
+
+inline bool AtomicCompareAndSwap64(volatile uint64_t* p,
+                                   uint64_t old_value, uint64_t new_value) {
+  return __sync_bool_compare_and_swap(p, old_value, new_value);
+}
+
+extern int NumCPUs();
+
+extern int CurrentCPU();
+
 inline bool Snappy_Compress(const char* input, size_t length,
                             ::std::string* output) {
 #ifdef SNAPPY
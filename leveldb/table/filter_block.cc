@@ -15,11 +15,23 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
+// Full filters are encoded with a base so large that every block
+// offset maps to the first (and only) filter.  Readers that predate
+// full filters therefore still find the right filter for every key.
+static const size_t kFullFilterBaseLg = 63;
+
 FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {
+    : policy_(policy),
+      full_(false) {
+}
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, bool full)
+    : policy_(policy),
+      full_(full) {
 }
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_) return;
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -34,7 +46,7 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
 }
 
 Slice FilterBlockBuilder::Finish() {
-  if (!start_.empty()) {
+  if (!start_.empty() || (full_ && filter_offsets_.empty())) {
     GenerateFilter();
   }
 
@@ -45,7 +57,8 @@ Slice FilterBlockBuilder::Finish() {
   }
 
   PutFixed32(&result_, array_offset);
-  result_.push_back(kFilterBaseLg);  // Save encoding parameter in result
+  // Save encoding parameter in result
+  result_.push_back(full_ ? kFullFilterBaseLg : kFilterBaseLg);
   return Slice(result_);
 }
 
@@ -108,4 +121,8 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+bool FilterBlockReader::full() const {
+  return num_ == 1 && base_lg_ == kFullFilterBaseLg;
+}
+
 }
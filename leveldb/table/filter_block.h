@@ -26,9 +26,14 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// A "full" builder ignores block boundaries and generates a single
+// filter over every key added, which readers can consult without
+// knowing which data block would hold a key.
 class FilterBlockBuilder {
  public:
   explicit FilterBlockBuilder(const FilterPolicy*);
+  FilterBlockBuilder(const FilterPolicy*, bool full);
 
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
@@ -38,6 +43,7 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const bool full_;
   std::string keys_;              // Flattened key contents
   std::vector<size_t> start_;     // Starting index in keys_ of each key
   std::string result_;            // Filter data computed so far
@@ -55,6 +61,10 @@ class FilterBlockReader {
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // True iff the block holds a single filter over all keys, in which
+  // case KeyMayMatch() ignores block_offset.
+  bool full() const;
+
  private:
   const FilterPolicy* policy_;
   const char* data_;    // Pointer to filter data (at block-start)
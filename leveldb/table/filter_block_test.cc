@@ -121,6 +121,36 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, FullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+  builder.StartBlock(9000);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+  FilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.full());
+
+  // Every offset maps to the one filter over all keys
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hello"));
+  ASSERT_TRUE(reader.KeyMayMatch(100000, "box"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "bar"));
+  ASSERT_TRUE(! reader.KeyMayMatch(100000, "missing"));
+
+  FilterBlockBuilder empty_builder(&policy_, true);
+  FilterBlockReader empty_reader(&policy_, empty_builder.Finish());
+  ASSERT_TRUE(empty_reader.full());
+  ASSERT_TRUE(! empty_reader.KeyMayMatch(0, "foo"));
+
+  FilterBlockBuilder segmented(&policy_);
+  segmented.StartBlock(0);
+  segmented.AddKey("foo");
+  ASSERT_TRUE(! FilterBlockReader(&policy_, segmented.Finish()).full());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -9,6 +9,7 @@
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -36,8 +37,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_ ? kPartitionedTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
 }
 
@@ -47,7 +50,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic == kPartitionedTableMagicNumber) {
+    partitioned_ = true;
+  } else if (magic == kTableMagicNumber) {
+    partitioned_ = false;
+  } else {
     return Status::InvalidArgument("not an sstable (bad magic number)");
   }
 
@@ -63,10 +70,37 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
+void TableHandles::EncodeTo(std::string* dst) const {
+  footer.EncodeTo(dst);
+  PutLengthPrefixedSlice(dst, filter_key);
+  PutLengthPrefixedSlice(dst, filter_handle);
+}
+
+Status TableHandles::DecodeFrom(Slice* input) {
+  if (input->size() < Footer::kEncodedLength) {
+    return Status::Corruption("table handles too short");
+  }
+  Status result = footer.DecodeFrom(input);
+  Slice key, handle;
+  if (result.ok()) {
+    if (GetLengthPrefixedSlice(input, &key) &&
+        GetLengthPrefixedSlice(input, &handle)) {
+      filter_key = key.ToString();
+      filter_handle = handle.ToString();
+    } else {
+      result = Status::Corruption("bad table handles");
+    }
+  }
+  return result;
+}
+
 Status ReadBlock(RandomAccessFile* file,
                  const ReadOptions& options,
                  const BlockHandle& handle,
                  BlockContents* result) {
+  PerfTimer timer(&perf_context.block_read_time);
+  PERF_COUNTER_ADD(block_read_count, 1);
+  PERF_COUNTER_ADD(block_read_bytes, handle.size());
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -89,6 +123,7 @@ Status ReadBlock(RandomAccessFile* file,
   // Check the crc of the type and the block contents
   const char* data = contents.data();    // Pointer to where Read put the data
   if (options.verify_checksums) {
+    PerfTimer checksum_timer(&perf_context.block_checksum_time);
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
@@ -117,6 +152,7 @@ Status ReadBlock(RandomAccessFile* file,
       // Ok
       break;
     case kSnappyCompression: {
+      PerfTimer decompress_timer(&perf_context.block_decompress_time);
       size_t ulength = 0;
       if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
         delete[] buf;
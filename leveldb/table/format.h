@@ -46,7 +46,7 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer() : partitioned_(false) { }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -60,6 +60,12 @@ class Footer {
     index_handle_ = h;
   }
 
+  // True iff the index block is a top-level index over index
+  // partitions.  Such tables carry kPartitionedTableMagicNumber so that
+  // readers that do not understand partitions reject them.
+  bool partitioned() const { return partitioned_; }
+  void set_partitioned(bool p) { partitioned_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
@@ -73,6 +79,20 @@ class Footer {
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_;
+};
+
+// The locations Table::Open reads from the tail of a table: its footer
+// and, if the table has a filter, the metaindex entry that names it.
+// TableBuilder records them so that a table can later be opened without
+// reading them back from the file.
+struct TableHandles {
+  Footer footer;
+  std::string filter_key;     // Empty if the table has no filter
+  std::string filter_handle;  // Metaindex value stored under filter_key
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(Slice* input);
 };
 
 // kTableMagicNumber was picked by running
@@ -80,6 +100,9 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables whose index and filter are partitioned.
+static const uint64_t kPartitionedTableMagicNumber = 0x88e241b785f4cff7ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -0,0 +1,138 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+// An iterator over a sorted vector of keys.  The value of every entry
+// is the name of the iterator, so that tests can tell children apart.
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(const std::vector<std::string>& keys,
+                 const std::string& name)
+      : keys_(keys), name_(name), pos_(keys.size()) {
+  }
+
+  virtual bool Valid() const { return pos_ < keys_.size(); }
+  virtual void SeekToFirst() { pos_ = 0; }
+  virtual void SeekToLast() {
+    pos_ = keys_.empty() ? 0 : keys_.size() - 1;
+  }
+  virtual void Seek(const Slice& target) {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(),
+                            target.ToString()) - keys_.begin();
+  }
+  virtual void Next() { assert(Valid()); pos_++; }
+  virtual void Prev() {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? keys_.size() : pos_ - 1;
+  }
+  virtual Slice key() const { assert(Valid()); return keys_[pos_]; }
+  virtual Slice value() const { assert(Valid()); return name_; }
+  virtual Status status() const { return Status::OK(); }
+
+ private:
+  const std::vector<std::string> keys_;
+  const std::string name_;
+  size_t pos_;
+};
+
+class MergerTest { };
+
+static std::string RandomKey(Random* rnd) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%08d", static_cast<int>(rnd->Uniform(100000)));
+  return buf;
+}
+
+TEST(MergerTest, TiesFollowChildOrder) {
+  std::vector<std::string> keys;
+  keys.push_back("a");
+  keys.push_back("b");
+  Iterator* list[3];
+  list[0] = new VectorIterator(keys, "0");
+  list[1] = new VectorIterator(keys, "1");
+  list[2] = new VectorIterator(keys, "2");
+  Iterator* iter = NewMergingIterator(BytewiseComparator(), list, 3);
+
+  std::string forward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->key().ToString() + iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("a0 a1 a2 b0 b1 b2 ", forward);
+
+  std::string backward;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    backward += iter->key().ToString() + iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("b2 b1 b0 a2 a1 a0 ", backward);
+  delete iter;
+}
+
+TEST(MergerTest, RandomWalk) {
+  Random rnd(301);
+  for (int n = 1; n <= 32; n = (n < 4) ? n + 1 : n * 2) {
+    // Distribute distinct keys over n children, leaving some empty
+    std::set<std::string> model;
+    std::vector<std::vector<std::string> > child_keys(n);
+    for (int i = 0; i < 200 * n; i++) {
+      const std::string key = RandomKey(&rnd);
+      if (model.insert(key).second) {
+        child_keys[rnd.Uniform(n)].push_back(key);
+      }
+    }
+    std::vector<Iterator*> list;
+    for (int i = 0; i < n; i++) {
+      std::sort(child_keys[i].begin(), child_keys[i].end());
+      list.push_back(new VectorIterator(child_keys[i], "v"));
+    }
+    Iterator* iter = NewMergingIterator(BytewiseComparator(), &list[0], n);
+
+    std::set<std::string>::const_iterator pos = model.end();
+    for (int step = 0; step < 5000; step++) {
+      const int op = rnd.Uniform(5);
+      if (op == 0) {
+        iter->SeekToFirst();
+        pos = model.begin();
+      } else if (op == 1) {
+        iter->SeekToLast();
+        pos = model.empty() ? model.end() : --model.end();
+      } else if (op == 2) {
+        const std::string target = RandomKey(&rnd);
+        iter->Seek(target);
+        pos = model.lower_bound(target);
+      } else if (pos != model.end() && op == 3) {
+        iter->Next();
+        ++pos;
+      } else if (pos != model.end()) {
+        iter->Prev();
+        pos = (pos == model.begin()) ? model.end() : --pos;
+      }
+      if (pos == model.end()) {
+        ASSERT_TRUE(!iter->Valid()) << n << " " << step;
+      } else {
+        ASSERT_TRUE(iter->Valid()) << n << " " << step;
+        ASSERT_EQ(*pos, iter->key().ToString());
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/readahead_file.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace leveldb {
+
+// Size of the first read ahead once a scan has been detected
+static const size_t kInitialReadahead = 8 * 1024;
+
+// Number of reads that must each continue the previous one before
+// reading ahead
+static const int kMinSequentialReads = 2;
+
+// Upper bound on the number of outstanding prefetches
+static const size_t kMaxPrefetched = 64;
+
+ReadaheadFile::ReadaheadFile(RandomAccessFile* file, uint64_t file_size,
+                             size_t max_readahead, bool sequential)
+    : file_(file),
+      file_size_(file_size),
+      max_readahead_(max_readahead),
+      fixed_(sequential),
+      mapped_(false),
+      buffer_offset_(0),
+      next_offset_(0),
+      sequential_reads_(0),
+      readahead_(sequential ? max_readahead
+                            : std::min(kInitialReadahead, max_readahead)),
+      advised_end_(0) {
+}
+
+ReadaheadFile::~ReadaheadFile() {
+  while (!prefetched_.empty()) {
+    DropPrefetched();
+  }
+}
+
+void ReadaheadFile::DropPrefetched() const {
+  delete prefetched_.front().read;
+  delete[] prefetched_.front().scratch;
+  prefetched_.pop_front();
+}
+
+void ReadaheadFile::Prefetch(uint64_t offset, size_t n) {
+  if (offset + n > file_size_ ||
+      (offset >= buffer_offset_ &&
+       offset + n <= buffer_offset_ + buffer_.size()) ||
+      (!prefetched_.empty() && offset <= prefetched_.back().offset) ||
+      prefetched_.size() >= kMaxPrefetched) {
+    return;
+  }
+  Prefetched p;
+  p.offset = offset;
+  p.n = n;
+  p.scratch = new char[n];
+  p.read = file_->ReadAsync(offset, n, p.scratch);
+  prefetched_.push_back(p);
+}
+
+Status ReadaheadFile::Read(uint64_t offset, size_t n, Slice* result,
+                           char* scratch) const {
+  while (!prefetched_.empty() && prefetched_.front().offset < offset) {
+    DropPrefetched();
+  }
+  if (!prefetched_.empty() && prefetched_.front().offset == offset &&
+      prefetched_.front().n == n) {
+    const Prefetched& p = prefetched_.front();
+    Slice data;
+    Status s = p.read->Wait(&data);
+    if (s.ok()) {
+      if (data.data() == p.scratch) {
+        memcpy(scratch, data.data(), data.size());
+        *result = Slice(scratch, data.size());
+      } else {
+        *result = data;  // Lives as long as the file
+        mapped_ = true;
+      }
+      next_offset_ = offset + n;
+    }
+    DropPrefetched();
+    if (s.ok()) {
+      return s;
+    }
+    // Try again below
+  }
+
+  if (offset >= buffer_offset_ &&
+      offset + n <= buffer_offset_ + buffer_.size()) {
+    memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+    *result = Slice(scratch, n);
+    next_offset_ = offset + n;
+    return Status::OK();
+  }
+
+  // A read that starts a little past the end of the previous one
+  // (e.g. because the blocks in between were found in the cache)
+  // still continues the scan.
+  if (offset >= next_offset_ && offset - next_offset_ <= readahead_) {
+    sequential_reads_++;
+  } else {
+    sequential_reads_ = 0;
+    if (!fixed_) {
+      readahead_ = std::min(kInitialReadahead, max_readahead_);
+    }
+  }
+  next_offset_ = offset + n;
+
+  size_t want = n;
+  if (offset < file_size_) {
+    want = std::max<uint64_t>(
+        n, std::min<uint64_t>(readahead_, file_size_ - offset));
+  }
+  if (want <= n || (!fixed_ && sequential_reads_ < kMinSequentialReads)) {
+    Status s = file_->Read(offset, n, result, scratch);
+    if (s.ok() && result->size() > 0 && result->data() != scratch) {
+      mapped_ = true;
+    }
+    return s;
+  }
+  readahead_ = std::min(readahead_ * 2, max_readahead_);
+
+  if (mapped_) {
+    if (offset + n > advised_end_) {
+      file_->Advise(offset, want, kWillNeed);
+      advised_end_ = offset + want;
+    }
+    return file_->Read(offset, n, result, scratch);
+  }
+
+  buffer_.resize(want);
+  Slice data;
+  Status s = file_->Read(offset, want, &data, &buffer_[0]);
+  if (!s.ok()) {
+    buffer_.clear();
+    return s;
+  }
+  if (data.data() != buffer_.data()) {
+    // The file handed out its own memory: copying it would gain
+    // nothing, so only ask for the pages to be read in.
+    mapped_ = true;
+    buffer_.clear();
+    file_->Advise(offset, want, kWillNeed);
+    advised_end_ = offset + want;
+    *result = Slice(data.data(), std::min(n, data.size()));
+    return s;
+  }
+  buffer_.resize(data.size());
+  buffer_offset_ = offset;
+  n = std::min(n, data.size());
+  memcpy(scratch, buffer_.data(), n);
+  *result = Slice(scratch, n);
+  return s;
+}
+
+}  // namespace leveldb
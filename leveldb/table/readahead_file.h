@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+// A file that reads the first "file_size" bytes of another file in
+// large chunks when it is read sequentially.  Once a few reads have
+// each started where the previous one ended, every read that misses
+// the buffer fetches up to "max_readahead" bytes, starting at 8KB and
+// doubling each time.  If "sequential" is true, reads are
+// "max_readahead" bytes from the first one.
+// Ranges can also be fetched in the background with Prefetch().
+//
+// Files that hand out their own memory (e.g. mmap-ed files) are not
+// copied; the operating system is asked to read ahead instead.
+//
+// Unlike other files, a ReadaheadFile is not safe for concurrent use;
+// it is meant to be owned by a single iterator.
+class ReadaheadFile : public RandomAccessFile {
+ public:
+  // Does not take ownership of "file", which must outlive this object.
+  ReadaheadFile(RandomAccessFile* file, uint64_t file_size,
+                size_t max_readahead, bool sequential);
+
+  // Waits for outstanding prefetches
+  virtual ~ReadaheadFile();
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const;
+
+  // Start reading bytes [offset..offset+n-1] in the background, for a
+  // later Read() of exactly that range.  Ranges must be prefetched in
+  // increasing order of offset, and are dropped once a read starts
+  // past them.
+  void Prefetch(uint64_t offset, size_t n);
+
+ private:
+  struct Prefetched {
+    uint64_t offset;
+    size_t n;
+    char* scratch;
+    PendingRead* read;
+  };
+
+  // Discard the oldest prefetch
+  void DropPrefetched() const;
+
+  RandomAccessFile* const file_;
+  const uint64_t file_size_;
+  const size_t max_readahead_;
+  const bool fixed_;
+
+  // Read() is const, but the file belongs to a single iterator
+  mutable bool mapped_;             // Does file_ hand out its own memory?
+  mutable std::string buffer_;      // Holds bytes [buffer_offset_, ...)
+  mutable uint64_t buffer_offset_;
+  mutable uint64_t next_offset_;    // Where the last read ended
+  mutable int sequential_reads_;
+  mutable size_t readahead_;        // Size of the next read ahead
+  mutable uint64_t advised_end_;    // End of the range last advised
+  mutable std::deque<Prefetched> prefetched_;  // In order of offset
+
+  // No copying allowed
+  ReadaheadFile(const ReadaheadFile&);
+  void operator=(const ReadaheadFile&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
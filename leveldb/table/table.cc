@@ -9,55 +9,174 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/statistics.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/readahead_file.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
+// A filter block reader together with the memory backing it, so that
+// it can be stored in the block cache.
+struct CachedFilter {
+  FilterBlockReader* reader;
+  const char* data;
+
+  ~CachedFilter() {
+    delete reader;
+    delete[] data;
+  }
+};
+
+static void RecordTick(Statistics* statistics, Ticker ticker) {
+  if (statistics != NULL) {
+    statistics->RecordTick(ticker, 1);
+  }
+}
+
+// Check "filter" for "k", counting whether it ruled the key out.
+static bool FilterMayMatch(Statistics* statistics, FilterBlockReader* filter,
+                           uint64_t block_offset, const Slice& k) {
+  const bool may_match = filter->KeyMayMatch(block_offset, k);
+  RecordTick(statistics,
+             may_match ? kBloomFilterPositive : kBloomFilterUseful);
+  PERF_COUNTER_ADD(bloom_filter_checks, 1);
+  if (!may_match) {
+    PERF_COUNTER_ADD(bloom_filter_useful, 1);
+  }
+  return may_match;
+}
+
+static CachedFilter* NewCachedFilter(const FilterPolicy* policy,
+                                     const BlockContents& block) {
+  CachedFilter* filter = new CachedFilter;
+  filter->reader = new FilterBlockReader(policy, block.data);
+  filter->data = block.heap_allocated ? block.data.data() : NULL;
+  return filter;
+}
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
     delete [] filter_data;
     delete index_block;
+    if (pinned_index != NULL) {
+      options.block_cache->Release(pinned_index);
+    }
+    if (pinned_filter != NULL) {
+      options.block_cache->Release(pinned_filter);
+    }
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
+  uint64_t file_size;
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  // When options.cache_index_and_filter_blocks is set, index_block
+  // and/or filter are NULL and the blocks are looked up in the block
+  // cache through these handles instead.
+  bool index_in_cache;
+  bool filter_in_cache;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  Cache::Handle* pinned_index;   // Non-NULL if pinned for our lifetime
+  Cache::Handle* pinned_filter;
+
+  // True iff index_block is a top-level index over index partitions.
+  // partition_filters is set if the partitions also carry filters
+  // built by options.filter_policy.
+  bool partitioned;
+  bool partition_filters;
 };
 
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  CachedFilter* filter = reinterpret_cast<CachedFilter*>(value);
+  delete filter;
+}
+
+static void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
+// Blocks are cached under the owning table's cache id followed by the
+// block offset.
+static Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle,
+                           char* buffer) {
+  EncodeFixed64(buffer, cache_id);
+  EncodeFixed64(buffer+8, handle.offset());
+  return Slice(buffer, 16);
+}
+
+Status Table::Open(const Options& options,
+                   RandomAccessFile* file,
+                   uint64_t size,
+                   Table** table) {
+  return Open(options, file, size, Slice(), table);
+}
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
+                   const Slice& handles,
                    Table** table) {
   *table = NULL;
   if (size < Footer::kEncodedLength) {
     return Status::InvalidArgument("file is too short to be an sstable");
   }
 
-  char footer_space[Footer::kEncodedLength];
-  Slice footer_input;
-  Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
-                        &footer_input, footer_space);
-  if (!s.ok()) return s;
+  TableHandles recorded;
+  Slice handles_input = handles;
+  const bool have_handles =
+      !handles.empty() && recorded.DecodeFrom(&handles_input).ok();
 
   Footer footer;
-  s = footer.DecodeFrom(&footer_input);
-  if (!s.ok()) return s;
+  Status s;
+  if (have_handles) {
+    footer = recorded.footer;
+  } else {
+    char footer_space[Footer::kEncodedLength];
+    Slice footer_input;
+    s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
+                   &footer_input, footer_space);
+    if (!s.ok()) return s;
+
+    s = footer.DecodeFrom(&footer_input);
+    if (!s.ok()) return s;
+  }
+
+  // With the handles at hand, blocks that live in the block cache can
+  // wait there until first use.  Pinned blocks are read up front.
+  Cache* block_cache = options.block_cache;
+  const bool lazy = have_handles && block_cache != NULL &&
+                    options.cache_index_and_filter_blocks &&
+                    !options.pin_l0_filter_and_index_blocks_in_cache;
 
   // Read the index block
   BlockContents contents;
   Block* index_block = NULL;
-  if (s.ok()) {
+  if (s.ok() && !lazy) {
     s = ReadBlock(file, ReadOptions(), footer.index_handle(), &contents);
     if (s.ok()) {
       index_block = new Block(contents);
@@ -70,13 +189,43 @@ Status Table::Open(const Options& options,
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
+    rep->file_size = size;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->index_in_cache = lazy;
+    rep->filter_in_cache = false;
+    rep->index_handle = footer.index_handle();
+    rep->pinned_index = NULL;
+    rep->pinned_filter = NULL;
+    rep->partitioned = footer.partitioned();
+    rep->partition_filters = false;
+
+    // Blocks that were not copied out of the file (e.g. mmap-ed data)
+    // cost no heap memory and are never placed in the cache.
+    if (!lazy && block_cache != NULL &&
+        options.cache_index_and_filter_blocks && contents.cachable) {
+      char cache_key_buffer[16];
+      Cache::Handle* h = block_cache->Insert(
+          BlockCacheKey(rep->cache_id, rep->index_handle, cache_key_buffer),
+          index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::kHighPriority);
+      if (options.pin_l0_filter_and_index_blocks_in_cache) {
+        rep->pinned_index = h;
+      } else {
+        block_cache->Release(h);
+      }
+      rep->index_block = NULL;
+      rep->index_in_cache = true;
+    }
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    if (have_handles) {
+      (*table)->UseRecordedMeta(recorded, lazy);
+    } else {
+      (*table)->ReadMeta(footer);
+    }
   } else {
     if (index_block) delete index_block;
   }
@@ -84,6 +233,29 @@ Status Table::Open(const Options& options,
   return s;
 }
 
+void Table::UseRecordedMeta(const TableHandles& handles, bool lazy) {
+  if (rep_->options.filter_policy == NULL) {
+    return;
+  }
+  // A table has at most one filter, so unless it was built by this
+  // policy there is no filter to use.
+  std::string key = rep_->partitioned ? "partitionedfilter." : "filter.";
+  key.append(rep_->options.filter_policy->Name());
+  if (handles.filter_key != key) {
+    return;
+  }
+  if (rep_->partitioned) {
+    rep_->partition_filters = true;
+  } else if (lazy) {
+    Slice v = handles.filter_handle;
+    if (rep_->filter_handle.DecodeFrom(&v).ok()) {
+      rep_->filter_in_cache = true;
+    }
+  } else {
+    ReadFilter(handles.filter_handle);
+  }
+}
+
 void Table::ReadMeta(const Footer& footer) {
   if (rep_->options.filter_policy == NULL) {
     return;  // Do not need any metadata
@@ -100,11 +272,15 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
+  std::string key = rep_->partitioned ? "partitionedfilter." : "filter.";
   key.append(rep_->options.filter_policy->Name());
   iter->Seek(key);
   if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+    if (rep_->partitioned) {
+      rep_->partition_filters = true;
+    } else {
+      ReadFilter(iter->value());
+    }
   }
   delete iter;
   delete meta;
@@ -124,29 +300,154 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  Cache* block_cache = rep_->options.block_cache;
+  if (block_cache != NULL && rep_->options.cache_index_and_filter_blocks &&
+      block.heap_allocated) {
+    CachedFilter* filter = NewCachedFilter(rep_->options.filter_policy, block);
+    char cache_key_buffer[16];
+    Cache::Handle* h = block_cache->Insert(
+        BlockCacheKey(rep_->cache_id, filter_handle, cache_key_buffer),
+        filter, block.data.size(), &DeleteCachedFilter,
+        Cache::kHighPriority);
+    if (rep_->options.pin_l0_filter_and_index_blocks_in_cache) {
+      rep_->pinned_filter = h;
+    } else {
+      block_cache->Release(h);
+    }
+    rep_->filter_handle = filter_handle;
+    rep_->filter_in_cache = true;
+    return;
+  }
+
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();     // Will need to delete later
   }
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
-Table::~Table() {
-  delete rep_;
+Iterator* Table::NewIndexIterator() const {
+  Iterator* iter = NewIndexBlockIterator();
+  if (rep_->partitioned) {
+    iter = NewTwoLevelIterator(iter, &Table::PartitionReader,
+                               const_cast<Table*>(this), ReadOptions());
+  }
+  return iter;
 }
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
+Iterator* Table::NewIndexBlockIterator() const {
+  const Comparator* comparator = rep_->options.comparator;
+  if (!rep_->index_in_cache) {
+    return rep_->index_block->NewIterator(comparator);
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  if (rep_->pinned_index != NULL) {
+    return reinterpret_cast<Block*>(
+        block_cache->Value(rep_->pinned_index))->NewIterator(comparator);
+  }
+
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(rep_->cache_id, rep_->index_handle,
+                            cache_key_buffer);
+  Cache::Handle* cache_handle = block_cache->Lookup(key);
+  if (cache_handle == NULL) {
+    RecordTick(rep_->options.statistics, kBlockCacheMiss);
+    BlockContents contents;
+    Status s = ReadBlock(rep_->file, ReadOptions(), rep_->index_handle,
+                         &contents);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    Block* block = new Block(contents);
+    if (!contents.cachable) {
+      Iterator* iter = block->NewIterator(comparator);
+      iter->RegisterCleanup(&DeleteBlock, block, NULL);
+      return iter;
+    }
+    cache_handle = block_cache->Insert(key, block, block->size(),
+                                       &DeleteCachedBlock,
+                                       Cache::kHighPriority);
+    RecordTick(rep_->options.statistics, kBlockCacheAdd);
+  } else {
+    RecordTick(rep_->options.statistics, kBlockCacheHit);
+    PERF_COUNTER_ADD(block_cache_hit_count, 1);
+  }
+  Block* block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+  Iterator* iter = block->NewIterator(comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+FilterBlockReader* Table::GetFilter(Cache::Handle** cache_handle) const {
+  *cache_handle = NULL;
+  if (!rep_->filter_in_cache) {
+    return rep_->filter;
+  }
+
+  if (rep_->pinned_filter == NULL) {
+    CachedFilter* unused;
+    return LoadFilter(rep_->filter_handle, cache_handle, &unused);
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  return reinterpret_cast<CachedFilter*>(
+      block_cache->Value(rep_->pinned_filter))->reader;
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
+void Table::LoadMetadata() const {
+  if (rep_->index_in_cache) {
+    delete NewIndexBlockIterator();
+  }
+  if (rep_->filter_in_cache) {
+    Cache::Handle* cache_handle;
+    GetFilter(&cache_handle);
+    if (cache_handle != NULL) {
+      rep_->options.block_cache->Release(cache_handle);
+    }
+  }
+}
+
+FilterBlockReader* Table::LoadFilter(const BlockHandle& handle,
+                                     Cache::Handle** cache_handle,
+                                     CachedFilter** uncached) const {
+  *cache_handle = NULL;
+  *uncached = NULL;
+  Cache* block_cache = rep_->options.block_cache;
+  BlockContents block;
+  if (block_cache == NULL) {
+    if (!ReadBlock(rep_->file, ReadOptions(), handle, &block).ok()) {
+      return NULL;  // Filters are optional; fall back to reading data
+    }
+    *uncached = NewCachedFilter(rep_->options.filter_policy, block);
+    return (*uncached)->reader;
+  }
+
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(rep_->cache_id, handle, cache_key_buffer);
+  Cache::Handle* h = block_cache->Lookup(key);
+  if (h == NULL) {
+    RecordTick(rep_->options.statistics, kBlockCacheMiss);
+    if (!ReadBlock(rep_->file, ReadOptions(), handle, &block).ok()) {
+      return NULL;
+    }
+    if (!block.cachable) {
+      *uncached = NewCachedFilter(rep_->options.filter_policy, block);
+      return (*uncached)->reader;
+    }
+    h = block_cache->Insert(key,
+                            NewCachedFilter(rep_->options.filter_policy, block),
+                            block.data.size(), &DeleteCachedFilter,
+                            Cache::kHighPriority);
+    RecordTick(rep_->options.statistics, kBlockCacheAdd);
+  } else {
+    RecordTick(rep_->options.statistics, kBlockCacheHit);
+    PERF_COUNTER_ADD(block_cache_hit_count, 1);
+  }
+  *cache_handle = h;
+  return reinterpret_cast<CachedFilter*>(block_cache->Value(h))->reader;
+}
+
+Table::~Table() {
+  delete rep_;
 }
 
 // Convert an index iterator value (i.e., an encoded BlockHandle)
@@ -155,7 +456,77 @@ Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
+  return ReadCachedBlock(table, table->rep_->file, options, index_value,
+                         Cache::kLowPriority);
+}
+
+namespace {
+// The table scanned by an iterator that reads ahead, and the file
+// through which the iterator reads its data blocks.
+struct ScanState {
+  Table* table;
+  ReadaheadFile* file;
+};
+
+void DeleteScanState(void* arg, void* ignored) {
+  ScanState* state = reinterpret_cast<ScanState*>(arg);
+  delete state->file;
+  delete state;
+}
+}  // namespace
+
+// Like BlockReader, but reads through the readahead file of a ScanState.
+Iterator* Table::ScanBlockReader(void* arg,
+                                 const ReadOptions& options,
+                                 const Slice& index_value) {
+  ScanState* state = reinterpret_cast<ScanState*>(arg);
+  return ReadCachedBlock(state->table, state->file, options, index_value,
+                         Cache::kLowPriority);
+}
+
+// Start reading the block named by an index value into the readahead
+// file of a ScanState, unless the block cache already holds it.
+void Table::PrefetchBlock(void* arg,
+                          const ReadOptions& options,
+                          const Slice& index_value) {
+  ScanState* state = reinterpret_cast<ScanState*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return;
+  }
+  Cache* block_cache = state->table->rep_->options.block_cache;
+  if (block_cache != NULL) {
+    char cache_key_buffer[16];
+    Cache::Handle* cache_handle = block_cache->Lookup(
+        BlockCacheKey(state->table->rep_->cache_id, handle,
+                      cache_key_buffer));
+    if (cache_handle != NULL) {
+      block_cache->Release(cache_handle);
+      return;
+    }
+  }
+  state->file->Prefetch(handle.offset(), handle.size() + kBlockTrailerSize);
+}
+
+// Like BlockReader, but for the values of a top-level index: returns
+// an iterator over an index partition, which is cached with the same
+// priority as whole index blocks.
+Iterator* Table::PartitionReader(void* arg,
+                                 const ReadOptions& options,
+                                 const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return ReadCachedBlock(table, table->rep_->file, options, index_value,
+                         Cache::kHighPriority);
+}
+
+Iterator* Table::ReadCachedBlock(Table* table,
+                                 RandomAccessFile* file,
+                                 const ReadOptions& options,
+                                 const Slice& index_value,
+                                 Cache::Priority priority) {
   Cache* block_cache = table->rep_->options.block_cache;
+  Statistics* statistics = table->rep_->options.statistics;
   Block* block = NULL;
   Cache::Handle* cache_handle = NULL;
 
@@ -169,24 +540,27 @@ Iterator* Table::BlockReader(void* arg,
     BlockContents contents;
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(table->rep_->cache_id, handle,
+                                cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
+        RecordTick(statistics, kBlockCacheHit);
+        PERF_COUNTER_ADD(block_cache_hit_count, 1);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        RecordTick(statistics, kBlockCacheMiss);
+        s = ReadBlock(file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+                key, block, block->size(), &DeleteCachedBlock, priority);
+            RecordTick(statistics, kBlockCacheAdd);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -208,31 +582,81 @@ Iterator* Table::BlockReader(void* arg,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  const size_t readahead = (options.readahead_size > 0
+                            ? options.readahead_size
+                            : rep_->options.readahead_size);
+  const int prefetch = rep_->options.prefetch_blocks;
+  if (readahead == 0 && prefetch == 0) {
+    return NewTwoLevelIterator(
+        NewIndexIterator(),
+        &Table::BlockReader, const_cast<Table*>(this), options);
+  }
+
+  // Data blocks are read through a file of the iterator's own that
+  // turns a run of consecutive block reads into a few large ones, and
+  // that holds the blocks fetched ahead of the iterator.
+  ScanState* state = new ScanState;
+  state->table = const_cast<Table*>(this);
+  state->file = new ReadaheadFile(rep_->file, rep_->file_size, readahead,
+                                  options.readahead_size > 0);
+  Iterator* iter;
+  if (prefetch > 0) {
+    iter = NewPrefetchingTwoLevelIterator(
+        NewIndexIterator(), NewIndexIterator(),
+        &Table::ScanBlockReader, &Table::PrefetchBlock, state, options,
+        prefetch);
+  } else {
+    iter = NewTwoLevelIterator(
+        NewIndexIterator(), &Table::ScanBlockReader, state, options);
+  }
+  iter->RegisterCleanup(&DeleteScanState, state, NULL);
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          bool (*saver)(void*, const Slice&, const Slice&),
+                          bool* filter_passed) {
+  Statistics* statistics = rep_->options.statistics;
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  bool more = false;
+  bool passed = false;
+  Cache::Handle* filter_cache_handle = NULL;
+  CachedFilter* uncached_filter = NULL;
+  FilterBlockReader* filter = NULL;
+  uint64_t filter_base = 0;
+  Iterator* iiter;
+  if (rep_->partitioned) {
+    iiter = NewPartitionIterator(k, &filter, &filter_base,
+                                 &filter_cache_handle, &uncached_filter,
+                                 &passed);
+  } else {
+    filter = GetFilter(&filter_cache_handle);
+    if (filter != NULL && filter->full()) {
+      // A full filter covers every data block, so a miss needs no
+      // index lookup at all.
+      passed = FilterMayMatch(statistics, filter, 0, k);
+      iiter = passed ? NewIndexIterator() : NewEmptyIterator();
+      filter = NULL;
+    } else {
+      iiter = NewIndexIterator();
+    }
+  }
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != NULL &&
-        handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
-    } else {
-      Slice handle = iiter->value();
+    bool may_match = true;
+    if (filter != NULL && handle.DecodeFrom(&handle_value).ok()) {
+      may_match = FilterMayMatch(statistics, filter,
+                                 handle.offset() - filter_base, k);
+      passed = may_match;
+    }
+    if (may_match) {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
       if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+        more = (*saver)(arg, block_iter->key(), block_iter->value());
       }
       s = block_iter->status();
       delete block_iter;
@@ -241,14 +665,76 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
   if (s.ok()) {
     s = iiter->status();
   }
+  if (filter_cache_handle != NULL) {
+    rep_->options.block_cache->Release(filter_cache_handle);
+  }
+  delete uncached_filter;
   delete iiter;
+  if (filter_passed != NULL) {
+    *filter_passed = passed;
+  }
+
+  if (s.ok() && more) {
+    // Rare (e.g. merge operands): the entries wanted may go on into
+    // the following blocks, so walk them with a full iterator.
+    Iterator* iter = NewIterator(options);
+    iter->Seek(k);
+    if (iter->Valid()) {
+      iter->Next();  // Already handed to saver
+    }
+    while (iter->Valid() && (*saver)(arg, iter->key(), iter->value())) {
+      iter->Next();
+    }
+    s = iter->status();
+    delete iter;
+  }
   return s;
 }
 
+Iterator* Table::NewPartitionIterator(const Slice& k,
+                                      FilterBlockReader** filter,
+                                      uint64_t* filter_base,
+                                      Cache::Handle** filter_cache_handle,
+                                      CachedFilter** uncached_filter,
+                                      bool* filter_passed) const {
+  Iterator* top_iter = NewIndexBlockIterator();
+  top_iter->Seek(k);
+  Iterator* result;
+  if (top_iter->Valid()) {
+    Slice input = top_iter->value();
+    BlockHandle index_handle, filter_handle;
+    if (rep_->partition_filters &&
+        index_handle.DecodeFrom(&input).ok() &&
+        filter_handle.DecodeFrom(&input).ok() &&
+        GetVarint64(&input, filter_base)) {
+      *filter = LoadFilter(filter_handle, filter_cache_handle,
+                           uncached_filter);
+    }
+    bool may_match = true;
+    if (*filter != NULL && (*filter)->full()) {
+      // Check the partition's full filter before its index partition
+      may_match = FilterMayMatch(rep_->options.statistics, *filter, 0, k);
+      *filter_passed = may_match;
+      *filter = NULL;
+    }
+    if (may_match) {
+      result = PartitionReader(const_cast<Table*>(this), ReadOptions(),
+                               top_iter->value());
+    } else {
+      result = NewEmptyIterator();
+    }
+  } else if (top_iter->status().ok()) {
+    result = NewEmptyIterator();
+  } else {
+    result = NewErrorIterator(top_iter->status());
+  }
+  delete top_iter;
+  return result;
+}
+
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator();
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -44,6 +44,17 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // When options.partition_index_and_filters is set, index_block and
+  // filter_block only cover the data blocks written since the last
+  // partition was cut, and top_index_block maps the last key of every
+  // partition to its location.  Filter offsets within a partition are
+  // relative to partition_base, the offset of its first data block.
+  BlockBuilder top_index_block;
+  uint64_t partition_base;
+
+  // Set by Finish(): see TableBuilder::Handles()
+  TableHandles handles;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
@@ -54,8 +65,11 @@ struct TableBuilder::Rep {
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+                     : new FilterBlockBuilder(opt.filter_policy,
+                                              opt.full_filters)),
+        pending_index_entry(false),
+        top_index_block(&index_block_options),
+        partition_base(0) {
     index_block_options.block_restart_interval = 1;
   }
 };
@@ -80,6 +94,14 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing partition_index_and_filters while building table");
+  }
+  if (options.full_filters != rep_->options.full_filters) {
+    return Status::InvalidArgument("changing full_filters while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -104,6 +126,11 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.partition_index_and_filters &&
+        r->index_block.CurrentSizeEstimate() >=
+        r->options.metadata_block_size) {
+      FinishPartition();
+    }
   }
 
   if (r->filter_block != NULL) {
@@ -132,7 +159,44 @@ void TableBuilder::Flush() {
     r->status = r->file->Flush();
   }
   if (r->filter_block != NULL) {
-    r->filter_block->StartBlock(r->offset);
+    r->filter_block->StartBlock(r->offset - r->partition_base);
+  }
+}
+
+// Writes out the current index and filter partitions and records them
+// in the top-level index under the last key added to the index
+// partition.  Each top-level entry holds the index partition handle,
+// followed, if there is a filter, by the filter partition handle and
+// the partition's base offset.
+void TableBuilder::FinishPartition() {
+  Rep* r = rep_;
+  if (!ok() || r->index_block.empty()) return;
+
+  std::string partition_encoding;
+  BlockHandle filter_handle;
+  if (r->filter_block != NULL) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_handle);
+    delete r->filter_block;
+    r->filter_block = new FilterBlockBuilder(r->options.filter_policy,
+                                             r->options.full_filters);
+  }
+  BlockHandle index_handle;
+  if (ok()) {
+    WriteBlock(&r->index_block, &index_handle);
+  }
+  if (ok()) {
+    index_handle.EncodeTo(&partition_encoding);
+    if (r->filter_block != NULL) {
+      filter_handle.EncodeTo(&partition_encoding);
+      PutVarint64(&partition_encoding, r->partition_base);
+    }
+    r->top_index_block.Add(r->last_key, Slice(partition_encoding));
+  }
+
+  // The next data block starts right after the partition blocks.
+  r->partition_base = r->offset;
+  if (r->filter_block != NULL) {
+    r->filter_block->StartBlock(0);
   }
 }
 
@@ -204,8 +268,21 @@ Status TableBuilder::Finish() {
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
 
+  // Write the last index and filter partitions
+  const bool partitioned = r->options.partition_index_and_filters;
+  if (partitioned && ok()) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+    }
+    FinishPartition();
+  }
+
   // Write filter block
-  if (ok() && r->filter_block != NULL) {
+  if (ok() && r->filter_block != NULL && !partitioned) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
@@ -213,13 +290,23 @@ Status TableBuilder::Finish() {
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != NULL) {
+    if (r->filter_block != NULL && partitioned) {
+      // Filter partitions are found through the top-level index; record
+      // which policy built them so that readers with another policy
+      // ignore them.
+      std::string key = "partitionedfilter.";
+      key.append(r->options.filter_policy->Name());
+      meta_index_block.Add(key, Slice());
+      r->handles.filter_key = key;
+    } else if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+      r->handles.filter_key = key;
+      r->handles.filter_handle = handle_encoding;
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -235,12 +322,14 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
   if (ok()) {
     Footer footer;
+    footer.set_partitioned(partitioned);
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
     std::string footer_encoding;
@@ -249,10 +338,18 @@ Status TableBuilder::Finish() {
     if (r->status.ok()) {
       r->offset += footer_encoding.size();
     }
+    r->handles.footer = footer;
   }
   return r->status;
 }
 
+std::string TableBuilder::Handles() const {
+  assert(rep_->closed && ok());
+  std::string result;
+  rep_->handles.EncodeTo(&result);
+  return result;
+}
+
 void TableBuilder::Abandon() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -9,8 +9,10 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
@@ -110,13 +112,16 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()), reads_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
 
+  // Number of calls to Read() so far
+  int reads() const { return reads_; }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
     if (offset > contents_.size()) {
@@ -127,11 +132,62 @@ class StringSource: public RandomAccessFile {
     }
     memcpy(scratch, &contents_[offset], n);
     *result = Slice(scratch, n);
+    reads_++;
     return Status::OK();
   }
 
  private:
   std::string contents_;
+  mutable int reads_;
+};
+
+// Like StringSource, but hands out pointers into its own copy of the
+// contents, as mmap-ed files do, and counts the ranges it is advised of.
+class MappedSource: public RandomAccessFile {
+ public:
+  MappedSource(const Slice& contents)
+      : contents_(contents.data(), contents.size()), advised_(0) {
+  }
+
+  int advised() const { return advised_; }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (offset + n > contents_.size()) {
+      return Status::InvalidArgument("invalid Read offset");
+    }
+    *result = Slice(contents_.data() + offset, n);
+    return Status::OK();
+  }
+
+  virtual void Advise(uint64_t offset, size_t n,
+                      AccessPattern pattern) const {
+    if (pattern == kWillNeed) {
+      advised_++;
+    }
+  }
+
+ private:
+  std::string contents_;
+  mutable int advised_;
+};
+
+// A StringSource that counts the reads started with ReadAsync()
+class AsyncStringSource: public StringSource {
+ public:
+  AsyncStringSource(const Slice& contents)
+      : StringSource(contents), async_reads_(0) { }
+
+  int async_reads() const { return async_reads_; }
+
+  virtual PendingRead* ReadAsync(uint64_t offset, size_t n,
+                                 char* scratch) const {
+    async_reads_++;
+    return StringSource::ReadAsync(offset, n, scratch);
+  }
+
+ private:
+  mutable int async_reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -398,6 +454,7 @@ class DBConstructor: public Constructor {
 
 enum TestType {
   TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
   DB_TEST
@@ -417,6 +474,9 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
 
+  { PARTITIONED_TABLE_TEST, false, 16 },
+  { PARTITIONED_TABLE_TEST, true, 16 },
+
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
   { BLOCK_TEST, false, 1024 },
@@ -454,6 +514,12 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        // Cut a partition every few data blocks
+        options_.partition_index_and_filters = true;
+        options_.metadata_block_size = 64;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -797,6 +863,272 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+static void BuildTable(const Options& options, int num_entries,
+                       std::string* contents, std::string* handles = NULL) {
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < num_entries; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    builder.Add(key, std::string(100, 'v'));
+  }
+  ASSERT_OK(builder.Finish());
+  *contents = sink.contents();
+  if (handles != NULL) {
+    *handles = builder.Handles();
+  }
+}
+
+static int CountEntries(Table* table) {
+  int count = 0;
+  Iterator* iter = table->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  return count;
+}
+
+TEST(TableTest, IndexAndFilterBlocksInCache) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.filter_policy = policy;
+  std::string contents;
+  BuildTable(options, 1000, &contents);
+  StringSource source(contents);
+
+  // A cache too small to hold anything: unpinned index and filter
+  // blocks are dropped as soon as they are released.
+  options.block_cache = NewLRUCache(1);
+  options.cache_index_and_filter_blocks = true;
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, contents.size(), &table));
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  ASSERT_EQ(1000, CountEntries(table));
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  delete table;
+
+  // Pinned blocks stay charged against the cache until the table goes away
+  options.pin_l0_filter_and_index_blocks_in_cache = true;
+  ASSERT_OK(Table::Open(options, &source, contents.size(), &table));
+  const size_t pinned = options.block_cache->TotalCharge();
+  ASSERT_GT(pinned, 0);
+  ASSERT_EQ(1000, CountEntries(table));
+  ASSERT_EQ(pinned, options.block_cache->TotalCharge());
+  delete table;
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+
+  delete options.block_cache;
+  delete policy;
+}
+
+TEST(TableTest, OpenWithRecordedHandles) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.filter_policy = policy;
+  std::string contents, handles;
+  BuildTable(options, 1000, &contents, &handles);
+  ASSERT_GT(handles.size(), 48);
+
+  // Without a block cache the footer and metaindex reads are skipped,
+  // leaving the index and the filter.
+  {
+    StringSource source(contents);
+    Table* table;
+    ASSERT_OK(Table::Open(options, &source, contents.size(), handles,
+                          &table));
+    ASSERT_EQ(2, source.reads());
+    ASSERT_EQ(1000, CountEntries(table));
+    delete table;
+  }
+
+  // With cached metadata nothing is read until the table is used
+  options.block_cache = NewLRUCache(1 << 20);
+  options.cache_index_and_filter_blocks = true;
+  {
+    StringSource source(contents);
+    Table* table;
+    ASSERT_OK(Table::Open(options, &source, contents.size(), handles,
+                          &table));
+    ASSERT_EQ(0, source.reads());
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+    ASSERT_EQ(1000, CountEntries(table));
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+    delete table;
+  }
+
+  // Malformed handles fall back to reading the file
+  {
+    StringSource source(contents);
+    Table* table;
+    ASSERT_OK(Table::Open(options, &source, contents.size(), "junk",
+                          &table));
+    ASSERT_GT(source.reads(), 0);
+    ASSERT_EQ(1000, CountEntries(table));
+    delete table;
+  }
+
+  delete options.block_cache;
+  delete policy;
+}
+
+TEST(TableTest, Readahead) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  std::string contents;
+  BuildTable(options, 2000, &contents);
+
+  // One read per block without readahead
+  options.readahead_size = 0;
+  StringSource plain_source(contents);
+  Table* table;
+  ASSERT_OK(Table::Open(options, &plain_source, contents.size(), &table));
+  const int opened = plain_source.reads();
+  ASSERT_EQ(2000, CountEntries(table));
+  const int blocks = plain_source.reads() - opened;
+  ASSERT_GT(blocks, 500);
+  delete table;
+
+  // A scan turns into a few large reads
+  options.readahead_size = 64 * 1024;
+  StringSource source(contents);
+  ASSERT_OK(Table::Open(options, &source, contents.size(), &table));
+  ASSERT_EQ(2000, CountEntries(table));
+  ASSERT_LT(source.reads() - opened, 20);
+
+  // Random seeks see the right data
+  Random rnd(301);
+  Iterator* iter = table->NewIterator(ReadOptions());
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", rnd.Uniform(2000));
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+    ASSERT_EQ(std::string(100, 'v'), iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // Reads ahead from the start when told the scan is sequential
+  ReadOptions sequential;
+  sequential.readahead_size = 1024 * 1024;
+  const int before = source.reads();
+  iter = table->NewIterator(sequential);
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(1, source.reads() - before);
+  delete iter;
+  delete table;
+
+  // Memory-backed files are advised instead of copied
+  MappedSource mapped(contents);
+  ASSERT_OK(Table::Open(options, &mapped, contents.size(), &table));
+  ASSERT_EQ(2000, CountEntries(table));
+  ASSERT_GT(mapped.advised(), 0);
+  ASSERT_LT(mapped.advised(), 20);
+  delete table;
+}
+
+TEST(TableTest, PrefetchBlocks) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  std::string contents;
+  BuildTable(options, 2000, &contents);
+
+  options.readahead_size = 0;
+  options.prefetch_blocks = 4;
+  AsyncStringSource source(contents);
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, contents.size(), &table));
+
+  // Point lookups do not prefetch
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->Seek("k000500");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k000500", iter->key().ToString());
+  ASSERT_EQ(0, source.async_reads());
+  delete iter;
+
+  // Once a scan moves past its second block, the blocks are fetched
+  // ahead of time, and only once
+  const int before = source.reads();
+  ASSERT_EQ(2000, CountEntries(table));
+  const int blocks = source.reads() - before;
+  ASSERT_GT(blocks, 500);
+  ASSERT_EQ(blocks - 2, source.async_reads());
+
+  // Prefetching restarts after a seek
+  iter = table->NewIterator(ReadOptions());
+  iter->Seek("k001000");
+  for (int i = 1000; i < 2000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+    ASSERT_EQ(std::string(100, 'v'), iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+  delete table;
+}
+
+TEST(TableTest, PartitionedIndexAndFilters) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.filter_policy = policy;
+  std::string flat;
+  BuildTable(options, 10000, &flat);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  std::string partitioned;
+  BuildTable(options, 10000, &partitioned);
+  StringSource flat_source(flat);
+  StringSource source(partitioned);
+
+  // Opening only reads the top-level index, which is a small fraction
+  // of the whole index.
+  options.block_cache = NewLRUCache(64 << 20);
+  options.cache_index_and_filter_blocks = true;
+  Table* flat_table;
+  ASSERT_OK(Table::Open(options, &flat_source, flat.size(), &flat_table));
+  const size_t flat_index = options.block_cache->TotalCharge();
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, partitioned.size(), &table));
+  const size_t top_index = options.block_cache->TotalCharge() - flat_index;
+  ASSERT_GT(top_index, 0);
+  ASSERT_LT(top_index * 10, flat_index);
+
+  // Partitions are loaded through the cache as the table is read
+  ASSERT_EQ(10000, CountEntries(table));
+  ASSERT_GT(options.block_cache->TotalCharge(), flat_index + top_index);
+
+  // Index and filter partitions are interleaved with the data blocks
+  ASSERT_TRUE(Between(table->ApproximateOffsetOf("k005000"),
+                      partitioned.size() * 45 / 100,
+                      partitioned.size() * 55 / 100));
+  ASSERT_TRUE(Between(table->ApproximateOffsetOf("xyz"),
+                      partitioned.size() - top_index - 1000,
+                      partitioned.size()));
+
+  delete table;
+  delete flat_table;
+  delete options.block_cache;
+  delete policy;
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -14,6 +14,7 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef void (*PrefetchFunction)(void*, const ReadOptions&, const Slice&);
 
 class TwoLevelIterator: public Iterator {
  public:
@@ -23,6 +24,16 @@ class TwoLevelIterator: public Iterator {
     void* arg,
     const ReadOptions& options);
 
+  // Also prefetch up to "depth" blocks ahead while moving forward
+  TwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* lookahead_iter,
+    BlockFunction block_function,
+    PrefetchFunction prefetch_function,
+    void* arg,
+    const ReadOptions& options,
+    int depth);
+
   virtual ~TwoLevelIterator();
 
   virtual void Seek(const Slice& target);
@@ -61,6 +72,7 @@ class TwoLevelIterator: public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void PrefetchAhead();
 
   BlockFunction block_function_;
   void* arg_;
@@ -71,6 +83,15 @@ class TwoLevelIterator: public Iterator {
   // If data_iter_ is non-NULL, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
+
+  // Prefetching is only done once the iterator has moved forward from
+  // one block to the next.  lookahead_iter_ then sits "ahead_" entries
+  // past index_iter_ (or ahead_ < 0 if it is not positioned), and the
+  // blocks in between have been passed to prefetch_function_.
+  IteratorWrapper lookahead_iter_;  // May be NULL
+  PrefetchFunction prefetch_function_;
+  const int depth_;
+  int ahead_;
 };
 
 TwoLevelIterator::TwoLevelIterator(
@@ -82,13 +103,37 @@ TwoLevelIterator::TwoLevelIterator(
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
-      data_iter_(NULL) {
+      data_iter_(NULL),
+      lookahead_iter_(NULL),
+      prefetch_function_(NULL),
+      depth_(0),
+      ahead_(-1) {
+}
+
+TwoLevelIterator::TwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* lookahead_iter,
+    BlockFunction block_function,
+    PrefetchFunction prefetch_function,
+    void* arg,
+    const ReadOptions& options,
+    int depth)
+    : block_function_(block_function),
+      arg_(arg),
+      options_(options),
+      index_iter_(index_iter),
+      data_iter_(NULL),
+      lookahead_iter_(lookahead_iter),
+      prefetch_function_(prefetch_function),
+      depth_(depth),
+      ahead_(-1) {
 }
 
 TwoLevelIterator::~TwoLevelIterator() {
 }
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  ahead_ = -1;
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.Seek(target);
@@ -96,6 +141,7 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  ahead_ = -1;
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
@@ -103,6 +149,7 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  ahead_ = -1;
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
@@ -117,6 +164,7 @@ void TwoLevelIterator::Next() {
 
 void TwoLevelIterator::Prev() {
   assert(Valid());
+  ahead_ = -1;
   data_iter_.Prev();
   SkipEmptyDataBlocksBackward();
 }
@@ -130,11 +178,38 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       return;
     }
     index_iter_.Next();
+    if (prefetch_function_ != NULL) {
+      // Get the following blocks coming before waiting for this one
+      PrefetchAhead();
+    }
     InitDataBlock();
     if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
   }
 }
 
+void TwoLevelIterator::PrefetchAhead() {
+  if (!index_iter_.Valid()) {
+    return;
+  }
+  if (ahead_ > 0) {
+    ahead_--;  // index_iter_ moved onto the next prefetched block
+  } else {
+    lookahead_iter_.Seek(index_iter_.key());
+    if (!lookahead_iter_.Valid()) {
+      SaveError(lookahead_iter_.status());
+      return;
+    }
+    ahead_ = 0;
+  }
+  while (ahead_ < depth_ && lookahead_iter_.Valid()) {
+    lookahead_iter_.Next();
+    if (lookahead_iter_.Valid()) {
+      (*prefetch_function_)(arg_, options_, lookahead_iter_.value());
+      ahead_++;
+    }
+  }
+}
+
 void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
   while (data_iter_.iter() == NULL || !data_iter_.Valid()) {
     // Move to next block
@@ -179,4 +254,16 @@ Iterator* NewTwoLevelIterator(
   return new TwoLevelIterator(index_iter, block_function, arg, options);
 }
 
+Iterator* NewPrefetchingTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* lookahead_iter,
+    BlockFunction block_function,
+    PrefetchFunction prefetch_function,
+    void* arg,
+    const ReadOptions& options,
+    int depth) {
+  return new TwoLevelIterator(index_iter, lookahead_iter, block_function,
+                              prefetch_function, arg, options, depth);
+}
+
 }  // namespace leveldb
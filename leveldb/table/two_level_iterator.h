@@ -29,6 +29,27 @@ extern Iterator* NewTwoLevelIterator(
     void* arg,
     const ReadOptions& options);
 
+// Like NewTwoLevelIterator(), but once the iterator moves forward from
+// one block to the next, it passes the index values of up to "depth"
+// following blocks to (*prefetch_function)(arg, options, index_value)
+// before creating the iterator over the next block.  The following
+// blocks are found with "lookahead_iter", an independent iterator over
+// the same index.  Takes ownership of both iterators.
+extern Iterator* NewPrefetchingTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* lookahead_iter,
+    Iterator* (*block_function)(
+        void* arg,
+        const ReadOptions& options,
+        const Slice& index_value),
+    void (*prefetch_function)(
+        void* arg,
+        const ReadOptions& options,
+        const Slice& index_value),
+    void* arg,
+    const ReadOptions& options,
+    int depth);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
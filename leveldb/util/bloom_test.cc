@@ -25,6 +25,7 @@ class BloomTest {
 
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) { }
 
   ~BloomTest() {
     delete policy_;
@@ -45,7 +46,8 @@ class BloomTest {
       key_slices.push_back(Slice(keys_[i]));
     }
     filter_.clear();
-    policy_->CreateFilter(&key_slices[0], key_slices.size(), &filter_);
+    policy_->CreateFilter(key_slices.empty() ? NULL : &key_slices[0],
+                          key_slices.size(), &filter_);
     keys_.clear();
     if (kVerbose >= 2) DumpFilter();
   }
@@ -54,6 +56,8 @@ class BloomTest {
     return filter_.size();
   }
 
+  std::string* filter() { return &filter_; }
+
   void DumpFilter() {
     fprintf(stderr, "F(");
     for (size_t i = 0; i+1 < filter_.size(); i++) {
@@ -152,6 +156,103 @@ TEST(BloomTest, VaryingLengths) {
 
 // Different bits-per-byte
 
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) { }
+};
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  Build();
+  ASSERT_EQ(65, FilterSize());
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedMalformedFilter) {
+  // Filters that are too short, truncated or of an unknown encoding
+  // must not hide keys
+  ASSERT_TRUE(Matches("hello"));
+  filter()->assign(10, '\0');
+  ASSERT_TRUE(Matches("hello"));
+
+  Add("world");
+  Build();
+  ASSERT_TRUE(! Matches("hello"));
+  filter()->resize(FilterSize() - 1);
+  ASSERT_TRUE(Matches("hello"));
+  filter()->resize(64);
+  ASSERT_TRUE(Matches("hello"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  char buffer[sizeof(int)];
+
+  // Confining probes to one line costs some accuracy, so the bounds
+  // are looser than for the standard bloom filter.
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Whole 64-byte lines plus the probe count
+    ASSERT_LE(FilterSize(), (length * 10 / 8) + 64 + 1) << length;
+    ASSERT_EQ(1, FilterSize() % 64) << length;
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate*100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.03);   // Must not be over 3%
+    if (rate > 0.02) mediocre_filters++;  // Allowed, but not too often
+    else good_filters++;
+  }
+  if (kVerbose >= 1) {
+    fprintf(stderr, "Filters: %d good, %d mediocre\n",
+            good_filters, mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters/5);
+}
+
+TEST(BlockedBloomTest, BlockedLargeFilter) {
+  // Large enough that lines are picked from many cache lines, which
+  // is where a weak line hash would show up as extra false positives.
+  char buffer[sizeof(int)];
+  const int length = 1000000;
+  for (int i = 0; i < length; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  for (int i = 0; i < length; i += 97) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << i;
+  }
+  double rate = FalsePositiveRate();
+  if (kVerbose >= 1) {
+    fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+            rate*100.0, length, static_cast<int>(FilterSize()));
+  }
+  ASSERT_LE(rate, 0.02);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
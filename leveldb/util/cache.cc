@@ -16,12 +16,23 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
+size_t Cache::TotalCharge() const {
+  return 0;
+}
+
 namespace {
 
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in circular doubly linked lists ordered by access time:
+// one for the high priority pool and one for everything else.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +43,8 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool is_high_pri;       // Inserted with Cache::kHighPriority
+  bool in_high_pri_pool;  // Currently on the high priority list
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -139,15 +152,30 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+
+  static uint32_t HashOf(Cache::Handle* handle) {
+    return reinterpret_cast<LRUHandle*>(handle)->hash;
+  }
+  static void* Value(Cache::Handle* handle) {
+    return reinterpret_cast<LRUHandle*>(handle)->value;
+  }
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -156,33 +184,44 @@ class LRUCache {
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
-  port::Mutex mutex_;
+  mutable port::Mutex mutex_;
   size_t usage_;
+  size_t high_pri_usage_;
   uint64_t last_id_;
 
-  // Dummy head of LRU list.
+  // Dummy heads of LRU lists.
   // lru.prev is newest entry, lru.next is oldest entry.
   LRUHandle lru_;
+  LRUHandle high_pri_lru_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
-    : usage_(0),
+    : capacity_(0),
+      high_pri_capacity_(0),
+      usage_(0),
+      high_pri_usage_(0),
       last_id_(0) {
-  // Make empty circular linked list
+  // Make empty circular linked lists
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
 }
 
 LRUCache::~LRUCache() {
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->refs == 1);  // Error if caller has an unreleased handle
-    Unref(e);
-    e = next;
+  LRUHandle* lists[2] = { &lru_, &high_pri_lru_ };
+  for (int i = 0; i < 2; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->refs == 1);  // Error if caller has an unreleased handle
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -199,14 +238,35 @@ void LRUCache::Unref(LRUHandle* e) {
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    high_pri_usage_ -= e->charge;
+    e->in_high_pri_pool = false;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+  // Make "e" newest entry by inserting just before the list head
+  LRUHandle* list = &lru_;
+  if (e->is_high_pri && high_pri_capacity_ > 0) {
+    list = &high_pri_lru_;
+    e->in_high_pri_pool = true;
+    high_pri_usage_ += e->charge;
+  }
+  e->next = list;
+  e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
+
+  // Demote the oldest high priority entries once their pool is full
+  while (high_pri_usage_ > high_pri_capacity_ &&
+         high_pri_lru_.next != &high_pri_lru_) {
+    LRUHandle* old = high_pri_lru_.next;
+    LRU_Remove(old);
+    old->next = &lru_;
+    old->prev = lru_.prev;
+    old->prev->next = old;
+    old->next->prev = old;
+  }
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
@@ -227,7 +287,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -238,6 +299,8 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->is_high_pri = (priority == Cache::kHighPriority);
+  e->in_high_pri_pool = false;
   memcpy(e->key_data, key.data(), key.size());
   LRU_Append(e);
   usage_ += charge;
@@ -248,8 +311,16 @@ Cache::Handle* LRUCache::Insert(
     Unref(old);
   }
 
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  // Evict low priority entries first
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (lru_.next != &lru_) {
+      old = lru_.next;
+    } else if (high_pri_lru_.next != &high_pri_lru_) {
+      old = high_pri_lru_.next;
+    } else {
+      break;
+    }
     LRU_Remove(old);
     table_.Remove(old->key(), old->hash);
     Unref(old);
@@ -267,12 +338,325 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
   }
 }
 
+// CLOCK cache implementation
+
+// Entries live in a fixed-size open addressed hash table.  The "meta"
+// word of each slot packs the slot state into its top two bits and the
+// number of outstanding handles into the rest.  Readers pin an entry by
+// atomically incrementing meta and checking the state they observed;
+// an entry may only change hands (evicted, freed, or reused) when a
+// compare-and-swap finds it unreferenced.  All other state transitions
+// are done with atomic adds so that a racing reader's increment is
+// never lost.
+static const uint32_t kStateShift = 30;
+static const uint32_t kRefsMask = (1u << kStateShift) - 1;
+static const uint32_t kStateEmpty = 0;         // Slot is free
+static const uint32_t kStateConstruction = 1;  // Owned by one thread
+static const uint32_t kStateVisible = 2;       // Entry can be looked up
+static const uint32_t kStateInvisible = 3;     // Erased, but still pinned
+
+// Entries are inserted with a countdown of 1 (kMaxCountdown for high
+// priority entries) and bumped to kMaxCountdown by every hit; the clock
+// hand decrements the countdown and evicts unpinned entries that reach
+// zero.
+static const uint32_t kMaxCountdown = 3;
+
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  char* key_data;
+  size_t key_length;
+  size_t charge;
+  uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool detached;      // True if allocated outside of the table
+  volatile uint32_t meta;
+  volatile uint32_t countdown;
+  // Number of entries whose probe sequence passes over this slot.
+  // A lookup can stop at a non-matching slot once this is zero.
+  volatile uint32_t displacements;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+static inline uint32_t StateOf(uint32_t meta) { return meta >> kStateShift; }
+static inline uint32_t RefsOf(uint32_t meta) { return meta & kRefsMask; }
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache.  Allocates the hash table.
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const { return usage_; }
+
+  static uint32_t HashOf(Cache::Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->hash;
+  }
+  static void* Value(Cache::Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+
+ private:
+  uint32_t Home(uint32_t hash) const { return hash & mask_; }
+  static uint32_t Increment(uint32_t hash) {
+    // Odd, so that the probe sequence visits every slot of the table
+    return ((hash >> 16) | (hash << 16)) | 1;
+  }
+
+  ClockHandle* Find(const Slice& key, uint32_t hash);
+  void Unref(ClockHandle* h);
+  void FreeEntry(ClockHandle* h);
+  void EvictFor(size_t charge);
+
+  // Initialized before use.
+  size_t capacity_;
+  uint32_t mask_;
+  uint32_t max_occupancy_;
+  ClockHandle* table_;
+
+  // Updated atomically; also modified by Release() outside of mutex_.
+  volatile size_t usage_;
+  volatile uint32_t occupancy_;
+
+  // mutex_ serializes Insert() and Erase().  Lookup() and Release() do
+  // not acquire it.
+  port::Mutex mutex_;
+  uint32_t clock_hand_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      mask_(0),
+      max_occupancy_(0),
+      table_(NULL),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {
+}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; table_ != NULL && i <= mask_; i++) {
+    ClockHandle* h = &table_[i];
+    const uint32_t state = StateOf(h->meta);
+    if (state == kStateVisible || state == kStateInvisible) {
+      assert(RefsOf(h->meta) == 0);  // Error if caller has unreleased handle
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+    }
+  }
+  delete[] table_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge) {
+  assert(estimated_entry_charge > 0);
+  capacity_ = capacity;
+  // Aim for a load factor of at most 0.7 when the cache is full.
+  const uint64_t entries = capacity / estimated_entry_charge + 1;
+  uint32_t length = 16;
+  while (length < entries * 10 / 7 && length < (1u << 30)) {
+    length *= 2;
+  }
+  mask_ = length - 1;
+  max_occupancy_ = length - length / 8;
+  table_ = new ClockHandle[length];
+  memset(table_, 0, sizeof(table_[0]) * length);
+}
+
+ClockHandle* ClockCache::Find(const Slice& key, uint32_t hash) {
+  const uint32_t incr = Increment(hash);
+  uint32_t slot = Home(hash);
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* h = &table_[slot];
+    if (StateOf(h->meta) == kStateVisible) {
+      const uint32_t meta = port::AtomicAdd32(&h->meta, 1);
+      if (StateOf(meta) == kStateVisible &&
+          h->hash == hash && key == h->key()) {
+        return h;
+      }
+      Unref(h);
+    }
+    if (h->displacements == 0) {
+      break;
+    }
+    slot = (slot + incr) & mask_;
+  }
+  return NULL;
+}
+
+void ClockCache::Unref(ClockHandle* h) {
+  const uint32_t meta = port::AtomicAdd32(&h->meta, -1);
+  if (meta == (kStateInvisible << kStateShift) &&
+      port::AtomicCompareAndSwap32(&h->meta, meta,
+                                   kStateConstruction << kStateShift)) {
+    FreeEntry(h);
+  }
+}
+
+// REQUIRES: h is in kStateConstruction and owned by the calling thread.
+void ClockCache::FreeEntry(ClockHandle* h) {
+  port::AtomicAddSize(&usage_, -h->charge);
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  if (h->detached) {
+    delete h;
+    return;
+  }
+
+  // Undo the displacements recorded when the entry was inserted
+  const uint32_t incr = Increment(h->hash);
+  for (uint32_t slot = Home(h->hash); &table_[slot] != h;
+       slot = (slot + incr) & mask_) {
+    port::AtomicAdd32(&table_[slot].displacements, -1);
+  }
+  port::AtomicAdd32(&occupancy_, -1);
+  port::AtomicAdd32(&h->meta, -static_cast<int32_t>(
+      (kStateConstruction - kStateEmpty) << kStateShift));
+}
+
+// REQUIRES: mutex_ held
+void ClockCache::EvictFor(size_t charge) {
+  // Every unpinned entry reaches a zero countdown within
+  // kMaxCountdown+1 sweeps, so bound the work done here.
+  const uint64_t max_steps = (static_cast<uint64_t>(mask_) + 1) *
+                             (kMaxCountdown + 1);
+  for (uint64_t step = 0;
+       step < max_steps &&
+           (usage_ + charge > capacity_ || occupancy_ >= max_occupancy_);
+       step++) {
+    ClockHandle* h = &table_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & mask_;
+    const uint32_t meta = h->meta;
+    if (StateOf(meta) != kStateVisible || RefsOf(meta) != 0) {
+      continue;
+    }
+    if (h->countdown > 0) {
+      h->countdown--;
+    } else if (port::AtomicCompareAndSwap32(
+                   &h->meta, meta, kStateConstruction << kStateShift)) {
+      FreeEntry(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ClockHandle* h = Find(key, hash);
+  if (h != NULL && h->countdown < kMaxCountdown) {
+    h->countdown = kMaxCountdown;
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
+  MutexLock l(&mutex_);
+
+  // Hide any existing entry for key before publishing the new one
+  ClockHandle* old = Find(key, hash);
+  if (old != NULL) {
+    port::AtomicAdd32(&old->meta, (kStateInvisible - kStateVisible)
+                                      << kStateShift);
+    Unref(old);
+  }
+
+  EvictFor(charge);
+
+  char* key_data = new char[key.size()];
+  memcpy(key_data, key.data(), key.size());
+
+  const uint32_t incr = Increment(hash);
+  uint32_t slot = Home(hash);
+  uint32_t probes = 0;
+  ClockHandle* h = NULL;
+  for (; probes <= mask_; probes++) {
+    ClockHandle* candidate = &table_[slot];
+    if (candidate->meta == 0 &&
+        port::AtomicCompareAndSwap32(&candidate->meta, 0,
+                                     kStateConstruction << kStateShift)) {
+      h = candidate;
+      break;
+    }
+    port::AtomicAdd32(&candidate->displacements, 1);
+    slot = (slot + incr) & mask_;
+  }
+
+  uint32_t published;
+  if (h != NULL) {
+    h->detached = false;
+    port::AtomicAdd32(&occupancy_, 1);
+    published = (kStateVisible - kStateConstruction) << kStateShift;
+  } else {
+    // The table is full of pinned entries.  Roll back and hand out an
+    // entry that is freed as soon as the caller releases it.
+    slot = Home(hash);
+    for (uint32_t i = 0; i < probes; i++) {
+      port::AtomicAdd32(&table_[slot].displacements, -1);
+      slot = (slot + incr) & mask_;
+    }
+    h = new ClockHandle;
+    h->meta = kStateConstruction << kStateShift;
+    h->displacements = 0;
+    h->detached = true;
+    published = (kStateInvisible - kStateConstruction) << kStateShift;
+  }
+  h->value = value;
+  h->deleter = deleter;
+  h->key_data = key_data;
+  h->key_length = key.size();
+  h->charge = charge;
+  h->hash = hash;
+  h->countdown = (priority == Cache::kHighPriority) ? kMaxCountdown : 1;
+  port::AtomicAddSize(&usage_, charge);
+  // Publish with one reference for the returned handle
+  port::AtomicAdd32(&h->meta, published + 1);
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* h = Find(key, hash);
+  if (h != NULL) {
+    port::AtomicAdd32(&h->meta, (kStateInvisible - kStateVisible)
+                                    << kStateShift);
+    Unref(h);
+  }
+}
+
 static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+static const int kMaxShardBits = 8;
+
+// Pick enough shards that concurrent readers rarely share one.
+static int DefaultShardBits() {
+  const int cpus = port::NumCPUs();
+  int bits = kNumShardBits;
+  while (bits < kMaxShardBits && (1 << bits) < 2 * cpus) {
+    bits++;
+  }
+  return bits;
+}
 
-class ShardedLRUCache : public Cache {
+template <class ShardType>
+class ShardedCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  const int num_shard_bits_;
+  ShardType* shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -280,49 +664,98 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) {
-    return hash >> (32 - kNumShardBits);
+  uint32_t Shard(uint32_t hash) const {
+    return (num_shard_bits_ == 0) ? 0 : hash >> (32 - num_shard_bits_);
+  }
+
+  static int SanitizeShardBits(int bits) {
+    if (bits < 0) return DefaultShardBits();
+    return (bits > kMaxShardBits) ? kMaxShardBits : bits;
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
-      : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
-    }
+  explicit ShardedCache(int num_shard_bits)
+      : num_shard_bits_(SanitizeShardBits(num_shard_bits)),
+        shard_(new ShardType[1 << num_shard_bits_]),
+        last_id_(0) {
   }
-  virtual ~ShardedLRUCache() { }
+  virtual ~ShardedCache() { delete[] shard_; }
+
+  int NumShards() const { return 1 << num_shard_bits_; }
+  ShardType* shard(int s) { return &shard_[s]; }
+
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     return shard_[Shard(hash)].Lookup(key, hash);
   }
   virtual void Release(Handle* handle) {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+    shard_[Shard(ShardType::HashOf(handle))].Release(handle);
   }
   virtual void Erase(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     shard_[Shard(hash)].Erase(key, hash);
   }
   virtual void* Value(Handle* handle) {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return ShardType::Value(handle);
   }
   virtual uint64_t NewId() {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < NumShards(); s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
 };
 
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return NewLRUCache(capacity, kNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return NewLRUCache(capacity, num_shard_bits, 0.5);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   double high_pri_pool_ratio) {
+  if (high_pri_pool_ratio < 0.0) high_pri_pool_ratio = 0.0;
+  if (high_pri_pool_ratio > 1.0) high_pri_pool_ratio = 1.0;
+  ShardedCache<LRUCache>* cache =
+      new ShardedCache<LRUCache>(num_shard_bits);
+  const int n = cache->NumShards();
+  const size_t per_shard = (capacity + (n - 1)) / n;
+  for (int s = 0; s < n; s++) {
+    cache->shard(s)->SetCapacity(per_shard, high_pri_pool_ratio);
+  }
+  return cache;
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  ShardedCache<ClockCache>* cache =
+      new ShardedCache<ClockCache>(num_shard_bits);
+  const int n = cache->NumShards();
+  const size_t per_shard = (capacity + (n - 1)) / n;
+  for (int s = 0; s < n; s++) {
+    cache->shard(s)->SetCapacity(per_shard, estimated_entry_charge);
+  }
+  return cache;
 }
 
 }  // namespace leveldb
@@ -5,7 +5,10 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -179,6 +182,242 @@ TEST(CacheTest, NewId) {
   ASSERT_NE(a, b);
 }
 
+TEST(CacheTest, TotalCharge) {
+  ASSERT_EQ(0, cache_->TotalCharge());
+  Insert(100, 101, 3);
+  Insert(200, 201, 4);
+  ASSERT_EQ(7, cache_->TotalCharge());
+
+  // Erased entries stay charged while a handle refers to them
+  Cache::Handle* h = cache_->Lookup(EncodeKey(100));
+  Erase(100);
+  ASSERT_EQ(7, cache_->TotalCharge());
+  cache_->Release(h);
+  ASSERT_EQ(4, cache_->TotalCharge());
+}
+
+TEST(CacheTest, ShardBits) {
+  // Every shard count must hold a full capacity worth of entries
+  for (int bits = -1; bits <= 8; bits++) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, bits);
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+    }
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ(1000 + i, Lookup(i));
+    }
+  }
+}
+
+TEST(CacheTest, HighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, 0.5);
+  cache_->Release(cache_->Insert(EncodeKey(100), EncodeValue(101), 1,
+                                 &CacheTest::Deleter, Cache::kHighPriority));
+
+  // A scan of low priority entries must not push out the high priority one
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  ASSERT_EQ(101, Lookup(100));
+
+  // Without a high priority pool it is evicted like everything else
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, 0.0);
+  cache_->Release(cache_->Insert(EncodeKey(100), EncodeValue(101), 1,
+                                 &CacheTest::Deleter, Cache::kHighPriority));
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  ASSERT_EQ(-1, Lookup(100));
+}
+
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 4, 1);
+  }
+};
+
+TEST(ClockCacheTest, ClockHitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1,  Lookup(200));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST(ClockCacheTest, ClockErase) {
+  Erase(200);
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  Insert(100, 101);
+  Insert(200, 201);
+  Erase(100);
+  ASSERT_EQ(-1,  Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1,  Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, ClockEntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, ClockEvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+
+  // Frequently used entry must survive many sweeps of the clock hand
+  for (int i = 0; i < 10 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+    ASSERT_EQ(2000+i, Lookup(1000+i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+}
+
+TEST(ClockCacheTest, ClockHeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2*kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000+index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000+i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+}
+
+TEST(ClockCacheTest, TableFull) {
+  // A single shard sized for a handful of entries, all of which are
+  // pinned: later inserts must still hand back usable handles.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0, kCacheSize);
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 100; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(1000+i), 1,
+                                     &CacheTest::Deleter));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000+i, DecodeValue(cache_->Value(handles[i])));
+  }
+  ASSERT_EQ(0, deleted_keys_.size());
+  for (int i = 0; i < 100; i++) {
+    cache_->Release(handles[i]);
+  }
+  int cached = 0;
+  for (int i = 0; i < 100; i++) {
+    if (Lookup(i) >= 0) cached++;
+  }
+  ASSERT_GT(cached, 0);
+  ASSERT_EQ(100, cached + deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, ClockNewId) {
+  uint64_t a = cache_->NewId();
+  uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+static void NoopDeleter(const Slice& key, void* v) { }
+
+struct ConcurrentState {
+  Cache* cache;
+  port::Mutex mu;
+  int running;
+  int failures;
+};
+
+static void ConcurrentReader(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  int failures = 0;
+  for (int i = 0; i < 100000; i++) {
+    const int k = i % 500;
+    Cache::Handle* h = state->cache->Lookup(EncodeKey(k));
+    if (h != NULL) {
+      if (DecodeValue(state->cache->Value(h)) != k) failures++;
+      state->cache->Release(h);
+    }
+  }
+  MutexLock l(&state->mu);
+  state->failures += failures;
+  state->running--;
+}
+
+TEST(ClockCacheTest, ConcurrentLookups) {
+  ConcurrentState state;
+  state.cache = NewClockCache(200, 2, 1);
+  state.running = 4;
+  state.failures = 0;
+  for (int i = 0; i < 4; i++) {
+    Env::Default()->StartThread(&ConcurrentReader, &state);
+  }
+  // Keep replacing and evicting entries while the readers run
+  for (int i = 0; ; i++) {
+    {
+      MutexLock l(&state.mu);
+      if (state.running == 0) break;
+    }
+    const int k = i % 500;
+    state.cache->Release(state.cache->Insert(
+        EncodeKey(k), EncodeValue(k), 1, &NoopDeleter));
+    if (i % 7 == 0) state.cache->Erase(EncodeKey((k * 3) % 500));
+  }
+  ASSERT_EQ(0, state.failures);
+  delete state.cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,38 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/compaction_filter.h"
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+CompactionFilter::~CompactionFilter() { }
+
+namespace {
+class PrefixCompactionFilter : public CompactionFilter {
+ private:
+  std::string prefix_;
+
+ public:
+  explicit PrefixCompactionFilter(const Slice& prefix)
+      : prefix_(prefix.data(), prefix.size()) {
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.PrefixCompactionFilter";
+  }
+
+  virtual bool Filter(int level, const Slice& key, const Slice& value,
+                      std::string* new_value, bool* value_changed) const {
+    return key.starts_with(prefix_);
+  }
+};
+}  // namespace
+
+const CompactionFilter* NewPrefixCompactionFilter(const Slice& prefix) {
+  return new PrefixCompactionFilter(prefix);
+}
+
+}  // namespace leveldb
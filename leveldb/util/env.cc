@@ -4,17 +4,74 @@
 
 #include "leveldb/env.h"
 
+#include <algorithm>
+
 namespace leveldb {
 
 Env::~Env() {
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewMmapRandomAccessFile(const std::string& fname,
+                                    RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+Status Env::LinkFile(const std::string& src, const std::string& target) {
+  return Status::NotSupported("hard links", src);
+}
+
+uint64_t Env::NowNanos() {
+  return NowMicros() * 1000;
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+void RandomAccessFile::Advise(uint64_t offset, size_t n,
+                              AccessPattern pattern) const {
+}
+
+namespace {
+// A read that finished before it was returned
+class CompletedRead : public PendingRead {
+ public:
+  CompletedRead(const Status& s, const Slice& result)
+      : status_(s), result_(result) { }
+
+  virtual Status Wait(Slice* result) {
+    *result = result_;
+    return status_;
+  }
+
+ private:
+  Status status_;
+  Slice result_;
+};
+}  // namespace
+
+PendingRead* RandomAccessFile::ReadAsync(uint64_t offset, size_t n,
+                                         char* scratch) const {
+  Slice result;
+  Status s = Read(offset, n, &result, scratch);
+  return new CompletedRead(s, result);
+}
+
+PendingRead::~PendingRead() {
+}
+
 WritableFile::~WritableFile() {
 }
 
@@ -90,6 +147,50 @@ Status ReadFileToString(Env* env, const std::string& fname, std::string* data) {
   return s;
 }
 
+Status CopyFile(Env* env, const std::string& src, const std::string& target,
+                uint64_t size) {
+  SequentialFile* file;
+  Status s = env->NewSequentialFile(src, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* dest;
+  s = env->NewWritableFile(target, &dest);
+  if (!s.ok()) {
+    delete file;
+    return s;
+  }
+  static const int kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  while (size > 0) {
+    Slice fragment;
+    s = file->Read(std::min<uint64_t>(size, kBufferSize), &fragment, space);
+    if (s.ok() && fragment.empty()) {
+      s = Status::Corruption(src, "file is shorter than expected");
+    }
+    if (s.ok()) {
+      s = dest->Append(fragment);
+    }
+    if (!s.ok()) {
+      break;
+    }
+    size -= fragment.size();
+  }
+  delete[] space;
+  delete file;
+  if (s.ok()) {
+    s = dest->Sync();
+  }
+  if (s.ok()) {
+    s = dest->Close();
+  }
+  delete dest;
+  if (!s.ok()) {
+    env->DeleteFile(target);
+  }
+  return s;
+}
+
 EnvWrapper::~EnvWrapper() {
 }
 
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <deque>
 #include <dirent.h>
 #include <errno.h>
@@ -19,10 +20,15 @@
 #if defined(LEVELDB_PLATFORM_ANDROID)
 #include <sys/stat.h>
 #endif
+#if defined(LEVELDB_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/posix_logger.h"
 
 namespace leveldb {
@@ -66,17 +72,355 @@ class PosixSequentialFile: public SequentialFile {
   }
 };
 
+#if defined(LEVELDB_HAVE_IO_URING)
+// A minimal io_uring that only submits reads, driven through the raw
+// system calls so that no library is needed.  Callers serialize all
+// calls except WaitForCompletion().
+class PosixIoUring {
+ public:
+  // Returns NULL if the kernel does not provide io_uring, or one that
+  // cannot read
+  static PosixIoUring* Create(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+      return NULL;
+    }
+    if (!SupportsRead(fd)) {
+      close(fd);
+      return NULL;
+    }
+    PosixIoUring* ring = new PosixIoUring(fd, params);
+    if (!ring->Map()) {
+      delete ring;
+      return NULL;
+    }
+    return ring;
+  }
+
+  ~PosixIoUring() {
+    if (sqes_ != NULL) munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    close(fd_);
+  }
+
+  // Queue a read of "n" bytes at "offset" of "fd" into "buf", to be
+  // reported with "tag".  Returns false if the ring is full or the
+  // read could not be submitted.
+  bool SubmitRead(int fd, uint64_t offset, size_t n, char* buf, void* tag) {
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    const unsigned tail = *sq_tail_;
+    if (tail - head >= params_.sq_entries ||
+        in_flight_ >= params_.cq_entries) {
+      return false;
+    }
+    const unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uintptr_t>(buf);
+    sqe->len = n;
+    sqe->user_data = reinterpret_cast<uintptr_t>(tag);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    int r;
+    do {
+      r = syscall(__NR_io_uring_enter, fd_, 1, 0, 0, NULL, 0);
+    } while (r < 0 && errno == EINTR);
+    if (r != 1) {
+      // Take the entry back
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+    in_flight_++;
+    return true;
+  }
+
+  // Block until at least one read has completed.  May be called
+  // concurrently with the other methods.
+  void WaitForCompletion() {
+    int r;
+    do {
+      r = syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                  NULL, 0);
+    } while (r < 0 && errno == EINTR);
+  }
+
+  // Call (*done)(tag, res) for each completed read, where "res" is the
+  // number of bytes read or a negated errno value.
+  void Reap(void (*done)(void* tag, int res)) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      (*done)(reinterpret_cast<void*>(cqe->user_data), cqe->res);
+      head++;
+      in_flight_--;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  // Whether the ring "fd" runs IORING_OP_READ.  Kernels 5.1 to 5.5 set
+  // up rings but fail such reads with EINVAL; they also lack
+  // IORING_REGISTER_PROBE, which tells.
+  static bool SupportsRead(int fd) {
+    const unsigned kOps = 256;
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(
+        calloc(1, sizeof(struct io_uring_probe) +
+                  kOps * sizeof(struct io_uring_probe_op)));
+    const bool result =
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                probe, kOps) >= 0 &&
+        IORING_OP_READ <= probe->last_op &&
+        IORING_OP_READ < probe->ops_len &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+    free(probe);
+    return result;
+  }
+
+  PosixIoUring(int fd, const struct io_uring_params& params)
+      : fd_(fd), params_(params), in_flight_(0),
+        sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_(NULL) { }
+
+  bool Map() {
+    sq_ring_size_ = params_.sq_off.array +
+                    params_.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params_.cq_off.cqes +
+                    params_.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single = (params_.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) return false;
+    if (single) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) return false;
+    }
+    sqes_size_ = params_.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = reinterpret_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = reinterpret_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+    char* cq = reinterpret_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params_.cq_off.cqes);
+    return true;
+  }
+
+  const int fd_;
+  const struct io_uring_params params_;
+  unsigned in_flight_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+};
+#endif  // defined(LEVELDB_HAVE_IO_URING)
+
+// Runs the reads started by PosixRandomAccessFile::ReadAsync().  Reads
+// go to an io_uring when the kernel has one and otherwise to a small
+// pool of threads that call pread().
+class PosixAsyncReader {
+ public:
+  explicit PosixAsyncReader(Env* env)
+      : env_(env), cv_(&mu_), threads_(0), idle_threads_(0)
+#if defined(LEVELDB_HAVE_IO_URING)
+      , ring_checked_(false), ring_(NULL), reaping_(false)
+#endif
+  { }
+
+  PendingRead* Start(const std::string& fname, int fd, uint64_t offset,
+                     size_t n, char* scratch);
+
+ private:
+  class Request;
+  friend class Request;
+
+  static const int kMaxThreads = 4;
+  static const unsigned kRingEntries = 64;
+
+  void WaitFor(Request* r);
+  static void ReadThread(void* arg);
+  static void Complete(void* tag, int res);
+
+  Env* const env_;
+  port::Mutex mu_;
+  port::CondVar cv_;  // Signalled when a read completes or is queued
+  std::deque<Request*> queue_;  // Reads waiting for a thread
+  int threads_;
+  int idle_threads_;
+#if defined(LEVELDB_HAVE_IO_URING)
+  bool ring_checked_;   // Has creating ring_ been attempted?
+  PosixIoUring* ring_;  // NULL if io_uring is unavailable
+  bool reaping_;        // Is a thread waiting for ring completions?
+#endif
+};
+
+class PosixAsyncReader::Request : public PendingRead {
+ public:
+  Request(PosixAsyncReader* reader, const std::string& fname, int fd,
+          uint64_t offset, size_t n, char* scratch)
+      : reader_(reader), fname_(fname), fd_(fd), offset_(offset), n_(n),
+        scratch_(scratch), in_ring_(false), done_(false), waited_(false),
+        res_(0) { }
+
+  virtual ~Request() {
+    if (!waited_) {
+      reader_->WaitFor(this);
+    }
+  }
+
+  virtual Status Wait(Slice* result) {
+    assert(!waited_);
+    reader_->WaitFor(this);
+    waited_ = true;
+    if (res_ < 0) {
+      *result = Slice(scratch_, 0);
+      return IOError(fname_, -res_);
+    }
+    *result = Slice(scratch_, res_);
+    return Status::OK();
+  }
+
+ private:
+  friend class PosixAsyncReader;
+
+  PosixAsyncReader* const reader_;
+  const std::string fname_;
+  const int fd_;
+  const uint64_t offset_;
+  const size_t n_;
+  char* const scratch_;
+  bool in_ring_;  // Submitted to the io_uring?
+  bool done_;     // Protected by reader_->mu_
+  bool waited_;
+  ssize_t res_;   // Bytes read or negated errno
+};
+
+PendingRead* PosixAsyncReader::Start(const std::string& fname, int fd,
+                                     uint64_t offset, size_t n,
+                                     char* scratch) {
+  Request* r = new Request(this, fname, fd, offset, n, scratch);
+  MutexLock l(&mu_);
+#if defined(LEVELDB_HAVE_IO_URING)
+  if (!ring_checked_) {
+    ring_checked_ = true;
+    ring_ = PosixIoUring::Create(kRingEntries);
+  }
+  if (ring_ != NULL && ring_->SubmitRead(fd, offset, n, scratch, r)) {
+    r->in_ring_ = true;
+    return r;
+  }
+#endif
+  queue_.push_back(r);
+  if (idle_threads_ == 0 && threads_ < kMaxThreads) {
+    threads_++;
+    env_->StartThread(&PosixAsyncReader::ReadThread, this);
+  }
+  cv_.SignalAll();
+  return r;
+}
+
+void PosixAsyncReader::WaitFor(Request* r) {
+  MutexLock l(&mu_);
+  while (!r->done_) {
+#if defined(LEVELDB_HAVE_IO_URING)
+    if (r->in_ring_ && !reaping_) {
+      // Become the thread that collects completions for everyone
+      reaping_ = true;
+      mu_.Unlock();
+      ring_->WaitForCompletion();
+      mu_.Lock();
+      ring_->Reap(&PosixAsyncReader::Complete);
+      reaping_ = false;
+      cv_.SignalAll();
+      continue;
+    }
+#endif
+    cv_.Wait();
+  }
+}
+
+void PosixAsyncReader::Complete(void* tag, int res) {
+  Request* r = reinterpret_cast<Request*>(tag);
+  r->res_ = res;
+  r->done_ = true;
+}
+
+void PosixAsyncReader::ReadThread(void* arg) {
+  PosixAsyncReader* reader = reinterpret_cast<PosixAsyncReader*>(arg);
+  MutexLock l(&reader->mu_);
+  while (true) {
+    while (reader->queue_.empty()) {
+      reader->idle_threads_++;
+      reader->cv_.Wait();
+      reader->idle_threads_--;
+    }
+    Request* r = reader->queue_.front();
+    reader->queue_.pop_front();
+
+    reader->mu_.Unlock();
+    ssize_t res = pread(r->fd_, r->scratch_, r->n_,
+                        static_cast<off_t>(r->offset_));
+    if (res < 0) {
+      res = -errno;
+    }
+    reader->mu_.Lock();
+    r->res_ = res;
+    r->done_ = true;
+    reader->cv_.SignalAll();
+  }
+}
+
 // pread() based random-access
 class PosixRandomAccessFile: public RandomAccessFile {
  private:
   std::string filename_;
   int fd_;
+  PosixAsyncReader* async_reader_;
 
  public:
-  PosixRandomAccessFile(const std::string& fname, int fd)
-      : filename_(fname), fd_(fd) { }
+  PosixRandomAccessFile(const std::string& fname, int fd,
+                        PosixAsyncReader* async_reader)
+      : filename_(fname), fd_(fd), async_reader_(async_reader) { }
   virtual ~PosixRandomAccessFile() { close(fd_); }
 
+  virtual PendingRead* ReadAsync(uint64_t offset, size_t n,
+                                 char* scratch) const {
+    return async_reader_->Start(filename_, fd_, offset, n, scratch);
+  }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const {
     Status s;
@@ -88,6 +432,20 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Advise(uint64_t offset, size_t n,
+                      AccessPattern pattern) const {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    int advice = POSIX_FADV_NORMAL;
+    switch (pattern) {
+      case kNormal:     advice = POSIX_FADV_NORMAL;     break;
+      case kSequential: advice = POSIX_FADV_SEQUENTIAL; break;
+      case kWillNeed:   advice = POSIX_FADV_WILLNEED;   break;
+    }
+    posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                  advice);
+#endif
+  }
 };
 
 // mmap() based random-access
@@ -103,6 +461,14 @@ class PosixMmapReadableFile: public RandomAccessFile {
       : filename_(fname), mmapped_region_(base), length_(length) { }
   virtual ~PosixMmapReadableFile() { munmap(mmapped_region_, length_); }
 
+  // The data needs no copying; the kernel reads the pages in the
+  // background while the caller goes on.
+  virtual PendingRead* ReadAsync(uint64_t offset, size_t n,
+                                 char* scratch) const {
+    Advise(offset, n, kWillNeed);
+    return RandomAccessFile::ReadAsync(offset, n, scratch);
+  }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const {
     Status s;
@@ -114,6 +480,27 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Advise(uint64_t offset, size_t n,
+                      AccessPattern pattern) const {
+    if (offset >= length_) {
+      return;
+    }
+    if (n == 0 || n > length_ - offset) {
+      n = length_ - offset;
+    }
+    // madvise() wants a page-aligned start
+    const uint64_t page_size = getpagesize();
+    const uint64_t start = offset & ~(page_size - 1);
+    int advice = MADV_NORMAL;
+    switch (pattern) {
+      case kNormal:     advice = MADV_NORMAL;     break;
+      case kSequential: advice = MADV_SEQUENTIAL; break;
+      case kWillNeed:   advice = MADV_WILLNEED;   break;
+    }
+    madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+            n + (offset - start), advice);
+  }
 };
 
 // We preallocate up to an extra megabyte and use memcpy to append new
@@ -286,6 +673,195 @@ class PosixMmapFile : public WritableFile {
   }
 };
 
+// Offsets, sizes and buffers of direct I/O must be multiples of the
+// device's logical block size, which this is a multiple of in practice.
+static const size_t kDirectIOAlignment = 4096;
+
+static size_t RoundDown(size_t x, size_t y) { return x - (x % y); }
+static size_t RoundUp(size_t x, size_t y) { return RoundDown(x + y - 1, y); }
+
+static char* NewAlignedBuffer(size_t n) {
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, kDirectIOAlignment, n) != 0) {
+    return NULL;
+  }
+  return reinterpret_cast<char*>(ptr);
+}
+
+// Open "fname" so that its data bypasses the page cache.  Returns -1
+// and sets errno if that is not possible.
+static int OpenDirect(const std::string& fname, int flags, int mode) {
+#if defined(O_DIRECT)
+  return open(fname.c_str(), flags | O_DIRECT, mode);
+#elif defined(F_NOCACHE)
+  int fd = open(fname.c_str(), flags, mode);
+  if (fd >= 0 && fcntl(fd, F_NOCACHE, 1) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    fd = -1;
+  }
+  return fd;
+#else
+  errno = EINVAL;
+  return -1;
+#endif
+}
+
+// pread() based random-access that bypasses the page cache.  Each read
+// is widened to aligned boundaries and goes through a buffer of its
+// own, so the file can still be used by several threads at once.
+class PosixDirectRandomAccessFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+
+ public:
+  PosixDirectRandomAccessFile(const std::string& fname, int fd)
+      : filename_(fname), fd_(fd) { }
+  virtual ~PosixDirectRandomAccessFile() { close(fd_); }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    const uint64_t start = offset - (offset % kDirectIOAlignment);
+    const size_t skip = offset - start;
+    const size_t size = RoundUp(skip + n, kDirectIOAlignment);
+    char* buf = NewAlignedBuffer(size);
+    if (buf == NULL) {
+      *result = Slice();
+      return IOError(filename_, ENOMEM);
+    }
+    Status s;
+    size_t got = 0;
+    while (got < size) {
+      ssize_t r = pread(fd_, buf + got, size - got,
+                        static_cast<off_t>(start + got));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        s = IOError(filename_, errno);
+        break;
+      } else if (r == 0) {
+        break;  // End of file
+      }
+      got += r;
+    }
+    if (s.ok() && got > skip) {
+      const size_t len = std::min(n, got - skip);
+      memcpy(scratch, buf + skip, len);
+      *result = Slice(scratch, len);
+    } else {
+      *result = Slice(scratch, 0);
+    }
+    free(buf);
+    return s;
+  }
+};
+
+// A file that bypasses the page cache when written.  Appends collect
+// in an aligned buffer that is written out whenever it fills up.
+// Flush() does nothing, since writing a partial block means writing it
+// again later; Sync() and Close() write the partial block padded with
+// zeroes, and trim the file back to its real length.  The partial block
+// stays in the buffer so that later appends can complete it.
+class PosixDirectWritableFile : public WritableFile {
+ public:
+  static const size_t kBufferSize = 1 << 20;
+
+ private:
+  std::string filename_;
+  int fd_;
+  char* buf_;
+  size_t pos_;            // Number of bytes in buf_
+  uint64_t file_offset_;  // Offset of buf_ in the file; always aligned
+
+  // Write out buf_[0,pos_-1], keeping any trailing partial block
+  Status WriteBuffer() {
+    const size_t padded = RoundUp(pos_, kDirectIOAlignment);
+    memset(buf_ + pos_, 0, padded - pos_);
+    size_t done = 0;
+    while (done < padded) {
+      ssize_t r = pwrite(fd_, buf_ + done, padded - done,
+                         static_cast<off_t>(file_offset_ + done));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return IOError(filename_, errno);
+      }
+      done += r;
+    }
+    if (padded != pos_ &&
+        ftruncate(fd_, static_cast<off_t>(file_offset_ + pos_)) < 0) {
+      return IOError(filename_, errno);
+    }
+    const size_t full = RoundDown(pos_, kDirectIOAlignment);
+    memmove(buf_, buf_ + full, pos_ - full);
+    file_offset_ += full;
+    pos_ -= full;
+    return Status::OK();
+  }
+
+ public:
+  PosixDirectWritableFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), pos_(0), file_offset_(0) { }
+
+  ~PosixDirectWritableFile() {
+    if (fd_ >= 0) {
+      PosixDirectWritableFile::Close();
+    }
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* src = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      size_t n = std::min(left, kBufferSize - pos_);
+      memcpy(buf_ + pos_, src, n);
+      pos_ += n;
+      src += n;
+      left -= n;
+      if (pos_ == kBufferSize) {
+        Status s = WriteBuffer();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status s;
+    if (pos_ > 0) {
+      s = WriteBuffer();
+    }
+    if (close(fd_) < 0 && s.ok()) {
+      s = IOError(filename_, errno);
+    }
+    fd_ = -1;
+    free(buf_);
+    buf_ = NULL;
+    return s;
+  }
+
+  virtual Status Flush() {
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s;
+    if (pos_ > 0) {
+      s = WriteBuffer();
+    }
+    if (s.ok() && fdatasync(fd_) < 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+};
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -329,8 +905,24 @@ class PosixEnv : public Env {
     int fd = open(fname.c_str(), O_RDONLY);
     if (fd < 0) {
       s = IOError(fname, errno);
-    } else if (sizeof(void*) >= 8) {
-      // Use mmap when virtual address-space is plentiful.
+    } else {
+      *result = new PosixRandomAccessFile(fname, fd, &async_reader_);
+    }
+    return s;
+  }
+
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         RandomAccessFile** result) {
+    if (sizeof(void*) < 8) {
+      // Virtual address-space is too scarce to map whole files
+      return NewRandomAccessFile(fname, result);
+    }
+    *result = NULL;
+    Status s;
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      s = IOError(fname, errno);
+    } else {
       uint64_t size;
       s = GetFileSize(fname, &size);
       if (s.ok()) {
@@ -342,8 +934,6 @@ class PosixEnv : public Env {
         }
       }
       close(fd);
-    } else {
-      *result = new PosixRandomAccessFile(fname, fd);
     }
     return s;
   }
@@ -361,6 +951,33 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+    int fd = OpenDirect(fname, O_RDONLY, 0);
+    if (fd < 0) {
+      // E.g. a file system that does not support direct I/O
+      return NewRandomAccessFile(fname, result);
+    }
+    *result = new PosixDirectRandomAccessFile(fname, fd);
+    return Status::OK();
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    int fd = OpenDirect(fname, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+      return NewWritableFile(fname, result);
+    }
+    char* buf = NewAlignedBuffer(PosixDirectWritableFile::kBufferSize);
+    if (buf == NULL) {
+      close(fd);
+      *result = NULL;
+      return IOError(fname, ENOMEM);
+    }
+    *result = new PosixDirectWritableFile(fname, fd, buf);
+    return Status::OK();
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -424,6 +1041,14 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    Status result;
+    if (link(src.c_str(), target.c_str()) != 0) {
+      result = IOError(src, errno);
+    }
+    return result;
+  }
+
   virtual Status LockFile(const std::string& fname, FileLock** lock) {
     *lock = NULL;
     Status result;
@@ -494,6 +1119,14 @@ class PosixEnv : public Env {
     return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
   }
 
+#if defined(CLOCK_MONOTONIC)
+  virtual uint64_t NowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+#endif
+
   virtual void SleepForMicroseconds(int micros) {
     usleep(micros);
   }
@@ -514,6 +1147,7 @@ class PosixEnv : public Env {
   }
 
   size_t page_size_;
+  PosixAsyncReader async_reader_;
   pthread_mutex_t mu_;
   pthread_cond_t bgsignal_;
   pthread_t bgthread_;
@@ -526,6 +1160,7 @@ class PosixEnv : public Env {
 };
 
 PosixEnv::PosixEnv() : page_size_(getpagesize()),
+                       async_reader_(this),
                        started_bgthread_(false) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
   PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
@@ -4,6 +4,8 @@
 
 #include "leveldb/env.h"
 
+#include <algorithm>
+
 #include "port/port.h"
 #include "util/testharness.h"
 
@@ -19,6 +21,35 @@ class EnvPosixTest {
  public:
   Env* env_;
   EnvPosixTest() : env_(Env::Default()) { }
+
+  // Read the file through several concurrent asynchronous reads
+  void CheckAsyncReads(RandomAccessFile* file, const std::string& data) {
+    const int kReads = 100;
+    const size_t kReadSize = 1000;
+    std::vector<std::string> scratch(kReads, std::string(kReadSize, 'x'));
+    std::vector<PendingRead*> reads;
+    for (int i = 0; i < kReads; i++) {
+      reads.push_back(file->ReadAsync(i * kReadSize, kReadSize,
+                                      &scratch[i][0]));
+    }
+    // Finish them out of order
+    for (int i = kReads - 1; i >= 0; i -= 2) {
+      Slice result;
+      ASSERT_OK(reads[i]->Wait(&result));
+      ASSERT_EQ(data.substr(i * kReadSize, kReadSize), result.ToString());
+    }
+    // Deleting waits for the rest
+    for (int i = 0; i < kReads; i++) {
+      delete reads[i];
+    }
+
+    // Reading past the end gives a short result
+    Slice result;
+    PendingRead* tail = file->ReadAsync(data.size() - 10, 10, &scratch[0][0]);
+    ASSERT_OK(tail->Wait(&result));
+    ASSERT_EQ(data.substr(data.size() - 10), result.ToString());
+    delete tail;
+  }
 };
 
 static void SetBool(void* ptr) {
@@ -97,6 +128,113 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+TEST(EnvPosixTest, ReadAsync) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  const std::string fname = test_dir + "/read_async.txt";
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%d,", i);
+    data.append(buf);
+  }
+  ASSERT_OK(WriteStringToFile(env_, data, fname));
+
+  // Memory-mapped file
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewMmapRandomAccessFile(fname, &file));
+  CheckAsyncReads(file, data);
+  delete file;
+
+  // pread() file, read through io_uring or the reader threads
+  ASSERT_OK(env_->NewRandomAccessFile(fname, &file));
+  CheckAsyncReads(file, data);
+  delete file;
+
+  ASSERT_OK(env_->DeleteFile(fname));
+}
+
+TEST(EnvPosixTest, DirectIO) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  const std::string fname = test_dir + "/direct_io.txt";
+  std::string data;
+  for (int i = 0; data.size() < 3000000; i++) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%d,", i);
+    data.append(buf);
+  }
+
+  // Unaligned appends, with syncs that leave a partial block behind
+  WritableFile* writable;
+  ASSERT_OK(env_->NewDirectWritableFile(fname, &writable));
+  size_t pos = 0;
+  for (int i = 0; pos < data.size(); i++) {
+    const size_t n = std::min<size_t>(1 + (i * 7919) % 20000,
+                                      data.size() - pos);
+    ASSERT_OK(writable->Append(Slice(data.data() + pos, n)));
+    pos += n;
+    if (i % 50 == 0) {
+      ASSERT_OK(writable->Sync());
+      uint64_t size;
+      ASSERT_OK(env_->GetFileSize(fname, &size));
+      ASSERT_EQ(pos, size);
+    }
+  }
+  ASSERT_OK(writable->Close());
+  delete writable;
+
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  ASSERT_TRUE(contents == data);
+
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewDirectRandomAccessFile(fname, &file));
+  char* scratch = new char[20000];
+  for (uint64_t offset = 0; offset < data.size(); offset += 12345) {
+    const size_t n = 1 + offset % 20000;
+    Slice result;
+    ASSERT_OK(file->Read(offset, n, &result, scratch));
+    ASSERT_EQ(data.substr(offset, n), result.ToString());
+  }
+  // Reading past the end gives a short result
+  Slice result;
+  ASSERT_OK(file->Read(data.size() - 10, 100, &result, scratch));
+  ASSERT_EQ(data.substr(data.size() - 10), result.ToString());
+  delete[] scratch;
+  delete file;
+
+  ASSERT_OK(env_->DeleteFile(fname));
+}
+
+TEST(EnvPosixTest, LinkAndCopyFile) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  const std::string fname = test_dir + "/link_src.txt";
+  const std::string link = test_dir + "/link_dst.txt";
+  const std::string copy = test_dir + "/copy_dst.txt";
+  env_->DeleteFile(link);
+  ASSERT_OK(WriteStringToFile(env_, "hello world", fname));
+
+  ASSERT_OK(env_->LinkFile(fname, link));
+  ASSERT_TRUE(!env_->LinkFile(fname, link).ok());
+  ASSERT_OK(CopyFile(env_, fname, copy, 5));
+  ASSERT_TRUE(!CopyFile(env_, fname, copy, 100).ok());
+  ASSERT_TRUE(!env_->FileExists(copy));
+  ASSERT_OK(CopyFile(env_, fname, copy, 5));
+
+  // The link outlives the original name
+  ASSERT_OK(env_->DeleteFile(fname));
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, link, &contents));
+  ASSERT_EQ("hello world", contents);
+  ASSERT_OK(ReadFileToString(env_, copy, &contents));
+  ASSERT_EQ("hello", contents);
+
+  ASSERT_OK(env_->DeleteFile(link));
+  ASSERT_OK(env_->DeleteFile(copy));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
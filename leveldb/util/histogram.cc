@@ -41,13 +41,23 @@ void Histogram::Clear() {
   }
 }
 
-void Histogram::Add(double value) {
-  // Linear search is fast enough for our usage in db_bench
-  int b = 0;
-  while (b < kNumBuckets - 1 && kBucketLimit[b] <= value) {
-    b++;
+int Histogram::BucketIndex(double value) {
+  // Binary search for the first limit greater than value
+  int lo = 0;
+  int hi = kNumBuckets - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (kBucketLimit[mid] <= value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
-  buckets_[b] += 1.0;
+  return lo;
+}
+
+void Histogram::Add(double value) {
+  buckets_[BucketIndex(value)] += 1.0;
   if (min_ > value) min_ = value;
   if (max_ < value) max_ = value;
   num_++;
@@ -71,24 +81,29 @@ double Histogram::Median() const {
 }
 
 double Histogram::Percentile(double p) const {
-  double threshold = num_ * (p / 100.0);
+  return Percentile(buckets_, num_, min_, max_, p);
+}
+
+double Histogram::Percentile(const double* buckets, double num,
+                             double min, double max, double p) {
+  double threshold = num * (p / 100.0);
   double sum = 0;
   for (int b = 0; b < kNumBuckets; b++) {
-    sum += buckets_[b];
+    sum += buckets[b];
     if (sum >= threshold) {
       // Scale linearly within this bucket
       double left_point = (b == 0) ? 0 : kBucketLimit[b-1];
       double right_point = kBucketLimit[b];
-      double left_sum = sum - buckets_[b];
+      double left_sum = sum - buckets[b];
       double right_sum = sum;
       double pos = (threshold - left_sum) / (right_sum - left_sum);
       double r = left_point + (right_point - left_point) * pos;
-      if (r < min_) r = min_;
-      if (r > max_) r = max_;
+      if (r < min) r = min;
+      if (r > max) r = max;
       return r;
     }
   }
-  return max_;
+  return max;
 }
 
 double Histogram::Average() const {
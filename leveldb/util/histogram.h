@@ -20,6 +20,17 @@ class Histogram {
 
   std::string ToString() const;
 
+  enum { kNumBuckets = 154 };
+  static const double kBucketLimit[kNumBuckets];
+
+  // Return the index of the bucket "value" falls in.
+  static int BucketIndex(double value);
+
+  // Return the "p"th percentile of "num" values with the given minimum
+  // and maximum, spread over kNumBuckets "buckets".
+  static double Percentile(const double* buckets, double num,
+                           double min, double max, double p);
+
  private:
   double min_;
   double max_;
@@ -27,8 +38,6 @@ class Histogram {
   double sum_;
   double sum_squares_;
 
-  enum { kNumBuckets = 154 };
-  static const double kBucketLimit[kNumBuckets];
   double buckets_[kNumBuckets];
 
   double Median() const;
@@ -0,0 +1,19 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/listener.h"
+
+namespace leveldb {
+
+EventListener::~EventListener() { }
+
+void EventListener::OnFlushCompleted(DB* db, const FlushJobInfo& info) { }
+
+void EventListener::OnCompactionCompleted(DB* db,
+                                          const CompactionJobInfo& info) { }
+
+void EventListener::OnStallConditionsChanged(DB* db,
+                                             const WriteStallInfo& info) { }
+
+}  // namespace leveldb
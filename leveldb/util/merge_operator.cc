@@ -0,0 +1,74 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() { }
+
+namespace {
+class UInt64AddOperator : public MergeOperator {
+ private:
+  static uint64_t Decode(const Slice& value) {
+    return (value.size() == 8) ? DecodeFixed64(value.data()) : 0;
+  }
+
+ public:
+  virtual const char* Name() const {
+    return "leveldb.UInt64AddOperator";
+  }
+
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const {
+    uint64_t sum = Decode(operand);
+    if (existing_value != NULL) {
+      sum += Decode(*existing_value);
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+};
+
+class StringAppendOperator : public MergeOperator {
+ private:
+  std::string delimiter_;
+
+ public:
+  explicit StringAppendOperator(const Slice& delimiter)
+      : delimiter_(delimiter.data(), delimiter.size()) {
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.StringAppendOperator";
+  }
+
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->reserve(existing_value->size() + delimiter_.size() +
+                         operand.size());
+      new_value->append(existing_value->data(), existing_value->size());
+      new_value->append(delimiter_);
+    }
+    new_value->append(operand.data(), operand.size());
+    return true;
+  }
+};
+}  // namespace
+
+const MergeOperator* NewUInt64AddOperator() {
+  return new UInt64AddOperator;
+}
+
+const MergeOperator* NewStringAppendOperator(const Slice& delimiter) {
+  return new StringAppendOperator(delimiter);
+}
+
+}  // namespace leveldb
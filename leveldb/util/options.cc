@@ -4,6 +4,7 @@
 
 #include "leveldb/options.h"
 
+#include <limits.h>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 
@@ -17,12 +18,49 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      soft_pending_compaction_bytes_limit(0),
+      hard_pending_compaction_bytes_limit(0),
+      delayed_write_rate(16 << 20),
+      num_levels(7),
+      level0_file_num_compaction_trigger(4),
+      target_file_size_base(2 << 20),
+      target_file_size_multiplier(1),
+      max_bytes_for_level_base(10 << 20),
+      max_bytes_for_level_multiplier(10),
+      level_compaction_dynamic_level_bytes(false),
+      compaction_style(kCompactionStyleLevel),
+      universal_size_ratio(1),
+      universal_min_merge_width(2),
+      universal_max_merge_width(INT_MAX),
+      universal_max_size_amplification_percent(200),
+      fifo_max_table_files_size(1 << 30),
+      ttl(0),
+      hide_expired_keys(false),
+      compaction_filter(NULL),
+      merge_operator(NULL),
+      recovery_threads(1),
       max_open_files(1000),
+      record_table_handles(false),
+      prewarm_threads(0),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
+      readahead_size(0),
+      prefetch_blocks(0),
+      use_direct_io_for_compaction(false),
+      allow_mmap_reads(false),
+      rate_limiter(NULL),
+      statistics(NULL),
+      listener(NULL),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      full_filters(false),
+      cache_index_and_filter_blocks(false),
+      pin_l0_filter_and_index_blocks_in_cache(false),
+      partition_index_and_filters(false),
+      metadata_block_size(4096) {
 }
 
 
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+LEVELDB_THREAD_LOCAL PerfLevel perf_level = kDisable;
+LEVELDB_THREAD_LOCAL PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+void PerfContext::Reset() {
+  memset(this, 0, sizeof(*this));
+}
+
+std::string PerfContext::ToString() const {
+  struct Counter {
+    const char* name;
+    uint64_t value;
+  };
+  const Counter counters[] = {
+    { "get_from_memtable_count", get_from_memtable_count },
+    { "get_from_memtable_time", get_from_memtable_time },
+    { "get_from_output_files_time", get_from_output_files_time },
+    { "files_checked", files_checked },
+    { "level0_files_checked", level0_files_checked },
+    { "find_table_count", find_table_count },
+    { "find_table_time", find_table_time },
+    { "table_open_count", table_open_count },
+    { "bloom_filter_checks", bloom_filter_checks },
+    { "bloom_filter_useful", bloom_filter_useful },
+    { "block_cache_hit_count", block_cache_hit_count },
+    { "block_read_count", block_read_count },
+    { "block_read_bytes", block_read_bytes },
+    { "block_read_time", block_read_time },
+    { "block_checksum_time", block_checksum_time },
+    { "block_decompress_time", block_decompress_time },
+  };
+  std::string r;
+  char buf[100];
+  for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+    if (counters[i].value == 0) continue;
+    snprintf(buf, sizeof(buf), "%s%s = %llu", r.empty() ? "" : ", ",
+             counters[i].name,
+             static_cast<unsigned long long>(counters[i].value));
+    r.append(buf);
+  }
+  return r;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+// The perf level and context of the calling thread
+extern LEVELDB_THREAD_LOCAL PerfLevel perf_level;
+extern LEVELDB_THREAD_LOCAL PerfContext perf_context;
+
+// Add "value" to the given counter of the calling thread's context
+#define PERF_COUNTER_ADD(counter, value)          \
+  do {                                            \
+    if (perf_level >= kEnableCount) {             \
+      perf_context.counter += (value);            \
+    }                                             \
+  } while (0)
+
+// Adds the time from its construction to its destruction, or to the
+// first call to Stop(), to a counter of the calling thread's context.
+// Does nothing unless the thread's perf level is kEnableTime.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t* counter)
+      : counter_(perf_level >= kEnableTime ? counter : NULL),
+        start_(counter_ != NULL ? Env::Default()->NowNanos() : 0) {
+  }
+
+  ~PerfTimer() {
+    Stop();
+  }
+
+  void Stop() {
+    if (counter_ != NULL) {
+      *counter_ += Env::Default()->NowNanos() - start_;
+      counter_ = NULL;
+    }
+  }
+
+ private:
+  uint64_t* counter_;
+  const uint64_t start_;
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
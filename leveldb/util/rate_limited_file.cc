@@ -0,0 +1,42 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limited_file.h"
+
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+namespace {
+
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* file, RateLimiter* limiter)
+      : file_(file), limiter_(limiter) { }
+  virtual ~RateLimitedFile() { delete file_; }
+
+  virtual Status Append(const Slice& data) {
+    limiter_->Request(data.size());
+    return file_->Append(data);
+  }
+  virtual Status Close() { return file_->Close(); }
+  virtual Status Flush() { return file_->Flush(); }
+  virtual Status Sync() { return file_->Sync(); }
+
+ private:
+  WritableFile* file_;
+  RateLimiter* limiter_;
+};
+
+}  // namespace
+
+WritableFile* NewRateLimitedFile(WritableFile* file, RateLimiter* limiter) {
+  if (limiter == NULL) {
+    return file;
+  }
+  return new RateLimitedFile(file, limiter);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,22 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
+
+namespace leveldb {
+
+class RateLimiter;
+class WritableFile;
+
+// Return a file that writes to "file", asking "limiter" for permission
+// before each append.  The result takes ownership of "file" but not of
+// "limiter", which must outlive it.  If "limiter" is NULL, returns
+// "file" itself.
+extern WritableFile* NewRateLimitedFile(WritableFile* file,
+                                        RateLimiter* limiter);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
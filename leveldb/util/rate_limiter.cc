@@ -0,0 +1,159 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {
+}
+
+void RateLimiter::ReportPendingCompactionBytes(uint64_t bytes) {
+}
+
+namespace {
+
+// Fraction of a second's worth of tokens the bucket can hold, i.e. how
+// long the writer may have been idle and still write at full speed
+static const int kBurstDivisor = 10;
+
+// An auto-tuned limiter moves between max/kTuneRange and max ...
+static const int kTuneRange = 8;
+
+// ... by a factor of kTuneStepNum/kTuneStepDen at each report
+static const int kTuneStepNum = 5;
+static const int kTuneStepDen = 4;
+
+// Longest sleep in one call to Env::SleepForMicroseconds(), which
+// takes an int; longer waits are slept in several calls.
+static const uint64_t kMaxSleepMicros = 1000000000;
+
+// A token bucket.  Tokens are added at the allowed rate, and every
+// request takes its size in tokens out of the bucket, leaving it in
+// debt if there were not enough; the caller then sleeps until the debt
+// would be paid off.  Later callers see the debt and sleep for longer,
+// so the rate holds however many threads make requests.
+class TokenBucket : public RateLimiter {
+ public:
+  TokenBucket(int64_t bytes_per_second, bool auto_tuned)
+      : env_(Env::Default()),
+        auto_tuned_(auto_tuned),
+        max_rate_(bytes_per_second),
+        rate_(auto_tuned ? MinRate(bytes_per_second) : bytes_per_second),
+        available_(0),
+        last_refill_micros_(env_->NowMicros()),
+        wait_micros_(0),
+        pending_bytes_(0) {
+    assert(bytes_per_second > 0);
+  }
+
+  virtual void Request(size_t bytes) {
+    uint64_t wait;
+    {
+      MutexLock l(&mu_);
+      Refill();
+      available_ -= static_cast<double>(bytes);
+      if (available_ >= 0) {
+        return;
+      }
+      // Bound the wait before converting it, since a huge request at
+      // a tiny rate would not fit in 64 bits
+      wait = static_cast<uint64_t>(
+          std::min(-available_ * 1e6 / rate_, 1e18));
+      wait_micros_ += wait;
+    }
+    while (wait > 0) {
+      const uint64_t micros = std::min(wait, kMaxSleepMicros);
+      env_->SleepForMicroseconds(static_cast<int>(micros));
+      wait -= micros;
+    }
+  }
+
+  virtual int64_t GetBytesPerSecond() const {
+    MutexLock l(&mu_);
+    return rate_;
+  }
+
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) {
+    assert(bytes_per_second > 0);
+    MutexLock l(&mu_);
+    Refill();
+    max_rate_ = bytes_per_second;
+    if (auto_tuned_) {
+      rate_ = std::max(MinRate(max_rate_), std::min(rate_, max_rate_));
+    } else {
+      rate_ = bytes_per_second;
+    }
+  }
+
+  virtual uint64_t GetTotalWaitMicros() const {
+    MutexLock l(&mu_);
+    return wait_micros_;
+  }
+
+  virtual void ReportPendingCompactionBytes(uint64_t bytes) {
+    if (!auto_tuned_) {
+      return;
+    }
+    MutexLock l(&mu_);
+    Refill();
+    if (bytes == 0) {
+      rate_ = MinRate(max_rate_);
+    } else if (bytes > pending_bytes_) {
+      // Grow by at least a byte, or tiny rates would never move
+      rate_ = std::min(max_rate_,
+                       std::max(rate_ + 1,
+                                rate_ * kTuneStepNum / kTuneStepDen));
+    } else if (bytes < pending_bytes_) {
+      rate_ = std::max(MinRate(max_rate_),
+                       rate_ * kTuneStepDen / kTuneStepNum);
+    }
+    pending_bytes_ = bytes;
+  }
+
+ private:
+  static int64_t MinRate(int64_t max_rate) {
+    return std::max<int64_t>(1, max_rate / kTuneRange);
+  }
+
+  // Add the tokens earned since the last refill at the current rate
+  void Refill() {
+    const uint64_t now = env_->NowMicros();
+    if (now > last_refill_micros_) {
+      available_ += (now - last_refill_micros_) * 1e-6 * rate_;
+      available_ = std::min(available_,
+                            static_cast<double>(rate_) / kBurstDivisor);
+    }
+    last_refill_micros_ = now;
+  }
+
+  Env* const env_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  int64_t max_rate_;
+  int64_t rate_;                  // Bytes per second
+  double available_;              // Tokens in the bucket; < 0 when in debt
+  uint64_t last_refill_micros_;
+  uint64_t wait_micros_;
+  uint64_t pending_bytes_;        // Last reported compaction backlog
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(int64_t bytes_per_second) {
+  return new TokenBucket(bytes_per_second, false);
+}
+
+RateLimiter* NewAutoTunedRateLimiter(int64_t max_bytes_per_second) {
+  return new TokenBucket(max_bytes_per_second, true);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,134 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RateLimiterTest { };
+
+TEST(RateLimiterTest, Rate) {
+  const int64_t kRate = 4 << 20;
+  RateLimiter* limiter = NewRateLimiter(kRate);
+  ASSERT_EQ(kRate, limiter->GetBytesPerSecond());
+
+  // The bucket starts out empty, so writing a second's worth of bytes
+  // takes about a second.
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 64; i++) {
+    limiter->Request(kRate / 64);
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+  ASSERT_GE(elapsed, 800000);
+  ASSERT_LE(elapsed, 5000000);
+  ASSERT_GE(limiter->GetTotalWaitMicros(), 800000);
+
+  limiter->SetBytesPerSecond(kRate * 2);
+  ASSERT_EQ(kRate * 2, limiter->GetBytesPerSecond());
+
+  // Ignored by a limiter that is not auto-tuned
+  limiter->ReportPendingCompactionBytes(1 << 30);
+  ASSERT_EQ(kRate * 2, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+namespace {
+struct RequestState {
+  RateLimiter* limiter;
+  port::Mutex mu;
+  port::CondVar cv;
+  int done;
+  RequestState() : cv(&mu), done(0) { }
+};
+
+static void RequestThread(void* arg) {
+  RequestState* state = reinterpret_cast<RequestState*>(arg);
+  for (int i = 0; i < 16; i++) {
+    state->limiter->Request(16 << 10);
+  }
+  state->mu.Lock();
+  state->done++;
+  state->cv.Signal();
+  state->mu.Unlock();
+}
+}  // namespace
+
+TEST(RateLimiterTest, Shared) {
+  // Four threads share the rate, so their 1MB take about a second
+  const int kThreads = 4;
+  RequestState state;
+  state.limiter = NewRateLimiter(1 << 20);
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < kThreads; i++) {
+    env->StartThread(&RequestThread, &state);
+  }
+  state.mu.Lock();
+  while (state.done < kThreads) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+  ASSERT_GE(env->NowMicros() - start, 800000);
+  delete state.limiter;
+}
+
+TEST(RateLimiterTest, AutoTuned) {
+  const int64_t kMax = 8 << 20;
+  RateLimiter* limiter = NewAutoTunedRateLimiter(kMax);
+  const int64_t min = limiter->GetBytesPerSecond();
+  ASSERT_EQ(kMax / 8, min);
+
+  // A growing backlog raises the rate up to the maximum
+  int64_t last = min;
+  for (uint64_t pending = 1; pending < 100; pending++) {
+    limiter->ReportPendingCompactionBytes(pending << 20);
+    const int64_t rate = limiter->GetBytesPerSecond();
+    ASSERT_GE(rate, last);
+    ASSERT_LE(rate, kMax);
+    last = rate;
+  }
+  ASSERT_EQ(kMax, last);
+
+  // A steady backlog keeps it
+  limiter->ReportPendingCompactionBytes(99 << 20);
+  ASSERT_EQ(kMax, limiter->GetBytesPerSecond());
+
+  // A shrinking one lowers it again
+  limiter->ReportPendingCompactionBytes(50 << 20);
+  ASSERT_LT(limiter->GetBytesPerSecond(), kMax);
+  ASSERT_GT(limiter->GetBytesPerSecond(), min);
+  limiter->ReportPendingCompactionBytes(0);
+  ASSERT_EQ(min, limiter->GetBytesPerSecond());
+
+  // A lower maximum also bounds the current rate
+  for (uint64_t pending = 1; pending < 100; pending++) {
+    limiter->ReportPendingCompactionBytes(pending << 20);
+  }
+  limiter->SetBytesPerSecond(kMax / 2);
+  ASSERT_EQ(kMax / 2, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+TEST(RateLimiterTest, AutoTunedTinyRate) {
+  // Growing a rate of a few bytes per second by a quarter rounds down
+  // to no change; it must still reach the maximum
+  RateLimiter* limiter = NewAutoTunedRateLimiter(24);
+  ASSERT_EQ(3, limiter->GetBytesPerSecond());
+  for (uint64_t pending = 1; pending < 100; pending++) {
+    limiter->ReportPendingCompactionBytes(pending);
+  }
+  ASSERT_EQ(24, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
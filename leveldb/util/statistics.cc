@@ -0,0 +1,221 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "port/port.h"
+#include "util/histogram.h"
+
+namespace leveldb {
+
+static const char* kTickerNames[kNumTickers] = {
+  "block_cache_hit",
+  "block_cache_miss",
+  "block_cache_add",
+  "bloom_filter_useful",
+  "bloom_filter_positive",
+  "bloom_filter_false_positive",
+  "memtable_hit",
+  "memtable_miss",
+  "keys_read",
+  "keys_written",
+  "bytes_read",
+  "bytes_written",
+  "seeks",
+  "stall_micros",
+  "compact_read_bytes",
+  "compact_write_bytes",
+  "flush_write_bytes",
+};
+
+static const char* kHistogramNames[kNumHistograms] = {
+  "get_micros",
+  "write_micros",
+  "seek_micros",
+  "compaction_micros",
+};
+
+const char* TickerName(Ticker ticker) {
+  assert(ticker >= 0 && ticker < kNumTickers);
+  return kTickerNames[ticker];
+}
+
+const char* HistogramName(HistogramType type) {
+  assert(type >= 0 && type < kNumHistograms);
+  return kHistogramNames[type];
+}
+
+Statistics::~Statistics() {
+}
+
+std::string Statistics::ToString() const {
+  std::string r;
+  char buf[200];
+  for (int i = 0; i < kNumTickers; i++) {
+    Ticker ticker = static_cast<Ticker>(i);
+    snprintf(buf, sizeof(buf), "%s: %llu\n", TickerName(ticker),
+             static_cast<unsigned long long>(GetTickerCount(ticker)));
+    r.append(buf);
+  }
+  for (int i = 0; i < kNumHistograms; i++) {
+    HistogramType type = static_cast<HistogramType>(i);
+    HistogramData data;
+    GetHistogramData(type, &data);
+    snprintf(buf, sizeof(buf),
+             "%s: count %llu average %.2f median %.2f p95 %.2f p99 %.2f "
+             "max %llu\n",
+             HistogramName(type),
+             static_cast<unsigned long long>(data.count),
+             data.average, data.median, data.percentile95,
+             data.percentile99,
+             static_cast<unsigned long long>(data.max));
+    r.append(buf);
+  }
+  return r;
+}
+
+namespace {
+
+// Bytes kept between the counters of two processors so that they never
+// share a cache line
+static const int kCacheLineSize = 64;
+
+struct HistogramShard {
+  volatile uint64_t count;
+  volatile uint64_t sum;
+  volatile uint64_t min;
+  volatile uint64_t max;
+  volatile uint64_t buckets[Histogram::kNumBuckets];
+};
+
+struct Shard {
+  volatile uint64_t tickers[kNumTickers];
+  HistogramShard histograms[kNumHistograms];
+  char padding[kCacheLineSize];
+};
+
+// Every processor updates a shard of its own with atomic instructions,
+// and readers add the shards up.  Threads that move to another
+// processor between picking a shard and updating it are still counted
+// correctly, only with some more contention.
+class StatisticsImpl : public Statistics {
+ public:
+  StatisticsImpl()
+      : num_shards_(port::NumCPUs()),
+        shards_(new Shard[num_shards_]) {
+    Reset();
+  }
+
+  virtual ~StatisticsImpl() {
+    delete[] shards_;
+  }
+
+  virtual void RecordTick(Ticker ticker, uint64_t count) {
+    assert(ticker >= 0 && ticker < kNumTickers);
+    port::AtomicAdd64(&CurrentShard()->tickers[ticker], count);
+  }
+
+  virtual uint64_t GetTickerCount(Ticker ticker) const {
+    assert(ticker >= 0 && ticker < kNumTickers);
+    uint64_t sum = 0;
+    for (int i = 0; i < num_shards_; i++) {
+      sum += shards_[i].tickers[ticker];
+    }
+    return sum;
+  }
+
+  virtual void MeasureTime(HistogramType type, uint64_t micros) {
+    assert(type >= 0 && type < kNumHistograms);
+    HistogramShard* h = &CurrentShard()->histograms[type];
+    const int b = Histogram::BucketIndex(static_cast<double>(micros));
+    port::AtomicAdd64(&h->buckets[b], 1);
+    port::AtomicAdd64(&h->sum, micros);
+    uint64_t v;
+    while ((v = h->min) > micros &&
+           !port::AtomicCompareAndSwap64(&h->min, v, micros)) {
+    }
+    while ((v = h->max) < micros &&
+           !port::AtomicCompareAndSwap64(&h->max, v, micros)) {
+    }
+    // Bump the count last so that readers rarely see a count that the
+    // buckets do not add up to
+    port::AtomicAdd64(&h->count, 1);
+  }
+
+  virtual void GetHistogramData(HistogramType type,
+                                HistogramData* data) const {
+    assert(type >= 0 && type < kNumHistograms);
+    double buckets[Histogram::kNumBuckets];
+    for (int b = 0; b < Histogram::kNumBuckets; b++) {
+      buckets[b] = 0;
+    }
+    data->count = 0;
+    data->sum = 0;
+    data->min = ~static_cast<uint64_t>(0);
+    data->max = 0;
+    for (int i = 0; i < num_shards_; i++) {
+      const HistogramShard& h = shards_[i].histograms[type];
+      data->count += h.count;
+      data->sum += h.sum;
+      if (h.min < data->min) data->min = h.min;
+      if (h.max > data->max) data->max = h.max;
+      for (int b = 0; b < Histogram::kNumBuckets; b++) {
+        buckets[b] += static_cast<double>(h.buckets[b]);
+      }
+    }
+    if (data->count == 0) {
+      data->min = 0;
+      data->average = 0;
+      data->median = 0;
+      data->percentile95 = 0;
+      data->percentile99 = 0;
+      return;
+    }
+    const double num = static_cast<double>(data->count);
+    const double min = static_cast<double>(data->min);
+    const double max = static_cast<double>(data->max);
+    data->average = static_cast<double>(data->sum) / num;
+    data->median = Histogram::Percentile(buckets, num, min, max, 50.0);
+    data->percentile95 = Histogram::Percentile(buckets, num, min, max, 95.0);
+    data->percentile99 = Histogram::Percentile(buckets, num, min, max, 99.0);
+  }
+
+  virtual void Reset() {
+    for (int i = 0; i < num_shards_; i++) {
+      Shard* shard = &shards_[i];
+      for (int t = 0; t < kNumTickers; t++) {
+        shard->tickers[t] = 0;
+      }
+      for (int t = 0; t < kNumHistograms; t++) {
+        HistogramShard* h = &shard->histograms[t];
+        h->count = 0;
+        h->sum = 0;
+        h->min = ~static_cast<uint64_t>(0);
+        h->max = 0;
+        for (int b = 0; b < Histogram::kNumBuckets; b++) {
+          h->buckets[b] = 0;
+        }
+      }
+    }
+  }
+
+ private:
+  const int num_shards_;
+  Shard* const shards_;
+
+  Shard* CurrentShard() {
+    return &shards_[port::CurrentCPU() % num_shards_];
+  }
+};
+
+}  // namespace
+
+Statistics* NewStatistics() {
+  return new StatisticsImpl;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,145 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <string.h>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/histogram.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class StatisticsTest { };
+
+TEST(StatisticsTest, Tickers) {
+  Statistics* stats = NewStatistics();
+  for (int i = 0; i < kNumTickers; i++) {
+    ASSERT_EQ(0, stats->GetTickerCount(static_cast<Ticker>(i)));
+  }
+  stats->RecordTick(kBlockCacheHit, 3);
+  stats->RecordTick(kBlockCacheHit, 4);
+  stats->RecordTick(kBytesWritten, 1 << 20);
+  ASSERT_EQ(7, stats->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(1 << 20, stats->GetTickerCount(kBytesWritten));
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheMiss));
+
+  stats->Reset();
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheHit));
+  delete stats;
+}
+
+TEST(StatisticsTest, Histograms) {
+  Statistics* stats = NewStatistics();
+  HistogramData data;
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+  ASSERT_EQ(0, data.min);
+  ASSERT_EQ(0.0, data.median);
+
+  for (int i = 1; i <= 100; i++) {
+    stats->MeasureTime(kGetMicros, i);
+  }
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(100, data.count);
+  ASSERT_EQ(5050, data.sum);
+  ASSERT_EQ(1, data.min);
+  ASSERT_EQ(100, data.max);
+  ASSERT_EQ(50.5, data.average);
+  ASSERT_GE(data.median, 40.0);
+  ASSERT_LE(data.median, 60.0);
+  ASSERT_GE(data.percentile95, 90.0);
+  ASSERT_LE(data.percentile99, 100.0);
+  ASSERT_LE(data.median, data.percentile95);
+  ASSERT_LE(data.percentile95, data.percentile99);
+
+  // Other histograms are untouched
+  stats->GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(0, data.count);
+
+  stats->Reset();
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+  ASSERT_EQ(0, data.max);
+  delete stats;
+}
+
+TEST(StatisticsTest, Names) {
+  ASSERT_EQ(0, strcmp("block_cache_hit", TickerName(kBlockCacheHit)));
+  ASSERT_EQ(0, strcmp("flush_write_bytes", TickerName(kFlushWriteBytes)));
+  ASSERT_EQ(0, strcmp("get_micros", HistogramName(kGetMicros)));
+  ASSERT_EQ(0, strcmp("compaction_micros",
+                      HistogramName(kCompactionMicros)));
+
+  Statistics* stats = NewStatistics();
+  stats->RecordTick(kSeeks, 12);
+  stats->MeasureTime(kSeekMicros, 7);
+  std::string s = stats->ToString();
+  ASSERT_TRUE(s.find("seeks: 12\n") != std::string::npos) << s;
+  ASSERT_TRUE(s.find("seek_micros: count 1 ") != std::string::npos) << s;
+  delete stats;
+}
+
+TEST(StatisticsTest, BucketIndex) {
+  ASSERT_EQ(0, Histogram::BucketIndex(0));
+  ASSERT_EQ(1, Histogram::BucketIndex(1));
+  ASSERT_EQ(9, Histogram::BucketIndex(9.5));
+  ASSERT_EQ(Histogram::kNumBuckets - 1, Histogram::BucketIndex(1e300));
+  for (int b = 0; b < Histogram::kNumBuckets - 1; b++) {
+    ASSERT_EQ(b + 1, Histogram::BucketIndex(Histogram::kBucketLimit[b]));
+  }
+}
+
+namespace {
+struct CountState {
+  Statistics* stats;
+  port::Mutex mu;
+  port::CondVar cv;
+  int done;
+  CountState() : cv(&mu), done(0) { }
+};
+
+static const int kIncrements = 100000;
+
+static void CountThread(void* arg) {
+  CountState* state = reinterpret_cast<CountState*>(arg);
+  for (int i = 0; i < kIncrements; i++) {
+    state->stats->RecordTick(kKeysRead, 1);
+    state->stats->MeasureTime(kWriteMicros, i % 1000);
+  }
+  state->mu.Lock();
+  state->done++;
+  state->cv.Signal();
+  state->mu.Unlock();
+}
+}  // namespace
+
+TEST(StatisticsTest, ConcurrentUpdates) {
+  const int kThreads = 4;
+  CountState state;
+  state.stats = NewStatistics();
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(&CountThread, &state);
+  }
+  state.mu.Lock();
+  while (state.done < kThreads) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+
+  ASSERT_EQ(kThreads * kIncrements, state.stats->GetTickerCount(kKeysRead));
+  HistogramData data;
+  state.stats->GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(kThreads * kIncrements, data.count);
+  ASSERT_EQ(0, data.min);
+  ASSERT_EQ(999, data.max);
+  delete state.stats;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -31,6 +31,22 @@ class DB
            { :create_if_missing => false, :error_if_exists => false }
     end
 
+    ## Opens the LevelDB database stored on disk at +pathname+ for reading
+    ## only.  Any number of processes can open it this way next to the one
+    ## that writes it, since its lock is not taken.  Writes raise an
+    ## exception.
+    ##
+    ## With <tt>:secondary => true</tt>, #catch_up reads the updates the
+    ## writing process has made since; otherwise the database is read as
+    ## it was when it was opened.
+    ##
+    ## See #make for possible options.
+    def open_readonly pathname, options={}
+      make path_string(pathname),
+           { :read_only => true }.merge(options).
+             merge(:create_if_missing => false, :error_if_exists => false)
+    end
+
     private
 
     ## Coerces the argument into a String for use as a filename/-path
@@ -59,6 +75,13 @@ class DB
   def keys; map { |k, v| k } end
   def values; map { |k, v| v } end
 
+  ## Returns the ColumnFamily named +name+, if the database was opened
+  ## with it or it was created since, and nil otherwise.
+  def column_family(name); @column_families[name.to_s] end
+
+  ## Names of the column families returned by #column_family.
+  def column_families; @column_families.keys end
+
   def inspect
     %(<#{self.class} #{@pathname.inspect}>)
   end
@@ -85,18 +108,58 @@ class WriteBatch
   end
 end
 
+class ColumnFamily
+  class << self
+    private :new
+  end
+
+  attr_reader :db, :name, :options
+
+  alias :[] :get
+  alias :[]= :put
+
+  def inspect
+    %(<#{self.class} #{@db.inspect} #{@name.inspect}>)
+  end
+end
+
 class Options
   DEFAULT_MAX_OPEN_FILES = 1000
   DEFAULT_WRITE_BUFFER_SIZE = 4 * 1024 * 1024
+  DEFAULT_RECOVERY_THREADS = 1
+  DEFAULT_PREWARM_THREADS = 0
   DEFAULT_BLOCK_SIZE = 4 * 1024
   DEFAULT_BLOCK_RESTART_INTERVAL = 16
+  DEFAULT_READAHEAD_SIZE = 0
+  DEFAULT_METADATA_BLOCK_SIZE = 4 * 1024
+  DEFAULT_NUM_LEVELS = 7
+  DEFAULT_LEVEL0_FILE_NUM_COMPACTION_TRIGGER = 4
+  DEFAULT_LEVEL0_SLOWDOWN_WRITES_TRIGGER = 8
+  DEFAULT_LEVEL0_STOP_WRITES_TRIGGER = 12
+  DEFAULT_TARGET_FILE_SIZE_BASE = 2 * 1024 * 1024
+  DEFAULT_TARGET_FILE_SIZE_MULTIPLIER = 1
+  DEFAULT_MAX_BYTES_FOR_LEVEL_BASE = 10 * 1024 * 1024
+  DEFAULT_MAX_BYTES_FOR_LEVEL_MULTIPLIER = 10
+  DEFAULT_TTL = 0
   DEFAULT_COMPRESSION = LevelDB::CompressionType::SnappyCompression
 
   attr_reader :create_if_missing, :error_if_exists,
               :block_cache_size, :paranoid_checks,
-              :write_buffer_size, :max_open_files,
-              :block_size, :block_restart_interval,
-              :compression
+              :write_buffer_size, :recovery_threads,
+              :max_open_files, :record_table_handles, :prewarm_threads,
+              :block_size, :block_restart_interval, :readahead_size,
+              :use_direct_io_for_compaction,
+              :num_levels, :level0_file_num_compaction_trigger,
+              :level0_slowdown_writes_trigger, :level0_stop_writes_trigger,
+              :target_file_size_base, :target_file_size_multiplier,
+              :max_bytes_for_level_base, :max_bytes_for_level_multiplier,
+              :level_compaction_dynamic_level_bytes,
+              :ttl, :hide_expired_keys, :compaction_filter_prefix,
+              :merge_operator,
+              :compression, :cache_index_and_filter_blocks,
+              :pin_l0_filter_and_index_blocks_in_cache,
+              :partition_index_and_filters, :metadata_block_size,
+              :statistics, :listener
 end
 
 end # module LevelDB
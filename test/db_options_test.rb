@@ -63,6 +63,20 @@ class DBOptionsTest < Test::Unit::TestCase
     assert_raises(TypeError) { LevelDB::DB.new @path, :write_buffer_size => "1234" }
   end
 
+  def test_recovery_threads_default
+    db = LevelDB::DB.new @path
+    assert_equal LevelDB::Options::DEFAULT_RECOVERY_THREADS, db.options.recovery_threads
+  end
+
+  def test_recovery_threads
+    db = LevelDB::DB.new @path, :recovery_threads => 4
+    db.put "k", "v"
+    db.close
+    db = LevelDB::DB.new @path, :recovery_threads => 4
+    assert_equal 4, db.options.recovery_threads
+    assert_equal "v", db.get("k")
+  end
+
   def test_max_open_files_default
     db = LevelDB::DB.new @path
     assert_equal LevelDB::Options::DEFAULT_MAX_OPEN_FILES, db.options.max_open_files
@@ -77,6 +91,27 @@ class DBOptionsTest < Test::Unit::TestCase
     assert_raises(TypeError) { LevelDB::DB.new @path, :max_open_files => "2000" }
   end
 
+  def test_record_table_handles_default
+    db = LevelDB::DB.new @path
+    assert_false db.options.record_table_handles
+  end
+
+  def test_prewarm_threads_default
+    db = LevelDB::DB.new @path
+    assert_equal LevelDB::Options::DEFAULT_PREWARM_THREADS, db.options.prewarm_threads
+  end
+
+  def test_prewarm_threads
+    db = LevelDB::DB.new @path, :record_table_handles => true,
+                                :cache_index_and_filter_blocks => true
+    assert db.options.record_table_handles
+    db.put "k", "v"
+    db.close
+    db = LevelDB::DB.new @path, :prewarm_threads => 2
+    assert_equal 2, db.options.prewarm_threads
+    assert_equal "v", db.get("k")
+  end
+
   def test_cache_size_default
     db = LevelDB::DB.new @path
     assert_nil db.options.block_cache_size
@@ -119,6 +154,137 @@ class DBOptionsTest < Test::Unit::TestCase
     assert_raises(TypeError) { LevelDB::DB.new @path, :block_restart_interval => "abc" }
   end
 
+  def test_readahead_size_default
+    db = LevelDB::DB.new @path
+    assert_equal LevelDB::Options::DEFAULT_READAHEAD_SIZE, db.options.readahead_size
+  end
+
+  def test_readahead_size
+    db = LevelDB::DB.new @path, :readahead_size => 1024 * 1024
+    assert_equal 1024 * 1024, db.options.readahead_size
+    db.put "k", "v"
+    pairs = []
+    db.each { |key, value| pairs << [key, value] }
+    assert_equal [["k", "v"]], pairs
+  end
+
+  def test_use_direct_io_for_compaction_default
+    db = LevelDB::DB.new @path
+    assert_false db.options.use_direct_io_for_compaction
+  end
+
+  def test_use_direct_io_for_compaction
+    db = LevelDB::DB.new @path, :use_direct_io_for_compaction => true
+    assert db.options.use_direct_io_for_compaction
+    db.put "k", "v"
+    db.close
+    db = LevelDB::DB.new @path, :use_direct_io_for_compaction => true
+    assert_equal "v", db.get("k")
+  end
+
+  def test_lsm_shape_default
+    db = LevelDB::DB.new @path
+    assert_equal LevelDB::Options::DEFAULT_NUM_LEVELS, db.options.num_levels
+    assert_equal LevelDB::Options::DEFAULT_LEVEL0_FILE_NUM_COMPACTION_TRIGGER,
+                 db.options.level0_file_num_compaction_trigger
+    assert_equal LevelDB::Options::DEFAULT_LEVEL0_SLOWDOWN_WRITES_TRIGGER,
+                 db.options.level0_slowdown_writes_trigger
+    assert_equal LevelDB::Options::DEFAULT_LEVEL0_STOP_WRITES_TRIGGER,
+                 db.options.level0_stop_writes_trigger
+    assert_equal LevelDB::Options::DEFAULT_TARGET_FILE_SIZE_BASE, db.options.target_file_size_base
+    assert_equal LevelDB::Options::DEFAULT_TARGET_FILE_SIZE_MULTIPLIER,
+                 db.options.target_file_size_multiplier
+    assert_equal LevelDB::Options::DEFAULT_MAX_BYTES_FOR_LEVEL_BASE,
+                 db.options.max_bytes_for_level_base
+    assert_equal LevelDB::Options::DEFAULT_MAX_BYTES_FOR_LEVEL_MULTIPLIER,
+                 db.options.max_bytes_for_level_multiplier
+    assert_false db.options.level_compaction_dynamic_level_bytes
+  end
+
+  def test_lsm_shape
+    db = LevelDB::DB.new @path, :num_levels => 3,
+                                :level0_file_num_compaction_trigger => 2,
+                                :target_file_size_base => 64 * 1024,
+                                :target_file_size_multiplier => 2,
+                                :max_bytes_for_level_base => 8 * 1024 * 1024 * 1024,
+                                :max_bytes_for_level_multiplier => 4,
+                                :level_compaction_dynamic_level_bytes => true
+    assert_equal 3, db.options.num_levels
+    assert_equal 2, db.options.level0_file_num_compaction_trigger
+    assert_equal 64 * 1024, db.options.target_file_size_base
+    assert_equal 2, db.options.target_file_size_multiplier
+    assert_equal 8 * 1024 * 1024 * 1024, db.options.max_bytes_for_level_base
+    assert_equal 4, db.options.max_bytes_for_level_multiplier
+    assert db.options.level_compaction_dynamic_level_bytes
+    db.put "k", "v"
+    assert_equal "v", db.get("k")
+  end
+
+  def test_lsm_shape_invalid
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path, :num_levels => 1 }
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path, :num_levels => 8 }
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path, :max_bytes_for_level_multiplier => 1 }
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path, :target_file_size_base => 0 }
+  end
+
+  def test_ttl_default
+    db = LevelDB::DB.new @path
+    assert_equal LevelDB::Options::DEFAULT_TTL, db.options.ttl
+    assert_false db.options.hide_expired_keys
+  end
+
+  def test_ttl
+    db = LevelDB::DB.new @path, :ttl => 3600, :hide_expired_keys => true
+    assert_equal 3600, db.options.ttl
+    assert db.options.hide_expired_keys
+    db.put "k", "v"
+    assert_equal "v", db.get("k")
+    assert_equal [["k", "v"]], db.to_a
+  end
+
+  def test_ttl_invalid
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path, :ttl => -1 }
+  end
+
+  def test_compaction_filter_prefix_default
+    db = LevelDB::DB.new @path
+    assert_nil db.options.compaction_filter_prefix
+  end
+
+  def test_compaction_filter_prefix
+    db = LevelDB::DB.new @path, :compaction_filter_prefix => "tmp:"
+    assert_equal "tmp:", db.options.compaction_filter_prefix
+    db.put "tmp:1", "v"
+    db.put "k", "v"
+    assert_equal "v", db.get("tmp:1")
+  end
+
+  def test_merge_operator_default
+    db = LevelDB::DB.new @path
+    assert_nil db.options.merge_operator
+  end
+
+  def test_merge_operator_uint64_add
+    db = LevelDB::DB.new @path, :merge_operator => :uint64_add
+    assert_equal :uint64_add, db.options.merge_operator
+    db.merge "n", 2
+    db.merge "n", [3].pack("Q<")
+    assert_equal 5, db.get("n").unpack("Q<").first
+  end
+
+  def test_merge_operator_string_append
+    db = LevelDB::DB.new @path, :merge_operator => :string_append
+    assert_equal :string_append, db.options.merge_operator
+    db.put "s", "a"
+    db.merge "s", "b"
+    db.merge "s", "c", :sync => true
+    assert_equal "a,b,c", db.get("s")
+  end
+
+  def test_merge_operator_invalid
+    assert_raises(TypeError) { LevelDB::DB.new @path, :merge_operator => :max }
+  end
+
   def test_compression_default
     db = LevelDB::DB.new @path
     assert_equal LevelDB::Options::DEFAULT_COMPRESSION, db.options.compression
@@ -129,6 +295,76 @@ class DBOptionsTest < Test::Unit::TestCase
     assert_equal LevelDB::CompressionType::NoCompression, db.options.compression
   end
 
+  def test_cache_index_and_filter_blocks_default
+    db = LevelDB::DB.new @path
+    assert_false db.options.cache_index_and_filter_blocks
+    assert_false db.options.pin_l0_filter_and_index_blocks_in_cache
+  end
+
+  def test_cache_index_and_filter_blocks
+    db = LevelDB::DB.new @path, :cache_index_and_filter_blocks => true,
+                                :pin_l0_filter_and_index_blocks_in_cache => true
+    assert db.options.cache_index_and_filter_blocks
+    assert db.options.pin_l0_filter_and_index_blocks_in_cache
+    db.put "k", "v"
+    assert_equal "v", db.get("k")
+  end
+
+  def test_partition_index_and_filters_default
+    db = LevelDB::DB.new @path
+    assert_false db.options.partition_index_and_filters
+    assert_equal LevelDB::Options::DEFAULT_METADATA_BLOCK_SIZE, db.options.metadata_block_size
+  end
+
+  def test_partition_index_and_filters
+    db = LevelDB::DB.new @path, :partition_index_and_filters => true,
+                                :metadata_block_size => 1024
+    assert db.options.partition_index_and_filters
+    assert_equal 1024, db.options.metadata_block_size
+    db.put "k", "v"
+    assert_equal "v", db.get("k")
+  end
+
+  def test_column_families_default
+    db = LevelDB::DB.new @path
+    assert_equal [], db.column_families
+    assert_nil db.column_family("users")
+  end
+
+  def test_column_families
+    db = LevelDB::DB.new @path, :column_families => {
+      "users" => { :merge_operator => :string_append },
+      "counts" => { :merge_operator => :uint64_add }
+    }
+    assert_equal ["counts", "users"], db.column_families.sort
+    users = db.column_family("users")
+    assert_equal "users", users.name
+    assert_equal :string_append, users.options.merge_operator
+    assert_nil db.options.merge_operator
+    users.put "k", "a"
+    users.merge "k", "b"
+    db.put "k", "v"
+    assert_equal "a,b", users.get("k")
+    assert_equal "v", db.get("k")
+    assert_raises(LevelDB::Error) { db.merge "k", "c" }
+    db.close
+
+    # every column family has to be listed again
+    assert_raises(LevelDB::Error) { LevelDB::DB.new @path }
+    db = LevelDB::DB.new @path, :column_families => {
+      "users" => { :merge_operator => :string_append },
+      "counts" => { :merge_operator => :uint64_add }
+    }
+    assert_equal "a,b", db.column_family("users")["k"]
+    assert_equal "v", db["k"]
+    db.close
+
+    # column families listed by name share the options of the database
+    db = LevelDB::DB.new @path, :column_families => ["users", "counts"],
+                                :merge_operator => :string_append
+    assert_equal "a,b", db.column_family("users")["k"]
+  end
+
   def test_compression_invalid_type
     assert_raises(TypeError) { LevelDB::DB.new @path, :compression => "1234" }
     assert_raises(TypeError) { LevelDB::DB.new @path, :compression => 999 }
@@ -1,6 +1,7 @@
 require 'test/unit'
 require File.expand_path("../../lib/leveldb", __FILE__)
 require 'fileutils'
+require 'stringio'
 
 class DBTest < Test::Unit::TestCase
   DB_PATH = "/tmp/iteration.db"
@@ -29,6 +30,10 @@ class DBTest < Test::Unit::TestCase
     assert_equal "1", @db.get("test:sync")
   end
 
+  def test_merge_without_operator
+    assert_raises(LevelDB::Error) { @db.merge "test:merge", "1" }
+  end
+
   def test_delete
     @db.put 'test:async', '1'
     @db.put 'test:sync', '1'
@@ -57,5 +62,172 @@ class DBTest < Test::Unit::TestCase
     assert_equal 'batch', @db.get('b')
     assert_nil @db.get('a')
   end
+
+  def test_column_family
+    users = @db.create_column_family 'users'
+    assert_equal users, @db.column_family('users')
+    assert_raises(LevelDB::Error) { @db.create_column_family 'users' }
+
+    users.put 'a', 'user'
+    users['b'] = 'user'
+    @db.put 'a', 'default'
+    assert_equal 'user', users.get('a')
+    assert_equal 'default', @db.get('a')
+    assert_equal 'user', users.delete('b')
+    assert_nil users['b']
+
+    @db.batch do |b|
+      b.put 'c', 'batch', users
+      b.put 'c', 'batch'
+      b.delete 'a', users
+    end
+    assert_equal 'batch', users.get('c')
+    assert_equal 'batch', @db.get('c')
+    assert_nil users.get('a')
+    assert_equal 'default', @db.get('a')
+
+    assert @db.drop_column_family(users)
+    assert_nil @db.column_family('users')
+    assert_raises(LevelDB::Error) { users.get 'c' }
+    assert_equal 'batch', @db.get('c')
+  end
+
+  def test_checkpoint
+    db_path = "/tmp/checkpoint_source.db"
+    path = "/tmp/checkpoint.db"
+    FileUtils.rm_rf [db_path, path]
+    db = LevelDB::DB.new db_path
+    db.put 'test:checkpoint', '1'
+    assert db.checkpoint(path)
+    assert_raises(LevelDB::Error) { db.checkpoint path }
+    db.put 'test:checkpoint', '2'
+
+    checkpoint = LevelDB::DB.load path
+    assert_equal '1', checkpoint.get('test:checkpoint')
+    assert_equal '2', db.get('test:checkpoint')
+    checkpoint.close
+    db.close
+  ensure
+    FileUtils.rm_rf [db_path, path]
+  end
+
+  def test_open_readonly
+    db_path = "/tmp/readonly.db"
+    FileUtils.rm_rf db_path
+    db = LevelDB::DB.new db_path
+    db.put 'test:readonly', '1'
+
+    readers = (1..2).map { LevelDB::DB.open_readonly db_path }
+    readers.each { |r| assert_equal '1', r.get('test:readonly') }
+    assert_raises(LevelDB::Error) { readers[0].put 'test:readonly', '2' }
+    assert_raises(LevelDB::Error) { readers[0].catch_up }
+
+    secondary = LevelDB::DB.open_readonly db_path, :secondary => true
+    db.put 'test:readonly', '3'
+    assert_equal '1', secondary.get('test:readonly')
+    assert secondary.catch_up
+    assert_equal '3', secondary.get('test:readonly')
+    assert_equal '1', readers[1].get('test:readonly')
+
+    (readers + [secondary, db]).each(&:close)
+    assert_raises(LevelDB::Error) { LevelDB::DB.open_readonly "/tmp/readonly_missing.db" }
+    assert !File.exist?("/tmp/readonly_missing.db")
+  ensure
+    FileUtils.rm_rf db_path
+  end
+
+  def test_statistics
+    db_path = "/tmp/statistics.db"
+    FileUtils.rm_rf db_path
+    assert_nil @db.statistics
+
+    db = LevelDB::DB.new db_path, :statistics => true
+    assert db.options.statistics
+    10.times { |i| db.put "test:#{i}", 'v' }
+    assert_equal 'v', db.get('test:3')
+    assert_nil db.get('test:missing')
+    db.each(:from => 'test:5') { break }
+
+    stats = db.statistics
+    assert_equal 10, stats[:keys_written]
+    assert_equal 2, stats[:keys_read]
+    assert_equal 2, stats[:memtable_miss] + stats[:memtable_hit]
+    assert_equal 1, stats[:seeks]
+    assert_equal 10, stats[:write_micros][:count]
+    assert_equal 2, stats[:get_micros][:count]
+    assert stats[:get_micros][:percentile99] >= stats[:get_micros][:median]
+    db.close
+    assert_equal 10, db.statistics[:keys_written]
+  ensure
+    FileUtils.rm_rf db_path
+  end
+
+  def test_listener
+    db_path = "/tmp/listener.db"
+    FileUtils.rm_rf db_path
+    queue = Queue.new
+    db = LevelDB::DB.new db_path, :listener => queue, :write_buffer_size => 64 * 1024,
+                         :level0_file_num_compaction_trigger => 2
+    assert_same queue, db.options.listener
+    value = 'v' * 1000
+    300.times { |i| db.put "test:#{i % 100}", value }
+
+    # Events arrive while the database is open
+    events = []
+    until events.any? { |e| e[:type] == :compaction_completed }
+      event = queue.pop(:timeout => 10)
+      assert event, "no compaction reported"
+      events << event
+    end
+    db.close
+    events << queue.pop until queue.empty?
+
+    flushes = events.select { |e| e[:type] == :flush_completed }
+    assert flushes.size >= 2
+    assert_equal 'default', flushes.first[:column_family]
+    assert flushes.all? { |e| e[:file_size] > 0 }
+
+    compaction = events.find { |e| e[:type] == :compaction_completed }
+    assert_equal 'OK', compaction[:status]
+    assert compaction[:input_files].size >= 2
+    assert (compaction[:input_files] - flushes.map { |e| e[:file_number] }).empty?
+    assert compaction[:bytes_written] > 0
+    assert compaction[:output_level] > compaction[:base_level]
+  ensure
+    FileUtils.rm_rf db_path
+  end
+
+  def test_listener_queue_errors
+    db_path = "/tmp/listener_errors.db"
+    FileUtils.rm_rf db_path
+    queue = Queue.new
+    def queue.push(event)
+      @failed ? super : (@failed = true; raise "queue is full")
+    end
+    db = LevelDB::DB.new db_path, :listener => queue, :write_buffer_size => 64 * 1024
+    value = 'v' * 1000
+    stderr, $stderr = $stderr, StringIO.new
+    300.times { |i| db.put "test:#{i}", value }
+
+    # The events after the one that failed still arrive
+    assert queue.pop(:timeout => 10), "no event after the error"
+    assert_match(/dropped an event of the listener: queue is full/, $stderr.string)
+    db.close
+  ensure
+    $stderr = stderr if stderr
+    FileUtils.rm_rf db_path
+  end
+
+  def test_perf_context
+    @db.put 'test:perf', '1'
+    assert_equal '1', @db.get('test:perf', :perf_context => true)
+    perf = LevelDB.perf_context
+    assert_equal 1, perf[:get_from_memtable_count]
+    assert_equal 0, perf[:files_checked]
+    assert perf.has_key?(:block_read_time)
+
+    @db.get 'test:perf'
+    assert_equal 1, LevelDB.perf_context[:get_from_memtable_count]
+  end
 end
 